@@ -0,0 +1,100 @@
+// Copyright (c) 2014 The Reddcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfile.h"
+
+#include "util.h"
+
+#include <boost/interprocess/file_mapping.hpp>
+
+using namespace std;
+
+CMappedFile::CMappedFile(const boost::filesystem::path &path)
+{
+    // The file handle is only needed to set up the mapping
+    boost::interprocess::file_mapping mapping(path.string().c_str(), boost::interprocess::read_only);
+    boost::interprocess::mapped_region regionNew(mapping, boost::interprocess::read_only);
+    region.swap(regionNew);
+}
+
+CBlockFileCache::CBlockFileCache() : nMaxFiles(DEFAULT_MAX_BLOCKFILE_MAPS), nHits(0), nMisses(0)
+{
+}
+
+void CBlockFileCache::Erase(std::map<Key, Entry>::iterator it)
+{
+    listUsed.erase(it->second.it);
+    mapFiles.erase(it);
+}
+
+void CBlockFileCache::SetMaxFiles(unsigned int nMaxFilesIn)
+{
+    LOCK(cs);
+    nMaxFiles = nMaxFilesIn;
+    while (mapFiles.size() > nMaxFiles)
+        Erase(mapFiles.find(listUsed.back()));
+}
+
+boost::shared_ptr<const CMappedFile> CBlockFileCache::Get(const char *prefix, int nFile, uint64_t nMinSize)
+{
+    LOCK(cs);
+    if (nMaxFiles == 0)
+        return boost::shared_ptr<const CMappedFile>();
+
+    Key key(prefix, nFile);
+    std::map<Key, Entry>::iterator it = mapFiles.find(key);
+    if (it != mapFiles.end()) {
+        if (it->second.pfile->size() >= nMinSize) {
+            nHits++;
+            listUsed.splice(listUsed.begin(), listUsed, it->second.it);
+            return it->second.pfile;
+        }
+        // the file grew since it was mapped
+        Erase(it);
+    }
+
+    nMisses++;
+    boost::filesystem::path path = GetDataDir() / "blocks" / strprintf("%s%05u.dat", prefix, nFile);
+    boost::shared_ptr<const CMappedFile> pfile;
+    try {
+        pfile.reset(new CMappedFile(path));
+    } catch (std::exception &e) {
+        LogPrint("blockfile", "Unable to map %s: %s\n", path.string(), e.what());
+        return boost::shared_ptr<const CMappedFile>();
+    }
+    if (pfile->size() < nMinSize)
+        return boost::shared_ptr<const CMappedFile>();
+
+    while (mapFiles.size() >= nMaxFiles)
+        Erase(mapFiles.find(listUsed.back()));
+    listUsed.push_front(key);
+    Entry &entry = mapFiles[key];
+    entry.pfile = pfile;
+    entry.it = listUsed.begin();
+    LogPrint("blockfile", "Mapped %s (%u bytes)\n", path.string(), (unsigned int)pfile->size());
+    return pfile;
+}
+
+void CBlockFileCache::Invalidate(const char *prefix, int nFile)
+{
+    LOCK(cs);
+    std::map<Key, Entry>::iterator it = mapFiles.find(Key(prefix, nFile));
+    if (it != mapFiles.end())
+        Erase(it);
+}
+
+void CBlockFileCache::Clear()
+{
+    LOCK(cs);
+    mapFiles.clear();
+    listUsed.clear();
+}
+
+void CBlockFileCache::GetStats(unsigned int &nFilesOut, uint64_t &nHitsOut, uint64_t &nMissesOut) const
+{
+    LOCK(cs);
+    nFilesOut = mapFiles.size();
+    nHitsOut = nHits;
+    nMissesOut = nMisses;
+}
@@ -0,0 +1,80 @@
+// Copyright (c) 2014 The Reddcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKFILE_H
+#define BITCOIN_BLOCKFILE_H
+
+#include "sync.h"
+
+#include <list>
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <utility>
+
+#include <boost/filesystem/path.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/shared_ptr.hpp>
+
+/** Maximum number of block and undo files kept mapped by default */
+static const unsigned int DEFAULT_MAX_BLOCKFILE_MAPS = sizeof(void*) > 4 ? 64 : 8;
+
+/** Read-only memory mapping of a whole file, as it was when mapped */
+class CMappedFile
+{
+private:
+    boost::interprocess::mapped_region region;
+
+    CMappedFile(const CMappedFile&);
+    void operator=(const CMappedFile&);
+
+public:
+    // throws std::exception if the file cannot be mapped
+    explicit CMappedFile(const boost::filesystem::path &path);
+
+    const char *data() const { return (const char*)region.get_address(); }
+    size_t size() const { return region.get_size(); }
+};
+
+/** Bounded, least recently used set of read-only mappings of blk?????.dat and
+ *  rev?????.dat files. Only files that are no longer appended to (or only
+ *  grow) may be mapped; a mapping that is too short for a read is replaced.
+ *  Mappings handed out stay valid until their last user releases them.
+ */
+class CBlockFileCache
+{
+private:
+    typedef std::pair<std::string, int> Key; // file prefix, file number
+    typedef std::list<Key> LRUList;          // most recently used first
+    struct Entry
+    {
+        boost::shared_ptr<const CMappedFile> pfile;
+        LRUList::iterator it;
+    };
+
+    mutable CCriticalSection cs;
+    unsigned int nMaxFiles;
+    LRUList listUsed;
+    std::map<Key, Entry> mapFiles;
+    uint64_t nHits;
+    uint64_t nMisses;
+
+    void Erase(std::map<Key, Entry>::iterator it);
+
+public:
+    CBlockFileCache();
+
+    void SetMaxFiles(unsigned int nMaxFilesIn);
+
+    // Mapping of file prefix+nFile covering at least its first nMinSize bytes, or NULL
+    boost::shared_ptr<const CMappedFile> Get(const char *prefix, int nFile, uint64_t nMinSize);
+
+    // Forget the mapping of one file (e.g. before it is truncated)
+    void Invalidate(const char *prefix, int nFile);
+    void Clear();
+
+    void GetStats(unsigned int &nFilesOut, uint64_t &nHitsOut, uint64_t &nMissesOut) const;
+};
+
+#endif // BITCOIN_BLOCKFILE_H
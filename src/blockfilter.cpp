@@ -0,0 +1,215 @@
+// Copyright (c) 2014 The Reddcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilter.h"
+
+#include "core.h"
+#include "hash.h"
+#include "main.h"
+#include "script.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+
+// High 64 bits of the 128-bit product a * b
+uint64_t MulHigh(uint64_t a, uint64_t b)
+{
+    uint64_t a_lo = a & 0xffffffff, a_hi = a >> 32;
+    uint64_t b_lo = b & 0xffffffff, b_hi = b >> 32;
+    uint64_t lo_lo = a_lo * b_lo;
+    uint64_t hi_lo = a_hi * b_lo;
+    uint64_t lo_hi = a_lo * b_hi;
+    uint64_t hi_hi = a_hi * b_hi;
+    uint64_t cross = (lo_lo >> 32) + (hi_lo & 0xffffffff) + lo_hi;
+    return (hi_lo >> 32) + (cross >> 32) + hi_hi;
+}
+
+class CBitWriter
+{
+private:
+    std::vector<unsigned char> &vch;
+    int nBits; // bits used in the last byte of vch, 8 = none free
+
+public:
+    CBitWriter(std::vector<unsigned char> &vchIn) : vch(vchIn), nBits(8) { }
+
+    void Write(uint64_t nValue, int nCount)
+    {
+        while (nCount > 0) {
+            if (nBits == 8) {
+                vch.push_back(0);
+                nBits = 0;
+            }
+            int n = std::min(8 - nBits, nCount);
+            unsigned char bits = (nValue >> (nCount - n)) & ((1 << n) - 1);
+            vch.back() |= bits << (8 - nBits - n);
+            nBits += n;
+            nCount -= n;
+        }
+    }
+
+    void WriteGolombRice(uint64_t nValue, int nP)
+    {
+        for (uint64_t q = nValue >> nP; q > 0; q--)
+            Write(1, 1);
+        Write(0, 1);
+        Write(nValue, nP);
+    }
+};
+
+class CBitReader
+{
+private:
+    const unsigned char *pch;
+    const unsigned char *pend;
+    int nBits; // bits already read from *pch
+
+public:
+    CBitReader(const unsigned char *pchIn, const unsigned char *pendIn) : pch(pchIn), pend(pendIn), nBits(0) { }
+
+    uint64_t Read(int nCount)
+    {
+        uint64_t nValue = 0;
+        while (nCount > 0) {
+            if (pch == pend)
+                throw std::ios_base::failure("CBitReader::Read : end of data");
+            int n = std::min(8 - nBits, nCount);
+            nValue = (nValue << n) | ((*pch >> (8 - nBits - n)) & ((1 << n) - 1));
+            nBits += n;
+            nCount -= n;
+            if (nBits == 8) {
+                pch++;
+                nBits = 0;
+            }
+        }
+        return nValue;
+    }
+
+    uint64_t ReadGolombRice(int nP)
+    {
+        uint64_t q = 0;
+        while (Read(1))
+            q++;
+        return (q << nP) + Read(nP);
+    }
+};
+
+} // anon namespace
+
+uint64_t CBlockFilter::HashToRange(const Element &element) const
+{
+    // The key is the first 16 bytes of the block hash, as two little endian words
+    uint64_t k0 = 0, k1 = 0;
+    for (int i = 7; i >= 0; i--) {
+        k0 = (k0 << 8) | hashBlock.begin()[i];
+        k1 = (k1 << 8) | hashBlock.begin()[i + 8];
+    }
+    uint64_t nHash = SipHash(k0, k1, element.empty() ? NULL : &element[0], element.size());
+    return MulHigh(nHash, nElements * M);
+}
+
+CBlockFilter::CBlockFilter(const uint256 &hashBlockIn, const std::vector<Element> &vElementsIn) : hashBlock(hashBlockIn)
+{
+    std::vector<Element> vElements;
+    vElements.reserve(vElementsIn.size());
+    BOOST_FOREACH(const Element &element, vElementsIn)
+        if (!element.empty())
+            vElements.push_back(element);
+    std::sort(vElements.begin(), vElements.end());
+    vElements.erase(std::unique(vElements.begin(), vElements.end()), vElements.end());
+    nElements = vElements.size();
+
+    std::vector<uint64_t> vValues;
+    vValues.reserve(nElements);
+    BOOST_FOREACH(const Element &element, vElements)
+        vValues.push_back(HashToRange(element));
+    std::sort(vValues.begin(), vValues.end());
+
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    WriteCompactSize(ss, nElements);
+    vchEncoded.assign(ss.begin(), ss.end());
+    CBitWriter writer(vchEncoded);
+    uint64_t nLast = 0;
+    BOOST_FOREACH(uint64_t nValue, vValues) {
+        writer.WriteGolombRice(nValue - nLast, P);
+        nLast = nValue;
+    }
+}
+
+CBlockFilter::CBlockFilter(const CBlock &block, const CBlockUndo &blockundo) : hashBlock(block.GetHash()), nElements(0)
+{
+    std::vector<Element> vElements;
+    BOOST_FOREACH(const CTransaction &tx, block.vtx) {
+        BOOST_FOREACH(const CTxOut &txout, tx.vout) {
+            const CScript &script = txout.scriptPubKey;
+            if (script.empty() || script[0] == OP_RETURN)
+                continue;
+            vElements.push_back(Element(script.begin(), script.end()));
+        }
+    }
+    BOOST_FOREACH(const CTxUndo &txundo, blockundo.vtxundo) {
+        BOOST_FOREACH(const CTxInUndo &txinundo, txundo.vprevout) {
+            const CScript &script = txinundo.txout.scriptPubKey;
+            vElements.push_back(Element(script.begin(), script.end()));
+        }
+    }
+    *this = CBlockFilter(hashBlock, vElements);
+}
+
+CBlockFilter::CBlockFilter(const uint256 &hashBlockIn, const std::vector<unsigned char> &vchEncodedIn) : hashBlock(hashBlockIn), vchEncoded(vchEncodedIn)
+{
+    CDataStream ss(vchEncoded, SER_NETWORK, PROTOCOL_VERSION);
+    nElements = ReadCompactSize(ss);
+    // Each element takes at least P + 1 bits
+    if (nElements > ss.size() * 8 / (P + 1))
+        throw std::ios_base::failure("CBlockFilter : invalid number of elements");
+}
+
+bool CBlockFilter::Match(const Element &element) const
+{
+    return MatchAny(std::vector<Element>(1, element));
+}
+
+bool CBlockFilter::MatchAny(const std::vector<Element> &vElements) const
+{
+    if (nElements == 0 || vElements.empty())
+        return false;
+
+    std::vector<uint64_t> vQueries;
+    vQueries.reserve(vElements.size());
+    BOOST_FOREACH(const Element &element, vElements)
+        vQueries.push_back(HashToRange(element));
+    std::sort(vQueries.begin(), vQueries.end());
+
+    // Decode the set in ascending order, walking the sorted queries alongside
+    CDataStream ss(vchEncoded, SER_NETWORK, PROTOCOL_VERSION);
+    ReadCompactSize(ss);
+    const unsigned char *pend = &vchEncoded[0] + vchEncoded.size();
+    CBitReader reader(pend - ss.size(), pend);
+    std::vector<uint64_t>::const_iterator itQuery = vQueries.begin();
+    uint64_t nValue = 0;
+    for (uint64_t i = 0; i < nElements; i++) {
+        nValue += reader.ReadGolombRice(P);
+        while (*itQuery < nValue)
+            if (++itQuery == vQueries.end())
+                return false;
+        if (*itQuery == nValue)
+            return true;
+    }
+    return false;
+}
+
+uint256 CBlockFilter::GetHash() const
+{
+    return Hash(vchEncoded.begin(), vchEncoded.end());
+}
+
+uint256 CBlockFilter::ComputeHeader(const uint256 &hashPrevHeader) const
+{
+    uint256 hashFilter = GetHash();
+    return Hash(hashFilter.begin(), hashFilter.end(), hashPrevHeader.begin(), hashPrevHeader.end());
+}
@@ -0,0 +1,82 @@
+// Copyright (c) 2014 The Reddcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKFILTER_H
+#define BITCOIN_BLOCKFILTER_H
+
+#include "serialize.h"
+#include "uint256.h"
+
+#include <stdint.h>
+#include <vector>
+
+class CBlock;
+class CBlockUndo;
+
+/** Filter types of the getcfilters family of messages */
+enum BlockFilterType
+{
+    BLOCK_FILTER_BASIC = 0,
+};
+
+/** Number of blocks indexed per database write while building the filter index */
+static const unsigned int BLOCK_FILTER_INDEX_BATCH_SIZE = 100;
+/** Maximum number of filters sent in reply to one getcfilters */
+static const unsigned int MAX_GETCFILTERS_SIZE = 1000;
+/** Maximum number of filter headers sent in reply to one getcfheaders */
+static const unsigned int MAX_GETCFHEADERS_SIZE = 2000;
+/** Distance between the filter headers sent in reply to getcfcheckpt */
+static const int CFCHECKPT_INTERVAL = 1000;
+
+/** Compact filter of a block (BIP 158 "basic" filter): a Golomb-Rice coded
+ *  set of the output scripts it creates and of the output scripts it spends.
+ *
+ * Every element is mapped by SipHash, keyed with the first 16 bytes of the
+ * block hash, to a number in [0, N * M). The sorted numbers are stored as
+ * Golomb-Rice coded differences with parameter P. Matching has a false
+ * positive rate of 1/M per queried element, and never false negatives.
+ *
+ * Encoded format:
+ * - CompactSize N
+ * - the coded differences, most significant bit first, padded to a whole byte
+ */
+class CBlockFilter
+{
+public:
+    typedef std::vector<unsigned char> Element;
+
+    static const int P = 19;
+    static const uint64_t M = 784931;
+
+private:
+    uint256 hashBlock;
+    uint64_t nElements;
+    std::vector<unsigned char> vchEncoded;
+
+    uint64_t HashToRange(const Element &element) const;
+
+public:
+    CBlockFilter() : hashBlock(0), nElements(0) { }
+
+    // filter of the given elements (duplicates and empty ones are ignored)
+    CBlockFilter(const uint256 &hashBlockIn, const std::vector<Element> &vElements);
+    // filter of a block given its undo data (empty for the genesis block)
+    CBlockFilter(const CBlock &block, const CBlockUndo &blockundo);
+    // filter as encoded, throws std::ios_base::failure if obviously malformed
+    CBlockFilter(const uint256 &hashBlockIn, const std::vector<unsigned char> &vchEncodedIn);
+
+    const uint256 &GetBlockHash() const { return hashBlock; }
+    const std::vector<unsigned char> &GetEncoded() const { return vchEncoded; }
+    uint64_t GetSize() const { return nElements; }
+
+    bool Match(const Element &element) const;
+    bool MatchAny(const std::vector<Element> &vElements) const;
+
+    // double SHA256 of the encoded filter
+    uint256 GetHash() const;
+    // header of this filter in the chain of filter headers
+    uint256 ComputeHeader(const uint256 &hashPrevHeader) const;
+};
+
+#endif // BITCOIN_BLOCKFILTER_H
@@ -4,6 +4,8 @@
 
 #include "coins.h"
 
+#include "version.h"
+
 #include <assert.h>
 
 // calculate number of bytes for the bitmask, and its number of non-zero bytes
@@ -53,6 +55,10 @@ bool CCoins::Spend(int nPos) {
 bool CCoinsView::GetCoins(const uint256 &txid, CCoins &coins) { return false; }
 bool CCoinsView::SetCoins(const uint256 &txid, const CCoins &coins) { return false; }
 bool CCoinsView::HaveCoins(const uint256 &txid) { return false; }
+bool CCoinsView::HaveOutput(const COutPoint &outpoint) {
+    CCoins coins;
+    return GetCoins(outpoint.hash, coins) && coins.IsAvailable(outpoint.n);
+}
 uint256 CCoinsView::GetBestBlock() { return uint256(0); }
 bool CCoinsView::SetBestBlock(const uint256 &hashBlock) { return false; }
 bool CCoinsView::BatchWrite(const std::map<uint256, CCoins> &mapCoins, const uint256 &hashBlock) { return false; }
@@ -63,6 +69,7 @@ CCoinsViewBacked::CCoinsViewBacked(CCoinsView &viewIn) : base(&viewIn) { }
 bool CCoinsViewBacked::GetCoins(const uint256 &txid, CCoins &coins) { return base->GetCoins(txid, coins); }
 bool CCoinsViewBacked::SetCoins(const uint256 &txid, const CCoins &coins) { return base->SetCoins(txid, coins); }
 bool CCoinsViewBacked::HaveCoins(const uint256 &txid) { return base->HaveCoins(txid); }
+bool CCoinsViewBacked::HaveOutput(const COutPoint &outpoint) { return base->HaveOutput(outpoint); }
 uint256 CCoinsViewBacked::GetBestBlock() { return base->GetBestBlock(); }
 bool CCoinsViewBacked::SetBestBlock(const uint256 &hashBlock) { return base->SetBestBlock(hashBlock); }
 void CCoinsViewBacked::SetBackend(CCoinsView &viewIn) { base = &viewIn; }
@@ -110,6 +117,13 @@ bool CCoinsViewCache::HaveCoins(const uint256 &txid) {
     return FetchCoins(txid) != cacheCoins.end();
 }
 
+bool CCoinsViewCache::HaveOutput(const COutPoint &outpoint) {
+    std::map<uint256,CCoins>::const_iterator it = cacheCoins.find(outpoint.hash);
+    if (it != cacheCoins.end())
+        return it->second.IsAvailable(outpoint.n);
+    return base->HaveOutput(outpoint);
+}
+
 uint256 CCoinsViewCache::GetBestBlock() {
     if (hashBlock == uint256(0))
         hashBlock = base->GetBestBlock();
@@ -194,3 +208,42 @@ double CCoinsViewCache::GetPriority(const CTransaction &tx, int nHeight)
     }
     return tx.ComputePriority(dResult);
 }
+
+void CCoinsRunningStats::ApplyTx(const CCoins &coins, int nSign) {
+    if (coins.IsPruned())
+        return;
+    nTransactions += nSign;
+    nSerializedSize += nSign * (int64_t)(32 + coins.GetSerializeSize(SER_DISK, CLIENT_VERSION));
+}
+
+void CCoinsRunningStats::ApplyOutput(const COutPoint &outpoint, const CCoins &coins, int nSign) {
+    assert(coins.IsAvailable(outpoint.n));
+    const CTxOut &out = coins.vout[outpoint.n];
+    // nTime and the coinstake flag are not part of the element: undo data cannot restore them
+    CDataStream ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << outpoint;
+    ss << VARINT(coins.nHeight * 2 + (coins.fCoinBase ? 1 : 0));
+    ss << out;
+    std::vector<unsigned char> vch(ss.begin(), ss.end());
+    if (nSign > 0)
+        muhash.Insert(vch);
+    else
+        muhash.Remove(vch);
+    nTransactionOutputs += nSign;
+    nTotalAmount += nSign * out.nValue;
+}
+
+void CCoinsRunningStats::ApplyCoins(const uint256 &txid, const CCoins &coins, int nSign) {
+    ApplyTx(coins, nSign);
+    for (unsigned int i = 0; i < coins.vout.size(); i++)
+        if (!coins.vout[i].IsNull())
+            ApplyOutput(COutPoint(txid, i), coins, nSign);
+}
+
+void CCoinsRunningStats::Add(const CCoinsRunningStats &delta) {
+    nTransactions += delta.nTransactions;
+    nTransactionOutputs += delta.nTransactionOutputs;
+    nSerializedSize += delta.nSerializedSize;
+    nTotalAmount += delta.nTotalAmount;
+    muhash *= delta.muhash;
+}
@@ -6,6 +6,7 @@
 #define BITCOIN_COINS_H
 
 #include "core.h"
+#include "muhash.h"
 #include "serialize.h"
 #include "uint256.h"
 
@@ -299,6 +300,41 @@ struct CCoinsStats
     CCoinsStats() : nHeight(0), hashBlock(0), nTransactions(0), nTransactionOutputs(0), nSerializedSize(0), hashSerialized(0), nTotalAmount(0) {}
 };
 
+/** Statistics about the unspent output set that can be maintained incrementally
+ *  as outputs are created and spent, instead of by a scan over the whole set.
+ *  An instance can hold either absolute values or a delta to be merged with Add().
+ */
+class CCoinsRunningStats
+{
+public:
+    uint256 hashBlock;
+    int64_t nTransactions;
+    int64_t nTransactionOutputs;
+    int64_t nSerializedSize;
+    int64_t nTotalAmount;
+    CMuHash3072 muhash; // over outpoint, height, coinbase flag and txout of every unspent output
+
+    CCoinsRunningStats() : hashBlock(0), nTransactions(0), nTransactionOutputs(0), nSerializedSize(0), nTotalAmount(0) {}
+
+    // account for (nSign=1) or remove (nSign=-1) the entry of a transaction, not its outputs
+    void ApplyTx(const CCoins &coins, int nSign);
+    // account for or remove a single unspent output
+    void ApplyOutput(const COutPoint &outpoint, const CCoins &coins, int nSign);
+    // account for or remove a transaction entry together with all its unspent outputs
+    void ApplyCoins(const uint256 &txid, const CCoins &coins, int nSign);
+    // merge the changes accumulated in delta (hashBlock is left alone)
+    void Add(const CCoinsRunningStats &delta);
+
+    IMPLEMENT_SERIALIZE(
+        READWRITE(hashBlock);
+        READWRITE(nTransactions);
+        READWRITE(nTransactionOutputs);
+        READWRITE(nSerializedSize);
+        READWRITE(nTotalAmount);
+        READWRITE(muhash);
+    )
+};
+
 
 /** Abstract view on the open txout dataset. */
 class CCoinsView
@@ -314,6 +350,10 @@ public:
     // This may (but cannot always) return true for fully spent transactions
     virtual bool HaveCoins(const uint256 &txid);
 
+    // Check whether a single output is unspent. Views that store outputs
+    // individually can answer this without materializing the whole CCoins.
+    virtual bool HaveOutput(const COutPoint &outpoint);
+
     // Retrieve the block hash whose state this CCoinsView currently represents
     virtual uint256 GetBestBlock();
 
@@ -342,6 +382,7 @@ public:
     bool GetCoins(const uint256 &txid, CCoins &coins);
     bool SetCoins(const uint256 &txid, const CCoins &coins);
     bool HaveCoins(const uint256 &txid);
+    bool HaveOutput(const COutPoint &outpoint);
     uint256 GetBestBlock();
     bool SetBestBlock(const uint256 &hashBlock);
     void SetBackend(CCoinsView &viewIn);
@@ -364,6 +405,9 @@ public:
     bool GetCoins(const uint256 &txid, CCoins &coins);
     bool SetCoins(const uint256 &txid, const CCoins &coins);
     bool HaveCoins(const uint256 &txid);
+    // Answered from the cache if the txid is cached, otherwise by the base
+    // view without pulling the CCoins into the cache.
+    bool HaveOutput(const COutPoint &outpoint);
     uint256 GetBestBlock();
     bool SetBestBlock(const uint256 &hashBlock);
     bool BatchWrite(const std::map<uint256, CCoins> &mapCoins, const uint256 &hashBlock);
@@ -0,0 +1,137 @@
+// Copyright (c) 2014 The Reddcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coinselection.h"
+
+#include "util.h"
+
+#include <limits>
+
+using namespace std;
+
+bool SelectCoinsBnB(const vector<int64_t>& vValue, int64_t nTarget, int64_t nTolerance,
+                    vector<char>& vfSelected, int64_t& nSelected,
+                    unsigned int nMaxTries, int64_t nTimeBudget)
+{
+    vfSelected.clear();
+    nSelected = 0;
+
+    int64_t nRemaining = 0; // sum of the values not decided on yet
+    for (unsigned int i = 0; i < vValue.size(); i++)
+        nRemaining += vValue[i];
+    if (nRemaining < nTarget)
+        return false;
+
+    int64_t nDeadline = GetTimeMicros() + nTimeBudget;
+    int64_t nBestExcess = std::numeric_limits<int64_t>::max();
+    int64_t nCurrent = 0;
+    vector<char> vfCurrent; // inclusion of vValue[0 .. vfCurrent.size() - 1]
+    vfCurrent.reserve(vValue.size());
+
+    for (unsigned int nTries = 0; nTries < nMaxTries; nTries++)
+    {
+        bool fBacktrack = false;
+        if (nCurrent + nRemaining < nTarget || nCurrent > nTarget + nTolerance)
+        {
+            // the target is out of reach, or overshot
+            fBacktrack = true;
+        }
+        else if (nCurrent >= nTarget)
+        {
+            if (nCurrent - nTarget < nBestExcess)
+            {
+                nBestExcess = nCurrent - nTarget;
+                vfSelected = vfCurrent;
+                vfSelected.resize(vValue.size(), false);
+                nSelected = nCurrent;
+                if (nBestExcess == 0)
+                    break;
+            }
+            fBacktrack = true;
+        }
+
+        if (fBacktrack)
+        {
+            // undo the trailing exclusions, then exclude the last included value
+            while (!vfCurrent.empty() && !vfCurrent.back())
+            {
+                nRemaining += vValue[vfCurrent.size() - 1];
+                vfCurrent.pop_back();
+            }
+            if (vfCurrent.empty())
+                break; // all branches explored
+            vfCurrent.back() = false;
+            nCurrent -= vValue[vfCurrent.size() - 1];
+        }
+        else
+        {
+            unsigned int i = vfCurrent.size();
+            nRemaining -= vValue[i];
+            // including a value equal to the one just excluded repeats a branch already explored
+            if (i > 0 && !vfCurrent.back() && vValue[i] == vValue[i - 1])
+                vfCurrent.push_back(false);
+            else
+            {
+                vfCurrent.push_back(true);
+                nCurrent += vValue[i];
+            }
+        }
+
+        if ((nTries & 1023) == 1023 && GetTimeMicros() > nDeadline)
+            break;
+    }
+
+    return !vfSelected.empty();
+}
+
+void ApproximateBestSubset(const vector<int64_t>& vValue, int64_t nTotalLower, int64_t nTargetValue,
+                           vector<char>& vfBest, int64_t& nBest, int iterations, int64_t nTimeBudget)
+{
+    vector<char> vfIncluded;
+
+    vfBest.assign(vValue.size(), true);
+    nBest = nTotalLower;
+
+    seed_insecure_rand();
+    int64_t nDeadline = GetTimeMicros() + nTimeBudget;
+
+    for (int nRep = 0; nRep < iterations && nBest != nTargetValue; nRep++)
+    {
+        // every round is a full pass over vValue; large candidate sets get fewer rounds
+        if (nRep > 0 && GetTimeMicros() > nDeadline)
+            break;
+
+        vfIncluded.assign(vValue.size(), false);
+        int64_t nTotal = 0;
+        bool fReachedTarget = false;
+        for (int nPass = 0; nPass < 2 && !fReachedTarget; nPass++)
+        {
+            for (unsigned int i = 0; i < vValue.size(); i++)
+            {
+                //The solver here uses a randomized algorithm,
+                //the randomness serves no real security purpose but is just
+                //needed to prevent degenerate behavior and it is important
+                //that the rng fast. We do not use a constant random sequence,
+                //because there may be some privacy improvement by making
+                //the selection random.
+                if (nPass == 0 ? insecure_rand()&1 : !vfIncluded[i])
+                {
+                    nTotal += vValue[i];
+                    vfIncluded[i] = true;
+                    if (nTotal >= nTargetValue)
+                    {
+                        fReachedTarget = true;
+                        if (nTotal < nBest)
+                        {
+                            nBest = nTotal;
+                            vfBest = vfIncluded;
+                        }
+                        nTotal -= vValue[i];
+                        vfIncluded[i] = false;
+                    }
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,36 @@
+// Copyright (c) 2014 The Reddcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_COINSELECTION_H
+#define BITCOIN_COINSELECTION_H
+
+#include <stdint.h>
+#include <vector>
+
+/** Maximum number of branches SelectCoinsBnB explores */
+static const unsigned int COINSELECTION_BNB_MAX_TRIES = 100000;
+/** Time a single coin selection search may take, in microseconds */
+static const int64_t COINSELECTION_TIME_BUDGET = 100000;
+
+/** Branch-and-bound search for a subset of vValue adding up to at least
+ *  nTarget and at most nTarget + nTolerance, with as little excess as
+ *  possible. vValue must be sorted by descending value. The search stops at
+ *  the first exact match, or once nMaxTries branches or nTimeBudget
+ *  microseconds are used up, and then returns the best subset found so far.
+ *  Returns false if no subset was found.
+ */
+bool SelectCoinsBnB(const std::vector<int64_t>& vValue, int64_t nTarget, int64_t nTolerance,
+                    std::vector<char>& vfSelected, int64_t& nSelected,
+                    unsigned int nMaxTries = COINSELECTION_BNB_MAX_TRIES,
+                    int64_t nTimeBudget = COINSELECTION_TIME_BUDGET);
+
+/** Stochastic approximation of the smallest subset of vValue adding up to at
+ *  least nTargetValue; nTotalLower is the sum of vValue. Runs at most
+ *  iterations rounds, and stops early after nTimeBudget microseconds.
+ */
+void ApproximateBestSubset(const std::vector<int64_t>& vValue, int64_t nTotalLower, int64_t nTargetValue,
+                           std::vector<char>& vfBest, int64_t& nBest, int iterations = 1000,
+                           int64_t nTimeBudget = COINSELECTION_TIME_BUDGET);
+
+#endif // BITCOIN_COINSELECTION_H
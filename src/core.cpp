@@ -7,6 +7,7 @@
 #include "util.h"
 #include "chainparams.h"
 #include "kernel.h"
+#include "sha256.h"
 
 std::string COutPoint::ToString() const
 {
@@ -323,11 +324,15 @@ uint256 CBlock::BuildMerkleTree() const
     int j = 0;
     for (int nSize = vtx.size(); nSize > 1; nSize = (nSize + 1) / 2)
     {
-        for (int i = 0; i < nSize; i += 2)
+        // Each pair of adjacent hashes is one 64-byte input, so a whole
+        // level is hashed in one batch
+        int nOut = vMerkleTree.size();
+        vMerkleTree.resize(nOut + (nSize + 1) / 2);
+        SHA256D64((unsigned char*)&vMerkleTree[nOut], (const unsigned char*)&vMerkleTree[j], nSize / 2);
+        if (nSize & 1)
         {
-            int i2 = std::min(i+1, nSize-1);
-            vMerkleTree.push_back(Hash(BEGIN(vMerkleTree[j+i]),  END(vMerkleTree[j+i]),
-                                       BEGIN(vMerkleTree[j+i2]), END(vMerkleTree[j+i2])));
+            const uint256& last = vMerkleTree[j+nSize-1];
+            vMerkleTree.back() = Hash(BEGIN(last), END(last), BEGIN(last), END(last));
         }
         j += nSize;
     }
@@ -51,6 +51,7 @@ CDBEnv::CDBEnv() : dbenv(DB_CXX_NO_EXCEPTIONS)
 {
     fDbEnvInit = false;
     fMockDb = false;
+    fLogStore = false;
 }
 
 CDBEnv::~CDBEnv()
@@ -215,14 +216,14 @@ bool CDBEnv::Salvage(std::string strFile, bool fAggressive,
 void CDBEnv::CheckpointLSN(std::string strFile)
 {
     dbenv.txn_checkpoint(0, 0, 0);
-    if (fMockDb)
+    if (fMockDb || mapLogDb.count(strFile))
         return;
     dbenv.lsn_reset(strFile.c_str(), 0);
 }
 
 
 CDB::CDB(const char *pszFile, const char* pszMode) :
-    pdb(NULL), activeTxn(NULL)
+    pdb(NULL), activeTxn(NULL), plog(NULL), activeLogTxn(NULL), fJoined(false)
 {
     int ret;
     if (pszFile == NULL)
@@ -241,6 +242,34 @@ CDB::CDB(const char *pszFile, const char* pszMode) :
 
         strFile = pszFile;
         ++bitdb.mapFileUseCount[strFile];
+
+        // join the batch of this thread on the file, if any
+        std::map<std::pair<std::string, boost::thread::id>, CDB*>::const_iterator it = bitdb.mapBatch.find(make_pair(strFile, boost::this_thread::get_id()));
+        if (it != bitdb.mapBatch.end()) {
+            activeTxn = it->second->activeTxn;
+            activeLogTxn = it->second->activeLogTxn;
+            fJoined = true;
+        }
+
+        if (bitdb.fLogStore)
+        {
+            plog = bitdb.OpenLog(strFile, fCreate);
+            if (plog == NULL)
+            {
+                --bitdb.mapFileUseCount[strFile];
+                strFile = "";
+                throw runtime_error(strprintf("CDB : can't open database log %s", pszFile));
+            }
+            if (fCreate && !Exists(string("version")))
+            {
+                bool fTmp = fReadOnly;
+                fReadOnly = false;
+                WriteVersion(CLIENT_VERSION);
+                fReadOnly = fTmp;
+            }
+            return;
+        }
+
         pdb = bitdb.mapDb[strFile];
         if (pdb == NULL)
         {
@@ -286,7 +315,7 @@ CDB::CDB(const char *pszFile, const char* pszMode) :
 
 void CDB::Flush()
 {
-    if (activeTxn)
+    if (activeTxn || plog)
         return;
 
     // Flush database activity from memory pool to disk log
@@ -299,12 +328,18 @@ void CDB::Flush()
 
 void CDB::Close()
 {
-    if (!pdb)
+    if (!pdb && !plog)
         return;
-    if (activeTxn)
-        activeTxn->abort();
+    if (!fJoined) {
+        if (activeTxn)
+            activeTxn->abort();
+        delete activeLogTxn;
+    }
     activeTxn = NULL;
+    activeLogTxn = NULL;
+    fJoined = false;
     pdb = NULL;
+    plog = NULL;
 
     Flush();
 
@@ -314,10 +349,240 @@ void CDB::Close()
     }
 }
 
+bool CDB::ReadLog(const CDataStream& ssKey, CDataStream& ssValue)
+{
+    CLogDB::Data key(ssKey.begin(), ssKey.end()), value;
+    if (activeLogTxn)
+    {
+        std::map<CLogDB::Data, std::pair<bool, CLogDB::Data>, CLogDBKeyLess>::const_iterator it = activeLogTxn->mapWrites.find(key);
+        if (it != activeLogTxn->mapWrites.end())
+        {
+            if (it->second.first)
+                return false;
+            ssValue.write(&it->second.second[0], it->second.second.size());
+            return true;
+        }
+    }
+    if (!plog->Read(key, value))
+        return false;
+    ssValue.write(&value[0], value.size());
+    return true;
+}
+
+bool CDB::WriteLog(const CDataStream& ssKey, const CDataStream& ssValue, bool fOverwrite)
+{
+    if (!fOverwrite && ExistsLog(ssKey))
+        return false;
+    CLogDB::Data key(ssKey.begin(), ssKey.end()), value(ssValue.begin(), ssValue.end());
+    if (activeLogTxn)
+    {
+        activeLogTxn->Write(key, value);
+        return true;
+    }
+    CLogDBBatch batch;
+    batch.Write(key, value);
+    return plog->Commit(batch);
+}
+
+bool CDB::EraseLog(const CDataStream& ssKey)
+{
+    CLogDB::Data key(ssKey.begin(), ssKey.end());
+    if (activeLogTxn)
+    {
+        activeLogTxn->Erase(key);
+        return true;
+    }
+    if (!plog->Exists(key))
+        return true;
+    CLogDBBatch batch;
+    batch.Erase(key);
+    return plog->Commit(batch);
+}
+
+bool CDB::ExistsLog(const CDataStream& ssKey)
+{
+    CLogDB::Data key(ssKey.begin(), ssKey.end());
+    if (activeLogTxn)
+    {
+        std::map<CLogDB::Data, std::pair<bool, CLogDB::Data>, CLogDBKeyLess>::const_iterator it = activeLogTxn->mapWrites.find(key);
+        if (it != activeLogTxn->mapWrites.end())
+            return !it->second.first;
+    }
+    return plog->Exists(key);
+}
+
+int CDBCursor::ReadLog(CDataStream& ssKey, CDataStream& ssValue, unsigned int fFlags)
+{
+    bool fAfter = fStarted;
+    if (fFlags == DB_SET_RANGE)
+    {
+        keyLast.assign(ssKey.begin(), ssKey.end());
+        fAfter = false;
+    }
+    else if (fFlags != DB_NEXT)
+        return EINVAL;
+
+    CLogDB::Data value;
+    if (!plog->ReadNext(keyLast, value, fAfter))
+        return DB_NOTFOUND;
+    fStarted = true;
+
+    ssKey.SetType(SER_DISK);
+    ssKey.clear();
+    ssKey.write(&keyLast[0], keyLast.size());
+    ssValue.SetType(SER_DISK);
+    ssValue.clear();
+    ssValue.write(&value[0], value.size());
+    return 0;
+}
+
+CDBBatch::CDBBatch(const std::string& strFilename) : CDB(strFilename.c_str(), "r+"), fOuter(false)
+{
+    if (fJoined)
+        return;
+    if (!TxnBegin())
+    {
+        LogPrintf("CDBBatch : cannot begin a transaction on %s\n", strFile);
+        return;
+    }
+    LOCK(bitdb.cs_db);
+    bitdb.mapBatch[make_pair(strFile, boost::this_thread::get_id())] = this;
+    fOuter = true;
+}
+
+bool CDBBatch::Commit()
+{
+    if (!fOuter)
+        return true;
+    fOuter = false;
+    {
+        LOCK(bitdb.cs_db);
+        bitdb.mapBatch.erase(make_pair(strFile, boost::this_thread::get_id()));
+    }
+    if (!TxnCommit())
+        return error("CDBBatch::Commit : failed to commit the transaction on %s", strFile);
+    return true;
+}
+
+CDBBatch::~CDBBatch()
+{
+    Commit();
+}
+
+CLogDB *CDBEnv::OpenLog(const std::string& strFile, bool fCreate)
+{
+    LOCK(cs_db);
+    std::map<std::string, CLogDB*>::iterator it = mapLogDb.find(strFile);
+    if (it != mapLogDb.end())
+        return it->second;
+
+    filesystem::path pathLog = GetDataDir() / (strFile + ".log");
+    bool fImport = !filesystem::exists(pathLog) && filesystem::exists(GetDataDir() / strFile);
+    CLogDB *plog = new CLogDB();
+    if (!plog->Open(pathLog, fCreate || fImport))
+    {
+        delete plog;
+        return NULL;
+    }
+
+    if (fImport)
+    {
+        LogPrintf("CDBEnv::OpenLog : Importing %s into %s\n", strFile, pathLog.string());
+        CLogDBBatch batch;
+        Db db(&dbenv, 0);
+        int ret = db.open(NULL, strFile.c_str(), "main", DB_BTREE, DB_RDONLY, 0);
+        Dbc* pcursor = NULL;
+        if (ret == 0)
+            ret = db.cursor(NULL, &pcursor, 0);
+        while (ret == 0)
+        {
+            Dbt datKey, datValue;
+            datKey.set_flags(DB_DBT_MALLOC);
+            datValue.set_flags(DB_DBT_MALLOC);
+            ret = pcursor->get(&datKey, &datValue, DB_NEXT);
+            if (ret != 0)
+                break;
+            batch.Write(CLogDB::Data((char*)datKey.get_data(), (char*)datKey.get_data() + datKey.get_size()),
+                        CLogDB::Data((char*)datValue.get_data(), (char*)datValue.get_data() + datValue.get_size()));
+            memset(datValue.get_data(), 0, datValue.get_size());
+            free(datKey.get_data());
+            free(datValue.get_data());
+        }
+        if (pcursor)
+            pcursor->close();
+        db.close(0);
+        if (ret != DB_NOTFOUND || !plog->Commit(batch))
+        {
+            LogPrintf("CDBEnv::OpenLog : Error %d importing %s\n", ret, strFile);
+            delete plog;
+            filesystem::remove(pathLog);
+            return NULL;
+        }
+
+        // Move the Berkeley DB file out of the way, so that it is not mistaken
+        // for the wallet in use and can be deleted when the keys get encrypted
+        std::string strImported = ImportedFile(strFile);
+        ret = dbenv.dbrename(NULL, strFile.c_str(), NULL, strImported.c_str(), DB_AUTO_COMMIT);
+        if (ret == 0)
+            LogPrintf("CDBEnv::OpenLog : Imported %s, renamed it to %s\n", strFile, strImported);
+        else
+            LogPrintf("CDBEnv::OpenLog : Imported %s, but failed to rename it to %s (error %d)\n", strFile, strImported, ret);
+    }
+
+    mapLogDb[strFile] = plog;
+    return plog;
+}
+
+bool CDBEnv::RemoveImported(const std::string& strFile)
+{
+    LOCK(cs_db);
+    std::string strImported = ImportedFile(strFile);
+    if (!filesystem::exists(GetDataDir() / strImported))
+        return true;
+    int ret = dbenv.dbremove(NULL, strImported.c_str(), NULL, DB_AUTO_COMMIT);
+    if (ret != 0)
+        return error("CDBEnv::RemoveImported : Error %d removing %s", ret, strImported);
+    LogPrintf("CDBEnv::RemoveImported : Removed %s\n", strImported);
+    return true;
+}
+
+bool CDBEnv::ExportLog(const std::string& strFile, const std::string& strFileDest)
+{
+    LOCK(cs_db);
+    CLogDB *plog = OpenLog(strFile, false);
+    if (plog == NULL)
+        return false;
+
+    dbenv.dbremove(NULL, strFileDest.c_str(), NULL, DB_AUTO_COMMIT);
+    Db* pdbCopy = new Db(&dbenv, 0);
+    int ret = pdbCopy->open(NULL, strFileDest.c_str(), "main", DB_BTREE, DB_CREATE, 0);
+    CLogDB::Data key, value;
+    bool fAfter = false;
+    while (ret == 0 && plog->ReadNext(key, value, fAfter))
+    {
+        Dbt datKey(&key[0], key.size());
+        Dbt datValue(&value[0], value.size());
+        ret = pdbCopy->put(NULL, &datKey, &datValue, 0);
+        fAfter = true;
+    }
+    if (pdbCopy->close(0))
+        ret = -1;
+    delete pdbCopy;
+    if (ret != 0)
+        return error("CDBEnv::ExportLog : Error %d writing %s", ret, strFileDest);
+    dbenv.txn_checkpoint(0, 0, 0);
+    dbenv.lsn_reset(strFileDest.c_str(), 0);
+    return true;
+}
+
 void CDBEnv::CloseDb(const string& strFile)
 {
     {
         LOCK(cs_db);
+        // log stores stay open, as opening one reads all of it
+        std::map<std::string, CLogDB*>::iterator it = mapLogDb.find(strFile);
+        if (it != mapLogDb.end())
+            it->second->Flush();
         if (mapDb[strFile] != NULL)
         {
             // Close the database handle
@@ -346,6 +611,16 @@ bool CDB::Rewrite(const string& strFile, const char* pszSkip)
             LOCK(bitdb.cs_db);
             if (!bitdb.mapFileUseCount.count(strFile) || bitdb.mapFileUseCount[strFile] == 0)
             {
+                if (bitdb.fLogStore)
+                {
+                    LogPrintf("CDB::Rewrite : Compacting %s...\n", strFile);
+                    CLogDB *plog = bitdb.OpenLog(strFile, false);
+                    bool fSuccess = plog && plog->Compact(pszSkip);
+                    if (!fSuccess)
+                        LogPrintf("CDB::Rewrite : Failed to compact database log %s\n", strFile);
+                    return fSuccess;
+                }
+
                 // Flush log data to the dat file
                 bitdb.CloseDb(strFile);
                 bitdb.CheckpointLSN(strFile);
@@ -370,7 +645,7 @@ bool CDB::Rewrite(const string& strFile, const char* pszSkip)
                         fSuccess = false;
                     }
 
-                    Dbc* pcursor = db.GetCursor();
+                    CDBCursor* pcursor = db.GetCursor();
                     if (pcursor)
                         while (fSuccess)
                         {
@@ -379,12 +654,12 @@ bool CDB::Rewrite(const string& strFile, const char* pszSkip)
                             int ret = db.ReadAtCursor(pcursor, ssKey, ssValue, DB_NEXT);
                             if (ret == DB_NOTFOUND)
                             {
-                                pcursor->close();
+                                delete pcursor;
                                 break;
                             }
                             else if (ret != 0)
                             {
-                                pcursor->close();
+                                delete pcursor;
                                 fSuccess = false;
                                 break;
                             }
@@ -465,6 +740,16 @@ void CDBEnv::Flush(bool fShutdown)
         LogPrint("db", "CDBEnv::Flush : Flush(%s)%s took %15dms\n", fShutdown ? "true" : "false", fDbEnvInit ? "" : " database not started", GetTimeMillis() - nStart);
         if (fShutdown)
         {
+            for (map<string, CLogDB*>::iterator it = mapLogDb.begin(); it != mapLogDb.end(); )
+            {
+                if (mapFileUseCount.count(it->first))
+                {
+                    it++;
+                    continue;
+                }
+                delete it->second;
+                mapLogDb.erase(it++);
+            }
             char** listp;
             if (mapFileUseCount.empty())
             {
@@ -6,6 +6,7 @@
 #ifndef BITCOIN_DB_H
 #define BITCOIN_DB_H
 
+#include "logdb.h"
 #include "serialize.h"
 #include "sync.h"
 #include "version.h"
@@ -15,9 +16,11 @@
 #include <vector>
 
 #include <boost/filesystem/path.hpp>
+#include <boost/thread.hpp>
 #include <db_cxx.h>
 
 class CAddrMan;
+class CDB;
 struct CBlockLocator;
 class CDiskBlockIndex;
 class COutPoint;
@@ -42,6 +45,12 @@ public:
     std::map<std::string, int> mapFileUseCount;
     std::map<std::string, Db*> mapDb;
 
+    // Keep databases in append-only logs (<file>.log) instead of Berkeley DB files
+    bool fLogStore;
+    std::map<std::string, CLogDB*> mapLogDb;
+    // Batches in progress (CDBBatch), by file and thread
+    std::map<std::pair<std::string, boost::thread::id>, CDB*> mapBatch;
+
     CDBEnv();
     ~CDBEnv();
     void MakeMock();
@@ -73,6 +82,18 @@ public:
     void CloseDb(const std::string& strFile);
     bool RemoveDb(const std::string& strFile);
 
+    /*
+     * Log store of strFile, opened on first use. A log that does not exist yet
+     * is created from the Berkeley DB file strFile, if there is one.
+     */
+    CLogDB *OpenLog(const std::string& strFile, bool fCreate);
+    // The Berkeley DB file strFile is renamed to once imported into its log
+    static std::string ImportedFile(const std::string& strFile) { return strFile + ".imported"; }
+    // Delete the imported Berkeley DB file of strFile, if any, e.g. once its keys are encrypted
+    bool RemoveImported(const std::string& strFile);
+    // Write the records of the log store of strFile to the Berkeley DB file strFileDest
+    bool ExportLog(const std::string& strFile, const std::string& strFileDest);
+
     DbTxn *TxnBegin(int flags=DB_TXN_WRITE_NOSYNC)
     {
         DbTxn* ptxn = NULL;
@@ -86,6 +107,30 @@ public:
 extern CDBEnv bitdb;
 
 
+/** Cursor over the records of a CDB, in key order */
+class CDBCursor
+{
+private:
+    CDBCursor(const CDBCursor&);
+    void operator=(const CDBCursor&);
+
+    CLogDB::Data keyLast;
+    bool fStarted;
+
+public:
+    Dbc* pcursor;        // Berkeley DB cursor, or NULL
+    const CLogDB* plog;  // log store, or NULL
+
+    explicit CDBCursor(Dbc* pcursorIn) : fStarted(false), pcursor(pcursorIn), plog(NULL) { }
+    explicit CDBCursor(const CLogDB* plogIn) : fStarted(false), pcursor(NULL), plog(plogIn) { }
+    ~CDBCursor() { if (pcursor) pcursor->close(); }
+
+    // Read the record at the cursor of a log store: DB_NEXT, or DB_SET_RANGE to ssKey.
+    // Records written by a transaction in progress are not seen.
+    int ReadLog(CDataStream& ssKey, CDataStream& ssValue, unsigned int fFlags);
+};
+
+
 /** RAII class that provides access to a Berkeley database */
 class CDB
 {
@@ -94,6 +139,15 @@ protected:
     std::string strFile;
     DbTxn *activeTxn;
     bool fReadOnly;
+    CLogDB *plog;              // log store, used instead of pdb if set
+    CLogDBBatch *activeLogTxn; // transaction on plog
+    bool fJoined;              // whether the transaction is that of a CDBBatch
+
+    // Log store counterparts of the Berkeley DB calls below
+    bool ReadLog(const CDataStream& ssKey, CDataStream& ssValue);
+    bool WriteLog(const CDataStream& ssKey, const CDataStream& ssValue, bool fOverwrite);
+    bool EraseLog(const CDataStream& ssKey);
+    bool ExistsLog(const CDataStream& ssKey);
 
     explicit CDB(const char* pszFile, const char* pszMode="r+");
     ~CDB() { Close(); }
@@ -108,13 +162,26 @@ protected:
     template<typename K, typename T>
     bool Read(const K& key, T& value)
     {
-        if (!pdb)
+        if (!pdb && !plog)
             return false;
 
         // Key
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(1000);
         ssKey << key;
+
+        if (plog) {
+            CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+            if (!ReadLog(ssKey, ssValue))
+                return false;
+            try {
+                ssValue >> value;
+            }
+            catch (std::exception &e) {
+                return false;
+            }
+            return true;
+        }
         Dbt datKey(&ssKey[0], ssKey.size());
 
         // Read
@@ -125,25 +192,26 @@ protected:
         if (datValue.get_data() == NULL)
             return false;
 
-        // Unserialize value
+        // Unserialize value in place; the buffer is wiped below, as it may hold keys
+        bool fRead = true;
         try {
-            CDataStream ssValue((char*)datValue.get_data(), (char*)datValue.get_data() + datValue.get_size(), SER_DISK, CLIENT_VERSION);
+            CSpanReader ssValue((char*)datValue.get_data(), (char*)datValue.get_data() + datValue.get_size(), SER_DISK, CLIENT_VERSION);
             ssValue >> value;
         }
         catch (std::exception &e) {
-            return false;
+            fRead = false;
         }
 
         // Clear and free memory
         memset(datValue.get_data(), 0, datValue.get_size());
         free(datValue.get_data());
-        return (ret == 0);
+        return fRead && (ret == 0);
     }
 
     template<typename K, typename T>
     bool Write(const K& key, const T& value, bool fOverwrite=true)
     {
-        if (!pdb)
+        if (!pdb && !plog)
             return false;
         if (fReadOnly)
             assert(!"Write called on database in read-only mode");
@@ -152,12 +220,15 @@ protected:
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(1000);
         ssKey << key;
-        Dbt datKey(&ssKey[0], ssKey.size());
 
         // Value
         CDataStream ssValue(SER_DISK, CLIENT_VERSION);
         ssValue.reserve(10000);
         ssValue << value;
+
+        if (plog)
+            return WriteLog(ssKey, ssValue, fOverwrite);
+        Dbt datKey(&ssKey[0], ssKey.size());
         Dbt datValue(&ssValue[0], ssValue.size());
 
         // Write
@@ -172,7 +243,7 @@ protected:
     template<typename K>
     bool Erase(const K& key)
     {
-        if (!pdb)
+        if (!pdb && !plog)
             return false;
         if (fReadOnly)
             assert(!"Erase called on database in read-only mode");
@@ -181,6 +252,9 @@ protected:
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(1000);
         ssKey << key;
+
+        if (plog)
+            return EraseLog(ssKey);
         Dbt datKey(&ssKey[0], ssKey.size());
 
         // Erase
@@ -194,13 +268,16 @@ protected:
     template<typename K>
     bool Exists(const K& key)
     {
-        if (!pdb)
+        if (!pdb && !plog)
             return false;
 
         // Key
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(1000);
         ssKey << key;
+
+        if (plog)
+            return ExistsLog(ssKey);
         Dbt datKey(&ssKey[0], ssKey.size());
 
         // Exists
@@ -211,19 +288,25 @@ protected:
         return (ret == 0);
     }
 
-    Dbc* GetCursor()
+    // Cursor over the records, to be deleted by the caller
+    CDBCursor* GetCursor()
     {
+        if (plog)
+            return new CDBCursor(plog);
         if (!pdb)
             return NULL;
         Dbc* pcursor = NULL;
-        int ret = pdb->cursor(NULL, &pcursor, 0);
+        int ret = pdb->cursor(activeTxn, &pcursor, 0);
         if (ret != 0)
             return NULL;
-        return pcursor;
+        return new CDBCursor(pcursor);
     }
 
-    int ReadAtCursor(Dbc* pcursor, CDataStream& ssKey, CDataStream& ssValue, unsigned int fFlags=DB_NEXT)
+    int ReadAtCursor(CDBCursor* pcursor, CDataStream& ssKey, CDataStream& ssValue, unsigned int fFlags=DB_NEXT)
     {
+        if (pcursor->plog)
+            return pcursor->ReadLog(ssKey, ssValue, fFlags);
+
         // Read at cursor
         Dbt datKey;
         if (fFlags == DB_SET || fFlags == DB_SET_RANGE || fFlags == DB_GET_BOTH || fFlags == DB_GET_BOTH_RANGE)
@@ -239,7 +322,7 @@ protected:
         }
         datKey.set_flags(DB_DBT_MALLOC);
         datValue.set_flags(DB_DBT_MALLOC);
-        int ret = pcursor->get(&datKey, &datValue, fFlags);
+        int ret = pcursor->pcursor->get(&datKey, &datValue, fFlags);
         if (ret != 0)
             return ret;
         else if (datKey.get_data() == NULL || datValue.get_data() == NULL)
@@ -262,8 +345,18 @@ protected:
     }
 
 public:
+    // Within a CDBBatch, transactions are part of the batch: they begin and
+    // commit without effect, and cannot be aborted.
     bool TxnBegin()
     {
+        if (fJoined)
+            return true;
+        if (plog) {
+            if (activeLogTxn)
+                return false;
+            activeLogTxn = new CLogDBBatch();
+            return true;
+        }
         if (!pdb || activeTxn)
             return false;
         DbTxn* ptxn = bitdb.TxnBegin();
@@ -275,6 +368,16 @@ public:
 
     bool TxnCommit()
     {
+        if (fJoined)
+            return true;
+        if (plog) {
+            if (!activeLogTxn)
+                return false;
+            bool ret = plog->Commit(*activeLogTxn);
+            delete activeLogTxn;
+            activeLogTxn = NULL;
+            return ret;
+        }
         if (!pdb || !activeTxn)
             return false;
         int ret = activeTxn->commit(0);
@@ -284,6 +387,15 @@ public:
 
     bool TxnAbort()
     {
+        if (fJoined)
+            return false;
+        if (plog) {
+            if (!activeLogTxn)
+                return false;
+            delete activeLogTxn;
+            activeLogTxn = NULL;
+            return true;
+        }
         if (!pdb || !activeTxn)
             return false;
         int ret = activeTxn->abort();
@@ -303,6 +415,30 @@ public:
     }
 
     bool static Rewrite(const std::string& strFile, const char* pszSkip = NULL);
+
+    friend class CDBBatch;
+};
+
+
+/** Groups the writes to a database file made by the current thread into one
+ *  transaction. CDB objects the thread opens on the file while the batch
+ *  exists join its transaction, which is committed when the outermost batch
+ *  on the file ends. Other threads writing the file block until then, so a
+ *  batch should be held under the lock that serializes the writes (cs_wallet).
+ *  CDB objects that joined the batch must not write after it commits.
+ */
+class CDBBatch : public CDB
+{
+private:
+    bool fOuter;
+
+public:
+    explicit CDBBatch(const std::string& strFilename);
+    // Commits the batch, unless it is nested in another one on the same file
+    // (which commits it instead) or was committed already. A batch not
+    // committed explicitly commits when it ends, only logging a failure.
+    bool Commit();
+    ~CDBBatch();
 };
 
 #endif // BITCOIN_DB_H
@@ -10,17 +10,20 @@
 #include "init.h"
 
 #include "addrman.h"
+#include "blockfile.h"
 #include "checkpoints.h"
 #include "key.h"
 #include "main.h"
 #include "miner.h"
 #include "net.h"
 #include "rpcserver.h"
+#include "sha256.h"
 #include "txdb.h"
 #include "ui_interface.h"
 #include "util.h"
 #ifdef ENABLE_WALLET
 #include "db.h"
+#include "stakepolicy.h"
 #include "wallet.h"
 #include "walletdb.h"
 #endif
@@ -103,7 +106,6 @@ bool ShutdownRequested()
     return fRequestShutdown;
 }
 
-static CCoinsViewDB *pcoinsdbview;
 
 void Shutdown()
 {
@@ -136,6 +138,7 @@ void Shutdown()
         delete pcoinsTip; pcoinsTip = NULL;
         delete pcoinsdbview; pcoinsdbview = NULL;
         delete pblocktree; pblocktree = NULL;
+        delete pblockfilterdb; pblockfilterdb = NULL;
     }
 #ifdef ENABLE_WALLET
     if (pwalletMain)
@@ -192,10 +195,13 @@ std::string HelpMessage(HelpMessageMode hmm)
 {
     string strUsage = _("Options:") + "\n";
     strUsage += "  -?                     " + _("This help message") + "\n";
+    strUsage += "  -addressindex          " + _("Maintain an index of the transactions and unspent outputs of every address (default: 0)") + "\n";
     strUsage += "  -alertnotify=<cmd>     " + _("Execute command when a relevant alert is received or we see a really long fork (%s in cmd is replaced by message)") + "\n";
+    strUsage += "  -blockfilterindex      " + _("Maintain a compact filter index of all blocks, used to speed up wallet rescans (default: 0)") + "\n";
     strUsage += "  -blocknotify=<cmd>     " + _("Execute command when the best block changes (%s in cmd is replaced by block hash)") + "\n";
     strUsage += "  -checkblocks=<n>       " + _("How many blocks to check at startup (default: 288, 0 = all)") + "\n";
     strUsage += "  -checklevel=<n>        " + _("How thorough the block verification of -checkblocks is (0-4, default: 3)") + "\n";
+    strUsage += "  -coinstats             " + _("Keep unspent transaction output set statistics up to date as blocks are connected (default: 1)") + "\n";
     strUsage += "  -conf=<file>           " + _("Specify configuration file (default: reddcoin.conf)") + "\n";
     if (hmm == HMM_BITCOIND)
     {
@@ -205,12 +211,23 @@ std::string HelpMessage(HelpMessageMode hmm)
     }
     strUsage += "  -datadir=<dir>         " + _("Specify data directory") + "\n";
     strUsage += "  -dbcache=<n>           " + strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache) + "\n";
+    strUsage += "  -dbblocksize=<n>       " + _("Set LevelDB table block size in kilobytes (default: 4)") + "\n";
+    strUsage += "  -dbwritebuffer=<n>     " + _("Set LevelDB write buffer size in megabytes (default: 0 = a quarter of the database cache)") + "\n";
+    strUsage += "  -dbmaxopenfiles=<n>    " + _("Keep at most <n> LevelDB table files open (default: 64)") + "\n";
+    strUsage += "  -dbbloombits=<n>       " + _("Set LevelDB bloom filter bits per key, 0 disables the filter (default: 10)") + "\n";
+    strUsage += "  -dbcompression=<n>     " + _("Compress LevelDB tables (0-1, default: 0)") + "\n";
+    strUsage += "                         " + _("Each -db<option> can be set for one database as -chainstatedb<option>, -blockindexdb<option> or -blockfilterdb<option>") + "\n";
     strUsage += "  -loadblock=<file>      " + _("Imports blocks from external blk000??.dat file") + " " + _("on startup") + "\n";
+    strUsage += "  -maxblockmaps=<n>      " + strprintf(_("Keep at most <n> finalized block and undo files memory mapped for reading, 0 disables mapping (default: %u)"), DEFAULT_MAX_BLOCKFILE_MAPS) + "\n";
     strUsage += "  -maxorphanblocks=<n>   " + strprintf(_("Keep at most <n> unconnectable blocks in memory (default: %u)"), DEFAULT_MAX_ORPHAN_BLOCKS) + "\n";
     strUsage += "  -maxorphantx=<n>       " + strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS) + "\n";
+    strUsage += "  -maxorphantxperpeer=<n> " + strprintf(_("Keep at most <n> unconnectable transactions from a single peer (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS_PER_PEER) + "\n";
+    strUsage += "  -maxorphantxsize=<n>   " + strprintf(_("Keep at most <n> kilobytes of unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS_SIZE) + "\n";
+    strUsage += "  -outpointcoins         " + _("Store the coin database with one record per unspent output (one-time upgrade, undone only by -reindex) (default: 0)") + "\n";
     strUsage += "  -par=<n>               " + strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"), -(int)boost::thread::hardware_concurrency(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS) + "\n";
     strUsage += "  -pid=<file>            " + _("Specify pid file (default: reddcoind.pid)") + "\n";
     strUsage += "  -reindex               " + _("Rebuild block chain index from current blk000??.dat files") + " " + _("on startup") + "\n";
+    strUsage += "  -spentindex            " + _("Maintain an index of the input spending every output (default: 0)") + "\n";
     strUsage += "  -txindex               " + _("Maintain a full transaction index (default: 1)") + "\n";
 
     strUsage += "\n" + _("Connection options:") + "\n";
@@ -230,6 +247,7 @@ std::string HelpMessage(HelpMessageMode hmm)
     strUsage += "  -maxsendbuffer=<n>     " + _("Maximum per-connection send buffer, <n>*1000 bytes (default: 1000)") + "\n";
     strUsage += "  -onion=<ip:port>       " + _("Use separate SOCKS5 proxy to reach peers via Tor hidden services (default: -proxy)") + "\n";
     strUsage += "  -onlynet=<net>         " + _("Only connect to nodes in network <net> (IPv4, IPv6 or Tor)") + "\n";
+    strUsage += "  -peerblockfilters      " + _("Serve compact block filters to peers (requires -blockfilterindex) (default: 0)") + "\n";
     strUsage += "  -port=<port>           " + _("Listen for connections on <port> (default: 8864 or testnet: 18864)") + "\n";
     strUsage += "  -proxy=<ip:port>       " + _("Connect through SOCKS proxy") + "\n";
     strUsage += "  -seednode=<ip>         " + _("Connect to a node to retrieve peer addresses, and disconnect") + "\n";
@@ -245,14 +263,21 @@ std::string HelpMessage(HelpMessageMode hmm)
 
 #ifdef ENABLE_WALLET
     strUsage += "\n" + _("Wallet options:") + "\n";
+    strUsage += "  -consolidate           " + _("Combine small outputs of an address into outputs of -stakecombinethreshold in the background, while the memory pool is quiet (default: 0)") + "\n";
+    strUsage += "  -consolidatebelow=<amt> " + _("Outputs smaller than this are combined (default: 1% of -stakecombinethreshold)") + "\n";
+    strUsage += "  -consolidateinputs=<n> " + strprintf(_("Combine the small outputs of an address once it has at least <n> of them (default: %u)"), DEFAULT_CONSOLIDATE_MIN_INPUTS) + "\n";
     strUsage += "  -disablewallet         " + _("Do not load the wallet and disable wallet RPC calls") + "\n";
     strUsage += "  -keypool=<n>           " + _("Set key pool size to <n> (default: 100)") + "\n";
     strUsage += "  -paytxfee=<amt>        " + _("Fee per kB to add to transactions you send") + "\n";
     strUsage += "  -rescan                " + _("Rescan the block chain for missing wallet transactions") + " " + _("on startup") + "\n";
+    strUsage += "  -rescanthreads=<n>     " + strprintf(_("Set the number of threads reading blocks during a rescan (up to %d, 0 = auto, <0 = leave that many cores free, default: %d)"), MAX_RESCAN_THREADS, DEFAULT_RESCAN_THREADS) + "\n";
     strUsage += "  -salvagewallet         " + _("Attempt to recover private keys from a corrupt wallet.dat") + " " + _("on startup") + "\n";
     strUsage += "  -spendzeroconfchange   " + _("Spend unconfirmed change when sending transactions (default: 1)") + "\n";
+    strUsage += "  -stakecombinethreshold=<amt> " + _("Output size aimed for when staking: larger staked outputs are split, smaller ones are combined up to it (default: 2000000)") + "\n";
+    strUsage += "  -stakesplitage=<n>     " + _("Split staked outputs of -stakecombinethreshold or more only if younger than <n> days (default: 45)") + "\n";
     strUsage += "  -upgradewallet         " + _("Upgrade wallet to latest format") + " " + _("on startup") + "\n";
     strUsage += "  -wallet=<file>         " + _("Specify wallet file (within data directory)") + " " + _("(default: wallet.dat)") + "\n";
+    strUsage += "  -walletlog             " + _("Store the wallet in an append-only log (<wallet>.log) instead of Berkeley DB; an existing Berkeley DB wallet is imported once and renamed to <wallet>.imported, and backupwallet writes Berkeley DB files (default: 0)") + "\n";
     strUsage += "  -walletnotify=<cmd>    " + _("Execute command when a wallet transaction changes (%s in cmd is replaced by TxID)") + "\n";
     strUsage += "  -stakenotify=<cmd>     " + _("Execute command when a coinstake transaction is created (%s in cmd is replaced by TxID)") + "\n" +
     strUsage += "  -zapwallettxes         " + _("Clear list of wallet transactions (diagnostic tool; implies -rescan)") + "\n";
@@ -267,6 +292,7 @@ std::string HelpMessage(HelpMessageMode hmm)
         strUsage += "  -disablesafemode       " + _("Disable safemode, override a real safe mode event (default: 0)") + "\n";
         strUsage += "  -testsafemode          " + _("Force safe mode (default: 0)") + "\n";
         strUsage += "  -dropmessagestest=<n>  " + _("Randomly drop 1 of every <n> network messages") + "\n";
+        strUsage += "  -ecdsa=<impl>          " + strprintf(_("ECDSA signature verification implementation, openssl or secp256k1 (default: %s)"), ECC_GetVerifier()) + "\n";
         strUsage += "  -fuzzmessagestest=<n>  " + _("Randomly fuzz 1 of every <n> network messages") + "\n";
         strUsage += "  -flushwallet           " + _("Run a thread to flush wallet periodically (default: 1)") + "\n";
     }
@@ -287,6 +313,7 @@ std::string HelpMessage(HelpMessageMode hmm)
     {
         strUsage += "  -limitfreerelay=<n>    " + _("Continuously rate-limit free transactions to <n>*1000 bytes per minute (default:15)") + "\n";
         strUsage += "  -maxsigcachesize=<n>   " + _("Limit size of signature cache to <n> entries (default: 50000)") + "\n";
+        strUsage += "  -maxpubkeycachesize=<n> " + strprintf(_("Limit the cache of parsed public keys to <n> entries (default: %u)"), DEFAULT_PUBKEY_CACHE_SIZE) + "\n";
     }
     strUsage += "  -mintxfee=<amt>        " + _("Fees smaller than this are considered zero fee (for transaction creation) (default:") + " " + FormatMoney(CTransaction::nMinTxFee) + ")" + "\n";
     strUsage += "  -minrelaytxfee=<amt>   " + _("Fees smaller than this are considered zero fee (for relaying) (default:") + " " + FormatMoney(CTransaction::nMinRelayTxFee) + ")" + "\n";
@@ -315,7 +342,11 @@ std::string HelpMessage(HelpMessageMode hmm)
     strUsage += "  -rpcpassword=<pw>      " + _("Password for JSON-RPC connections") + "\n";
     strUsage += "  -rpcport=<port>        " + _("Listen for JSON-RPC connections on <port> (default: 8863 or testnet: 18863)") + "\n";
     strUsage += "  -rpcallowip=<ip>       " + _("Allow JSON-RPC connections from specified IP address") + "\n";
-    strUsage += "  -rpcthreads=<n>        " + _("Set the number of threads to service RPC calls (default: 4)") + "\n";
+    strUsage += "  -rpcthreads=<n>        " + strprintf(_("Set the number of threads to service RPC calls (default: %d)"), DEFAULT_RPC_THREADS) + "\n";
+    strUsage += "  -rpcworkqueue=<n>      " + strprintf(_("Set the number of RPC calls that may wait for a thread, further ones are answered with HTTP 503 (default: %d)"), DEFAULT_RPC_WORK_QUEUE) + "\n";
+    strUsage += "  -rpcidletimeout=<n>    " + strprintf(_("Close RPC connections that take more than <n> seconds to send a request (default: %d)"), DEFAULT_RPC_IDLE_TIMEOUT) + "\n";
+    strUsage += "  -rpcmaxbatch=<n>       " + strprintf(_("Maximum number of requests in a JSON-RPC batch (default: %u)"), DEFAULT_RPC_MAX_BATCH) + "\n";
+    strUsage += "  -rest                  " + strprintf(_("Accept public REST requests for blocks, transactions, headers and the mempool without authorization (default: %u)"), DEFAULT_REST_ENABLE) + "\n";
 
     strUsage += "\n" + _("RPC SSL options: (see the wiki.reddcoin.com for SSL setup instructions)") + "\n";
     strUsage += "  -rpcssl                                  " + _("Use OpenSSL (https) for JSON-RPC connections") + "\n";
@@ -403,6 +434,12 @@ bool InitSanityCheck(void)
         return false;
     }
 
+    if (!SHA256SelfTest())
+    {
+        InitError("SHA-256 does not produce the expected hashes. The build or the CPU is broken.");
+        return false;
+    }
+
     // TODO: remaining sanity checks, see #4081
 
     return true;
@@ -613,8 +650,36 @@ bool AppInit2(boost::thread_group& threadGroup)
         if (!ParseMoney(mapArgs["-reservebalance"], nReserveBalance))
             return InitError(_("Invalid amount for -reservebalance=<amount>"));
     }
+
+    if (mapArgs.count("-stakecombinethreshold"))
+    {
+        if (!ParseMoney(mapArgs["-stakecombinethreshold"], stakePolicy.nTargetOutput) || stakePolicy.nTargetOutput <= 0)
+            return InitError(strprintf(_("Invalid amount for -stakecombinethreshold=<amount>: '%s'"), mapArgs["-stakecombinethreshold"]));
+        stakePolicy.nSmallOutput = stakePolicy.nTargetOutput / 100;
+    }
+    nStakeCombineThreshold = stakePolicy.nTargetOutput;
+    if (mapArgs.count("-stakesplitage"))
+    {
+        int64_t nDays = GetArg("-stakesplitage", 45);
+        if (nDays < 0 || nDays > 365)
+            return InitError(strprintf(_("Invalid number of days for -stakesplitage: '%s'"), mapArgs["-stakesplitage"]));
+        nStakeSplitAge = nDays * 24 * 60 * 60;
+    }
+    if (mapArgs.count("-consolidatebelow"))
+    {
+        if (!ParseMoney(mapArgs["-consolidatebelow"], stakePolicy.nSmallOutput) || stakePolicy.nSmallOutput > stakePolicy.nTargetOutput)
+            return InitError(strprintf(_("Invalid amount for -consolidatebelow=<amount>: '%s'"), mapArgs["-consolidatebelow"]));
+    }
+    stakePolicy.nMinInputs = std::max((int64_t)2, std::min((int64_t)CONSOLIDATE_MAX_INPUTS, GetArg("-consolidateinputs", DEFAULT_CONSOLIDATE_MIN_INPUTS)));
+    stakePolicy.fEnabled = GetBoolArg("-consolidate", false);
 #endif
     // ********************************************************* Step 4: application initialization: dir lock, daemonize, pidfile, debug log
+    // Select the SHA-256 implementation for this CPU, before any threads are started
+    std::string strSHA256 = SHA256AutoDetect();
+    if (mapArgs.count("-ecdsa") && !ECC_SetVerifier(mapArgs["-ecdsa"]))
+        return InitError(strprintf(_("Unknown or unavailable -ecdsa implementation: '%s'"), mapArgs["-ecdsa"]));
+    ECC_SetPubKeyCacheSize(std::max((int64_t)0, GetArg("-maxpubkeycachesize", DEFAULT_PUBKEY_CACHE_SIZE)));
+
     // Sanity check
     if (!InitSanityCheck())
         return InitError(_("Initialization sanity check failed. Reddcoin Core is shutting down."));
@@ -638,6 +703,8 @@ bool AppInit2(boost::thread_group& threadGroup)
     LogPrintf("\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n");
     LogPrintf("Reddcoin version %s (%s)\n", FormatFullVersion(), CLIENT_DATE);
     LogPrintf("Using OpenSSL version %s\n", SSLeay_version(SSLEAY_VERSION));
+    LogPrintf("Using SHA256 implementation %s\n", strSHA256);
+    LogPrintf("Using ECDSA verifier %s\n", ECC_GetVerifier());
 #ifdef ENABLE_WALLET
     LogPrintf("Using BerkeleyDB version %s\n", DbEnv::version(0, 0, 0));
 #endif
@@ -682,14 +749,22 @@ bool AppInit2(boost::thread_group& threadGroup)
             }
         }
 
-        if (GetBoolArg("-salvagewallet", false))
+        bitdb.fLogStore = GetBoolArg("-walletlog", false);
+        bool fWalletLogExists = filesystem::exists(GetDataDir() / (strWalletFile + ".log"));
+        if (!bitdb.fLogStore && fWalletLogExists)
+            return InitError(strprintf(_("Wallet %s is stored in %s.log, which needs -walletlog"), strWalletFile, strWalletFile));
+
+        // Once imported into the log, the Berkeley DB file is no longer used
+        bool fVerifyWallet = !(bitdb.fLogStore && fWalletLogExists);
+
+        if (fVerifyWallet && GetBoolArg("-salvagewallet", false))
         {
             // Recover readable keypairs:
             if (!CWalletDB::Recover(bitdb, strWalletFile, true))
                 return false;
         }
 
-        if (filesystem::exists(GetDataDir() / strWalletFile))
+        if (fVerifyWallet && filesystem::exists(GetDataDir() / strWalletFile))
         {
             CDBEnv::VerifyResult r = bitdb.Verify(strWalletFile, CWalletDB::Recover);
             if (r == CDBEnv::RECOVER_OK)
@@ -836,13 +911,19 @@ bool AppInit2(boost::thread_group& threadGroup)
     else if (nTotalCache > (nMaxDbCache << 20))
         nTotalCache = (nMaxDbCache << 20); // total cache cannot be greater than nMaxDbCache
     size_t nBlockTreeDBCache = nTotalCache / 8;
-    if (nBlockTreeDBCache > (1 << 21) && !GetBoolArg("-txindex", true))
+    if (nBlockTreeDBCache > (1 << 21) && !GetBoolArg("-txindex", true) && !GetBoolArg("-addressindex", false) && !GetBoolArg("-spentindex", false))
         nBlockTreeDBCache = (1 << 21); // block tree db cache shouldn't be larger than 2 MiB
     nTotalCache -= nBlockTreeDBCache;
+    size_t nBlockFilterDBCache = 0;
+    if (GetBoolArg("-blockfilterindex", false))
+        nBlockFilterDBCache = std::min(nTotalCache / 8, (size_t)16 << 20);
+    nTotalCache -= nBlockFilterDBCache;
     size_t nCoinDBCache = nTotalCache / 2; // use half of the remaining cache for coindb cache
     nTotalCache -= nCoinDBCache;
     nCoinCacheSize = nTotalCache / 300; // coins in memory require around 300 bytes
 
+    SetMaxBlockFileMaps(std::max(0, (int)GetArg("-maxblockmaps", DEFAULT_MAX_BLOCKFILE_MAPS)));
+
     bool fLoaded = false;
     while (!fLoaded) {
         bool fReset = fReindex;
@@ -862,6 +943,15 @@ bool AppInit2(boost::thread_group& threadGroup)
                 pcoinsdbview = new CCoinsViewDB(nCoinDBCache, false, fReindex);
                 pcoinsTip = new CCoinsViewCache(*pcoinsdbview);
 
+                // Convert the coin database to one record per output, or finish an interrupted conversion
+                if ((GetBoolArg("-outpointcoins", false) && !pcoinsdbview->IsOutpointLayout()) || pcoinsdbview->IsUpgrading()) {
+                    uiInterface.InitMessage(_("Upgrading coin database..."));
+                    if (!pcoinsdbview->UpgradeToOutpointLayout()) {
+                        strLoadError = _("Error upgrading coin database");
+                        break;
+                    }
+                }
+
                 if (fReindex)
                     pblocktree->WriteReindexing(true);
 
@@ -887,6 +977,16 @@ bool AppInit2(boost::thread_group& threadGroup)
                     break;
                 }
 
+                // Check for changed -addressindex and -spentindex state
+                if (fAddressIndex != GetBoolArg("-addressindex", false)) {
+                    strLoadError = _("You need to rebuild the database using -reindex to change -addressindex");
+                    break;
+                }
+                if (fSpentIndex != GetBoolArg("-spentindex", false)) {
+                    strLoadError = _("You need to rebuild the database using -reindex to change -spentindex");
+                    break;
+                }
+
                 uiInterface.InitMessage(_("Verifying blocks..."));
                 if (!VerifyDB(GetArg("-checklevel", 3),
                               GetArg("-checkblocks", 288))) {
@@ -931,6 +1031,16 @@ bool AppInit2(boost::thread_group& threadGroup)
     }
     LogPrintf(" block index %15dms\n", GetTimeMillis() - nStart);
 
+    if (GetBoolArg("-blockfilterindex", false))
+    {
+        pblockfilterdb = new CBlockFilterDB(nBlockFilterDBCache);
+        threadGroup.create_thread(&ThreadBlockFilterIndex);
+        if (GetBoolArg("-peerblockfilters", false))
+            nLocalServices |= NODE_COMPACT_FILTERS;
+    }
+    else if (GetBoolArg("-peerblockfilters", false))
+        return InitError(_("Cannot serve compact block filters (-peerblockfilters) without -blockfilterindex."));
+
     if (GetBoolArg("-printblockindex", false) || GetBoolArg("-printblocktree", false))
     {
         PrintBlockTree();
@@ -983,6 +1093,7 @@ bool AppInit2(boost::thread_group& threadGroup)
         uiInterface.InitMessage(_("Loading wallet..."));
 
         nStart = GetTimeMillis();
+        int64_t nMemoryStart = GetResidentMemory();
         bool fFirstRun = true;
         pwalletMain = new CWallet(strWalletFile);
         DBErrors nLoadWalletRet = pwalletMain->LoadWallet(fFirstRun);
@@ -1041,6 +1152,19 @@ bool AppInit2(boost::thread_group& threadGroup)
 
         LogPrintf("%s", strErrors.str());
         LogPrintf(" wallet      %15dms\n", GetTimeMillis() - nStart);
+        if (nMemoryStart > 0)
+            LogPrintf("Wallet resident memory: %dMB (%dMB total)\n",
+                      (GetResidentMemory() - nMemoryStart) >> 20, GetResidentMemory() >> 20);
+
+        // Left from an import into the log store, possibly from before the wallet was encrypted
+        if (bitdb.fLogStore && pwalletMain->IsCrypted())
+        {
+            std::string strImported = CDBEnv::ImportedFile(strWalletFile);
+            if (filesystem::exists(GetDataDir() / strImported) || filesystem::exists(GetDataDir() / strWalletFile))
+                InitWarning(strprintf(_("Warning: %s or %s is no longer used since the wallet was imported into %s.log,"
+                                        " but may still hold private keys that are not encrypted. Delete it once you"
+                                        " have a backup."), strWalletFile, strImported, strWalletFile));
+        }
 
         RegisterWallet(pwalletMain);
 
@@ -1055,6 +1179,15 @@ bool AppInit2(boost::thread_group& threadGroup)
                 pindexRescan = chainActive.FindFork(locator);
             else
                 pindexRescan = chainActive.Genesis();
+
+            // Resume a rescan that did not complete
+            CBlockLocator locatorRescan;
+            if (walletdb.ReadRescanBlock(locatorRescan))
+            {
+                CBlockIndex *pindexResume = chainActive.FindFork(locatorRescan);
+                if (pindexResume && (!pindexRescan || pindexResume->nHeight < pindexRescan->nHeight))
+                    pindexRescan = pindexResume;
+            }
         }
         if (chainActive.Tip() && chainActive.Tip() != pindexRescan)
         {
@@ -1142,6 +1275,10 @@ bool AppInit2(boost::thread_group& threadGroup)
 
         // Run a thread to flush wallet periodically
         threadGroup.create_thread(boost::bind(&ThreadFlushWalletDB, boost::ref(pwalletMain->strWalletFile)));
+
+        // Combine small outputs for staking in the background
+        if (stakePolicy.fEnabled)
+            threadGroup.create_thread(boost::bind(&ThreadStakePolicy, pwalletMain));
     }
 #endif
 
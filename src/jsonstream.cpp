@@ -0,0 +1,716 @@
+// Copyright (c) 2014 The Reddcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "jsonstream.h"
+
+#include <limits>
+#include <locale>
+#include <sstream>
+#include <stdio.h>
+#include <string.h>
+#include <wctype.h>
+
+using namespace std;
+using namespace json_spirit;
+
+//
+// Writer
+//
+
+static void AppendEscaped(string& str, const string& s)
+{
+    static const char* pszHex = "0123456789ABCDEF";
+
+    str += '"';
+    const char* pbegin = s.data();
+    const char* pend = pbegin + s.size();
+    const char* prun = pbegin;
+    for (const char* p = pbegin; p != pend; p++)
+    {
+        unsigned char c = *p;
+        if (c >= 0x20 && c < 0x7f && c != '"' && c != '\\')
+            continue;
+
+        str.append(prun, p);
+        prun = p + 1;
+        switch (c)
+        {
+        case '"':  str += "\\\""; break;
+        case '\\': str += "\\\\"; break;
+        case '\b': str += "\\b"; break;
+        case '\f': str += "\\f"; break;
+        case '\n': str += "\\n"; break;
+        case '\r': str += "\\r"; break;
+        case '\t': str += "\\t"; break;
+        default:
+            // json_spirit keeps the bytes above 0x7f its locale calls printable
+            if (c > 0x7f && iswprint(c))
+                str += (char)c;
+            else
+            {
+                char buf[6] = { '\\', 'u', '0', '0', pszHex[c >> 4], pszHex[c & 0xf] };
+                str.append(buf, sizeof(buf));
+            }
+        }
+    }
+    str.append(prun, pend);
+    str += '"';
+}
+
+static void AppendUInt(string& str, uint64_t n)
+{
+    char buf[20];
+    char* p = buf + sizeof(buf);
+    do
+    {
+        *--p = '0' + n % 10;
+        n /= 10;
+    } while (n != 0);
+    str.append(p, buf + sizeof(buf));
+}
+
+static void AppendInt(string& str, int64_t n)
+{
+    if (n < 0)
+    {
+        str += '-';
+        AppendUInt(str, 0 - (uint64_t)n);
+    }
+    else
+        AppendUInt(str, n);
+}
+
+static void AppendReal(string& str, double d)
+{
+    // same digits as ostream << fixed << setprecision(8), which formats
+    // with the C locale and then puts in the stream's decimal point
+    char buf[400];
+    int nLen = snprintf(buf, sizeof(buf), "%.8f", d);
+    if (nLen <= 0 || nLen >= (int)sizeof(buf))
+        return;
+    if (d != d || d == numeric_limits<double>::infinity() || d == -numeric_limits<double>::infinity())
+    {
+        str.append(buf, nLen);
+        return;
+    }
+    // whatever decimal point the C locale uses becomes '.'
+    const char* pIntEnd = buf;
+    if (*pIntEnd == '-')
+        pIntEnd++;
+    while (*pIntEnd >= '0' && *pIntEnd <= '9')
+        pIntEnd++;
+    str.append(buf, pIntEnd - buf);
+    str += '.';
+    str.append(buf + nLen - 8, buf + nLen);
+}
+
+void CJSONWriter::Separate()
+{
+    if (fAfterKey)
+    {
+        fAfterKey = false;
+        return;
+    }
+    if (vfEmpty.empty())
+        return;
+    if (vfEmpty.back())
+        vfEmpty.back() = false;
+    else
+        str += ',';
+}
+
+void CJSONWriter::WriteValue(const Value& value)
+{
+    switch (value.type())
+    {
+    case obj_type:
+    {
+        const Object& obj = value.get_obj();
+        str += '{';
+        for (Object::const_iterator it = obj.begin(); it != obj.end(); ++it)
+        {
+            if (it != obj.begin())
+                str += ',';
+            AppendEscaped(str, it->name_);
+            str += ':';
+            WriteValue(it->value_);
+        }
+        str += '}';
+        break;
+    }
+    case array_type:
+    {
+        const Array& arr = value.get_array();
+        str += '[';
+        for (Array::const_iterator it = arr.begin(); it != arr.end(); ++it)
+        {
+            if (it != arr.begin())
+                str += ',';
+            WriteValue(*it);
+        }
+        str += ']';
+        break;
+    }
+    case str_type:
+        AppendEscaped(str, value.get_str());
+        break;
+    case bool_type:
+        str += value.get_bool() ? "true" : "false";
+        break;
+    case int_type:
+        if (value.is_uint64())
+            AppendUInt(str, value.get_uint64());
+        else
+            AppendInt(str, value.get_int64());
+        break;
+    case real_type:
+        AppendReal(str, value.get_real());
+        break;
+    case null_type:
+        str += "null";
+        break;
+    }
+}
+
+void CJSONWriter::BeginObject()
+{
+    Separate();
+    str += '{';
+    vfEmpty.push_back(true);
+}
+
+void CJSONWriter::EndObject()
+{
+    vfEmpty.pop_back();
+    str += '}';
+}
+
+void CJSONWriter::BeginArray()
+{
+    Separate();
+    str += '[';
+    vfEmpty.push_back(true);
+}
+
+void CJSONWriter::EndArray()
+{
+    vfEmpty.pop_back();
+    str += ']';
+}
+
+void CJSONWriter::Key(const string& strKey)
+{
+    Separate();
+    AppendEscaped(str, strKey);
+    str += ':';
+    fAfterKey = true;
+}
+
+void CJSONWriter::Write(const Value& value)
+{
+    Separate();
+    WriteValue(value);
+}
+
+void CJSONWriter::Write(const Object& obj)
+{
+    BeginObject();
+    for (Object::const_iterator it = obj.begin(); it != obj.end(); ++it)
+    {
+        Key(it->name_);
+        Write(it->value_);
+    }
+    EndObject();
+}
+
+void CJSONWriter::Write(const Array& arr)
+{
+    BeginArray();
+    for (Array::const_iterator it = arr.begin(); it != arr.end(); ++it)
+        Write(*it);
+    EndArray();
+}
+
+void CJSONWriter::WriteString(const string& s)
+{
+    Separate();
+    AppendEscaped(str, s);
+}
+
+void CJSONWriter::WriteInt(int64_t n)
+{
+    Separate();
+    AppendInt(str, n);
+}
+
+void CJSONWriter::WriteUInt(uint64_t n)
+{
+    Separate();
+    AppendUInt(str, n);
+}
+
+void CJSONWriter::WriteReal(double d)
+{
+    Separate();
+    AppendReal(str, d);
+}
+
+void CJSONWriter::WriteBool(bool f)
+{
+    Separate();
+    str += f ? "true" : "false";
+}
+
+void CJSONWriter::WriteNull()
+{
+    Separate();
+    str += "null";
+}
+
+string WriteJSON(const Value& value)
+{
+    string str;
+    CJSONWriter writer(str);
+    writer.Write(value);
+    return str;
+}
+
+//
+// Reader
+//
+
+static int HexDigit(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Undo the escapes of a string's contents the way json_spirit does: \u
+// keeps the low byte of the code point, \x takes two hex digits and
+// unknown escapes are dropped.
+static void SubstituteEscapes(const char* pbegin, const char* pend, string& str)
+{
+    str.reserve(pend - pbegin);
+    const char* prun = pbegin;
+    for (const char* p = pbegin; p < pend - 1; p++)
+    {
+        if (*p != '\\')
+            continue;
+        str.append(prun, p);
+        p++;
+        switch (*p)
+        {
+        case 't':  str += '\t'; break;
+        case 'b':  str += '\b'; break;
+        case 'f':  str += '\f'; break;
+        case 'n':  str += '\n'; break;
+        case 'r':  str += '\r'; break;
+        case '\\': str += '\\'; break;
+        case '/':  str += '/';  break;
+        case '"':  str += '"';  break;
+        case 'x':
+            if (pend - p >= 3)
+            {
+                str += (char)((max(HexDigit(p[1]), 0) << 4) + max(HexDigit(p[2]), 0));
+                p += 2;
+            }
+            break;
+        case 'u':
+            if (pend - p >= 5)
+            {
+                str += (char)((max(HexDigit(p[3]), 0) << 4) + max(HexDigit(p[4]), 0));
+                p += 4;
+            }
+            break;
+        }
+        prun = p + 1;
+    }
+    str.append(prun, pend);
+}
+
+namespace {
+
+/** Recursive descent JSON parser building the Value in place */
+class CJSONReader
+{
+private:
+    const char* p;
+    const char* pend;
+    unsigned int nDepth;
+
+    static bool IsSpace(char c)
+    {
+        return c == ' ' || (c >= '\t' && c <= '\r');
+    }
+
+    void SkipSpace()
+    {
+        while (p != pend && IsSpace(*p))
+            p++;
+    }
+
+    bool ReadLiteral(const char* psz)
+    {
+        size_t nLen = strlen(psz);
+        if ((size_t)(pend - p) < nLen || memcmp(p, psz, nLen) != 0)
+            return false;
+        p += nLen;
+        return true;
+    }
+
+    // Unsigned digits in radix, at most nMaxDigits of them and not above nMax
+    static bool ParseUInt(const char*& q, const char* qend, int nRadix, int nMaxDigits, uint64_t nMax, uint64_t& n)
+    {
+        n = 0;
+        int nDigits = 0;
+        for (; q != qend && (nMaxDigits < 0 || nDigits < nMaxDigits); q++, nDigits++)
+        {
+            int nDigit = HexDigit(*q);
+            if (nDigit < 0 || nDigit >= nRadix)
+                break;
+            if (n > (nMax - nDigit) / nRadix)
+                return false;
+            n = n * nRadix + nDigit;
+        }
+        return nDigits > 0;
+    }
+
+    // Escape sequence after a backslash, as accepted by json_spirit's lexer
+    bool SkipEscape()
+    {
+        static const int nCharDigits = numeric_limits<char>::digits;
+        static const uint64_t nCharMax = numeric_limits<char>::max();
+
+        const char* q = p;
+        uint64_t n;
+        if (ParseUInt(q, pend, 8, nCharDigits / 3 + 1, nCharMax, n))
+        {
+            p = q;
+            return true;
+        }
+        if (p != pend && (*p == 'x' || *p == 'X'))
+        {
+            q = p + 1;
+            if (!ParseUInt(q, pend, 16, nCharDigits / 4 + 1, nCharMax, n))
+                return false;
+            p = q;
+            return true;
+        }
+        if (p == pend)
+            return false;
+        p++;
+        return true;
+    }
+
+    bool ReadString(string& str)
+    {
+        const char* pbegin = ++p;
+        bool fEscapes = false;
+        while (true)
+        {
+            if (p == pend)
+                return false;
+            if (*p == '"')
+                break;
+            if (*p++ == '\\')
+            {
+                fEscapes = true;
+                if (!SkipEscape())
+                    return false;
+            }
+        }
+        if (fEscapes)
+            SubstituteEscapes(pbegin, p, str);
+        else
+            str.assign(pbegin, p);
+        p++;
+        return true;
+    }
+
+    static bool IsDigit(char c)
+    {
+        return c >= '0' && c <= '9';
+    }
+
+    // A number with a decimal point or an exponent
+    bool ReadReal(double& d)
+    {
+        static const double vPow10[] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+        };
+
+        const char* q = p;
+        bool fNeg = false;
+        if (q != pend && (*q == '+' || *q == '-'))
+            fNeg = *q++ == '-';
+
+        // significant digits, as long as they fit
+        uint64_t nMantissa = 0;
+        int nDigits = 0;
+        int64_t nScale = 0;
+        const char* pInt = q;
+        for (; q != pend && IsDigit(*q); q++)
+        {
+            if (nDigits < 19)
+            {
+                nMantissa = nMantissa * 10 + (*q - '0');
+                if (nMantissa > 0)
+                    nDigits++;
+            }
+            else
+                nScale++;
+        }
+        bool fInt = q != pInt;
+        bool fExp;
+        if (q != pend && *q == '.')
+        {
+            q++;
+            const char* pFrac = q;
+            for (; q != pend && IsDigit(*q); q++)
+            {
+                if (nDigits < 19)
+                {
+                    nMantissa = nMantissa * 10 + (*q - '0');
+                    if (nMantissa > 0)
+                        nDigits++;
+                    nScale--;
+                }
+            }
+            if (q == pFrac && !fInt)
+                return false;
+            fExp = q != pend && (*q == 'e' || *q == 'E');
+        }
+        else
+        {
+            fExp = fInt && q != pend && (*q == 'e' || *q == 'E');
+            if (!fExp)
+                return false;
+        }
+        if (fExp)
+        {
+            q++;
+            bool fNegExp = false;
+            if (q != pend && (*q == '+' || *q == '-'))
+                fNegExp = *q++ == '-';
+            uint64_t nExp;
+            if (!ParseUInt(q, pend, 10, -1, numeric_limits<int>::max(), nExp))
+                return false;
+            nScale += fNegExp ? -(int64_t)nExp : (int64_t)nExp;
+        }
+
+        if (nMantissa == 0)
+            d = 0;
+        else if (nMantissa <= ((uint64_t)1 << 53) && nScale >= -22 && nScale <= 22)
+        {
+            // both operands are exact, so the result is rounded correctly
+            d = (double)nMantissa;
+            d = nScale >= 0 ? d * vPow10[nScale] : d / vPow10[-nScale];
+        }
+        else
+        {
+            // leading '+' and a bare trailing '.' are not understood by every stream
+            string strNum;
+            strNum.reserve(q - p + 1);
+            for (const char* r = (p != pInt ? p + 1 : p); r != q; r++)
+                strNum += *r;
+            istringstream stream(strNum);
+            stream.imbue(locale::classic());
+            stream >> d;
+            if (stream.fail()) // out of range, the syntax was checked above
+                d = nScale < 0 ? 0 : numeric_limits<double>::infinity();
+        }
+        if (fNeg)
+            d = -d;
+        p = q;
+        return true;
+    }
+
+    bool ReadNumber(Value& value)
+    {
+        double d;
+        if (ReadReal(d))
+        {
+            value = Value(d);
+            return true;
+        }
+
+        const char* q = p;
+        bool fNeg = false;
+        if (q != pend && (*q == '+' || *q == '-'))
+            fNeg = *q++ == '-';
+        uint64_t n;
+        if (ParseUInt(q, pend, 10, -1, fNeg ? (uint64_t)numeric_limits<int64_t>::max() + 1 : numeric_limits<int64_t>::max(), n))
+        {
+            value = Value(fNeg ? (int64_t)(0 - n) : (int64_t)n);
+            p = q;
+            return true;
+        }
+
+        // values beyond int64 range, without a sign
+        q = p;
+        if (ParseUInt(q, pend, 10, -1, numeric_limits<uint64_t>::max(), n))
+        {
+            value = Value(n);
+            p = q;
+            return true;
+        }
+        return false;
+    }
+
+    // Number of elements of the array or object at p. Growing the vector
+    // would copy every element read so far, so room for them is reserved
+    // first; this is only an estimate, the parser validates the text.
+    size_t CountElements() const
+    {
+        int nLevel = 0;
+        size_t nCommas = 0;
+        bool fAny = false;
+        for (const char* q = p + 1; q != pend; q++)
+        {
+            char c = *q;
+            if (c == '"')
+            {
+                for (q++; q != pend && *q != '"'; q++)
+                    if (*q == '\\' && q + 1 != pend)
+                        q++;
+                if (q == pend)
+                    break;
+                fAny = true;
+            }
+            else if (c == '[' || c == '{')
+            {
+                nLevel++;
+                fAny = true;
+            }
+            else if (c == ']' || c == '}')
+            {
+                if (nLevel-- == 0)
+                    break;
+            }
+            else if (c == ',')
+            {
+                if (nLevel == 0)
+                    nCommas++;
+            }
+            else if (!IsSpace(c))
+                fAny = true;
+        }
+        return fAny ? nCommas + 1 : 0;
+    }
+
+    bool ReadObject(Value& value)
+    {
+        if (++nDepth > MAX_JSON_DEPTH)
+            return false;
+        value = Object();
+        Object& obj = value.get_obj();
+        obj.reserve(CountElements());
+        p++;
+        SkipSpace();
+        if (p != pend && *p == '"')
+        {
+            while (true)
+            {
+                obj.push_back(Pair("", Value()));
+                Pair& pair = obj.back();
+                if (!ReadString(pair.name_))
+                    return false;
+                SkipSpace();
+                if (p == pend || *p != ':')
+                    return false;
+                p++;
+                if (!ReadValue(pair.value_))
+                    return false;
+                SkipSpace();
+                if (p == pend || *p != ',')
+                    break;
+                p++;
+                SkipSpace();
+                if (p == pend || *p != '"')
+                    return false;
+            }
+        }
+        if (p == pend || *p != '}')
+            return false;
+        p++;
+        nDepth--;
+        return true;
+    }
+
+    bool ReadArray(Value& value)
+    {
+        if (++nDepth > MAX_JSON_DEPTH)
+            return false;
+        value = Array();
+        Array& arr = value.get_array();
+        arr.reserve(CountElements());
+        p++;
+        SkipSpace();
+        if (p != pend && *p != ']')
+        {
+            while (true)
+            {
+                arr.push_back(Value());
+                if (!ReadValue(arr.back()))
+                    return false;
+                SkipSpace();
+                if (p == pend || *p != ',')
+                    break;
+                p++;
+            }
+        }
+        if (p == pend || *p != ']')
+            return false;
+        p++;
+        nDepth--;
+        return true;
+    }
+
+public:
+    CJSONReader(const string& str) : p(str.data()), pend(str.data() + str.size()), nDepth(0) {}
+
+    bool ReadValue(Value& value)
+    {
+        SkipSpace();
+        if (p == pend)
+            return false;
+        switch (*p)
+        {
+        case '"':
+        {
+            string str;
+            if (!ReadString(str))
+                return false;
+            value = str;
+            return true;
+        }
+        case '{':
+            return ReadObject(value);
+        case '[':
+            return ReadArray(value);
+        case 't':
+            value = true;
+            return ReadLiteral("true");
+        case 'f':
+            value = false;
+            return ReadLiteral("false");
+        case 'n':
+            value = Value::null;
+            return ReadLiteral("null");
+        default:
+            return ReadNumber(value);
+        }
+    }
+};
+
+}
+
+bool ReadJSON(const string& str, Value& value)
+{
+    CJSONReader reader(str);
+    return reader.ReadValue(value);
+}
@@ -0,0 +1,70 @@
+// Copyright (c) 2014 The Reddcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_JSONSTREAM_H
+#define BITCOIN_JSONSTREAM_H
+
+#include "json/json_spirit_value.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/** Deepest nesting of arrays and objects ReadJSON accepts */
+static const unsigned int MAX_JSON_DEPTH = 512;
+
+/**
+ * Compact JSON writer that appends to a string.
+ *
+ * The output is byte for byte what json_spirit::write_string(value, false)
+ * produces, but is written straight into the caller's buffer instead of
+ * through an ostringstream. Documents can be written piece by piece, so a
+ * reply does not have to be assembled into one Value first:
+ *
+ *   writer.BeginObject();
+ *   writer.Key("result"); writer.Write(result);
+ *   writer.EndObject();
+ */
+class CJSONWriter
+{
+private:
+    std::string& str;
+    std::vector<char> vfEmpty; // for each open array or object: nothing written in it yet
+    bool fAfterKey;
+
+    void Separate();
+    void WriteValue(const json_spirit::Value& value);
+
+public:
+    CJSONWriter(std::string& strIn) : str(strIn), fAfterKey(false) {}
+
+    void BeginObject();
+    void EndObject();
+    void BeginArray();
+    void EndArray();
+    void Key(const std::string& strKey);
+
+    void Write(const json_spirit::Value& value);
+    void Write(const json_spirit::Object& obj);
+    void Write(const json_spirit::Array& arr);
+    void WriteString(const std::string& s);
+    void WriteInt(int64_t n);
+    void WriteUInt(uint64_t n);
+    void WriteReal(double d);
+    void WriteBool(bool f);
+    void WriteNull();
+};
+
+/** Serialize value like json_spirit::write_string(value, false) */
+std::string WriteJSON(const json_spirit::Value& value);
+
+/** Parse a JSON text in a single pass, accepting what json_spirit::read_string
+ *  accepts, including its handling of escapes and of text after the value.
+ *  Reals are rounded correctly, where Spirit's scaling by powers of ten can
+ *  be off in the last bits for numbers with an exponent. Returns false if str
+ *  holds no valid value or nests deeper than MAX_JSON_DEPTH.
+ */
+bool ReadJSON(const std::string& str, json_spirit::Value& value);
+
+#endif // BITCOIN_JSONSTREAM_H
@@ -4,6 +4,12 @@
 
 #include "key.h"
 
+#include "secp256k1.h"
+#include "sync.h"
+
+#include <list>
+#include <map>
+
 #include <openssl/bn.h>
 #include <openssl/ecdsa.h>
 #include <openssl/obj_mac.h>
@@ -226,11 +232,18 @@ public:
         return true;
     }
 
-    bool Verify(const uint256 &hash, const std::vector<unsigned char>& vchSig) {
-        // -1 = error, 0 = bad sig, 1 = good
-        if (ECDSA_verify(0, (unsigned char*)&hash, sizeof(hash), &vchSig[0], vchSig.size(), pkey) != 1)
+    // Takes the signature already parsed, so that what is accepted does
+    // not depend on the DER rules of the OpenSSL version linked against.
+    bool Verify(const uint256 &hash, const unsigned char r[32], const unsigned char s[32]) {
+        ECDSA_SIG *sig = ECDSA_SIG_new();
+        if (sig == NULL)
             return false;
-        return true;
+        BN_bin2bn(r, 32, sig->r);
+        BN_bin2bn(s, 32, sig->s);
+        // -1 = error, 0 = bad sig, 1 = good
+        bool fOk = ECDSA_do_verify((unsigned char*)&hash, sizeof(hash), sig, pkey) == 1;
+        ECDSA_SIG_free(sig);
+        return fOk;
     }
 
     bool SignCompact(const uint256 &hash, unsigned char *p64, int &rec) {
@@ -434,13 +447,160 @@ bool CKey::Load(CPrivKey &privkey, CPubKey &vchPubKey, bool fSkipCheck=false) {
     return true;
 }
 
+// OpenSSL stays the default until the built-in verifier has more review
+static bool fNativeVerify = false;
+
+/** Bounded, least recently used map from serialized public keys to their
+ *  parsed form, shared by all verifying threads, so that keys that sign
+ *  often are only decompressed and set up once. Invalid keys are not kept.
+ *  Key is CSecp256k1PubKey for the built-in verifier, and for OpenSSL the
+ *  uncompressed encoding, which o2i_ECPublicKey reads without a square root.
+ */
+template <typename Key>
+class CPubKeyCache
+{
+private:
+    typedef std::list<CPubKey> LRUList; // most recently used first
+    struct Entry
+    {
+        Key key;
+        LRUList::iterator it;
+    };
+
+    CCriticalSection cs;
+    unsigned int nMaxEntries;
+    LRUList listUsed;
+    std::map<CPubKey, Entry> mapKeys;
+    uint64_t nHits;
+    uint64_t nMisses;
+
+    void EvictTo(unsigned int nEntries) {
+        while (mapKeys.size() > nEntries) {
+            mapKeys.erase(listUsed.back());
+            listUsed.pop_back();
+        }
+    }
+
+public:
+    CPubKeyCache() : nMaxEntries(DEFAULT_PUBKEY_CACHE_SIZE), nHits(0), nMisses(0) {}
+
+    void SetMaxEntries(unsigned int nMaxEntriesIn) {
+        LOCK(cs);
+        nMaxEntries = nMaxEntriesIn;
+        EvictTo(nMaxEntries);
+    }
+
+    // Parse pubkey into keyOut, from the cache if it is there
+    bool Get(const CPubKey &pubkey, Key &keyOut) {
+        {
+            LOCK(cs);
+            typename std::map<CPubKey, Entry>::iterator it = mapKeys.find(pubkey);
+            if (it != mapKeys.end()) {
+                nHits++;
+                listUsed.splice(listUsed.begin(), listUsed, it->second.it);
+                keyOut = it->second.key;
+                return true;
+            }
+            nMisses++;
+        }
+
+        // Parse without holding the lock; another thread may add the same key
+        if (!ParseCachedKey(pubkey, keyOut))
+            return false;
+
+        LOCK(cs);
+        if (nMaxEntries == 0 || mapKeys.count(pubkey))
+            return true;
+        EvictTo(nMaxEntries - 1);
+        listUsed.push_front(pubkey);
+        Entry &entry = mapKeys[pubkey];
+        entry.key = keyOut;
+        entry.it = listUsed.begin();
+        return true;
+    }
+
+    void GetStats(unsigned int &nEntriesOut, uint64_t &nHitsOut, uint64_t &nMissesOut) {
+        LOCK(cs);
+        nEntriesOut = mapKeys.size();
+        nHitsOut = nHits;
+        nMissesOut = nMisses;
+    }
+};
+
+static bool ParseCachedKey(const CPubKey &pubkey, CPubKey &pubkeyFull) {
+    CECKey key;
+    if (!key.SetPubKey(pubkey))
+        return false;
+    key.GetPubKey(pubkeyFull, false);
+    return true;
+}
+
+static CPubKeyCache<CPubKey> openSSLKeyCache;
+
+#if defined(HAVE_NATIVE_SECP256K1)
+static bool ParseCachedKey(const CPubKey &pubkey, CSecp256k1PubKey &keyOut) {
+    return keyOut.Parse(pubkey.begin(), pubkey.size());
+}
+
+static CPubKeyCache<CSecp256k1PubKey> nativeKeyCache;
+#endif
+
+void ECC_SetPubKeyCacheSize(unsigned int nEntries) {
+    openSSLKeyCache.SetMaxEntries(nEntries);
+#if defined(HAVE_NATIVE_SECP256K1)
+    nativeKeyCache.SetMaxEntries(nEntries);
+#endif
+}
+
+void ECC_GetPubKeyCacheStats(unsigned int &nEntriesOut, uint64_t &nHitsOut, uint64_t &nMissesOut) {
+#if defined(HAVE_NATIVE_SECP256K1)
+    if (fNativeVerify) {
+        nativeKeyCache.GetStats(nEntriesOut, nHitsOut, nMissesOut);
+        return;
+    }
+#endif
+    openSSLKeyCache.GetStats(nEntriesOut, nHitsOut, nMissesOut);
+}
+
+bool ECC_SetVerifier(const std::string &strName) {
+    if (strName == "openssl") {
+        fNativeVerify = false;
+        return true;
+    }
+#if defined(HAVE_NATIVE_SECP256K1)
+    if (strName == "secp256k1") {
+        fNativeVerify = true;
+        return true;
+    }
+#endif
+    return false;
+}
+
+std::string ECC_GetVerifier() {
+    return fNativeVerify ? "secp256k1" : "openssl";
+}
+
 bool CPubKey::Verify(const uint256 &hash, const std::vector<unsigned char>& vchSig) const {
     if (!IsValid())
         return false;
+    unsigned char r[32], s[32];
+    if (vchSig.empty() || !ECDSASignatureParseLax(&vchSig[0], vchSig.size(), r, s))
+        return false;
+#if defined(HAVE_NATIVE_SECP256K1)
+    if (fNativeVerify) {
+        CSecp256k1PubKey key;
+        if (!nativeKeyCache.Get(*this, key))
+            return false;
+        return key.Verify((const unsigned char*)&hash, r, s);
+    }
+#endif
+    CPubKey pubkeyFull;
+    if (!openSSLKeyCache.Get(*this, pubkeyFull))
+        return false;
     CECKey key;
-    if (!key.SetPubKey(*this))
+    if (!key.SetPubKey(pubkeyFull))
         return false;
-    if (!key.Verify(hash, vchSig))
+    if (!key.Verify(hash, r, s))
         return false;
     return true;
 }
@@ -473,10 +633,14 @@ bool CPubKey::VerifyCompact(const uint256 &hash, const std::vector<unsigned char
 bool CPubKey::IsFullyValid() const {
     if (!IsValid())
         return false;
-    CECKey key;
-    if (!key.SetPubKey(*this))
-        return false;
-    return true;
+#if defined(HAVE_NATIVE_SECP256K1)
+    if (fNativeVerify) {
+        CSecp256k1PubKey key;
+        return nativeKeyCache.Get(*this, key);
+    }
+#endif
+    CPubKey pubkeyFull;
+    return openSSLKeyCache.Get(*this, pubkeyFull);
 }
 
 bool CPubKey::Decompress() {
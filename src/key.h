@@ -11,7 +11,9 @@
 #include "serialize.h"
 #include "uint256.h"
 
+#include <stdint.h>
 #include <stdexcept>
+#include <string>
 #include <vector>
 
 // secp256k1:
@@ -310,4 +312,20 @@ struct CExtKey {
 /** Check that required EC support is available at runtime */
 bool ECC_InitSanityCheck(void);
 
+/** Select the ECDSA implementation used by CPubKey::Verify: "openssl" (the
+ *  default) or "secp256k1", the built-in verifier where it is available.
+ *  Returns false if the name is unknown or not built in. Call before any
+ *  verifying threads are started. */
+bool ECC_SetVerifier(const std::string &strName);
+std::string ECC_GetVerifier();
+
+/** Default number of parsed public keys kept for verification */
+static const unsigned int DEFAULT_PUBKEY_CACHE_SIZE = 10000;
+
+/** Bound the cache of parsed public keys used by CPubKey::Verify and
+ *  IsFullyValid (0 disables it). Each verifier has a cache of its own; the
+ *  statistics are those of the one selected. */
+void ECC_SetPubKeyCacheSize(unsigned int nEntries);
+void ECC_GetPubKeyCacheStats(unsigned int &nEntriesOut, uint64_t &nHitsOut, uint64_t &nMissesOut);
+
 #endif
@@ -25,23 +25,60 @@ void HandleError(const leveldb::Status &status) throw(leveldb_error) {
     throw leveldb_error("Unknown database error");
 }
 
-static leveldb::Options GetOptions(size_t nCacheSize) {
+CLevelDBOptions::CLevelDBOptions(size_t nCacheSizeIn) {
+    nCacheSize = nCacheSizeIn;
+    nBlockSize = 4096;
+    nWriteBufferSize = 0;
+    nMaxOpenFiles = 64;
+    nBloomBits = 10;
+    fCompression = false;
+}
+
+static int64_t GetDBArg(const std::string &strName, const std::string &strOption, int64_t nDefault) {
+    return GetArg("-" + strName + "db" + strOption, GetArg("-db" + strOption, nDefault));
+}
+
+CLevelDBOptions CLevelDBOptions::FromArgs(const std::string &strName, size_t nCacheSize) {
+    CLevelDBOptions dboptions(nCacheSize);
+    dboptions.nBlockSize = (size_t)std::max((int64_t)1, GetDBArg(strName, "blocksize", dboptions.nBlockSize / 1024)) * 1024;
+    dboptions.nWriteBufferSize = (size_t)std::max((int64_t)0, GetDBArg(strName, "writebuffer", 0)) << 20;
+    dboptions.nMaxOpenFiles = (int)std::max((int64_t)20, GetDBArg(strName, "maxopenfiles", dboptions.nMaxOpenFiles));
+    dboptions.nBloomBits = (int)std::max((int64_t)0, GetDBArg(strName, "bloombits", dboptions.nBloomBits));
+    dboptions.fCompression = GetDBArg(strName, "compression", dboptions.fCompression) != 0;
+    return dboptions;
+}
+
+static leveldb::Options GetLevelDBOptions(const CLevelDBOptions &dboptions) {
     leveldb::Options options;
-    options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
-    options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
-    options.filter_policy = leveldb::NewBloomFilterPolicy(10);
-    options.compression = leveldb::kNoCompression;
-    options.max_open_files = 64;
+    options.block_cache = leveldb::NewLRUCache(dboptions.nCacheSize / 2);
+    if (dboptions.nWriteBufferSize > 0)
+        options.write_buffer_size = dboptions.nWriteBufferSize;
+    else
+        options.write_buffer_size = dboptions.nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
+    options.block_size = dboptions.nBlockSize;
+    if (dboptions.nBloomBits > 0)
+        options.filter_policy = leveldb::NewBloomFilterPolicy(dboptions.nBloomBits);
+    options.compression = dboptions.fCompression ? leveldb::kSnappyCompression : leveldb::kNoCompression;
+    options.max_open_files = dboptions.nMaxOpenFiles;
     return options;
 }
 
-CLevelDBWrapper::CLevelDBWrapper(const boost::filesystem::path &path, size_t nCacheSize, bool fMemory, bool fWipe) {
+CLevelDBWrapper::CLevelDBWrapper(const boost::filesystem::path &path, size_t nCacheSize, bool fMemory, bool fWipe) : dboptions(nCacheSize) {
+    strName = path.filename().string();
+    Open(path, fMemory, fWipe);
+}
+
+CLevelDBWrapper::CLevelDBWrapper(const boost::filesystem::path &path, const std::string &strNameIn, const CLevelDBOptions &dboptionsIn, bool fMemory, bool fWipe) : dboptions(dboptionsIn), strName(strNameIn) {
+    Open(path, fMemory, fWipe);
+}
+
+void CLevelDBWrapper::Open(const boost::filesystem::path &path, bool fMemory, bool fWipe) {
     penv = NULL;
     readoptions.verify_checksums = true;
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize);
+    options = GetLevelDBOptions(dboptions);
     options.create_if_missing = true;
     if (fMemory) {
         penv = leveldb::NewMemEnv(leveldb::Env::Default());
@@ -54,6 +91,9 @@ CLevelDBWrapper::CLevelDBWrapper(const boost::filesystem::path &path, size_t nCa
         TryCreateDirectory(path);
         LogPrintf("Opening LevelDB in %s\n", path.string());
     }
+    LogPrint("coindb", "LevelDB %s: cache %u, block size %u, write buffer %u, max open files %d, bloom bits %d, compression %d\n",
+        strName, dboptions.nCacheSize, options.block_size, options.write_buffer_size, options.max_open_files,
+        dboptions.nBloomBits, dboptions.fCompression);
     leveldb::Status status = leveldb::DB::Open(options, path.string(), &pdb);
     HandleError(status);
     LogPrintf("Opened LevelDB successfully\n");
@@ -75,3 +115,19 @@ bool CLevelDBWrapper::WriteBatch(CLevelDBBatch &batch, bool fSync) throw(leveldb
     HandleError(status);
     return true;
 }
+
+uint64_t CLevelDBWrapper::GetApproximateSize() {
+    // Keys are serialized with a one byte prefix, so this range covers all of them
+    static const char chBegin = 0x00, chEnd[2] = { (char)0xff, (char)0xff };
+    leveldb::Range range(leveldb::Slice(&chBegin, 1), leveldb::Slice(chEnd, 2));
+    uint64_t nSize = 0;
+    pdb->GetApproximateSizes(&range, 1, &nSize);
+    return nSize;
+}
+
+void CLevelDBWrapper::Compact() {
+    int64_t nStart = GetTimeMillis();
+    LogPrintf("Compacting LevelDB %s\n", strName);
+    pdb->CompactRange(NULL, NULL);
+    LogPrintf("Compacted LevelDB %s in %dms\n", strName, GetTimeMillis() - nStart);
+}
@@ -21,6 +21,24 @@ public:
 
 void HandleError(const leveldb::Status &status) throw(leveldb_error);
 
+/** Tuning parameters for a CLevelDBWrapper. The defaults match what was
+ *  hard-coded before; SSD and HDD deployments usually want different values. */
+struct CLevelDBOptions
+{
+    size_t nCacheSize;        // block cache plus write buffers, in bytes
+    size_t nBlockSize;        // uncompressed size of a table block, in bytes
+    size_t nWriteBufferSize;  // in bytes, 0 = a quarter of nCacheSize
+    int nMaxOpenFiles;
+    int nBloomBits;           // bits per key of the bloom filter, 0 = no filter
+    bool fCompression;
+
+    CLevelDBOptions(size_t nCacheSizeIn = 0);
+
+    /** Options for the database called strName, taking -db<option> arguments
+     *  and -<strName>db<option> overrides into account */
+    static CLevelDBOptions FromArgs(const std::string &strName, size_t nCacheSize);
+};
+
 // Batch of changes queued to be written to a CLevelDBWrapper
 class CLevelDBBatch
 {
@@ -28,15 +46,20 @@ class CLevelDBBatch
 
 private:
     leveldb::WriteBatch batch;
+    // reused for every record, so a large batch allocates (and wipes) them once
+    CDataStream ssKey;
+    CDataStream ssValue;
 
 public:
+    CLevelDBBatch() : ssKey(SER_DISK, CLIENT_VERSION), ssValue(SER_DISK, CLIENT_VERSION) { }
+
     template<typename K, typename V> void Write(const K& key, const V& value) {
-        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        ssKey.clear();
         ssKey.reserve(ssKey.GetSerializeSize(key));
         ssKey << key;
         leveldb::Slice slKey(&ssKey[0], ssKey.size());
 
-        CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+        ssValue.clear();
         ssValue.reserve(ssValue.GetSerializeSize(value));
         ssValue << value;
         leveldb::Slice slValue(&ssValue[0], ssValue.size());
@@ -45,13 +68,17 @@ public:
     }
 
     template<typename K> void Erase(const K& key) {
-        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        ssKey.clear();
         ssKey.reserve(ssKey.GetSerializeSize(key));
         ssKey << key;
         leveldb::Slice slKey(&ssKey[0], ssKey.size());
 
         batch.Delete(slKey);
     }
+
+    void Clear() {
+        batch.Clear();
+    }
 };
 
 class CLevelDBWrapper
@@ -78,8 +105,17 @@ private:
     // the database itself
     leveldb::DB *pdb;
 
+    // tuning the database was opened with
+    CLevelDBOptions dboptions;
+
+    // short name used in logs and RPC output
+    std::string strName;
+
+    void Open(const boost::filesystem::path &path, bool fMemory, bool fWipe);
+
 public:
     CLevelDBWrapper(const boost::filesystem::path &path, size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    CLevelDBWrapper(const boost::filesystem::path &path, const std::string &strNameIn, const CLevelDBOptions &dboptionsIn, bool fMemory = false, bool fWipe = false);
     ~CLevelDBWrapper();
 
     template<typename K, typename V> bool Read(const K& key, V& value) throw(leveldb_error) {
@@ -97,7 +133,7 @@ public:
             HandleError(status);
         }
         try {
-            CDataStream ssValue(strValue.data(), strValue.data() + strValue.size(), SER_DISK, CLIENT_VERSION);
+            CSpanReader ssValue(strValue.data(), strValue.data() + strValue.size(), SER_DISK, CLIENT_VERSION);
             ssValue >> value;
         } catch(std::exception &e) {
             return false;
@@ -146,9 +182,29 @@ public:
         return WriteBatch(batch, true);
     }
 
+    const std::string &GetName() const {
+        return strName;
+    }
+
+    const CLevelDBOptions &GetOptions() const {
+        return dboptions;
+    }
+
+    // Read a leveldb.* property, e.g. "leveldb.stats" or "leveldb.num-files-at-level0"
+    bool GetProperty(const std::string &strProperty, std::string &strValue) {
+        return pdb->GetProperty(strProperty, &strValue);
+    }
+
+    // Approximate on-disk size of the whole key space, in bytes
+    uint64_t GetApproximateSize();
+
+    // Compact the whole key space; blocks until done
+    void Compact();
+
     // not exactly clean encapsulation, but it's easiest for now
-    leveldb::Iterator *NewIterator() {
-        return pdb->NewIterator(iteroptions);
+    // (fFillCache for short range reads on the lookup path, not for full scans)
+    leveldb::Iterator *NewIterator(bool fFillCache = false) {
+        return pdb->NewIterator(fFillCache ? readoptions : iteroptions);
     }
 };
 
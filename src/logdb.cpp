@@ -0,0 +1,298 @@
+// Copyright (c) 2014 The Reddcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "logdb.h"
+
+#include "hash.h"
+#include "util.h"
+#include "version.h"
+
+#include <boost/filesystem.hpp>
+
+using namespace std;
+
+// Approximate size of a live record in the log
+static uint64_t RecordSize(const CLogDB::Data &key, const CLogDB::Data &value)
+{
+    return 1 + GetSizeOfCompactSize(key.size()) + key.size() + GetSizeOfCompactSize(value.size()) + value.size();
+}
+
+// Append one frame holding the records of batch; returns its size, or 0 on failure
+static uint64_t AppendFrame(FILE *file, const CLogDBBatch &batch)
+{
+    CDataStream ssPayload(SER_DISK, CLIENT_VERSION);
+    WriteCompactSize(ssPayload, batch.mapWrites.size());
+    for (std::map<CLogDB::Data, std::pair<bool, CLogDB::Data>, CLogDBKeyLess>::const_iterator it = batch.mapWrites.begin(); it != batch.mapWrites.end(); it++) {
+        char fErase = it->second.first ? 1 : 0;
+        ssPayload << fErase << it->first;
+        if (!fErase)
+            ssPayload << it->second.second;
+    }
+
+    uint32_t nSize = ssPayload.size();
+    unsigned char pchSize[4] = { (unsigned char)nSize, (unsigned char)(nSize >> 8), (unsigned char)(nSize >> 16), (unsigned char)(nSize >> 24) };
+    uint256 hash = Hash(ssPayload.begin(), ssPayload.end());
+    if (fwrite(pchSize, 1, sizeof(pchSize), file) != sizeof(pchSize) ||
+        fwrite(&ssPayload[0], 1, nSize, file) != nSize ||
+        fwrite(hash.begin(), 1, hash.size(), file) != hash.size() ||
+        fflush(file) != 0)
+        return 0;
+    return sizeof(pchSize) + nSize + hash.size();
+}
+
+CLogDB::CLogDB() : file(NULL), nFileSize(0), nDataSize(0)
+{
+}
+
+CLogDB::~CLogDB()
+{
+    Close();
+}
+
+void CLogDB::Replay(FILE *fileIn, uint64_t nTotalSize)
+{
+    while (true) {
+        unsigned char pchSize[4];
+        if (fread(pchSize, 1, sizeof(pchSize), fileIn) != sizeof(pchSize))
+            break;
+        uint32_t nSize = pchSize[0] | (pchSize[1] << 8) | (pchSize[2] << 16) | ((uint32_t)pchSize[3] << 24);
+        if (nFileSize + sizeof(pchSize) + nSize + sizeof(uint256) > nTotalSize)
+            break;
+        CSerializeData vchPayload(nSize);
+        uint256 hash;
+        if ((nSize > 0 && fread(&vchPayload[0], 1, nSize, fileIn) != nSize) ||
+            fread(hash.begin(), 1, hash.size(), fileIn) != hash.size())
+            break;
+        if (Hash(vchPayload.begin(), vchPayload.end()) != hash)
+            break;
+
+        CLogDBBatch batch;
+        try {
+            CDataStream ssPayload(vchPayload.begin(), vchPayload.end(), SER_DISK, CLIENT_VERSION);
+            uint64_t nRecords = ReadCompactSize(ssPayload);
+            for (uint64_t i = 0; i < nRecords; i++) {
+                char fErase;
+                Data key, value;
+                ssPayload >> fErase >> key;
+                if (fErase) {
+                    batch.Erase(key);
+                } else {
+                    ssPayload >> value;
+                    batch.Write(key, value);
+                }
+            }
+        } catch (std::exception &e) {
+            break;
+        }
+
+        for (std::map<Data, std::pair<bool, Data>, CLogDBKeyLess>::const_iterator it = batch.mapWrites.begin(); it != batch.mapWrites.end(); it++) {
+            std::map<Data, Data, CLogDBKeyLess>::iterator mi = mapData.find(it->first);
+            if (mi != mapData.end()) {
+                nDataSize -= RecordSize(mi->first, mi->second);
+                mapData.erase(mi);
+            }
+            if (!it->second.first) {
+                mapData.insert(make_pair(it->first, it->second.second));
+                nDataSize += RecordSize(it->first, it->second.second);
+            }
+        }
+        nFileSize += sizeof(pchSize) + nSize + hash.size();
+    }
+}
+
+bool CLogDB::Open(const boost::filesystem::path &pathIn, bool fCreate)
+{
+    LOCK(cs);
+    if (file)
+        return error("CLogDB::Open : %s already open", path.string());
+
+    path = pathIn;
+    bool fExists = boost::filesystem::exists(path);
+    if (!fExists && !fCreate)
+        return false;
+    file = fopen(path.string().c_str(), fExists ? "rb+" : "wb+");
+    if (!file)
+        return error("CLogDB::Open : cannot open %s", path.string());
+
+    mapData.clear();
+    nFileSize = 0;
+    nDataSize = 0;
+    uint64_t nSize = fExists ? boost::filesystem::file_size(path) : 0;
+    Replay(file, nSize);
+
+    // cut off an interrupted last frame, so that new frames follow the valid ones
+    if (nSize > nFileSize) {
+        LogPrintf("CLogDB::Open : %s has %d bytes after the last complete frame, truncating\n", path.string(), nSize - nFileSize);
+        if (!TruncateFile(file, nFileSize)) {
+            fclose(file);
+            file = NULL;
+            return error("CLogDB::Open : cannot truncate %s", path.string());
+        }
+    }
+    fseek(file, nFileSize, SEEK_SET);
+    LogPrint("db", "CLogDB::Open : %s has %u records (%d of %d bytes live)\n", path.string(), mapData.size(), nDataSize, nFileSize);
+    return true;
+}
+
+void CLogDB::Close()
+{
+    LOCK(cs);
+    if (!file)
+        return;
+    FileCommit(file);
+    fclose(file);
+    file = NULL;
+    mapData.clear();
+}
+
+bool CLogDB::IsOpen() const
+{
+    LOCK(cs);
+    return file != NULL;
+}
+
+bool CLogDB::Read(const Data &key, Data &value) const
+{
+    LOCK(cs);
+    std::map<Data, Data, CLogDBKeyLess>::const_iterator it = mapData.find(key);
+    if (it == mapData.end())
+        return false;
+    value = it->second;
+    return true;
+}
+
+bool CLogDB::Exists(const Data &key) const
+{
+    LOCK(cs);
+    return mapData.count(key) > 0;
+}
+
+bool CLogDB::ReadNext(Data &key, Data &value, bool fAfter) const
+{
+    LOCK(cs);
+    std::map<Data, Data, CLogDBKeyLess>::const_iterator it = fAfter ? mapData.upper_bound(key) : mapData.lower_bound(key);
+    if (it == mapData.end())
+        return false;
+    key = it->first;
+    value = it->second;
+    return true;
+}
+
+bool CLogDB::Commit(const CLogDBBatch &batch)
+{
+    LOCK(cs);
+    if (!file)
+        return false;
+    if (batch.empty())
+        return true;
+
+    uint64_t nFrameSize = AppendFrame(file, batch);
+    if (nFrameSize == 0) {
+        // drop whatever part of the frame made it to the file
+        TruncateFile(file, nFileSize);
+        fseek(file, nFileSize, SEEK_SET);
+        return error("CLogDB::Commit : cannot write to %s", path.string());
+    }
+    nFileSize += nFrameSize;
+
+    for (std::map<Data, std::pair<bool, Data>, CLogDBKeyLess>::const_iterator it = batch.mapWrites.begin(); it != batch.mapWrites.end(); it++) {
+        std::map<Data, Data, CLogDBKeyLess>::iterator mi = mapData.find(it->first);
+        if (mi != mapData.end()) {
+            nDataSize -= RecordSize(mi->first, mi->second);
+            mapData.erase(mi);
+        }
+        if (!it->second.first) {
+            mapData.insert(make_pair(it->first, it->second.second));
+            nDataSize += RecordSize(it->first, it->second.second);
+        }
+    }
+
+    if (nFileSize > 2 * nDataSize + LOGDB_COMPACT_MIN_WASTE)
+        CompactLocked(NULL);
+    return true;
+}
+
+bool CLogDB::Flush()
+{
+    LOCK(cs);
+    if (!file)
+        return false;
+    FileCommit(file);
+    return true;
+}
+
+bool CLogDB::Compact(const char *pszSkip)
+{
+    LOCK(cs);
+    return CompactLocked(pszSkip);
+}
+
+bool CLogDB::CompactLocked(const char *pszSkip)
+{
+    if (!file)
+        return false;
+
+    int64_t nStart = GetTimeMillis();
+    boost::filesystem::path pathNew = path.string() + ".new";
+    FILE *fileNew = fopen(pathNew.string().c_str(), "wb");
+    if (!fileNew)
+        return error("CLogDB::Compact : cannot create %s", pathNew.string());
+
+    size_t nSkip = pszSkip ? strlen(pszSkip) : 0;
+    uint64_t nFileSizeNew = 0;
+    bool fSuccess = true;
+    CLogDBBatch batch;
+    for (std::map<Data, Data, CLogDBKeyLess>::iterator it = mapData.begin(); fSuccess; ) {
+        if (it != mapData.end() && nSkip > 0 && !it->first.empty() && memcmp(&it->first[0], pszSkip, std::min(it->first.size(), nSkip)) == 0) {
+            mapData.erase(it++);
+            continue;
+        }
+        if (it == mapData.end() || batch.mapWrites.size() >= LOGDB_COMPACT_FRAME_RECORDS) {
+            if (!batch.empty()) {
+                uint64_t nFrameSize = AppendFrame(fileNew, batch);
+                fSuccess = nFrameSize > 0;
+                nFileSizeNew += nFrameSize;
+                batch.mapWrites.clear();
+            }
+            if (it == mapData.end())
+                break;
+        }
+        batch.Write(it->first, it->second);
+        it++;
+    }
+    FileCommit(fileNew);
+    fclose(fileNew);
+    if (!fSuccess) {
+        boost::filesystem::remove(pathNew);
+        return error("CLogDB::Compact : cannot write %s", pathNew.string());
+    }
+
+    fclose(file);
+    file = NULL;
+    bool fRenamed = RenameOver(pathNew, path);
+    file = fopen(path.string().c_str(), "rb+");
+    if (!file)
+        return error("CLogDB::Compact : cannot reopen %s", path.string());
+    if (!fRenamed) {
+        fseek(file, nFileSize, SEEK_SET);
+        boost::filesystem::remove(pathNew);
+        return error("CLogDB::Compact : cannot replace %s", path.string());
+    }
+    nFileSize = nFileSizeNew;
+    fseek(file, nFileSize, SEEK_SET);
+
+    nDataSize = 0;
+    for (std::map<Data, Data, CLogDBKeyLess>::const_iterator it = mapData.begin(); it != mapData.end(); it++)
+        nDataSize += RecordSize(it->first, it->second);
+    LogPrint("db", "CLogDB::Compact : rewrote %s with %u records (%d bytes) in %dms\n", path.string(), mapData.size(), nFileSizeNew, GetTimeMillis() - nStart);
+    return true;
+}
+
+void CLogDB::GetStats(uint64_t &nFileSizeOut, uint64_t &nDataSizeOut, size_t &nRecordsOut) const
+{
+    LOCK(cs);
+    nFileSizeOut = nFileSize;
+    nDataSizeOut = nDataSize;
+    nRecordsOut = mapData.size();
+}
@@ -0,0 +1,108 @@
+// Copyright (c) 2014 The Reddcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_LOGDB_H
+#define BITCOIN_LOGDB_H
+
+#include "serialize.h"
+#include "sync.h"
+
+#include <algorithm>
+#include <map>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <utility>
+
+#include <boost/filesystem/path.hpp>
+
+/** Number of records per frame when a log is compacted */
+static const unsigned int LOGDB_COMPACT_FRAME_RECORDS = 1000;
+/** Superseded bytes a log may hold before it is compacted on commit */
+static const uint64_t LOGDB_COMPACT_MIN_WASTE = 1 << 20;
+
+/** Orders keys as unsigned bytes, like the default Berkeley DB btree comparison */
+struct CLogDBKeyLess
+{
+    bool operator()(const CSerializeData &a, const CSerializeData &b) const
+    {
+        size_t nSize = std::min(a.size(), b.size());
+        int nCmp = nSize ? memcmp(&a[0], &b[0], nSize) : 0;
+        return nCmp < 0 || (nCmp == 0 && a.size() < b.size());
+    }
+};
+
+/** Writes and erases applied to a CLogDB in one commit */
+class CLogDBBatch
+{
+public:
+    typedef CSerializeData Data;
+
+    // key -> (fErase, value)
+    std::map<Data, std::pair<bool, Data>, CLogDBKeyLess> mapWrites;
+
+    void Write(const Data &key, const Data &value) { mapWrites[key] = std::make_pair(false, value); }
+    void Erase(const Data &key) { mapWrites[key] = std::make_pair(true, Data()); }
+    bool empty() const { return mapWrites.empty(); }
+};
+
+/** Append-only, log-structured key/value store.
+ *
+ * All records are kept in memory; the file is only ever appended to, one
+ * frame per commit, and rewritten with just the live records by Compact().
+ *
+ * Frame format:
+ * - uint32_t size of the payload
+ * - payload: CompactSize number of records, then for each record
+ *   - char fErase
+ *   - the key (as a vector)
+ *   - the value (as a vector), unless fErase
+ * - uint256 double SHA256 of the payload
+ *
+ * A frame is applied as a whole or not at all: when the log is opened, a
+ * truncated or corrupt last frame (an interrupted write) is cut off.
+ * Commits are written to the operating system at once; Flush() syncs them
+ * to disk.
+ */
+class CLogDB
+{
+public:
+    typedef CSerializeData Data;
+
+private:
+    mutable CCriticalSection cs;
+    boost::filesystem::path path;
+    FILE *file;
+    std::map<Data, Data, CLogDBKeyLess> mapData;
+    uint64_t nFileSize; // size of the valid frames in the file
+    uint64_t nDataSize; // size the live records take in the file, roughly
+
+    void Replay(FILE *fileIn, uint64_t nTotalSize);
+    bool CompactLocked(const char *pszSkip);
+
+public:
+    CLogDB();
+    ~CLogDB();
+
+    // Open the log at pathIn and load its records
+    bool Open(const boost::filesystem::path &pathIn, bool fCreate);
+    void Close();
+    bool IsOpen() const;
+
+    bool Read(const Data &key, Data &value) const;
+    bool Exists(const Data &key) const;
+    // Next record in key order: the first with a key >= key, or > key if fAfter
+    bool ReadNext(Data &key, Data &value, bool fAfter) const;
+
+    // Apply and append a batch; compacts the log when mostly superseded
+    bool Commit(const CLogDBBatch &batch);
+    // Sync the log to disk
+    bool Flush();
+    // Rewrite the log with only the live records, dropping the ones whose key starts with pszSkip
+    bool Compact(const char *pszSkip = NULL);
+
+    void GetStats(uint64_t &nFileSizeOut, uint64_t &nDataSizeOut, size_t &nRecordsOut) const;
+};
+
+#endif // BITCOIN_LOGDB_H
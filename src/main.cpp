@@ -7,6 +7,7 @@
 
 #include "addrman.h"
 #include "alert.h"
+#include "blockfile.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
@@ -48,6 +49,8 @@ bool fImporting = false;
 bool fReindex = false;
 bool fBenchmark = false;
 bool fTxIndex = true;
+bool fAddressIndex = false;
+bool fSpentIndex = false;
 unsigned int nCoinCacheSize = 5000;
 
 /** Fees smaller than this (in satoshi) are considered zero fee (for transaction creation) */
@@ -66,9 +69,15 @@ multimap<uint256, COrphanBlock*> mapOrphanBlocksByPrev;
 struct COrphanTx {
     CTransaction tx;
     NodeId fromPeer;
+    int64_t nTimeExpire;
+    unsigned int nTxSize;
+    set<uint256> setParentsTried; // parents whose arrival this orphan was already retried for
 };
 map<uint256, COrphanTx> mapOrphanTransactions;
 map<uint256, set<uint256> > mapOrphanTransactionsByPrev;
+map<NodeId, set<uint256> > mapOrphanTransactionsByPeer;
+size_t nOrphanTransactionsSize = 0;
+deque<pair<uint256, uint256> > queueOrphanWork; // (orphan, parent that arrived) to retry
 void EraseOrphansFor(NodeId peer);
 
 // Constant stuff for coinbase transactions we create:
@@ -112,6 +121,9 @@ namespace {
     CBlockFileInfo infoLastBlockFile;
     int nLastBlockFile = 0;
 
+    // Read-only mappings of finalized block and undo files
+    CBlockFileCache blockFileCache;
+
     // Every received block is assigned a unique and increasing identifier, so we
     // know which one to give priority in case of a fork.
     CCriticalSection cs_nBlockSequenceId;
@@ -144,6 +156,8 @@ namespace {
 struct CMainSignals {
     // Notifies listeners of updated transaction data (passing hash, transaction, and optionally the block it is found in.
     boost::signals2::signal<void (const uint256 &, const CTransaction &, const CBlock *)> SyncTransaction;
+    // Notifies listeners of all transactions in a newly connected block.
+    boost::signals2::signal<void (const CBlock &)> SyncBlock;
     // Notifies listeners of an erased transaction (currently disabled, requires transaction replacement).
     boost::signals2::signal<void (const uint256 &)> EraseTransaction;
     // Notifies listeners of an updated transaction without new data (for now: a coinbase potentially becoming visible).
@@ -159,6 +173,7 @@ struct CMainSignals {
 
 void RegisterWallet(CWalletInterface* pwalletIn) {
     g_signals.SyncTransaction.connect(boost::bind(&CWalletInterface::SyncTransaction, pwalletIn, _1, _2, _3));
+    g_signals.SyncBlock.connect(boost::bind(&CWalletInterface::SyncBlock, pwalletIn, _1));
     g_signals.EraseTransaction.connect(boost::bind(&CWalletInterface::EraseFromWallet, pwalletIn, _1));
     g_signals.UpdatedTransaction.connect(boost::bind(&CWalletInterface::UpdatedTransaction, pwalletIn, _1));
     g_signals.SetBestChain.connect(boost::bind(&CWalletInterface::SetBestChain, pwalletIn, _1));
@@ -172,6 +187,7 @@ void UnregisterWallet(CWalletInterface* pwalletIn) {
     g_signals.SetBestChain.disconnect(boost::bind(&CWalletInterface::SetBestChain, pwalletIn, _1));
     g_signals.UpdatedTransaction.disconnect(boost::bind(&CWalletInterface::UpdatedTransaction, pwalletIn, _1));
     g_signals.EraseTransaction.disconnect(boost::bind(&CWalletInterface::EraseFromWallet, pwalletIn, _1));
+    g_signals.SyncBlock.disconnect(boost::bind(&CWalletInterface::SyncBlock, pwalletIn, _1));
     g_signals.SyncTransaction.disconnect(boost::bind(&CWalletInterface::SyncTransaction, pwalletIn, _1, _2, _3));
 }
 
@@ -181,6 +197,7 @@ void UnregisterAllWallets() {
     g_signals.SetBestChain.disconnect_all_slots();
     g_signals.UpdatedTransaction.disconnect_all_slots();
     g_signals.EraseTransaction.disconnect_all_slots();
+    g_signals.SyncBlock.disconnect_all_slots();
     g_signals.SyncTransaction.disconnect_all_slots();
 }
 
@@ -410,8 +427,14 @@ CBlockIndex *CChain::FindFork(const CBlockLocator &locator) const {
     return Genesis();
 }
 
+CCoinsViewDB *pcoinsdbview = NULL;
 CCoinsViewCache *pcoinsTip = NULL;
 CBlockTreeDB *pblocktree = NULL;
+CBlockFilterDB *pblockfilterdb = NULL;
+
+// Statistics of the UTXO set at chainActive.Tip(), valid if fCoinStatsTip (protected by cs_main)
+static CCoinsRunningStats coinStatsTip;
+static bool fCoinStatsTip = false;
 
 //////////////////////////////////////////////////////////////////////////////
 //
@@ -438,13 +461,18 @@ bool AddOrphanTx(const CTransaction& tx, NodeId peer)
         return false;
     }
 
-    mapOrphanTransactions[hash].tx = tx;
-    mapOrphanTransactions[hash].fromPeer = peer;
+    COrphanTx& orphan = mapOrphanTransactions[hash];
+    orphan.tx = tx;
+    orphan.fromPeer = peer;
+    orphan.nTimeExpire = GetTime() + ORPHAN_TX_EXPIRE_TIME;
+    orphan.nTxSize = sz;
     BOOST_FOREACH(const CTxIn& txin, tx.vin)
         mapOrphanTransactionsByPrev[txin.prevout.hash].insert(hash);
+    mapOrphanTransactionsByPeer[peer].insert(hash);
+    nOrphanTransactionsSize += sz;
 
-    LogPrint("mempool", "stored orphan tx %s (mapsz %u prevsz %u)\n", hash.ToString(),
-             mapOrphanTransactions.size(), mapOrphanTransactionsByPrev.size());
+    LogPrint("mempool", "stored orphan tx %s (mapsz %u prevsz %u bytes %u)\n", hash.ToString(),
+             mapOrphanTransactions.size(), mapOrphanTransactionsByPrev.size(), nOrphanTransactionsSize);
     return true;
 }
 
@@ -462,26 +490,29 @@ void static EraseOrphanTx(uint256 hash)
         if (itPrev->second.empty())
             mapOrphanTransactionsByPrev.erase(itPrev);
     }
+    map<NodeId, set<uint256> >::iterator itPeer = mapOrphanTransactionsByPeer.find(it->second.fromPeer);
+    if (itPeer != mapOrphanTransactionsByPeer.end())
+    {
+        itPeer->second.erase(hash);
+        if (itPeer->second.empty())
+            mapOrphanTransactionsByPeer.erase(itPeer);
+    }
+    nOrphanTransactionsSize -= it->second.nTxSize;
     mapOrphanTransactions.erase(it);
 }
 
 void EraseOrphansFor(NodeId peer)
 {
-    int nErased = 0;
-    map<uint256, COrphanTx>::iterator iter = mapOrphanTransactions.begin();
-    while (iter != mapOrphanTransactions.end())
-    {
-        map<uint256, COrphanTx>::iterator maybeErase = iter++; // increment to avoid iterator becoming invalid
-        if (maybeErase->second.fromPeer == peer)
-        {
-            EraseOrphanTx(maybeErase->second.tx.GetHash());
-            ++nErased;
-        }
-    }
-    if (nErased > 0) LogPrint("mempool", "Erased %d orphan tx from peer %d\n", nErased, peer);
+    map<NodeId, set<uint256> >::iterator itPeer = mapOrphanTransactionsByPeer.find(peer);
+    if (itPeer == mapOrphanTransactionsByPeer.end())
+        return;
+    // Copy: EraseOrphanTx removes entries from (and finally erases) this set
+    set<uint256> setErase = itPeer->second;
+    BOOST_FOREACH(const uint256& hash, setErase)
+        EraseOrphanTx(hash);
+    LogPrint("mempool", "Erased %d orphan tx from peer %d\n", setErase.size(), peer);
 }
 
-
 unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans)
 {
     unsigned int nEvicted = 0;
@@ -498,6 +529,136 @@ unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans)
     return nEvicted;
 }
 
+unsigned int LimitOrphanTxMemory(size_t nMaxBytes)
+{
+    unsigned int nEvicted = 0;
+    while (nOrphanTransactionsSize > nMaxBytes)
+    {
+        // Evict a random orphan:
+        uint256 randomhash = GetRandHash();
+        map<uint256, COrphanTx>::iterator it = mapOrphanTransactions.lower_bound(randomhash);
+        if (it == mapOrphanTransactions.end())
+            it = mapOrphanTransactions.begin();
+        EraseOrphanTx(it->first);
+        ++nEvicted;
+    }
+    return nEvicted;
+}
+
+unsigned int LimitOrphanTxForPeer(NodeId peer, unsigned int nMaxOrphans)
+{
+    unsigned int nEvicted = 0;
+    map<NodeId, set<uint256> >::iterator itPeer = mapOrphanTransactionsByPeer.find(peer);
+    while (itPeer != mapOrphanTransactionsByPeer.end() && itPeer->second.size() > nMaxOrphans)
+    {
+        // Evict a random orphan of this peer; the set entry goes away with it
+        set<uint256>::iterator it = itPeer->second.lower_bound(GetRandHash());
+        if (it == itPeer->second.end())
+            it = itPeer->second.begin();
+        bool fLast = (itPeer->second.size() == 1);
+        EraseOrphanTx(*it);
+        ++nEvicted;
+        if (fLast)
+            break;
+    }
+    return nEvicted;
+}
+
+unsigned int ExpireOrphanTx(int64_t nNow)
+{
+    static int64_t nNextSweep;
+    if (nNow < nNextSweep)
+        return 0;
+    nNextSweep = nNow + ORPHAN_TX_EXPIRE_INTERVAL;
+
+    unsigned int nErased = 0;
+    map<uint256, COrphanTx>::iterator iter = mapOrphanTransactions.begin();
+    while (iter != mapOrphanTransactions.end())
+    {
+        map<uint256, COrphanTx>::iterator maybeErase = iter++; // increment to avoid iterator becoming invalid
+        if (maybeErase->second.nTimeExpire <= nNow)
+        {
+            EraseOrphanTx(maybeErase->first);
+            ++nErased;
+        }
+    }
+    if (nErased > 0) LogPrint("mempool", "Erased %d expired orphan tx\n", nErased);
+    return nErased;
+}
+
+// Queue the orphans spending outputs of hashParent for another acceptance attempt.
+void QueueOrphanWork(const uint256& hashParent)
+{
+    map<uint256, set<uint256> >::iterator itByPrev = mapOrphanTransactionsByPrev.find(hashParent);
+    if (itByPrev == mapOrphanTransactionsByPrev.end())
+        return;
+    BOOST_FOREACH(const uint256& orphanHash, itByPrev->second)
+        queueOrphanWork.push_back(make_pair(orphanHash, hashParent));
+}
+
+// Try to accept at most nMaxBatch queued orphans into the memory pool. Dependents
+// of an accepted orphan are queued behind it, so chains resolve parent-first over
+// successive calls; an orphan still missing another parent stays in the pool until
+// that parent arrives. An orphan is retried at most once per parent, so one whose
+// parents trickle in (or are announced repeatedly) is not validated over and over.
+// Requires cs_main.
+unsigned int ProcessOrphanWork(unsigned int nMaxBatch)
+{
+    unsigned int nProcessed = 0;
+    set<NodeId> setMisbehaving;
+    while (!queueOrphanWork.empty() && nProcessed < nMaxBatch)
+    {
+        uint256 orphanHash = queueOrphanWork.front().first;
+        uint256 hashParent = queueOrphanWork.front().second;
+        queueOrphanWork.pop_front();
+        map<uint256, COrphanTx>::iterator it = mapOrphanTransactions.find(orphanHash);
+        if (it == mapOrphanTransactions.end())
+            continue; // resolved or evicted
+        if (!it->second.setParentsTried.insert(hashParent).second)
+            continue; // already retried for this parent
+        const CTransaction& orphanTx = it->second.tx;
+        NodeId fromPeer = it->second.fromPeer;
+        ++nProcessed;
+
+        if (setMisbehaving.count(fromPeer))
+        {
+            EraseOrphanTx(orphanHash);
+            continue;
+        }
+
+        bool fMissingInputs = false;
+        // Use a dummy CValidationState so someone can't setup nodes to counter-DoS based on orphan
+        // resolution (that is, feeding people an invalid transaction based on LegitTxX in order to get
+        // anyone relaying LegitTxX banned)
+        CValidationState stateDummy;
+        if (AcceptToMemoryPool(mempool, stateDummy, orphanTx, true, &fMissingInputs))
+        {
+            LogPrint("mempool", "   accepted orphan tx %s\n", orphanHash.ToString());
+            RelayTransaction(orphanTx, orphanHash);
+            mapAlreadyAskedFor.erase(CInv(MSG_TX, orphanHash));
+            QueueOrphanWork(orphanHash);
+            EraseOrphanTx(orphanHash);
+        }
+        else if (!fMissingInputs)
+        {
+            int nDos = 0;
+            if (stateDummy.IsInvalid(nDos) && nDos > 0)
+            {
+                // Punish peer that gave us an invalid orphan tx
+                Misbehaving(fromPeer, nDos);
+                setMisbehaving.insert(fromPeer);
+                LogPrint("mempool", "   invalid orphan tx %s\n", orphanHash.ToString());
+            }
+            // too-little-fee orphan
+            LogPrint("mempool", "   removed orphan tx %s\n", orphanHash.ToString());
+            EraseOrphanTx(orphanHash);
+        }
+    }
+    if (nProcessed > 0)
+        mempool.check(pcoinsTip);
+    return nProcessed;
+}
+
 
 
 
@@ -1067,16 +1228,8 @@ bool GetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlock
         if (fTxIndex) {
             CDiskTxPos postx;
             if (pblocktree->ReadTxIndex(hash, postx)) {
-                CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
-                CBlockHeader header;
-                try {
-                    file >> header;
-                    fseek(file, postx.nTxOffset, SEEK_CUR);
-                    file >> txOut;
-                } catch (std::exception &e) {
-                    return error("%s : Deserialize or I/O error - %s", __func__, e.what());
-                }
-                hashBlock = header.GetHash();
+                if (!ReadTransactionFromDisk(txOut, hashBlock, postx))
+                    return false;
                 if (txOut.GetHash() != hash)
                     return error("%s : txid mismatch", __func__);
                 return true;
@@ -1148,30 +1301,192 @@ bool WriteBlockToDisk(CBlock& block, CDiskBlockPos& pos)
     return true;
 }
 
+// Locate the record written at pos (after the message start and its size) in a
+// read-only mapping of its file, plus nTrailer bytes following it. Only files that
+// are no longer appended to are mapped; returns NULL if the caller should use stdio.
+static boost::shared_ptr<const CMappedFile> MapDiskRecord(const CDiskBlockPos &pos, const char *prefix, unsigned int nTrailer, const char *&pbegin, const char *&pend)
+{
+    boost::shared_ptr<const CMappedFile> pfile;
+    if (pos.IsNull() || pos.nPos < 8)
+        return pfile;
+    {
+        LOCK(cs_LastBlockFile);
+        if (pos.nFile >= nLastBlockFile)
+            return pfile;
+    }
+    pfile = blockFileCache.Get(prefix, pos.nFile, pos.nPos);
+    if (!pfile)
+        return pfile;
+    unsigned int nSize = 0;
+    try {
+        CSpanReader header(pfile->data() + pos.nPos - 8, pfile->data() + pos.nPos, SER_DISK, CLIENT_VERSION);
+        MessageStartChars pchMessageStart;
+        header >> FLATDATA(pchMessageStart) >> nSize;
+        if (memcmp(pchMessageStart, Params().MessageStart(), MESSAGE_START_SIZE))
+            return boost::shared_ptr<const CMappedFile>();
+    } catch (std::exception &e) {
+        return boost::shared_ptr<const CMappedFile>();
+    }
+    uint64_t nEnd = (uint64_t)pos.nPos + nSize + nTrailer;
+    if (nEnd > pfile->size()) {
+        // undo data may still be appended to older files; map again
+        pfile = blockFileCache.Get(prefix, pos.nFile, nEnd);
+        if (!pfile)
+            return pfile;
+    }
+    pbegin = pfile->data() + pos.nPos;
+    pend = pbegin + nSize + nTrailer;
+    return pfile;
+}
+
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos)
 {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein = CAutoFile(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (!filein)
-        return error("ReadBlockFromDisk : OpenBlockFile failed");
+    const char *pbegin, *pend;
+    boost::shared_ptr<const CMappedFile> pfile = MapDiskRecord(pos, "blk", 0, pbegin, pend);
+    if (pfile) {
+        // Deserialize straight from the mapped file
+        try {
+            CSpanReader(pbegin, pend, SER_DISK, CLIENT_VERSION) >> block;
+        }
+        catch (std::exception &e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    } else {
+        // Open history file to read
+        CAutoFile filein = CAutoFile(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+        if (!filein)
+            return error("ReadBlockFromDisk : OpenBlockFile failed");
+
+        // Read block
+        try {
+            filein >> block;
+        }
+        catch (std::exception &e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+
+    // Check the header
+    if (block.IsProofOfWork() && !CheckProofOfWork(block.GetHash(), block.nBits))
+        return error("ReadBlockFromDisk : Errors in block header");
 
-    // Read block
+    return true;
+}
+
+bool ReadRawBlockFromDisk(std::string& strBlock, const CDiskBlockPos& pos)
+{
+    const char *pbegin, *pend;
+    boost::shared_ptr<const CMappedFile> pfile = MapDiskRecord(pos, "blk", 0, pbegin, pend);
+    if (pfile) {
+        strBlock.append(pbegin, pend - pbegin);
+        return true;
+    }
+
+    // The size of the record precedes it
+    if (pos.IsNull() || pos.nPos < 8)
+        return error("%s : invalid position", __func__);
+    CAutoFile filein = CAutoFile(OpenBlockFile(CDiskBlockPos(pos.nFile, pos.nPos - 4), true), SER_DISK, CLIENT_VERSION);
+    if (!filein)
+        return error("%s : OpenBlockFile failed", __func__);
+    unsigned int nSize = 0;
     try {
-        filein >> block;
+        filein >> nSize;
     }
     catch (std::exception &e) {
         return error("%s : Deserialize or I/O error - %s", __func__, e.what());
     }
+    if (nSize == 0 || nSize > MAX_BLOCK_SIZE)
+        return error("%s : invalid block size %u", __func__, nSize);
+    size_t nOldSize = strBlock.size();
+    strBlock.resize(nOldSize + nSize);
+    if (fread(&strBlock[nOldSize], 1, nSize, filein) != nSize) {
+        strBlock.resize(nOldSize);
+        return error("%s : I/O error", __func__);
+    }
+    return true;
+}
 
-    // Check the header
-    if (block.IsProofOfWork() && !CheckProofOfWork(block.GetHash(), block.nBits))
-        return error("ReadBlockFromDisk : Errors in block header");
+bool ReadTransactionFromDisk(CTransaction& tx, uint256 &hashBlock, const CDiskTxPos &postx)
+{
+    CBlockHeader header;
+    const char *pbegin, *pend;
+    boost::shared_ptr<const CMappedFile> pfile = MapDiskRecord(postx, "blk", 0, pbegin, pend);
+    if (pfile) {
+        try {
+            CSpanReader reader(pbegin, pend, SER_DISK, CLIENT_VERSION);
+            reader >> header;
+            reader.ignore(postx.nTxOffset);
+            reader >> tx;
+        } catch (std::exception &e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    } else {
+        CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
+        if (!file)
+            return error("%s : OpenBlockFile failed", __func__);
+        try {
+            file >> header;
+            fseek(file, postx.nTxOffset, SEEK_CUR);
+            file >> tx;
+        } catch (std::exception &e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+    hashBlock = header.GetHash();
+    return true;
+}
+
+bool CBlockUndo::ReadFromDisk(const CDiskBlockPos &pos, const uint256 &hashBlock)
+{
+    // The checksum follows the undo data
+    uint256 hashChecksum;
+    const char *pbegin, *pend;
+    boost::shared_ptr<const CMappedFile> pfile = MapDiskRecord(pos, "rev", sizeof(hashChecksum), pbegin, pend);
+    if (pfile) {
+        try {
+            CSpanReader(pbegin, pend, SER_DISK, CLIENT_VERSION) >> *this >> hashChecksum;
+        }
+        catch (std::exception &e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    } else {
+        // Open history file to read
+        CAutoFile filein = CAutoFile(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
+        if (!filein)
+            return error("CBlockUndo::ReadFromDisk : OpenBlockFile failed");
+
+        // Read block
+        try {
+            filein >> *this;
+            filein >> hashChecksum;
+        }
+        catch (std::exception &e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+
+    // Verify checksum
+    CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
+    hasher << hashBlock;
+    hasher << *this;
+    if (hashChecksum != hasher.GetHash())
+        return error("CBlockUndo::ReadFromDisk : Checksum mismatch");
 
     return true;
 }
 
+bool ReadBlockFilter(const uint256 &hashBlock, CBlockFilter &filter)
+{
+    return pblockfilterdb && pblockfilterdb->ReadFilter(hashBlock, filter);
+}
+
+void SetMaxBlockFileMaps(unsigned int nMaxFiles)
+{
+    blockFileCache.SetMaxFiles(nMaxFiles);
+}
+
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex)
 {
     if (!ReadBlockFromDisk(block, pindex->GetBlockPos()))
@@ -1547,22 +1862,35 @@ void UpdateTime(CBlockHeader& block, const CBlockIndex* pindexPrev)
 
 
 
-void UpdateCoins(const CTransaction& tx, CValidationState &state, CCoinsViewCache &inputs, CTxUndo &txundo, int nHeight, const uint256 &txhash)
+void UpdateCoins(const CTransaction& tx, CValidationState &state, CCoinsViewCache &inputs, CTxUndo &txundo, int nHeight, const uint256 &txhash, CCoinsRunningStats *pstats)
 {
     bool ret;
     // mark inputs spent
     if (!tx.IsCoinBase()) {
         BOOST_FOREACH(const CTxIn &txin, tx.vin) {
             CCoins &coins = inputs.GetCoins(txin.prevout.hash);
+            if (pstats) {
+                pstats->ApplyTx(coins, -1);
+                pstats->ApplyOutput(txin.prevout, coins, -1);
+            }
             CTxInUndo undo;
             ret = coins.Spend(txin.prevout, undo);
             assert(ret);
             txundo.vprevout.push_back(undo);
+            if (pstats)
+                pstats->ApplyTx(coins, 1);
         }
     }
 
     // add outputs
-    ret = inputs.SetCoins(txhash, CCoins(tx, nHeight));
+    CCoins coinsNew(tx, nHeight);
+    if (pstats) {
+        // an unspent transaction with the same hash gets overwritten (see BIP30)
+        if (inputs.HaveCoins(txhash))
+            pstats->ApplyCoins(txhash, inputs.GetCoins(txhash), -1);
+        pstats->ApplyCoins(txhash, coinsNew, 1);
+    }
+    ret = inputs.SetCoins(txhash, coinsNew);
     assert(ret);
 }
 
@@ -1688,7 +2016,25 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, CCoinsViewCach
 
 
 
-bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool* pfClean)
+bool GetAddressIndexKey(const CScript &scriptPubKey, int &nType, uint160 &hashAddress)
+{
+    CTxDestination dest;
+    if (!ExtractDestination(scriptPubKey, dest))
+        return false;
+    if (const CKeyID *keyID = boost::get<CKeyID>(&dest)) {
+        nType = ADDRESS_INDEX_KEY;
+        hashAddress = *keyID;
+        return true;
+    }
+    if (const CScriptID *scriptID = boost::get<CScriptID>(&dest)) {
+        nType = ADDRESS_INDEX_SCRIPT;
+        hashAddress = *scriptID;
+        return true;
+    }
+    return false;
+}
+
+bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool* pfClean, CCoinsRunningStats *pstats)
 {
     assert(pindex->GetBlockHash() == view.GetBestBlock());
 
@@ -1707,6 +2053,10 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
     if (blockUndo.vtxundo.size() + 1 != block.vtx.size())
         return error("DisconnectBlock() : block and undo data inconsistent");
 
+    std::vector<std::pair<CAddressIndexKey, int64_t> > vAddressIndex;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vAddressUnspentIndex;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > vSpentIndex;
+
     // undo transactions in reverse order
     for (int i = block.vtx.size() - 1; i >= block.IsProofOfStake() ? 1 : 0; i--) {
         const CTransaction &tx = block.vtx[i];
@@ -1718,6 +2068,8 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
         // specially with outsEmpty.
         CCoins outsEmpty;
         CCoins &outs = view.HaveCoins(hash) ? view.GetCoins(hash) : outsEmpty;
+        if (pstats)
+            pstats->ApplyCoins(hash, outs, -1);
         outs.ClearUnspendable();
 
         CCoins outsBlock = CCoins(tx, pindex->nHeight);
@@ -1729,6 +2081,17 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
         if (outs != outsBlock)
             fClean = fClean && error("DisconnectBlock() : added transaction mismatch? database corrupted");
 
+        if (fAddressIndex) {
+            for (unsigned int k = 0; k < tx.vout.size(); k++) {
+                int nType;
+                uint160 hashAddress;
+                if (!GetAddressIndexKey(tx.vout[k].scriptPubKey, nType, hashAddress))
+                    continue;
+                vAddressIndex.push_back(std::make_pair(CAddressIndexKey(nType, hashAddress, pindex->nHeight, hash, k, false), tx.vout[k].nValue));
+                vAddressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(nType, hashAddress, hash, k), CAddressUnspentValue()));
+            }
+        }
+
         // remove outputs
         outs = CCoins();
 
@@ -1742,6 +2105,8 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
                 const CTxInUndo &undo = txundo.vprevout[j];
                 CCoins coins;
                 view.GetCoins(out.hash, coins); // this can fail if the prevout was already entirely spent
+                if (pstats)
+                    pstats->ApplyTx(coins, -1);
                 if (undo.nHeight != 0) {
                     // undo data contains height: this is the last output of the prevout tx being spent
                     if (!coins.IsPruned())
@@ -1759,12 +2124,35 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
                 if (coins.vout.size() < out.n+1)
                     coins.vout.resize(out.n+1);
                 coins.vout[out.n] = undo.txout;
+                if (pstats) {
+                    pstats->ApplyTx(coins, 1);
+                    pstats->ApplyOutput(out, coins, 1);
+                }
                 if (!view.SetCoins(out.hash, coins))
                     return error("DisconnectBlock() : cannot restore coin inputs");
+
+                int nType;
+                uint160 hashAddress;
+                if (fAddressIndex && GetAddressIndexKey(undo.txout.scriptPubKey, nType, hashAddress)) {
+                    vAddressIndex.push_back(std::make_pair(CAddressIndexKey(nType, hashAddress, pindex->nHeight, hash, j, true), -undo.txout.nValue));
+                    vAddressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(nType, hashAddress, out.hash, out.n),
+                                                                  CAddressUnspentValue(undo.txout.nValue, undo.txout.scriptPubKey, coins.nHeight)));
+                }
+                if (fSpentIndex)
+                    vSpentIndex.push_back(std::make_pair(CSpentIndexKey(out.hash, out.n), CSpentIndexValue()));
             }
         }
     }
 
+    // a memory-only disconnect (pfClean set, as by VerifyDB) must leave the indexes alone
+    if (fAddressIndex && !pfClean) {
+        if (!pblocktree->EraseAddressIndex(vAddressIndex) || !pblocktree->UpdateAddressUnspentIndex(vAddressUnspentIndex))
+            return state.Abort(_("Failed to write address index"));
+    }
+    if (fSpentIndex && !pfClean)
+        if (!pblocktree->UpdateSpentIndex(vSpentIndex))
+            return state.Abort(_("Failed to write spent index"));
+
     // move best block pointer to prevout block
     view.SetBestBlock(pindex->pprev->GetBlockHash());
 
@@ -1782,6 +2170,12 @@ void static FlushBlockFile(bool fFinalize = false)
 
     CDiskBlockPos posOld(nLastBlockFile, 0);
 
+    // the file is not supposed to be mapped yet, but never keep a mapping past a truncation
+    if (fFinalize) {
+        blockFileCache.Invalidate("blk", nLastBlockFile);
+        blockFileCache.Invalidate("rev", nLastBlockFile);
+    }
+
     FILE *fileOld = OpenBlockFile(posOld);
     if (fileOld) {
         if (fFinalize)
@@ -1808,7 +2202,119 @@ void ThreadScriptCheck() {
     scriptcheckqueue.Thread();
 }
 
-bool ConnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool fJustCheck)
+static CCriticalSection cs_blockfilterstatus;
+static int nBlockFilterHeight = -1;
+static bool fBlockFilterSynced = false;
+static std::string strBlockFilterError;
+
+static void SetBlockFilterIndexStatus(const CBlockIndex *pindexLast, bool fSynced, const std::string &strError = "")
+{
+    LOCK(cs_blockfilterstatus);
+    nBlockFilterHeight = pindexLast ? pindexLast->nHeight : -1;
+    fBlockFilterSynced = fSynced;
+    strBlockFilterError = strError;
+}
+
+bool GetBlockFilterIndexStatus(int &nHeight, std::string &strError)
+{
+    LOCK(cs_blockfilterstatus);
+    nHeight = nBlockFilterHeight;
+    strError = strBlockFilterError;
+    return fBlockFilterSynced;
+}
+
+CBlockFilterIndexer::CBlockFilterIndexer(CBlockFilterDB &dbIn, const CChain &chainIn) :
+    db(dbIn), chain(chainIn), pindexLast(NULL), pindexHeader(NULL), hashHeader(0)
+{
+    // the filter header of the best block is read before indexing on from it
+    uint256 hashBest;
+    if (db.ReadBestBlock(hashBest)) {
+        LOCK(cs_main);
+        map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashBest);
+        if (mi != mapBlockIndex.end())
+            pindexLast = mi->second;
+    }
+}
+
+bool CBlockFilterIndexer::Step(unsigned int nMaxBlocks, unsigned int &nIndexed, std::string &strError)
+{
+    nIndexed = 0;
+    std::vector<CBlockIndex*> vIndex;
+    {
+        LOCK(cs_main);
+        // continue from the fork point if the chain was reorganized
+        while (pindexLast && !chain.Contains(pindexLast))
+            pindexLast = pindexLast->pprev;
+        if (pindexLast != pindexHeader) {
+            // start over if the header to chain from is missing
+            if (!pindexLast || !db.ReadFilterHeader(pindexLast->GetBlockHash(), hashHeader)) {
+                pindexLast = NULL;
+                hashHeader = 0;
+            }
+            pindexHeader = pindexLast;
+        }
+        CBlockIndex *pindex = pindexLast ? chain.Next(pindexLast) : chain.Genesis();
+        for (; pindex && vIndex.size() < nMaxBlocks; pindex = chain.Next(pindex))
+            vIndex.push_back(pindex);
+    }
+    if (vIndex.empty())
+        return true;
+
+    std::vector<std::pair<CBlockFilter, uint256> > vFilters;
+    uint256 hashHeaderNew = hashHeader;
+    BOOST_FOREACH(CBlockIndex *pindex, vIndex) {
+        CBlock block;
+        CBlockUndo blockundo;
+        if (!ReadBlockFromDisk(block, pindex) ||
+            (pindex->pprev && !blockundo.ReadFromDisk(pindex->GetUndoPos(), pindex->pprev->GetBlockHash()))) {
+            strError = strprintf("unable to read block %s", pindex->GetBlockHash().ToString());
+            return false;
+        }
+        CBlockFilter filter(block, blockundo);
+        hashHeaderNew = filter.ComputeHeader(hashHeaderNew);
+        vFilters.push_back(make_pair(filter, hashHeaderNew));
+    }
+    if (!db.WriteFilters(vFilters, vIndex.back()->GetBlockHash())) {
+        strError = "unable to write filters";
+        return false;
+    }
+    pindexLast = pindexHeader = vIndex.back();
+    hashHeader = hashHeaderNew;
+    nIndexed = vIndex.size();
+    return true;
+}
+
+void ThreadBlockFilterIndex()
+{
+    RenameThread("reddcoin-filter");
+
+    CBlockFilterIndexer indexer(*pblockfilterdb, chainActive);
+    bool fSynced = false;
+    while (true) {
+        boost::this_thread::interruption_point();
+
+        unsigned int nIndexed;
+        std::string strError;
+        if (!indexer.Step(BLOCK_FILTER_INDEX_BATCH_SIZE, nIndexed, strError)) {
+            error("ThreadBlockFilterIndex() : %s, stopping", strError);
+            SetBlockFilterIndexStatus(indexer.GetLast(), false, strError);
+            return;
+        }
+        const CBlockIndex *pindexLast = indexer.GetLast();
+        if (nIndexed == 0) {
+            if (!fSynced)
+                LogPrintf("Block filter index synchronized at height %d\n", pindexLast ? pindexLast->nHeight : -1);
+            fSynced = true;
+            SetBlockFilterIndexStatus(pindexLast, true);
+            MilliSleep(1000);
+            continue;
+        }
+        SetBlockFilterIndexStatus(pindexLast, false);
+        LogPrint("blockfilter", "Block filter index at height %d\n", pindexLast->nHeight);
+    }
+}
+
+bool ConnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool fJustCheck, CCoinsRunningStats *pstats)
 {
     AssertLockHeld(cs_main);
     // Check it again in case a previous version let a bad block in
@@ -1860,6 +2366,9 @@ bool ConnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, C
     CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
     std::vector<std::pair<uint256, CDiskTxPos> > vPos;
     vPos.reserve(block.vtx.size());
+    std::vector<std::pair<CAddressIndexKey, int64_t> > vAddressIndex;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vAddressUnspentIndex;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > vSpentIndex;
 
     // PoSV
     int64_t nValueIn = 0;
@@ -1907,10 +2416,41 @@ bool ConnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, C
             if (!CheckInputs(tx, state, view, fScriptChecks, flags, nScriptCheckThreads ? &vChecks : NULL))
                 return false;
             control.Add(vChecks);
+
+            if (!fJustCheck && (fAddressIndex || fSpentIndex)) {
+                const uint256 &hash = block.GetTxHash(i);
+                for (unsigned int j = 0; j < tx.vin.size(); j++) {
+                    const COutPoint &out = tx.vin[j].prevout;
+                    const CTxOut prevout = view.GetOutputFor(tx.vin[j]);
+                    int nType = 0;
+                    uint160 hashAddress = 0;
+                    bool fAddress = GetAddressIndexKey(prevout.scriptPubKey, nType, hashAddress);
+                    if (fAddressIndex && fAddress) {
+                        vAddressIndex.push_back(std::make_pair(CAddressIndexKey(nType, hashAddress, pindex->nHeight, hash, j, true), -prevout.nValue));
+                        vAddressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(nType, hashAddress, out.hash, out.n), CAddressUnspentValue()));
+                    }
+                    if (fSpentIndex)
+                        vSpentIndex.push_back(std::make_pair(CSpentIndexKey(out.hash, out.n),
+                                                             CSpentIndexValue(hash, j, pindex->nHeight, prevout.nValue, nType, hashAddress)));
+                }
+            }
+        }
+
+        if (!fJustCheck && fAddressIndex) {
+            const uint256 &hash = block.GetTxHash(i);
+            for (unsigned int k = 0; k < tx.vout.size(); k++) {
+                int nType;
+                uint160 hashAddress;
+                if (!GetAddressIndexKey(tx.vout[k].scriptPubKey, nType, hashAddress))
+                    continue;
+                vAddressIndex.push_back(std::make_pair(CAddressIndexKey(nType, hashAddress, pindex->nHeight, hash, k, false), tx.vout[k].nValue));
+                vAddressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(nType, hashAddress, hash, k),
+                                                              CAddressUnspentValue(tx.vout[k].nValue, tx.vout[k].scriptPubKey, pindex->nHeight)));
+            }
         }
 
         CTxUndo txundo;
-        UpdateCoins(tx, state, view, txundo, pindex->nHeight, block.GetTxHash(i));
+        UpdateCoins(tx, state, view, txundo, pindex->nHeight, block.GetTxHash(i), pstats);
         if (!tx.IsCoinBase())
             blockundo.vtxundo.push_back(txundo);
 
@@ -1949,7 +2489,14 @@ bool ConnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, C
         return state.DoS(100, false);
     int64_t nTime2 = GetTimeMicros() - nStart;
     if (fBenchmark)
+    {
         LogPrintf("- Verify %u txins: %.2fms (%.3fms/txin)\n", nInputs - 1, 0.001 * nTime2, nInputs <= 1 ? 0 : 0.001 * nTime2 / (nInputs-1));
+        unsigned int nKeys;
+        uint64_t nHits, nMisses;
+        ECC_GetPubKeyCacheStats(nKeys, nHits, nMisses);
+        LogPrintf("- Public key cache: %u keys, %d hits, %d misses (%.1f%% hit rate)\n", nKeys, nHits, nMisses,
+                  nHits + nMisses == 0 ? 0.0 : 100.0 * nHits / (nHits + nMisses));
+    }
 
     if (fJustCheck)
         return true;
@@ -1980,14 +2527,21 @@ bool ConnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, C
         if (!pblocktree->WriteTxIndex(vPos))
             return state.Abort(_("Failed to write transaction index"));
 
+    if (fAddressIndex) {
+        if (!pblocktree->WriteAddressIndex(vAddressIndex) || !pblocktree->UpdateAddressUnspentIndex(vAddressUnspentIndex))
+            return state.Abort(_("Failed to write address index"));
+    }
+    if (fSpentIndex)
+        if (!pblocktree->UpdateSpentIndex(vSpentIndex))
+            return state.Abort(_("Failed to write spent index"));
+
     // add this block to the view's block chain
     bool ret;
     ret = view.SetBestBlock(pindex->GetBlockHash());
     assert(ret);
 
     // Watch for transactions paying to me
-    for (unsigned int i = 0; i < block.vtx.size(); i++)
-        g_signals.SyncTransaction(block.GetTxHash(i), block.vtx[i], &block);
+    g_signals.SyncBlock(block);
 
     return true;
 }
@@ -2059,12 +2613,17 @@ bool static DisconnectTip(CValidationState &state) {
         return state.Abort(_("Failed to read block"));
     // Apply the block atomically to the chain state.
     int64_t nStart = GetTimeMicros();
+    CCoinsRunningStats statsDelta;
     {
         CCoinsViewCache view(*pcoinsTip, true);
-        if (!DisconnectBlock(block, state, pindexDelete, view))
+        if (!DisconnectBlock(block, state, pindexDelete, view, NULL, fCoinStatsTip ? &statsDelta : NULL))
             return error("DisconnectTip() : DisconnectBlock %s failed", pindexDelete->GetBlockHash().ToString());
         assert(view.Flush());
     }
+    if (fCoinStatsTip) {
+        coinStatsTip.Add(statsDelta);
+        coinStatsTip.hashBlock = pindexDelete->pprev->GetBlockHash();
+    }
     if (fBenchmark)
         LogPrintf("- Disconnect: %.2fms\n", (GetTimeMicros() - nStart) * 0.001);
     // Write the chain state to disk, if necessary.
@@ -2110,10 +2669,11 @@ bool static ConnectTip(CValidationState &state, CBlockIndex *pindexNew) {
         return state.Abort(_("Failed to read block"));
     // Apply the block atomically to the chain state.
     int64_t nStart = GetTimeMicros();
+    CCoinsRunningStats statsDelta;
     {
         CCoinsViewCache view(*pcoinsTip, true);
         CInv inv(MSG_BLOCK, pindexNew->GetBlockHash());
-        if (!ConnectBlock(block, state, pindexNew, view)) {
+        if (!ConnectBlock(block, state, pindexNew, view, false, fCoinStatsTip ? &statsDelta : NULL)) {
             if (state.IsInvalid())
                 InvalidBlockFound(pindexNew, state);
             return error("ConnectTip() : ConnectBlock %s failed", pindexNew->GetBlockHash().ToString());
@@ -2121,6 +2681,10 @@ bool static ConnectTip(CValidationState &state, CBlockIndex *pindexNew) {
         mapBlockSource.erase(inv.hash);
         assert(view.Flush());
     }
+    if (fCoinStatsTip) {
+        coinStatsTip.Add(statsDelta);
+        coinStatsTip.hashBlock = pindexNew->GetBlockHash();
+    }
     if (fBenchmark)
         LogPrintf("- Connect: %.2fms\n", (GetTimeMicros() - nStart) * 0.001);
     // Write the chain state to disk, if necessary.
@@ -3088,6 +3652,12 @@ bool static LoadBlockIndexDB()
     pblocktree->ReadFlag("txindex", fTxIndex);
     LogPrintf("LoadBlockIndexDB(): transaction index %s\n", fTxIndex ? "enabled" : "disabled");
 
+    // Check whether we have an address index and a spent index
+    pblocktree->ReadFlag("addressindex", fAddressIndex);
+    LogPrintf("LoadBlockIndexDB(): address index %s\n", fAddressIndex ? "enabled" : "disabled");
+    pblocktree->ReadFlag("spentindex", fSpentIndex);
+    LogPrintf("LoadBlockIndexDB(): spent index %s\n", fSpentIndex ? "enabled" : "disabled");
+
     // Load pointer to end of best chain
     std::map<uint256, CBlockIndex*>::iterator it = mapBlockIndex.find(pcoinsTip->GetBestBlock());
     if (it == mapBlockIndex.end())
@@ -3181,6 +3751,54 @@ void UnloadBlockIndex()
     setBlockIndexValid.clear();
     chainActive.SetTip(NULL);
     pindexBestInvalid = NULL;
+    blockFileCache.Clear();
+    coinStatsTip = CCoinsRunningStats();
+    fCoinStatsTip = false;
+}
+
+// Pick up the UTXO set statistics saved with the coin database, if they match its best block
+void static LoadCoinStatsTip()
+{
+    coinStatsTip = CCoinsRunningStats();
+    fCoinStatsTip = false;
+    if (GetBoolArg("-coinstats", true)) {
+        uint256 hashBest = pcoinsTip->GetBestBlock();
+        if (hashBest == 0) {
+            // empty coin database: the statistics start out empty as well
+            fCoinStatsTip = true;
+        } else if (pcoinsdbview->ReadRunningStats(coinStatsTip) && coinStatsTip.hashBlock == hashBest) {
+            fCoinStatsTip = true;
+        } else {
+            coinStatsTip = CCoinsRunningStats();
+            LogPrintf("UTXO set statistics not saved for the best block; they will be computed on first use\n");
+        }
+    }
+    pcoinsdbview->SetRunningStats(fCoinStatsTip ? &coinStatsTip : NULL);
+}
+
+bool GetCoinStatsTip(CCoinsRunningStats &stats)
+{
+    AssertLockHeld(cs_main);
+    if (!fCoinStatsTip)
+        return false;
+    stats = coinStatsTip;
+    return true;
+}
+
+bool ComputeCoinStatsTip(CCoinsRunningStats &stats, int nThreads)
+{
+    AssertLockHeld(cs_main);
+    // the scan sees the database only
+    if (!pcoinsTip->Flush())
+        return false;
+    if (!pcoinsdbview->GetRunningStats(stats, nThreads))
+        return false;
+    if (GetBoolArg("-coinstats", true)) {
+        coinStatsTip = stats;
+        fCoinStatsTip = true;
+        pcoinsdbview->SetRunningStats(&coinStatsTip);
+    }
+    return true;
 }
 
 bool LoadBlockIndex()
@@ -3188,6 +3806,7 @@ bool LoadBlockIndex()
     // Load block index from databases
     if (!fReindex && !LoadBlockIndexDB())
         return false;
+    LoadCoinStatsTip();
     return true;
 }
 
@@ -3198,9 +3817,13 @@ bool InitBlockIndex() {
     if (chainActive.Genesis() != NULL)
         return true;
 
-    // Use the provided setting for -txindex in the new database
+    // Use the provided settings for -txindex, -addressindex and -spentindex in the new database
     fTxIndex = GetBoolArg("-txindex", true);
     pblocktree->WriteFlag("txindex", fTxIndex);
+    fAddressIndex = GetBoolArg("-addressindex", false);
+    pblocktree->WriteFlag("addressindex", fAddressIndex);
+    fSpentIndex = GetBoolArg("-spentindex", false);
+    pblocktree->WriteFlag("spentindex", fSpentIndex);
     LogPrintf("Initializing databases...\n");
 
     // Only add the genesis block if not reindexing (in which case we reuse the one already on disk)
@@ -3597,7 +4220,38 @@ void static ProcessGetData(CNode* pfrom)
     }
 }
 
-bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
+// Block at which a request for compact filters of nFilterType stops, if it is
+// served and in the main chain
+static CBlockIndex* GetFilterRequestStop(unsigned char nFilterType, const uint256& hashStop)
+{
+    AssertLockHeld(cs_main);
+    if (!pblockfilterdb || !(nLocalServices & NODE_COMPACT_FILTERS) || nFilterType != BLOCK_FILTER_BASIC)
+        return NULL;
+    map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashStop);
+    if (mi == mapBlockIndex.end() || !chainActive.Contains(mi->second))
+        return NULL;
+    return mi->second;
+}
+
+// Blocks from nStartHeight to hashStop requested by a getcfilters or getcfheaders
+static bool GetFilterRequestBlocks(CNode* pfrom, unsigned char nFilterType, unsigned int nStartHeight, const uint256& hashStop,
+                                   unsigned int nMaxSize, vector<CBlockIndex*>& vIndex)
+{
+    LOCK(cs_main);
+    CBlockIndex* pindexStop = GetFilterRequestStop(nFilterType, hashStop);
+    if (!pindexStop)
+        return false;
+    if (nStartHeight > (unsigned int)pindexStop->nHeight || pindexStop->nHeight - nStartHeight >= nMaxSize)
+    {
+        Misbehaving(pfrom->GetId(), 10);
+        return false;
+    }
+    for (int nHeight = nStartHeight; nHeight <= pindexStop->nHeight; nHeight++)
+        vIndex.push_back(chainActive[nHeight]);
+    return true;
+}
+
+bool static ProcessMessage(CNode* pfrom, string strCommand, CSpanReader& vRecv)
 {
     RandAddSeedPerfmon();
     LogPrint("net", "received: %s (%u bytes)\n", strCommand, vRecv.size());
@@ -3940,10 +4594,88 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
     }
 
 
+    else if (strCommand == "getcfilters")
+    {
+        unsigned char nFilterType;
+        unsigned int nStartHeight;
+        uint256 hashStop;
+        vRecv >> nFilterType >> nStartHeight >> hashStop;
+
+        vector<CBlockIndex*> vIndex;
+        if (GetFilterRequestBlocks(pfrom, nFilterType, nStartHeight, hashStop, MAX_GETCFILTERS_SIZE, vIndex))
+        {
+            BOOST_FOREACH(CBlockIndex* pindex, vIndex)
+            {
+                CBlockFilter filter;
+                if (!pblockfilterdb->ReadFilter(pindex->GetBlockHash(), filter))
+                    break; // not indexed yet
+                pfrom->PushMessage("cfilter", nFilterType, pindex->GetBlockHash(), filter.GetEncoded());
+            }
+        }
+    }
+
+
+    else if (strCommand == "getcfheaders")
+    {
+        unsigned char nFilterType;
+        unsigned int nStartHeight;
+        uint256 hashStop;
+        vRecv >> nFilterType >> nStartHeight >> hashStop;
+
+        vector<CBlockIndex*> vIndex;
+        if (GetFilterRequestBlocks(pfrom, nFilterType, nStartHeight, hashStop, MAX_GETCFHEADERS_SIZE, vIndex))
+        {
+            uint256 hashPrevHeader = 0;
+            bool fFound = vIndex[0]->pprev == NULL ||
+                          pblockfilterdb->ReadFilterHeader(vIndex[0]->pprev->GetBlockHash(), hashPrevHeader);
+            vector<uint256> vFilterHashes;
+            BOOST_FOREACH(CBlockIndex* pindex, vIndex)
+            {
+                CBlockFilter filter;
+                if (!fFound || !pblockfilterdb->ReadFilter(pindex->GetBlockHash(), filter))
+                {
+                    fFound = false;
+                    break;
+                }
+                vFilterHashes.push_back(filter.GetHash());
+            }
+            if (fFound)
+                pfrom->PushMessage("cfheaders", nFilterType, hashStop, hashPrevHeader, vFilterHashes);
+        }
+    }
+
+
+    else if (strCommand == "getcfcheckpt")
+    {
+        unsigned char nFilterType;
+        uint256 hashStop;
+        vRecv >> nFilterType >> hashStop;
+
+        // Filter headers at every CFCHECKPT_INTERVAL blocks up to hashStop
+        bool fServed = false;
+        vector<uint256> vBlocks;
+        {
+            LOCK(cs_main);
+            CBlockIndex* pindexStop = GetFilterRequestStop(nFilterType, hashStop);
+            fServed = pindexStop != NULL;
+            for (int nHeight = CFCHECKPT_INTERVAL; fServed && nHeight <= pindexStop->nHeight; nHeight += CFCHECKPT_INTERVAL)
+                vBlocks.push_back(chainActive[nHeight]->GetBlockHash());
+        }
+        vector<uint256> vHeaders;
+        BOOST_FOREACH(const uint256& hashBlock, vBlocks)
+        {
+            uint256 hashHeader;
+            if (!pblockfilterdb->ReadFilterHeader(hashBlock, hashHeader))
+                break;
+            vHeaders.push_back(hashHeader);
+        }
+        if (fServed && vHeaders.size() == vBlocks.size())
+            pfrom->PushMessage("cfcheckpt", nFilterType, hashStop, vHeaders);
+    }
+
+
     else if (strCommand == "tx")
     {
-        vector<uint256> vWorkQueue;
-        vector<uint256> vEraseQueue;
         CTransaction tx;
         vRecv >> tx;
 
@@ -3959,8 +4691,6 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
             mempool.check(pcoinsTip);
             RelayTransaction(tx, inv.hash);
             mapAlreadyAskedFor.erase(inv);
-            vWorkQueue.push_back(inv.hash);
-            vEraseQueue.push_back(inv.hash);
 
 
             LogPrint("mempool", "AcceptToMemoryPool: %s %s : accepted %s (poolsz %u)\n",
@@ -3968,56 +4698,12 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
                 tx.GetHash().ToString(),
                 mempool.mapTx.size());
 
-            // Recursively process any orphan transactions that depended on this one
-            set<NodeId> setMisbehaving;
-            for (unsigned int i = 0; i < vWorkQueue.size(); i++)
-            {
-                map<uint256, set<uint256> >::iterator itByPrev = mapOrphanTransactionsByPrev.find(vWorkQueue[i]);
-                if (itByPrev == mapOrphanTransactionsByPrev.end())
-                    continue;
-                for (set<uint256>::iterator mi = itByPrev->second.begin();
-                     mi != itByPrev->second.end();
-                     ++mi)
-                {
-                    const uint256& orphanHash = *mi;
-                    const CTransaction& orphanTx = mapOrphanTransactions[orphanHash].tx;
-                    NodeId fromPeer = mapOrphanTransactions[orphanHash].fromPeer;
-                    bool fMissingInputs2 = false;
-                    // Use a dummy CValidationState so someone can't setup nodes to counter-DoS based on orphan
-                    // resolution (that is, feeding people an invalid transaction based on LegitTxX in order to get
-                    // anyone relaying LegitTxX banned)
-                    CValidationState stateDummy;
-
-                    vEraseQueue.push_back(orphanHash);
-
-                    if (setMisbehaving.count(fromPeer))
-                        continue;
-                    if (AcceptToMemoryPool(mempool, stateDummy, orphanTx, true, &fMissingInputs2))
-                    {
-                        LogPrint("mempool", "   accepted orphan tx %s\n", orphanHash.ToString());
-                        RelayTransaction(orphanTx, orphanHash);
-                        mapAlreadyAskedFor.erase(CInv(MSG_TX, orphanHash));
-                        vWorkQueue.push_back(orphanHash);
-                    }
-                    else if (!fMissingInputs2)
-                    {
-                        int nDos = 0;
-                        if (stateDummy.IsInvalid(nDos) && nDos > 0)
-                        {
-                            // Punish peer that gave us an invalid orphan tx
-                            Misbehaving(fromPeer, nDos);
-                            setMisbehaving.insert(fromPeer);
-                            LogPrint("mempool", "   invalid orphan tx %s\n", orphanHash.ToString());
-                        }
-                        // too-little-fee orphan
-                        LogPrint("mempool", "   removed orphan tx %s\n", orphanHash.ToString());
-                    }
-                    mempool.check(pcoinsTip);
-                }
-            }
-
-            BOOST_FOREACH(uint256 hash, vEraseQueue)
-                EraseOrphanTx(hash);
+            // Process orphan transactions that depended on this one. Whatever
+            // does not fit in this batch is worked off from SendMessages, so a
+            // long chain of dependents does not stall message processing.
+            EraseOrphanTx(inv.hash);
+            QueueOrphanWork(inv.hash);
+            ProcessOrphanWork(MAX_ORPHAN_WORK_PER_MESSAGE);
         }
         else if (fMissingInputs)
         {
@@ -4025,7 +4711,12 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
 
             // DoS prevention: do not allow mapOrphanTransactions to grow unbounded
             unsigned int nMaxOrphanTx = (unsigned int)std::max((int64_t)0, GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
-            unsigned int nEvicted = LimitOrphanTxSize(nMaxOrphanTx);
+            unsigned int nMaxOrphanTxPeer = (unsigned int)std::max((int64_t)0, GetArg("-maxorphantxperpeer", DEFAULT_MAX_ORPHAN_TRANSACTIONS_PER_PEER));
+            size_t nMaxOrphanTxSize = (size_t)std::max((int64_t)0, GetArg("-maxorphantxsize", DEFAULT_MAX_ORPHAN_TRANSACTIONS_SIZE)) * 1000;
+            unsigned int nEvicted = ExpireOrphanTx(GetTime());
+            nEvicted += LimitOrphanTxForPeer(pfrom->GetId(), nMaxOrphanTxPeer);
+            nEvicted += LimitOrphanTxSize(nMaxOrphanTx);
+            nEvicted += LimitOrphanTxMemory(nMaxOrphanTxSize);
             if (nEvicted > 0)
                 LogPrint("mempool", "mapOrphan overflow, removed %u tx\n", nEvicted);
         }
@@ -4354,8 +5045,7 @@ bool ProcessMessages(CNode* pfrom)
         unsigned int nMessageSize = hdr.nMessageSize;
 
         // Checksum
-        CDataStream& vRecv = msg.vRecv;
-        uint256 hash = Hash(vRecv.begin(), vRecv.begin() + nMessageSize);
+        uint256 hash = Hash(msg.vRecv.begin(), msg.vRecv.begin() + nMessageSize);
         unsigned int nChecksum = 0;
         memcpy(&nChecksum, &hash, sizeof(nChecksum));
         if (nChecksum != hdr.nChecksum)
@@ -4369,6 +5059,7 @@ bool ProcessMessages(CNode* pfrom)
         bool fRet = false;
         try
         {
+            CSpanReader vRecv = msg.GetDataReader();
             fRet = ProcessMessage(pfrom, strCommand, vRecv);
             boost::this_thread::interruption_point();
         }
@@ -4454,6 +5145,9 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
         if (!lockMain)
             return true;
 
+        // Resolve orphan transaction chains left over from earlier "tx" messages
+        ProcessOrphanWork(MAX_ORPHAN_WORK_PER_MESSAGE);
+
         // Address refresh broadcast
         static int64_t nLastRebroadcast;
         if (!IsInitialBlockDownload() && (GetTime() - nLastRebroadcast > 24 * 60 * 60))
@@ -4661,5 +5355,8 @@ public:
         // orphan transactions
         mapOrphanTransactions.clear();
         mapOrphanTransactionsByPrev.clear();
+        mapOrphanTransactionsByPeer.clear();
+        nOrphanTransactionsSize = 0;
+        queueOrphanWork.clear();
     }
 } instance_of_cmaincleanup;
@@ -46,6 +46,16 @@ static const unsigned int MAX_STANDARD_TX_SIZE = 100000;
 static const unsigned int MAX_BLOCK_SIGOPS = MAX_BLOCK_SIZE/50;
 /** Default for -maxorphantx, maximum number of orphan transactions kept in memory */
 static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS = 100;
+/** Default for -maxorphantxperpeer, maximum number of orphan transactions kept per peer */
+static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS_PER_PEER = 25;
+/** Default for -maxorphantxsize, maximum total size of orphan transactions kept in memory (kB) */
+static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS_SIZE = 1000;
+/** Seconds an orphan transaction is kept before it expires */
+static const int64_t ORPHAN_TX_EXPIRE_TIME = 20 * 60;
+/** Minimum seconds between two sweeps for expired orphan transactions */
+static const int64_t ORPHAN_TX_EXPIRE_INTERVAL = 5 * 60;
+/** Maximum number of orphan transactions revalidated per message handler pass */
+static const unsigned int MAX_ORPHAN_WORK_PER_MESSAGE = 100;
 /** Default for -maxorphanblocks, maximum number of orphan blocks kept in memory */
 static const unsigned int DEFAULT_MAX_ORPHAN_BLOCKS = 750;
 /** The maximum size of a blk?????.dat file (since 0.8) */
@@ -101,6 +111,8 @@ extern bool fReindex;
 extern bool fBenchmark;
 extern int nScriptCheckThreads;
 extern bool fTxIndex;
+extern bool fAddressIndex;
+extern bool fSpentIndex;
 extern unsigned int nCoinCacheSize;
 
 // Reddcoin PoSV
@@ -114,7 +126,10 @@ static const uint64_t nMinDiskSpace = 52428800;
 
 
 class CCoinsDB;
+class CBlockFilter;
+class CBlockFilterDB;
 class CBlockTreeDB;
+class CCoinsViewDB;
 struct CDiskBlockPos;
 class CTxUndo;
 class CScriptCheck;
@@ -156,6 +171,11 @@ bool InitBlockIndex();
 bool LoadBlockIndex();
 /** Unload database information */
 void UnloadBlockIndex();
+/** Get the statistics of the UTXO set at the tip maintained as blocks are (dis)connected; false if not available */
+bool GetCoinStatsTip(CCoinsRunningStats &stats);
+/** Compute the statistics of the UTXO set at the tip by a scan of the coin database using nThreads threads.
+ *  The result replaces the maintained statistics, if enabled. */
+bool ComputeCoinStatsTip(CCoinsRunningStats &stats, int nThreads);
 /** Verify consistency of the block and coin databases */
 bool VerifyDB(int nCheckLevel, int nCheckDepth);
 /** Print the loaded block tree */
@@ -166,6 +186,10 @@ bool ProcessMessages(CNode* pfrom);
 bool SendMessages(CNode* pto, bool fSendTrickle);
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Build the compact block filter index from the block and undo files, and keep it up to date */
+void ThreadBlockFilterIndex();
+/** Height the block filter index reached, whether it caught up with the tip, and why it stopped if it did */
+bool GetBlockFilterIndexStatus(int &nHeight, std::string &strError);
 /** Check whether a block hash satisfies the proof-of-work requirement specified by nBits */
 bool CheckProofOfWork(uint256 hash, unsigned int nBits);
 /** Calculate the minimum amount of work a received block needs, without knowing its direct parent */
@@ -323,7 +347,8 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, CCoinsViewCach
                  std::vector<CScriptCheck> *pvChecks = NULL);
 
 // Apply the effects of this transaction on the UTXO set represented by view
-void UpdateCoins(const CTransaction& tx, CValidationState &state, CCoinsViewCache &inputs, CTxUndo &txundo, int nHeight, const uint256 &txhash);
+// If pstats is not NULL, the resulting change of the UTXO set statistics is accumulated in it.
+void UpdateCoins(const CTransaction& tx, CValidationState &state, CCoinsViewCache &inputs, CTxUndo &txundo, int nHeight, const uint256 &txhash, CCoinsRunningStats *pstats = NULL);
 
 // Context-independent validity checks
 bool CheckTransaction(const CTransaction& tx, CValidationState& state);
@@ -380,32 +405,8 @@ public:
         return true;
     }
 
-    bool ReadFromDisk(const CDiskBlockPos &pos, const uint256 &hashBlock)
-    {
-        // Open history file to read
-        CAutoFile filein = CAutoFile(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
-        if (!filein)
-            return error("CBlockUndo::ReadFromDisk : OpenBlockFile failed");
-
-        // Read block
-        uint256 hashChecksum;
-        try {
-            filein >> *this;
-            filein >> hashChecksum;
-        }
-        catch (std::exception &e) {
-            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
-        }
-
-        // Verify checksum
-        CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
-        hasher << hashBlock;
-        hasher << *this;
-        if (hashChecksum != hasher.GetHash())
-            return error("CBlockUndo::ReadFromDisk : Checksum mismatch");
-
-        return true;
-    }
+    // Read the undo data at pos; finalized undo files are read through a memory mapping
+    bool ReadFromDisk(const CDiskBlockPos &pos, const uint256 &hashBlock);
 };
 
 
@@ -599,6 +600,16 @@ public:
 bool WriteBlockToDisk(CBlock& block, CDiskBlockPos& pos);
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex);
+// Append the serialized block at pos to strBlock as it is stored, without deserializing it
+bool ReadRawBlockFromDisk(std::string& strBlock, const CDiskBlockPos& pos);
+// Read a single transaction, and the hash of the block containing it, at a -txindex position
+bool ReadTransactionFromDisk(CTransaction& tx, uint256 &hashBlock, const CDiskTxPos &postx);
+// Keep at most nMaxFiles finalized block and undo files mapped for reading (0 disables mapping)
+void SetMaxBlockFileMaps(unsigned int nMaxFiles);
+// Compact filter of a block, if -blockfilterindex is enabled and has indexed it
+bool ReadBlockFilter(const uint256 &hashBlock, CBlockFilter &filter);
+// Address index type (AddressIndexType) and hash of the address an output script pays to, if any
+bool GetAddressIndexKey(const CScript &scriptPubKey, int &nType, uint160 &hashAddress);
 
 
 /** Functions for validating blocks and updating the block tree */
@@ -606,11 +617,14 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex);
 /** Undo the effects of this block (with given index) on the UTXO set represented by coins.
  *  In case pfClean is provided, operation will try to be tolerant about errors, and *pfClean
  *  will be true if no problems were found. Otherwise, the return value will be false in case
- *  of problems. Note that in any case, coins may be modified. */
-bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& coins, bool* pfClean = NULL);
+ *  of problems. Note that in any case, coins may be modified. If pstats is provided, the change
+ *  of the UTXO set statistics is accumulated in it. The address and spent indexes are only
+ *  updated when pfClean is not provided. */
+bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& coins, bool* pfClean = NULL, CCoinsRunningStats *pstats = NULL);
 
-// Apply the effects of this block (with given index) on the UTXO set represented by coins
-bool ConnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& coins, bool fJustCheck = false);
+// Apply the effects of this block (with given index) on the UTXO set represented by coins,
+// accumulating the change of the UTXO set statistics in pstats if provided
+bool ConnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& coins, bool fJustCheck = false, CCoinsRunningStats *pstats = NULL);
 
 // Add this block to the block index, and if necessary, switch the active block chain to this
 bool AddToBlockIndex(CBlock& block, CValidationState &state, const CDiskBlockPos &pos, const uint256 &hashProof);
@@ -1183,9 +1197,39 @@ extern CChain chainMostWork;
 /** Global variable that points to the active CCoinsView (protected by cs_main) */
 extern CCoinsViewCache *pcoinsTip;
 
+/** Global variable that points to the coin database backing pcoinsTip (protected by cs_main) */
+extern CCoinsViewDB *pcoinsdbview;
+
 /** Global variable that points to the active block tree (protected by cs_main) */
 extern CBlockTreeDB *pblocktree;
 
+/** Global variable that points to the compact block filter index, NULL unless -blockfilterindex */
+extern CBlockFilterDB *pblockfilterdb;
+
+/** Builds the compact block filter index of a chain, resuming after the last
+ *  block the database holds. Driven by ThreadBlockFilterIndex. */
+class CBlockFilterIndexer
+{
+private:
+    CBlockFilterDB &db;
+    const CChain &chain;
+    // Last block indexed, and the filter header of pindexHeader (the same block
+    // unless a restart or a reorganization moved pindexLast)
+    CBlockIndex *pindexLast;
+    CBlockIndex *pindexHeader;
+    uint256 hashHeader;
+
+public:
+    CBlockFilterIndexer(CBlockFilterDB &dbIn, const CChain &chainIn);
+
+    /** Index up to nMaxBlocks more blocks of the chain; nIndexed is 0 once the
+     *  index reached the tip. Returns false, with strError set, if a block
+     *  could not be read or the filters not written. */
+    bool Step(unsigned int nMaxBlocks, unsigned int &nIndexed, std::string &strError);
+
+    const CBlockIndex *GetLast() const { return pindexLast; }
+};
+
 struct CBlockTemplate
 {
     CBlock block;
@@ -1229,6 +1273,11 @@ public:
 class CWalletInterface {
 protected:
     virtual void SyncTransaction(const uint256 &hash, const CTransaction &tx, const CBlock *pblock) =0;
+    // Sync all transactions of a newly connected block; wallets may override this to group their writes
+    virtual void SyncBlock(const CBlock &block) {
+        for (unsigned int i = 0; i < block.vtx.size(); i++)
+            SyncTransaction(block.GetTxHash(i), block.vtx[i], &block);
+    }
     virtual void EraseFromWallet(const uint256 &hash) =0;
     virtual void SetBestChain(const CBlockLocator &locator) =0;
     virtual void UpdatedTransaction(const uint256 &hash) =0;
@@ -0,0 +1,111 @@
+// Copyright (c) 2014 The Reddcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "muhash.h"
+
+#include "hash.h"
+#include "sha256.h"
+
+#include <assert.h>
+#include <string.h>
+
+const CBigNum &CMuHash3072::Modulus()
+{
+    static const CBigNum bnModulus = (CBigNum(1) << 3072) - CBigNum(1103717);
+    return bnModulus;
+}
+
+void CMuHash3072::MulMod(CBigNum &bn, const CBigNum &bnFactor)
+{
+    CAutoBN_CTX pctx;
+    if (!BN_mod_mul(&bn, &bn, &bnFactor, &Modulus(), pctx))
+        throw bignum_error("CMuHash3072::MulMod : BN_mod_mul failed");
+}
+
+// Expand an element to a number in [1, modulus): SHA256 in counter mode
+// over the (double SHA256) hash of the element.
+CBigNum CMuHash3072::ToNumber(const std::vector<unsigned char> &vch)
+{
+    uint256 hashSeed = Hash(vch.begin(), vch.end());
+    unsigned char pchData[36];
+    memcpy(pchData, hashSeed.begin(), 32);
+    unsigned char pchNumber[BYTE_SIZE];
+    for (unsigned int i = 0; i < BYTE_SIZE / 32; i++) {
+        pchData[32] = i & 0xff;
+        pchData[33] = (i >> 8) & 0xff;
+        pchData[34] = (i >> 16) & 0xff;
+        pchData[35] = (i >> 24) & 0xff;
+        CSHA256().Write(pchData, sizeof(pchData)).Finalize(pchNumber + 32 * i);
+    }
+    CBigNum bn;
+    if (!BN_bin2bn(pchNumber, BYTE_SIZE, &bn))
+        throw bignum_error("CMuHash3072::ToNumber : BN_bin2bn failed");
+    // Out of range with probability ~2^-3052; reduce to stay in the group
+    if (bn >= Modulus())
+        bn -= Modulus();
+    if (BN_is_zero(&bn))
+        bn = CBigNum(1);
+    return bn;
+}
+
+CMuHash3072::CMuHash3072() : bnNumerator(1), bnDenominator(1)
+{
+}
+
+void CMuHash3072::Insert(const std::vector<unsigned char> &vch)
+{
+    MulMod(bnNumerator, ToNumber(vch));
+}
+
+void CMuHash3072::Remove(const std::vector<unsigned char> &vch)
+{
+    MulMod(bnDenominator, ToNumber(vch));
+}
+
+CMuHash3072& CMuHash3072::operator*=(const CMuHash3072 &other)
+{
+    MulMod(bnNumerator, other.bnNumerator);
+    MulMod(bnDenominator, other.bnDenominator);
+    return *this;
+}
+
+CMuHash3072& CMuHash3072::operator/=(const CMuHash3072 &other)
+{
+    MulMod(bnNumerator, other.bnDenominator);
+    MulMod(bnDenominator, other.bnNumerator);
+    return *this;
+}
+
+std::vector<unsigned char> CMuHash3072::GetBytes() const
+{
+    CAutoBN_CTX pctx;
+    CBigNum bnInverse;
+    if (!BN_mod_inverse(&bnInverse, &bnDenominator, &Modulus(), pctx))
+        throw bignum_error("CMuHash3072::GetBytes : BN_mod_inverse failed");
+    CBigNum bnValue = bnNumerator;
+    MulMod(bnValue, bnInverse);
+
+    std::vector<unsigned char> vch(BYTE_SIZE, 0);
+    unsigned int nSize = BN_num_bytes(&bnValue);
+    assert(nSize <= BYTE_SIZE);
+    BN_bn2bin(&bnValue, &vch[BYTE_SIZE - nSize]);
+    return vch;
+}
+
+void CMuHash3072::SetBytes(const std::vector<unsigned char> &vch)
+{
+    if (vch.size() != BYTE_SIZE)
+        throw std::ios_base::failure("CMuHash3072::SetBytes : invalid size");
+    if (!BN_bin2bn(&vch[0], vch.size(), &bnNumerator))
+        throw bignum_error("CMuHash3072::SetBytes : BN_bin2bn failed");
+    if (bnNumerator >= Modulus() || BN_is_zero(&bnNumerator))
+        throw std::ios_base::failure("CMuHash3072::SetBytes : value out of range");
+    bnDenominator = CBigNum(1);
+}
+
+uint256 CMuHash3072::GetHash() const
+{
+    std::vector<unsigned char> vch = GetBytes();
+    return Hash(vch.begin(), vch.end());
+}
@@ -0,0 +1,66 @@
+// Copyright (c) 2014 The Reddcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_MUHASH_H
+#define BITCOIN_MUHASH_H
+
+#include "bignum.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <vector>
+
+/** Hash of a multiset of byte strings (MuHash in the group of integers
+ *  modulo the prime 2^3072 - 1103717).
+ *
+ * Every element is expanded to a 3072-bit number. Inserting an element
+ * multiplies it into the numerator, removing one multiplies it into the
+ * denominator; the value of the set is numerator / denominator. As
+ * multiplication commutes the result does not depend on the order of
+ * the operations, and hashes of disjoint sets can be combined, which
+ * allows both incremental maintenance and parallel computation.
+ *
+ * Serialized format:
+ * - the value of the set as a 384 byte big endian number
+ */
+class CMuHash3072
+{
+private:
+    CBigNum bnNumerator;
+    CBigNum bnDenominator;
+
+    static const CBigNum &Modulus();
+    static CBigNum ToNumber(const std::vector<unsigned char> &vch);
+    static void MulMod(CBigNum &bn, const CBigNum &bnFactor);
+
+    // numerator / denominator as a 384 byte big endian number
+    std::vector<unsigned char> GetBytes() const;
+    void SetBytes(const std::vector<unsigned char> &vch);
+
+public:
+    static const unsigned int BYTE_SIZE = 384;
+
+    // the hash of the empty set
+    CMuHash3072();
+
+    void Insert(const std::vector<unsigned char> &vch);
+    void Remove(const std::vector<unsigned char> &vch);
+
+    // union with (resp. difference with) the set hashed by other
+    CMuHash3072& operator*=(const CMuHash3072 &other);
+    CMuHash3072& operator/=(const CMuHash3072 &other);
+
+    uint256 GetHash() const;
+
+    IMPLEMENT_SERIALIZE(({
+        std::vector<unsigned char> vch;
+        if (!fRead)
+            vch = GetBytes();
+        READWRITE(vch);
+        if (fRead)
+            const_cast<CMuHash3072*>(this)->SetBytes(vch);
+    });)
+};
+
+#endif // BITCOIN_MUHASH_H
@@ -158,10 +158,10 @@ public:
     CMessageHeader hdr;             // complete header
     unsigned int nHdrPos;
 
-    CDataStream vRecv;              // received message data
+    std::vector<char> vRecv;        // received message data; public, so not wiped when freed
     unsigned int nDataPos;
 
-    CNetMessage(int nTypeIn, int nVersionIn) : hdrbuf(nTypeIn, nVersionIn), vRecv(nTypeIn, nVersionIn) {
+    CNetMessage(int nTypeIn, int nVersionIn) : hdrbuf(nTypeIn, nVersionIn) {
         hdrbuf.resize(24);
         in_data = false;
         nHdrPos = 0;
@@ -178,7 +178,13 @@ public:
     void SetVersion(int nVersionIn)
     {
         hdrbuf.SetVersion(nVersionIn);
-        vRecv.SetVersion(nVersionIn);
+    }
+
+    // Deserialize the message data in place
+    CSpanReader GetDataReader() const
+    {
+        const char *pbegin = vRecv.empty() ? NULL : &vRecv[0];
+        return CSpanReader(pbegin, pbegin + vRecv.size(), hdrbuf.nType, hdrbuf.nVersion);
     }
 
     int readHeader(const char *pch, unsigned int nBytes);
@@ -0,0 +1,320 @@
+// Copyright (c) 2014 The Reddcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_PREVECTOR_H
+#define BITCOIN_PREVECTOR_H
+
+#include <algorithm>
+#include <assert.h>
+#include <iterator>
+#include <new>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <boost/type_traits/integral_constant.hpp>
+#include <boost/type_traits/is_integral.hpp>
+
+#pragma pack(push, 1)
+/** Vector-like container that keeps up to N elements inline and only
+ *  allocates when it grows beyond that. It is a drop-in replacement for
+ *  std::vector<T> where most instances are small, such as scripts.
+ *
+ *  Differences from std::vector:
+ *  - T must be a plain data type: elements are moved with memcpy/memmove
+ *    and never constructed or destroyed.
+ *  - Iterators are plain pointers.
+ *  - Size and capacity are limited to what Size can hold.
+ *
+ *  The layout is packed, so with N = 28 the whole object takes 32 bytes,
+ *  against 24 for a std::vector that also needs a heap block for any data.
+ */
+template<unsigned int N, typename T, typename Size = uint32_t, typename Diff = int32_t>
+class prevector
+{
+public:
+    typedef Size size_type;
+    typedef Diff difference_type;
+    typedef T value_type;
+    typedef value_type& reference;
+    typedef const value_type& const_reference;
+    typedef value_type* pointer;
+    typedef const value_type* const_pointer;
+    typedef value_type* iterator;
+    typedef const value_type* const_iterator;
+    typedef std::reverse_iterator<iterator> reverse_iterator;
+    typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
+private:
+    size_type _size; // the size when stored inline, N + 1 + the size when on the heap
+    union direct_or_indirect {
+        char direct[sizeof(T) * N];
+        struct {
+            size_type capacity;
+            char* indirect;
+        } heap;
+    } _union;
+
+    T* direct_ptr(difference_type pos) { return reinterpret_cast<T*>(_union.direct) + pos; }
+    const T* direct_ptr(difference_type pos) const { return reinterpret_cast<const T*>(_union.direct) + pos; }
+    T* indirect_ptr(difference_type pos) { return reinterpret_cast<T*>(_union.heap.indirect) + pos; }
+    const T* indirect_ptr(difference_type pos) const { return reinterpret_cast<const T*>(_union.heap.indirect) + pos; }
+    bool is_direct() const { return _size <= N; }
+
+    void change_capacity(size_type new_capacity)
+    {
+        if (new_capacity <= N) {
+            if (!is_direct()) {
+                char* indirect = _union.heap.indirect;
+                size_type nSize = size();
+                memcpy(direct_ptr(0), indirect, nSize * sizeof(T));
+                free(indirect);
+                _size = nSize;
+            }
+        } else if (!is_direct()) {
+            char* indirect = static_cast<char*>(realloc(_union.heap.indirect, (size_t)new_capacity * sizeof(T)));
+            if (!indirect)
+                throw std::bad_alloc();
+            _union.heap.indirect = indirect;
+            _union.heap.capacity = new_capacity;
+        } else {
+            char* indirect = static_cast<char*>(malloc((size_t)new_capacity * sizeof(T)));
+            if (!indirect)
+                throw std::bad_alloc();
+            memcpy(indirect, direct_ptr(0), size() * sizeof(T));
+            _union.heap.indirect = indirect;
+            _union.heap.capacity = new_capacity;
+            _size += N + 1;
+        }
+    }
+
+    // Make room for nCount more elements, growing the heap block geometrically
+    void grow(size_type nCount)
+    {
+        size_type new_size = size() + nCount;
+        if (capacity() < new_size)
+            change_capacity(new_size + (new_size >> 1));
+    }
+
+    T* item_ptr(difference_type pos) { return is_direct() ? direct_ptr(pos) : indirect_ptr(pos); }
+    const T* item_ptr(difference_type pos) const { return is_direct() ? direct_ptr(pos) : indirect_ptr(pos); }
+
+    void set_size(size_type nSize) { _size = is_direct() ? nSize : nSize + N + 1; }
+
+    // Like std::vector, a pair of integers passed as a range means a count and a value
+    template<typename Integer>
+    void assign_dispatch(Integer n, Integer val, boost::true_type) { assign((size_type)n, (T)val); }
+    template<typename InputIterator>
+    void assign_dispatch(InputIterator first, InputIterator last, boost::false_type)
+    {
+        clear();
+        size_type n = std::distance(first, last);
+        if (capacity() < n)
+            change_capacity(n);
+        std::copy(first, last, item_ptr(0));
+        set_size(n);
+    }
+
+    template<typename Integer>
+    void insert_dispatch(T* pos, Integer n, Integer val, boost::true_type) { insert(pos, (size_type)n, (T)val); }
+    template<typename InputIterator>
+    void insert_dispatch(T* pos, InputIterator first, InputIterator last, boost::false_type)
+    {
+        size_type p = pos - item_ptr(0);
+        size_type count = std::distance(first, last);
+        grow(count);
+        T* ptr = item_ptr(p);
+        memmove(ptr + count, ptr, (size() - p) * sizeof(T));
+        std::copy(first, last, ptr);
+        set_size(size() + count);
+    }
+
+public:
+    prevector() : _size(0) {}
+
+    explicit prevector(size_type n, const T& val = T()) : _size(0)
+    {
+        assign(n, val);
+    }
+
+    template<typename InputIterator>
+    prevector(InputIterator first, InputIterator last) : _size(0)
+    {
+        assign(first, last);
+    }
+
+    prevector(const prevector& other) : _size(0)
+    {
+        assign(other.begin(), other.end());
+    }
+
+    ~prevector()
+    {
+        if (!is_direct())
+            free(_union.heap.indirect);
+    }
+
+    prevector& operator=(const prevector& other)
+    {
+        if (&other != this)
+            assign(other.begin(), other.end());
+        return *this;
+    }
+
+    void assign(size_type n, const T& val)
+    {
+        clear();
+        if (capacity() < n)
+            change_capacity(n);
+        std::fill(item_ptr(0), item_ptr(0) + n, val);
+        set_size(n);
+    }
+
+    template<typename InputIterator>
+    void assign(InputIterator first, InputIterator last)
+    {
+        assign_dispatch(first, last, boost::is_integral<InputIterator>());
+    }
+
+    size_type size() const { return is_direct() ? _size : _size - N - 1; }
+    bool empty() const { return size() == 0; }
+    size_type capacity() const { return is_direct() ? N : _union.heap.capacity; }
+
+    iterator begin() { return item_ptr(0); }
+    const_iterator begin() const { return item_ptr(0); }
+    iterator end() { return item_ptr(size()); }
+    const_iterator end() const { return item_ptr(size()); }
+    reverse_iterator rbegin() { return reverse_iterator(end()); }
+    const_reverse_iterator rbegin() const { return const_reverse_iterator(end()); }
+    reverse_iterator rend() { return reverse_iterator(begin()); }
+    const_reverse_iterator rend() const { return const_reverse_iterator(begin()); }
+
+    T& operator[](size_type pos) { return *item_ptr(pos); }
+    const T& operator[](size_type pos) const { return *item_ptr(pos); }
+    T& front() { return *item_ptr(0); }
+    const T& front() const { return *item_ptr(0); }
+    T& back() { return *item_ptr(size() - 1); }
+    const T& back() const { return *item_ptr(size() - 1); }
+    T* data() { return item_ptr(0); }
+    const T* data() const { return item_ptr(0); }
+
+    void reserve(size_type new_capacity)
+    {
+        if (new_capacity > capacity())
+            change_capacity(new_capacity);
+    }
+
+    void shrink_to_fit()
+    {
+        change_capacity(size());
+    }
+
+    void resize(size_type new_size, const T& val = T())
+    {
+        size_type cur_size = size();
+        if (new_size > capacity())
+            change_capacity(new_size);
+        if (new_size > cur_size)
+            std::fill(item_ptr(cur_size), item_ptr(new_size), val);
+        set_size(new_size);
+    }
+
+    void clear()
+    {
+        set_size(0);
+    }
+
+    iterator insert(iterator pos, const T& value)
+    {
+        size_type p = pos - begin();
+        T val = value; // may refer into this prevector
+        grow(1);
+        T* ptr = item_ptr(p);
+        memmove(ptr + 1, ptr, (size() - p) * sizeof(T));
+        *ptr = val;
+        set_size(size() + 1);
+        return ptr;
+    }
+
+    void insert(iterator pos, size_type count, const T& value)
+    {
+        size_type p = pos - begin();
+        T val = value;
+        grow(count);
+        T* ptr = item_ptr(p);
+        memmove(ptr + count, ptr, (size() - p) * sizeof(T));
+        std::fill(ptr, ptr + count, val);
+        set_size(size() + count);
+    }
+
+    // The range must not lie within this prevector
+    template<typename InputIterator>
+    void insert(iterator pos, InputIterator first, InputIterator last)
+    {
+        insert_dispatch(pos, first, last, boost::is_integral<InputIterator>());
+    }
+
+    iterator erase(iterator pos)
+    {
+        return erase(pos, pos + 1);
+    }
+
+    iterator erase(iterator first, iterator last)
+    {
+        iterator p = first;
+        memmove(first, last, (end() - last) * sizeof(T));
+        set_size(size() - (last - first));
+        return p;
+    }
+
+    void push_back(const T& value)
+    {
+        T val = value;
+        grow(1);
+        *item_ptr(size()) = val;
+        set_size(size() + 1);
+    }
+
+    void pop_back()
+    {
+        set_size(size() - 1);
+    }
+
+    void swap(prevector& other)
+    {
+        char tmp[sizeof(prevector)];
+        memcpy(tmp, this, sizeof(prevector));
+        memcpy((void*)this, &other, sizeof(prevector));
+        memcpy((void*)&other, tmp, sizeof(prevector));
+    }
+
+    // Heap memory in use, for memory usage accounting
+    size_t allocated_memory() const
+    {
+        return is_direct() ? 0 : (size_t)_union.heap.capacity * sizeof(T);
+    }
+
+    // Same ordering as std::vector
+    friend bool operator==(const prevector& a, const prevector& b)
+    {
+        return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin());
+    }
+
+    friend bool operator!=(const prevector& a, const prevector& b)
+    {
+        return !(a == b);
+    }
+
+    friend bool operator<(const prevector& a, const prevector& b)
+    {
+        return std::lexicographical_compare(a.begin(), a.end(), b.begin(), b.end());
+    }
+
+    friend bool operator>(const prevector& a, const prevector& b) { return b < a; }
+    friend bool operator<=(const prevector& a, const prevector& b) { return !(b < a); }
+    friend bool operator>=(const prevector& a, const prevector& b) { return !(a < b); }
+};
+#pragma pack(pop)
+
+#endif // BITCOIN_PREVECTOR_H
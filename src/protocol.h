@@ -62,6 +62,9 @@ class CMessageHeader
 enum
 {
     NODE_NETWORK = (1 << 0),
+    // NODE_COMPACT_FILTERS means the node serves compact block filters (getcfilters,
+    // getcfheaders and getcfcheckpt)
+    NODE_COMPACT_FILTERS = (1 << 6),
 };
 
 /** A CService with information about it as peer */
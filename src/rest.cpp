@@ -0,0 +1,247 @@
+// Copyright (c) 2014 The Reddcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "core.h"
+#include "jsonstream.h"
+#include "main.h"
+#include "rpcprotocol.h"
+#include "rpcserver.h"
+#include "sync.h"
+#include "util.h"
+
+#include <stdint.h>
+
+#include <boost/algorithm/string.hpp>
+#include "json/json_spirit_utils.h"
+#include "json/json_spirit_value.h"
+
+using namespace std;
+using namespace json_spirit;
+
+//
+// Read-only REST interface, served on the RPC port when -rest is set.
+// Requests need no authorization, so only public chain data is exposed:
+//
+//   /rest/block/<hash>.<bin|hex|json>
+//   /rest/tx/<txid>.<bin|hex|json>            (confirmed transactions need -txindex)
+//   /rest/headers/<count>/<hash>.<bin|hex|json>
+//   /rest/chaininfo.json
+//   /rest/mempool/contents.json
+//
+
+/** Most headers returned by one /rest/headers request */
+static const int MAX_REST_HEADERS = 2000;
+
+enum RESTFormat {
+    RF_UNDEF,
+    RF_BINARY,
+    RF_HEX,
+    RF_JSON,
+};
+
+static const struct {
+    RESTFormat rf;
+    const char *name;
+} rf_names[] = {
+    { RF_BINARY, "bin" },
+    { RF_HEX,    "hex" },
+    { RF_JSON,   "json" },
+};
+
+// Split "name.ext" into name and format
+static RESTFormat ParseDataFormat(string& strParam, const string& strReq)
+{
+    size_t pos = strReq.rfind('.');
+    if (pos == string::npos)
+    {
+        strParam = strReq;
+        return RF_UNDEF;
+    }
+    strParam = strReq.substr(0, pos);
+    const string strSuffix = strReq.substr(pos + 1);
+    for (unsigned int i = 0; i < sizeof(rf_names) / sizeof(rf_names[0]); i++)
+        if (strSuffix == rf_names[i].name)
+            return rf_names[i].rf;
+    return RF_UNDEF;
+}
+
+static bool ParseHashStr(const string& strHash, uint256& hash)
+{
+    if (strHash.size() != 64 || !IsHex(strHash))
+        return false;
+    hash.SetHex(strHash);
+    return true;
+}
+
+static string RESTError(int nStatus, const string& strMessage, bool& fKeepAlive)
+{
+    fKeepAlive = false;
+    return HTTPReply(nStatus, strMessage + "\r\n", false, "text/plain");
+}
+
+static string RESTReply(RESTFormat rf, const string& strData, bool fKeepAlive)
+{
+    switch (rf)
+    {
+    case RF_BINARY:
+        return HTTPReply(HTTP_OK, strData, fKeepAlive, "application/octet-stream");
+    case RF_HEX:
+        return HTTPReply(HTTP_OK, HexStr(strData.begin(), strData.end()) + "\n", fKeepAlive, "text/plain");
+    default:
+        return HTTPReply(HTTP_OK, strData + "\n", fKeepAlive, "application/json");
+    }
+}
+
+static string RESTBlock(const vector<string>& vParams, bool& fKeepAlive)
+{
+    string strHash;
+    RESTFormat rf = vParams.size() == 2 ? ParseDataFormat(strHash, vParams[1]) : RF_UNDEF;
+    if (rf == RF_UNDEF)
+        return RESTError(HTTP_NOT_FOUND, "output format not found (available: .bin, .hex, .json)", fKeepAlive);
+    uint256 hash;
+    if (!ParseHashStr(strHash, hash))
+        return RESTError(HTTP_BAD_REQUEST, "Invalid hash: " + strHash, fKeepAlive);
+
+    CBlockIndex* pblockindex;
+    CDiskBlockPos pos;
+    {
+        LOCK(cs_main);
+        map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hash);
+        if (mi == mapBlockIndex.end())
+            return RESTError(HTTP_NOT_FOUND, strHash + " not found", fKeepAlive);
+        pblockindex = mi->second;
+        if (!(pblockindex->nStatus & BLOCK_HAVE_DATA))
+            return RESTError(HTTP_NOT_FOUND, strHash + " not available", fKeepAlive);
+        pos = pblockindex->GetBlockPos();
+    }
+
+    if (rf != RF_JSON)
+    {
+        // hand out the block as it is stored
+        string strBlock;
+        if (!ReadRawBlockFromDisk(strBlock, pos))
+            return RESTError(HTTP_INTERNAL_SERVER_ERROR, strHash + " could not be read", fKeepAlive);
+        return RESTReply(rf, strBlock, fKeepAlive);
+    }
+
+    CBlock block;
+    if (!ReadBlockFromDisk(block, pos))
+        return RESTError(HTTP_INTERNAL_SERVER_ERROR, strHash + " could not be read", fKeepAlive);
+    Object objBlock;
+    {
+        LOCK(cs_main);
+        objBlock = blockToJSON(block, pblockindex);
+    }
+    return RESTReply(rf, WriteJSON(objBlock), fKeepAlive);
+}
+
+static string RESTTransaction(const vector<string>& vParams, bool& fKeepAlive)
+{
+    string strHash;
+    RESTFormat rf = vParams.size() == 2 ? ParseDataFormat(strHash, vParams[1]) : RF_UNDEF;
+    if (rf == RF_UNDEF)
+        return RESTError(HTTP_NOT_FOUND, "output format not found (available: .bin, .hex, .json)", fKeepAlive);
+    uint256 hash;
+    if (!ParseHashStr(strHash, hash))
+        return RESTError(HTTP_BAD_REQUEST, "Invalid hash: " + strHash, fKeepAlive);
+
+    CTransaction tx;
+    uint256 hashBlock = 0;
+    if (!GetTransaction(hash, tx, hashBlock))
+        return RESTError(HTTP_NOT_FOUND, strHash + " not found", fKeepAlive);
+
+    if (rf != RF_JSON)
+    {
+        CDataStream ssTx(SER_NETWORK, PROTOCOL_VERSION);
+        ssTx << tx;
+        return RESTReply(rf, ssTx.str(), fKeepAlive);
+    }
+
+    Object objTx;
+    {
+        LOCK(cs_main);
+        TxToJSON(tx, hashBlock, objTx);
+    }
+    return RESTReply(rf, WriteJSON(objTx), fKeepAlive);
+}
+
+static string RESTHeaders(const vector<string>& vParams, bool& fKeepAlive)
+{
+    string strHash;
+    RESTFormat rf = vParams.size() == 3 ? ParseDataFormat(strHash, vParams[2]) : RF_UNDEF;
+    if (rf == RF_UNDEF)
+        return RESTError(HTTP_NOT_FOUND, "output format not found (available: .bin, .hex, .json)", fKeepAlive);
+    int nCount = atoi(vParams[1]);
+    if (nCount < 1 || nCount > MAX_REST_HEADERS)
+        return RESTError(HTTP_BAD_REQUEST, strprintf("Header count out of range: %s", vParams[1]), fKeepAlive);
+    uint256 hash;
+    if (!ParseHashStr(strHash, hash))
+        return RESTError(HTTP_BAD_REQUEST, "Invalid hash: " + strHash, fKeepAlive);
+
+    // the requested block and its successors in the active chain
+    CDataStream ssHeaders(SER_NETWORK, PROTOCOL_VERSION);
+    Array arrHeaders;
+    {
+        LOCK(cs_main);
+        map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hash);
+        if (mi == mapBlockIndex.end())
+            return RESTError(HTTP_NOT_FOUND, strHash + " not found", fKeepAlive);
+        for (CBlockIndex* pindex = mi->second; pindex != NULL && nCount > 0 && chainActive.Contains(pindex);
+             pindex = chainActive.Next(pindex), nCount--)
+        {
+            if (rf == RF_JSON)
+                arrHeaders.push_back(blockheaderToJSON(pindex));
+            else
+                ssHeaders << pindex->GetBlockHeader();
+        }
+    }
+
+    if (rf == RF_JSON)
+        return RESTReply(rf, WriteJSON(arrHeaders), fKeepAlive);
+    return RESTReply(rf, ssHeaders.str(), fKeepAlive);
+}
+
+// Run a read-only RPC method under cs_main and reply with its result
+static string RESTCall(rpcfn_type pfn, const Array& params, bool& fKeepAlive)
+{
+    Value result;
+    try
+    {
+        LOCK(cs_main);
+        result = (*pfn)(params, false);
+    }
+    catch (Object& objError)
+    {
+        return RESTError(HTTP_INTERNAL_SERVER_ERROR, find_value(objError, "message").get_str(), fKeepAlive);
+    }
+    catch (std::exception& e)
+    {
+        return RESTError(HTTP_INTERNAL_SERVER_ERROR, e.what(), fKeepAlive);
+    }
+    return RESTReply(RF_JSON, WriteJSON(result), fKeepAlive);
+}
+
+string HTTPReq_REST(const string& strURI, bool& fKeepAlive)
+{
+    // strip "/rest/" and any query string
+    string strPath = strURI.substr(6, strURI.find('?') - 6);
+    vector<string> vParams;
+    boost::split(vParams, strPath, boost::is_any_of("/"));
+
+    if (vParams[0] == "block")
+        return RESTBlock(vParams, fKeepAlive);
+    if (vParams[0] == "tx")
+        return RESTTransaction(vParams, fKeepAlive);
+    if (vParams[0] == "headers")
+        return RESTHeaders(vParams, fKeepAlive);
+    if (vParams.size() == 1 && vParams[0] == "chaininfo.json")
+        return RESTCall(&getblockchaininfo, Array(), fKeepAlive);
+    if (vParams.size() == 2 && vParams[0] == "mempool" && vParams[1] == "contents.json")
+    {
+        Array params;
+        params.push_back(true);
+        return RESTCall(&getrawmempool, params, fKeepAlive);
+    }
+    return RESTError(HTTP_NOT_FOUND, "not found", fKeepAlive);
+}
@@ -4,13 +4,17 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "rpcserver.h"
+#include "base58.h"
 #include "main.h"
 #include "sync.h"
 #include "checkpoints.h"
 #include "chainparams.h"
+#include "txdb.h"
 
 #include <stdint.h>
 
+#include <boost/thread.hpp>
+
 #include "json/json_spirit_value.h"
 
 using namespace json_spirit;
@@ -105,6 +109,32 @@ Object blockToJSON(const CBlock& block, const CBlockIndex* blockindex)
 }
 
 
+Object blockheaderToJSON(const CBlockIndex* blockindex)
+{
+    Object result;
+    result.push_back(Pair("hash", blockindex->GetBlockHash().GetHex()));
+    int confirmations = -1;
+    // Only report confirmations if the block is on the main chain
+    if (chainActive.Contains(blockindex))
+        confirmations = chainActive.Height() - blockindex->nHeight + 1;
+    result.push_back(Pair("confirmations", confirmations));
+    result.push_back(Pair("height", blockindex->nHeight));
+    result.push_back(Pair("version", blockindex->nVersion));
+    result.push_back(Pair("merkleroot", blockindex->hashMerkleRoot.GetHex()));
+    result.push_back(Pair("time", (int64_t)blockindex->nTime));
+    result.push_back(Pair("nonce", (uint64_t)blockindex->nNonce));
+    result.push_back(Pair("bits", HexBits(blockindex->nBits)));
+    result.push_back(Pair("difficulty", GetDifficulty(blockindex)));
+    result.push_back(Pair("chainwork", blockindex->nChainWork.GetHex()));
+
+    if (blockindex->pprev)
+        result.push_back(Pair("previousblockhash", blockindex->pprev->GetBlockHash().GetHex()));
+    CBlockIndex *pnext = chainActive.Next(blockindex);
+    if (pnext)
+        result.push_back(Pair("nextblockhash", pnext->GetBlockHash().GetHex()));
+    return result;
+}
+
 Value getblockcount(const Array& params, bool fHelp)
 {
     if (fHelp || params.size() != 0)
@@ -246,6 +276,8 @@ Value getblockhash(const Array& params, bool fHelp)
             + HelpExampleRpc("getblockhash", "1000")
         );
 
+    LOCK(cs_main);
+
     int nHeight = params[0].get_int();
     if (nHeight < 0 || nHeight > chainActive.Height())
         throw runtime_error("Block number out of range.");
@@ -297,12 +329,17 @@ Value getblock(const Array& params, bool fHelp)
     if (params.size() > 1)
         fVerbose = params[1].get_bool();
 
-    if (mapBlockIndex.count(hash) == 0)
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+    CBlockIndex* pblockindex;
+    {
+        LOCK(cs_main);
+        std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hash);
+        if (mi == mapBlockIndex.end())
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+        pblockindex = mi->second;
+    }
 
+    // Stored blocks do not change, reading one needs no lock
     CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
-
     if(!ReadBlockFromDisk(block, pblockindex))
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
 
@@ -314,16 +351,306 @@ Value getblock(const Array& params, bool fHelp)
         return strHex;
     }
 
+    LOCK(cs_main);
     return blockToJSON(block, pblockindex);
 }
 
+Value getblockfilter(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getblockfilter \"hash\"\n"
+            "\nReturns the compact filter of block 'hash' (needs -blockfilterindex).\n"
+            "\nArguments:\n"
+            "1. \"hash\"          (string, required) The block hash\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"filter\" : \"hex\",  (string) The encoded filter\n"
+            "  \"header\" : \"hash\"  (string) The filter header, committing to this and all previous filters\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getblockfilter", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\"")
+            + HelpExampleRpc("getblockfilter", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\"")
+        );
+
+    if (!pblockfilterdb)
+        throw JSONRPCError(RPC_MISC_ERROR, "Block filters are not indexed (use -blockfilterindex)");
+
+    uint256 hash(params[0].get_str());
+    if (mapBlockIndex.count(hash) == 0)
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+
+    CBlockFilter filter;
+    uint256 hashHeader;
+    if (!pblockfilterdb->ReadFilter(hash, filter) || !pblockfilterdb->ReadFilterHeader(hash, hashHeader)) {
+        int nHeight;
+        std::string strError;
+        GetBlockFilterIndexStatus(nHeight, strError);
+        if (!strError.empty())
+            throw JSONRPCError(RPC_MISC_ERROR, strprintf("Block filter index stopped at height %d: %s", nHeight, strError));
+        throw JSONRPCError(RPC_MISC_ERROR, strprintf("Filter of this block is not indexed yet (index at height %d)", nHeight));
+    }
+
+    Object result;
+    result.push_back(Pair("filter", HexStr(filter.GetEncoded())));
+    result.push_back(Pair("header", hashHeader.GetHex()));
+    return result;
+}
+
+// Address index type and hash of an address string
+static void ParseIndexedAddress(const std::string &strAddress, int &nType, uint160 &hashAddress)
+{
+    CBitcoinAddress address(strAddress);
+    CKeyID keyID;
+    if (address.GetKeyID(keyID)) {
+        nType = ADDRESS_INDEX_KEY;
+        hashAddress = keyID;
+    } else if (address.IsScript()) {
+        nType = ADDRESS_INDEX_SCRIPT;
+        hashAddress = boost::get<CScriptID>(address.Get());
+    } else {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid Reddcoin address");
+    }
+}
+
+static std::string IndexedAddressToString(int nType, const uint160 &hashAddress)
+{
+    if (nType == ADDRESS_INDEX_KEY)
+        return CBitcoinAddress(CKeyID(hashAddress)).ToString();
+    return CBitcoinAddress(CScriptID(hashAddress)).ToString();
+}
+
+// Optional "from" and "count" paging arguments at params[nPos] and params[nPos+1]
+static void ParsePaging(const Array& params, unsigned int nPos, int &nFrom, int &nCount)
+{
+    nFrom = 0;
+    nCount = 1000;
+    if (params.size() > nPos)
+        nFrom = params[nPos].get_int();
+    if (params.size() > nPos + 1)
+        nCount = params[nPos + 1].get_int();
+    if (nFrom < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative from");
+    if (nCount < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative count");
+}
+
+Value getaddressdeltas(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() < 1 || params.size() > 5)
+        throw runtime_error(
+            "getaddressdeltas \"address\" ( startheight endheight from count )\n"
+            "\nReturns the outputs paying to an address and the inputs spending them, ordered by height (needs -addressindex).\n"
+            "\nArguments:\n"
+            "1. \"address\"       (string, required) The address\n"
+            "2. startheight     (numeric, optional, default=0) The first block height to include\n"
+            "3. endheight       (numeric, optional, default=0) The last block height to include, 0 for the tip\n"
+            "4. from            (numeric, optional, default=0) The number of entries to skip\n"
+            "5. count           (numeric, optional, default=1000) The maximum number of entries to return\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"txid\" : \"hash\",     (string) The transaction id\n"
+            "    \"index\" : n,         (numeric) The output index, or the input index if spending\n"
+            "    \"height\" : n,        (numeric) The height of the block containing the transaction\n"
+            "    \"spending\" : true|false, (boolean) Whether this is an input spending from the address\n"
+            "    \"amount\" : x.xxx     (numeric) The amount received, negative if spending\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddressdeltas", "\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\"")
+            + HelpExampleCli("getaddressdeltas", "\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\" 100000 0 1000 1000")
+            + HelpExampleRpc("getaddressdeltas", "\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\", 100000")
+        );
+
+    if (!fAddressIndex)
+        throw JSONRPCError(RPC_MISC_ERROR, "Addresses are not indexed (use -addressindex)");
+
+    int nType;
+    uint160 hashAddress;
+    ParseIndexedAddress(params[0].get_str(), nType, hashAddress);
+    int nStartHeight = 0, nEndHeight = 0;
+    if (params.size() > 1)
+        nStartHeight = params[1].get_int();
+    if (params.size() > 2)
+        nEndHeight = params[2].get_int();
+    if (nStartHeight < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative startheight");
+    if (nEndHeight < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative endheight");
+    int nFrom, nCount;
+    ParsePaging(params, 3, nFrom, nCount);
+    if (nCount == 0)
+        return Array();
+
+    std::vector<std::pair<CAddressIndexKey, int64_t> > vIndex;
+    if (!pblocktree->ReadAddressIndex(nType, hashAddress, vIndex, nStartHeight, nEndHeight, (size_t)nFrom + nCount))
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read address index");
+
+    Array result;
+    for (unsigned int i = nFrom; i < vIndex.size(); i++) {
+        const CAddressIndexKey &key = vIndex[i].first;
+        Object entry;
+        entry.push_back(Pair("txid", key.txid.GetHex()));
+        entry.push_back(Pair("index", (int)key.nIndex));
+        entry.push_back(Pair("height", key.nHeight));
+        entry.push_back(Pair("spending", key.fSpending));
+        entry.push_back(Pair("amount", ValueFromAmount(vIndex[i].second)));
+        result.push_back(entry);
+    }
+    return result;
+}
+
+Value getaddressutxos(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() < 1 || params.size() > 3)
+        throw runtime_error(
+            "getaddressutxos \"address\" ( from count )\n"
+            "\nReturns the unspent outputs paying to an address, as of the best block (needs -addressindex).\n"
+            "\nArguments:\n"
+            "1. \"address\"       (string, required) The address\n"
+            "2. from            (numeric, optional, default=0) The number of outputs to skip\n"
+            "3. count           (numeric, optional, default=1000) The maximum number of outputs to return\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"txid\" : \"hash\",     (string) The transaction id\n"
+            "    \"vout\" : n,          (numeric) The output index\n"
+            "    \"height\" : n,        (numeric) The height of the block containing the transaction\n"
+            "    \"scriptPubKey\" : \"hex\", (string) The output script\n"
+            "    \"amount\" : x.xxx     (numeric) The output value\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddressutxos", "\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\"")
+            + HelpExampleRpc("getaddressutxos", "\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\", 0, 100")
+        );
+
+    if (!fAddressIndex)
+        throw JSONRPCError(RPC_MISC_ERROR, "Addresses are not indexed (use -addressindex)");
+
+    int nType;
+    uint160 hashAddress;
+    ParseIndexedAddress(params[0].get_str(), nType, hashAddress);
+    int nFrom, nCount;
+    ParsePaging(params, 1, nFrom, nCount);
+    if (nCount == 0)
+        return Array();
+
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vUnspent;
+    if (!pblocktree->ReadAddressUnspentIndex(nType, hashAddress, vUnspent, (size_t)nFrom + nCount))
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read address index");
+
+    Array result;
+    for (unsigned int i = nFrom; i < vUnspent.size(); i++) {
+        const CAddressUnspentKey &key = vUnspent[i].first;
+        const CAddressUnspentValue &value = vUnspent[i].second;
+        Object entry;
+        entry.push_back(Pair("txid", key.txid.GetHex()));
+        entry.push_back(Pair("vout", (int)key.n));
+        entry.push_back(Pair("height", value.nHeight));
+        entry.push_back(Pair("scriptPubKey", HexStr(value.scriptPubKey.begin(), value.scriptPubKey.end())));
+        entry.push_back(Pair("amount", ValueFromAmount(value.nValue)));
+        result.push_back(entry);
+    }
+    return result;
+}
+
+Value getaddressbalance(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddressbalance \"address\"\n"
+            "\nReturns the balance of an address, as of the best block (needs -addressindex).\n"
+            "\nArguments:\n"
+            "1. \"address\"       (string, required) The address\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"balance\" : x.xxx,  (numeric) The total value of the unspent outputs paying to the address\n"
+            "  \"received\" : x.xxx, (numeric) The total value ever paid to the address\n"
+            "  \"txouts\" : n        (numeric) The number of unspent outputs paying to the address\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddressbalance", "\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\"")
+            + HelpExampleRpc("getaddressbalance", "\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\"")
+        );
+
+    if (!fAddressIndex)
+        throw JSONRPCError(RPC_MISC_ERROR, "Addresses are not indexed (use -addressindex)");
+
+    int nType;
+    uint160 hashAddress;
+    ParseIndexedAddress(params[0].get_str(), nType, hashAddress);
+
+    int64_t nBalance, nReceived;
+    int nTxOuts;
+    if (!pblocktree->SumAddressIndex(nType, hashAddress, nBalance, nReceived, nTxOuts))
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read address index");
+
+    Object result;
+    result.push_back(Pair("balance", ValueFromAmount(nBalance)));
+    result.push_back(Pair("received", ValueFromAmount(nReceived)));
+    result.push_back(Pair("txouts", nTxOuts));
+    return result;
+}
+
+Value getspentinfo(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 2)
+        throw runtime_error(
+            "getspentinfo \"txid\" n\n"
+            "\nReturns the input spending a transaction output in the best chain (needs -spentindex).\n"
+            "\nArguments:\n"
+            "1. \"txid\"          (string, required) The transaction id\n"
+            "2. n               (numeric, required) The output index\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"txid\" : \"hash\",    (string) The id of the spending transaction\n"
+            "  \"index\" : n,        (numeric) The index of the spending input\n"
+            "  \"height\" : n,       (numeric) The height of the block containing the spending transaction\n"
+            "  \"amount\" : x.xxx,   (numeric) The value of the spent output\n"
+            "  \"address\" : \"address\" (string, optional) The address the spent output paid to\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getspentinfo", "\"txid\" 1")
+            + HelpExampleRpc("getspentinfo", "\"txid\", 1")
+        );
+
+    if (!fSpentIndex)
+        throw JSONRPCError(RPC_MISC_ERROR, "Spent outputs are not indexed (use -spentindex)");
+
+    uint256 hash(params[0].get_str());
+    int n = params[1].get_int();
+    if (n < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid output index");
+
+    CSpentIndexValue value;
+    if (!pblocktree->ReadSpentIndex(CSpentIndexKey(hash, n), value))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unable to find a spending input for this output");
+
+    Object result;
+    result.push_back(Pair("txid", value.txid.GetHex()));
+    result.push_back(Pair("index", (int)value.nInput));
+    result.push_back(Pair("height", value.nHeight));
+    result.push_back(Pair("amount", ValueFromAmount(value.nValue)));
+    if (value.nType != 0)
+        result.push_back(Pair("address", IndexedAddressToString(value.nType, value.hashAddress)));
+    return result;
+}
+
 Value gettxoutsetinfo(const Array& params, bool fHelp)
 {
-    if (fHelp || params.size() != 0)
+    if (fHelp || params.size() > 1)
         throw runtime_error(
-            "gettxoutsetinfo\n"
+            "gettxoutsetinfo ( \"mode\" )\n"
             "\nReturns statistics about the unspent transaction output set.\n"
-            "Note this call may take some time.\n"
+            "\nArguments:\n"
+            "1. \"mode\"     (string, optional, default=cached) How to obtain the statistics:\n"
+            "               \"cached\" - kept up to date as blocks are connected; the first call may scan the database\n"
+            "               \"verify\" - recompute them by a parallel scan of the database and compare with the cached ones\n"
+            "               \"legacy\" - sequential scan of the database (may take some time), includes hash_serialized\n"
             "\nResult:\n"
             "{\n"
             "  \"height\":n,     (numeric) The current block height (index)\n"
@@ -331,26 +658,70 @@ Value gettxoutsetinfo(const Array& params, bool fHelp)
             "  \"transactions\": n,      (numeric) The number of transactions\n"
             "  \"txouts\": n,            (numeric) The number of output transactions\n"
             "  \"bytes_serialized\": n,  (numeric) The serialized size\n"
-            "  \"hash_serialized\": \"hash\",   (string) The serialized hash\n"
-            "  \"total_amount\": x.xxx          (numeric) The total amount\n"
+            "  \"hash_serialized\": \"hash\",   (string) The serialized hash (legacy mode only)\n"
+            "  \"muhash\": \"hash\",   (string) Order independent hash of the unspent outputs (not in legacy mode)\n"
+            "  \"total_amount\": x.xxx,         (numeric) The total amount\n"
+            "  \"consistent\": true|false       (boolean) Whether the cached statistics matched the scan (verify mode only)\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("gettxoutsetinfo", "")
+            + HelpExampleCli("gettxoutsetinfo", "\"verify\"")
             + HelpExampleRpc("gettxoutsetinfo", "")
         );
 
+    string strMode = "cached";
+    if (params.size() > 0)
+        strMode = params[0].get_str();
+
     Object ret;
 
-    CCoinsStats stats;
-    if (pcoinsTip->GetStats(stats)) {
-        ret.push_back(Pair("height", (int64_t)stats.nHeight));
-        ret.push_back(Pair("bestblock", stats.hashBlock.GetHex()));
-        ret.push_back(Pair("transactions", (int64_t)stats.nTransactions));
-        ret.push_back(Pair("txouts", (int64_t)stats.nTransactionOutputs));
-        ret.push_back(Pair("bytes_serialized", (int64_t)stats.nSerializedSize));
-        ret.push_back(Pair("hash_serialized", stats.hashSerialized.GetHex()));
-        ret.push_back(Pair("total_amount", ValueFromAmount(stats.nTotalAmount)));
+    if (strMode == "legacy") {
+        CCoinsStats stats;
+        if (pcoinsTip->GetStats(stats)) {
+            ret.push_back(Pair("height", (int64_t)stats.nHeight));
+            ret.push_back(Pair("bestblock", stats.hashBlock.GetHex()));
+            ret.push_back(Pair("transactions", (int64_t)stats.nTransactions));
+            ret.push_back(Pair("txouts", (int64_t)stats.nTransactionOutputs));
+            ret.push_back(Pair("bytes_serialized", (int64_t)stats.nSerializedSize));
+            ret.push_back(Pair("hash_serialized", stats.hashSerialized.GetHex()));
+            ret.push_back(Pair("total_amount", ValueFromAmount(stats.nTotalAmount)));
+        }
+        return ret;
+    }
+    if (strMode != "cached" && strMode != "verify")
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid mode");
+
+    CCoinsRunningStats stats;
+    bool fCached = GetCoinStatsTip(stats);
+    bool fConsistent = true;
+    if (!fCached || strMode == "verify") {
+        CCoinsRunningStats statsScan;
+        int nThreads = std::max(1, (int)boost::thread::hardware_concurrency());
+        if (!ComputeCoinStatsTip(statsScan, nThreads))
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read coin database");
+        if (fCached) {
+            fConsistent = stats.hashBlock == statsScan.hashBlock &&
+                          stats.nTransactions == statsScan.nTransactions &&
+                          stats.nTransactionOutputs == statsScan.nTransactionOutputs &&
+                          stats.nSerializedSize == statsScan.nSerializedSize &&
+                          stats.nTotalAmount == statsScan.nTotalAmount &&
+                          stats.muhash.GetHash() == statsScan.muhash.GetHash();
+            if (!fConsistent)
+                LogPrintf("gettxoutsetinfo : cached UTXO set statistics were inconsistent, replaced by the scanned ones\n");
+        }
+        stats = statsScan;
     }
+
+    map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(stats.hashBlock);
+    ret.push_back(Pair("height", mi == mapBlockIndex.end() ? (int64_t)-1 : (int64_t)mi->second->nHeight));
+    ret.push_back(Pair("bestblock", stats.hashBlock.GetHex()));
+    ret.push_back(Pair("transactions", stats.nTransactions));
+    ret.push_back(Pair("txouts", stats.nTransactionOutputs));
+    ret.push_back(Pair("bytes_serialized", stats.nSerializedSize));
+    ret.push_back(Pair("muhash", stats.muhash.GetHash().GetHex()));
+    ret.push_back(Pair("total_amount", ValueFromAmount(stats.nTotalAmount)));
+    if (strMode == "verify")
+        ret.push_back(Pair("consistent", fConsistent));
     return ret;
 }
 
@@ -401,6 +772,8 @@ Value gettxout(const Array& params, bool fHelp)
     if (params.size() > 2)
         fMempool = params[2].get_bool();
 
+    LOCK(cs_main);
+
     CCoins coins;
     if (fMempool) {
         LOCK(mempool.cs);
@@ -409,6 +782,9 @@ Value gettxout(const Array& params, bool fHelp)
             return Value::null;
         mempool.pruneSpent(hash, coins); // TODO: this should be done by the CCoinsViewMemPool
     } else {
+        // Cheap per-output check first, so misses don't pull coins into the cache
+        if (n<0 || !pcoinsTip->HaveOutput(COutPoint(hash, n)))
+            return Value::null;
         if (!pcoinsTip->GetCoins(hash, coins))
             return Value::null;
     }
@@ -458,6 +834,124 @@ Value verifychain(const Array& params, bool fHelp)
     return VerifyDB(nCheckLevel, nCheckDepth);
 }
 
+static CLevelDBWrapper *GetDBByName(const string& strName)
+{
+    if (strName == "chainstate")
+        return &pcoinsdbview->GetDB();
+    if (strName == "blockindex")
+        return pblocktree;
+    if (strName == "blockfilter" && pblockfilterdb)
+        return pblockfilterdb;
+    throw JSONRPCError(RPC_INVALID_PARAMETER, "Unknown database: " + strName);
+}
+
+static Object DBStatsToJSON(CLevelDBWrapper &db)
+{
+    const CLevelDBOptions &dboptions = db.GetOptions();
+    Object options;
+    options.push_back(Pair("cachesize", (uint64_t)dboptions.nCacheSize));
+    options.push_back(Pair("blocksize", (uint64_t)dboptions.nBlockSize));
+    options.push_back(Pair("writebuffer", (uint64_t)(dboptions.nWriteBufferSize ? dboptions.nWriteBufferSize : dboptions.nCacheSize / 4)));
+    options.push_back(Pair("maxopenfiles", dboptions.nMaxOpenFiles));
+    options.push_back(Pair("bloombits", dboptions.nBloomBits));
+    options.push_back(Pair("compression", dboptions.fCompression));
+
+    Object obj;
+    obj.push_back(Pair("options", options));
+    obj.push_back(Pair("approximate_size", (uint64_t)db.GetApproximateSize()));
+
+    Array files;
+    for (int nLevel = 0; ; nLevel++) {
+        string strFiles;
+        if (!db.GetProperty(strprintf("leveldb.num-files-at-level%d", nLevel), strFiles))
+            break;
+        files.push_back(atoi(strFiles));
+    }
+    obj.push_back(Pair("files_per_level", files));
+
+    string strValue;
+    if (db.GetProperty("leveldb.stats", strValue))
+        obj.push_back(Pair("stats", strValue));
+    if (db.GetProperty("leveldb.sstables", strValue))
+        obj.push_back(Pair("sstables", strValue));
+    return obj;
+}
+
+Value getdbstats(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() > 1)
+        throw runtime_error(
+            "getdbstats ( \"database\" )\n"
+            "\nReturns LevelDB tuning and statistics for the chainstate and block index databases.\n"
+            "\nArguments:\n"
+            "1. \"database\"    (string, optional) \"chainstate\", \"blockindex\" or \"blockfilter\", default all\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"chainstate\": {\n"
+            "    \"options\": {...},          (object) cachesize, blocksize, writebuffer, maxopenfiles, bloombits, compression\n"
+            "    \"approximate_size\": n,     (numeric) approximate size on disk in bytes\n"
+            "    \"files_per_level\": [n,...], (array) number of table files at each level\n"
+            "    \"stats\": \"...\",            (string) compaction statistics per level\n"
+            "    \"sstables\": \"...\"          (string) table files of the current version\n"
+            "  },\n"
+            "  \"blockindex\": {...}\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getdbstats", "")
+            + HelpExampleCli("getdbstats", "\"chainstate\"")
+            + HelpExampleRpc("getdbstats", "\"chainstate\"")
+        );
+
+    vector<string> vNames;
+    if (params.size() > 0)
+        vNames.push_back(params[0].get_str());
+    else {
+        vNames.push_back("chainstate");
+        vNames.push_back("blockindex");
+        if (pblockfilterdb)
+            vNames.push_back("blockfilter");
+    }
+
+    Object ret;
+    BOOST_FOREACH(const string& strName, vNames)
+        ret.push_back(Pair(strName, DBStatsToJSON(*GetDBByName(strName))));
+    return ret;
+}
+
+Value compactdb(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() > 1)
+        throw runtime_error(
+            "compactdb ( \"database\" )\n"
+            "\nCompacts the whole key space of a LevelDB database. This may take a long time.\n"
+            "\nArguments:\n"
+            "1. \"database\"    (string, optional) \"chainstate\", \"blockindex\" or \"blockfilter\", default all\n"
+            "\nExamples:\n"
+            + HelpExampleCli("compactdb", "\"chainstate\"")
+            + HelpExampleRpc("compactdb", "\"chainstate\"")
+        );
+
+    vector<string> vNames;
+    if (params.size() > 0)
+        vNames.push_back(params[0].get_str());
+    else {
+        vNames.push_back("chainstate");
+        vNames.push_back("blockindex");
+        if (pblockfilterdb)
+            vNames.push_back("blockfilter");
+    }
+
+    // Flush the coin cache first so its changes get compacted as well
+    {
+        LOCK(cs_main);
+        pcoinsTip->Flush();
+    }
+
+    BOOST_FOREACH(const string& strName, vNames)
+        GetDBByName(strName)->Compact();
+    return Value::null;
+}
+
 Value getblockchaininfo(const Array& params, bool fHelp)
 {
     if (fHelp || params.size() != 0)
@@ -472,6 +966,11 @@ Value getblockchaininfo(const Array& params, bool fHelp)
             "  \"difficulty\": xxxxxx,     (numeric) the current difficulty\n"
             "  \"verificationprogress\": xxxx, (numeric) estimate of verification progress [0..1]\n"
             "  \"chainwork\": \"xxxx\"     (string) total amount of work in active chain, in hexadecimal\n"
+            "  \"blockfilterindex\": {      (object, only with -blockfilterindex) state of the block filter index\n"
+            "    \"synced\": true|false,    (boolean) whether the index caught up with the active chain\n"
+            "    \"height\": xxxxxx,        (numeric) height of the last indexed block\n"
+            "    \"error\": \"...\"         (string, optional) why indexing stopped\n"
+            "  }\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getblockchaininfo", "")
@@ -491,5 +990,15 @@ Value getblockchaininfo(const Array& params, bool fHelp)
     obj.push_back(Pair("difficulty",    (double)GetDifficulty()));
     obj.push_back(Pair("verificationprogress", Checkpoints::GuessVerificationProgress(chainActive.Tip())));
     obj.push_back(Pair("chainwork",     chainActive.Tip()->nChainWork.GetHex()));
+    if (pblockfilterdb) {
+        int nHeight;
+        std::string strError;
+        Object filterindex;
+        filterindex.push_back(Pair("synced", GetBlockFilterIndexStatus(nHeight, strError)));
+        filterindex.push_back(Pair("height", nHeight));
+        if (!strError.empty())
+            filterindex.push_back(Pair("error", strError));
+        obj.push_back(Pair("blockfilterindex", filterindex));
+    }
     return obj;
 }
@@ -147,6 +147,7 @@ Array RPCConvertValues(const std::string &strMethod, const std::vector<std::stri
     if (strMethod == "sendfrom"               && n > 3) ConvertTo<int64_t>(params[3]);
     if (strMethod == "listtransactions"       && n > 1) ConvertTo<int64_t>(params[1]);
     if (strMethod == "listtransactions"       && n > 2) ConvertTo<int64_t>(params[2]);
+    if (strMethod == "listtransactions"       && n > 3) ConvertTo<int64_t>(params[3]);
     if (strMethod == "listaccounts"           && n > 0) ConvertTo<int64_t>(params[0]);
     if (strMethod == "walletpassphrase"       && n > 1) ConvertTo<int64_t>(params[1]);
     if (strMethod == "walletpassphrase"       && n > 2) ConvertTo<bool>(params[2]);
@@ -169,10 +170,19 @@ Array RPCConvertValues(const std::string &strMethod, const std::vector<std::stri
     if (strMethod == "signrawtransaction"     && n > 2) ConvertTo<Array>(params[2], true);
     if (strMethod == "sendrawtransaction"     && n > 1) ConvertTo<bool>(params[1], true);
     if (strMethod == "gettxout"               && n > 1) ConvertTo<int64_t>(params[1]);
+    if (strMethod == "getaddressdeltas"       && n > 1) ConvertTo<int64_t>(params[1]);
+    if (strMethod == "getaddressdeltas"       && n > 2) ConvertTo<int64_t>(params[2]);
+    if (strMethod == "getaddressdeltas"       && n > 3) ConvertTo<int64_t>(params[3]);
+    if (strMethod == "getaddressdeltas"       && n > 4) ConvertTo<int64_t>(params[4]);
+    if (strMethod == "getaddressutxos"        && n > 1) ConvertTo<int64_t>(params[1]);
+    if (strMethod == "getaddressutxos"        && n > 2) ConvertTo<int64_t>(params[2]);
+    if (strMethod == "getspentinfo"           && n > 1) ConvertTo<int64_t>(params[1]);
     if (strMethod == "gettxout"               && n > 2) ConvertTo<bool>(params[2]);
     if (strMethod == "lockunspent"            && n > 0) ConvertTo<bool>(params[0]);
     if (strMethod == "lockunspent"            && n > 1) ConvertTo<Array>(params[1]);
     if (strMethod == "importprivkey"          && n > 2) ConvertTo<bool>(params[2]);
+    if (strMethod == "importkeys"             && n > 0) ConvertTo<Array>(params[0]);
+    if (strMethod == "importkeys"             && n > 1) ConvertTo<bool>(params[1]);
     if (strMethod == "verifychain"            && n > 0) ConvertTo<int64_t>(params[0]);
     if (strMethod == "verifychain"            && n > 1) ConvertTo<int64_t>(params[1]);
     if (strMethod == "keypoolrefill"          && n > 0) ConvertTo<int64_t>(params[0]);
@@ -182,6 +192,7 @@ Array RPCConvertValues(const std::string &strMethod, const std::vector<std::stri
     if (strMethod == "reservebalance"         && n > 1) ConvertTo<double>(params[1]);
     if (strMethod == "getinterest"            && n > 0) ConvertTo<boost::int64_t>(params[0]);
     if (strMethod == "getinterest"            && n > 1) ConvertTo<boost::int64_t>(params[1]);
+    if (strMethod == "consolidatecoins"       && n > 0) ConvertTo<bool>(params[0]);
 
     return params;
 }
@@ -10,12 +10,17 @@
 #include "wallet.h"
 
 #include <fstream>
+#include <limits>
 #include <stdint.h>
 
 #include <boost/algorithm/string.hpp>
+#include <boost/assign/list_of.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/scoped_ptr.hpp>
+#include "json/json_spirit_utils.h"
 #include "json/json_spirit_value.h"
 
+using namespace boost::assign;
 using namespace json_spirit;
 using namespace std;
 
@@ -108,6 +113,7 @@ Value importprivkey(const Array& params, bool fHelp)
 
     CPubKey pubkey = key.GetPubKey();
     CKeyID vchAddress = pubkey.GetID();
+    CBlockIndex *pindexRescan = NULL;
     {
         LOCK2(cs_main, pwalletMain->cs_wallet);
 
@@ -126,11 +132,14 @@ Value importprivkey(const Array& params, bool fHelp)
         // whenever a key is imported, we need to scan the whole chain
         pwalletMain->nTimeFirstKey = 1; // 0 would be considered 'no value'
 
-        if (fRescan) {
-            pwalletMain->ScanForWalletTransactions(chainActive.Genesis(), true);
-        }
+        if (fRescan)
+            pindexRescan = chainActive.Genesis();
     }
 
+    // The rescan takes the locks it needs by itself
+    if (pindexRescan)
+        pwalletMain->ScanForWalletTransactions(pindexRescan, true);
+
     return Value::null;
 }
 
@@ -232,6 +241,196 @@ Value importwallet(const Array& params, bool fHelp)
     return Value::null;
 }
 
+Value importkeys(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() < 1 || params.size() > 2)
+        throw runtime_error(
+            "importkeys [{\"key\":\"privkey\",\"label\":\"label\",\"timestamp\":n},...] ( rescan )\n"
+            "\nAdds many private keys and redeem scripts to your wallet at once, followed by a single\n"
+            "rescan from the earliest birthday. A running rescan can be stopped with abortrescan;\n"
+            "calling importkeys again resumes it.\n"
+            + HelpRequiringPassphrase() + "\n"
+            "\nArguments:\n"
+            "1. \"entries\"    (string, required) A json array of objects, each with one of\n"
+            "     [\n"
+            "       {\n"
+            "         \"key\":\"privkey\",          (string) a private key (see dumpprivkey)\n"
+            "         \"redeemscript\":\"hex\",     (string) a hex-encoded redeem script\n"
+            "         \"label\":\"label\",          (string, optional) label of the address\n"
+            "         \"timestamp\":n             (numeric, optional) birthday in seconds since epoch, default: scan the whole chain\n"
+            "       }\n"
+            "       ,...\n"
+            "     ]\n"
+            "2. rescan       (boolean, optional, default=true) Rescan the block chain for transactions\n"
+            "\nResult:\n"
+            "[                 (json array of json objects) one for each entry\n"
+            "  {\n"
+            "    \"address\":\"address\",   (string) the address of the key or script\n"
+            "    \"result\":\"result\"      (string) \"added\", \"exists\" or \"error\"\n"
+            "    \"error\":{...}          (json object, only on errors) the error\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("importkeys", "\"[{\\\"key\\\":\\\"mykey\\\",\\\"timestamp\\\":1400000000}]\"")
+            + HelpExampleCli("importkeys", "\"[{\\\"redeemscript\\\":\\\"myscript\\\"}]\" false")
+            + HelpExampleRpc("importkeys", "[{\"key\":\"mykey\",\"timestamp\":1400000000}], true")
+        );
+
+    EnsureWalletIsUnlocked();
+
+    const Array& entries = params[0].get_array();
+    bool fRescan = true;
+    if (params.size() > 1)
+        fRescan = params[1].get_bool();
+
+    Array results;
+    unsigned int nKeys = 0, nScripts = 0;
+    int64_t nTimeBegin = std::numeric_limits<int64_t>::max();
+    CBlockIndex *pindexRescan = NULL;
+    {
+        LOCK2(cs_main, pwalletMain->cs_wallet);
+
+        // write all keys and scripts in one database transaction
+        boost::scoped_ptr<CDBBatch> batch(pwalletMain->fFileBacked ? new CDBBatch(pwalletMain->strWalletFile) : NULL);
+        BOOST_FOREACH(const Value& value, entries)
+        {
+            Object result;
+            try
+            {
+                if (value.type() != obj_type)
+                    throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid parameter, expected object");
+                const Object& entry = value.get_obj();
+                RPCTypeCheck(entry, map_list_of("key", str_type)("redeemscript", str_type)("label", str_type)("timestamp", int_type), true);
+                const Value& vKey = find_value(entry, "key");
+                const Value& vScript = find_value(entry, "redeemscript");
+                const Value& vLabel = find_value(entry, "label");
+                const Value& vTime = find_value(entry, "timestamp");
+                string strLabel = vLabel.type() == null_type ? "" : vLabel.get_str();
+                int64_t nTime = vTime.type() == null_type ? 1 : std::max((int64_t)1, vTime.get_int64()); // 0 would be considered 'no value'
+
+                bool fAdded = false;
+                if (vKey.type() != null_type && vScript.type() == null_type)
+                {
+                    CBitcoinSecret vchSecret;
+                    if (!vchSecret.SetString(vKey.get_str()))
+                        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid private key encoding");
+                    CKey key = vchSecret.GetKey();
+                    if (!key.IsValid())
+                        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Private key outside allowed range");
+                    CPubKey pubkey = key.GetPubKey();
+                    CKeyID keyid = pubkey.GetID();
+                    result.push_back(Pair("address", CBitcoinAddress(keyid).ToString()));
+                    if (!pwalletMain->HaveKey(keyid))
+                    {
+                        pwalletMain->mapKeyMetadata[keyid].nCreateTime = nTime;
+                        if (!pwalletMain->AddKeyPubKey(key, pubkey))
+                            throw JSONRPCError(RPC_WALLET_ERROR, "Error adding key to wallet");
+                        pwalletMain->SetAddressBook(keyid, strLabel, "receive");
+                        nKeys++;
+                        fAdded = true;
+                    }
+                }
+                else if (vScript.type() != null_type && vKey.type() == null_type)
+                {
+                    if (!IsHex(vScript.get_str()))
+                        throw JSONRPCError(RPC_INVALID_PARAMETER, "Redeem script must be hex");
+                    std::vector<unsigned char> vchScript = ParseHex(vScript.get_str());
+                    CScript redeemScript(vchScript.begin(), vchScript.end());
+                    CScriptID scriptid = redeemScript.GetID();
+                    result.push_back(Pair("address", CBitcoinAddress(scriptid).ToString()));
+                    if (!pwalletMain->HaveCScript(scriptid))
+                    {
+                        if (!pwalletMain->AddCScript(redeemScript))
+                            throw JSONRPCError(RPC_WALLET_ERROR, "Error adding redeem script to wallet");
+                        pwalletMain->SetAddressBook(scriptid, strLabel, "send");
+                        nScripts++;
+                        fAdded = true;
+                    }
+                }
+                else
+                    throw JSONRPCError(RPC_INVALID_PARAMETER, "Entry needs either a key or a redeemscript");
+
+                if (fAdded)
+                    nTimeBegin = std::min(nTimeBegin, nTime);
+                result.push_back(Pair("result", fAdded ? "added" : "exists"));
+            }
+            catch (Object& objError)
+            {
+                result.push_back(Pair("result", "error"));
+                result.push_back(Pair("error", objError));
+            }
+            catch (std::exception& e)
+            {
+                result.push_back(Pair("result", "error"));
+                result.push_back(Pair("error", JSONRPCError(RPC_INVALID_PARAMETER, e.what())));
+            }
+            results.push_back(result);
+        }
+        if (batch && !batch->Commit())
+            throw JSONRPCError(RPC_WALLET_ERROR, "Error writing keys and scripts to wallet");
+        batch.reset();
+
+        if (nKeys + nScripts > 0)
+        {
+            pwalletMain->MarkDirty();
+            if (!pwalletMain->nTimeFirstKey || nTimeBegin < pwalletMain->nTimeFirstKey)
+                pwalletMain->nTimeFirstKey = nTimeBegin;
+        }
+
+        if (fRescan)
+        {
+            if (nKeys + nScripts > 0)
+            {
+                pindexRescan = chainActive.Tip();
+                while (pindexRescan && pindexRescan->pprev && pindexRescan->nTime > nTimeBegin - 7200)
+                    pindexRescan = pindexRescan->pprev;
+            }
+
+            // resume a rescan that was aborted or interrupted
+            CBlockLocator locator;
+            if (pwalletMain->fFileBacked && CWalletDB(pwalletMain->strWalletFile).ReadRescanBlock(locator))
+            {
+                CBlockIndex *pindexResume = chainActive.FindFork(locator);
+                if (pindexResume && (!pindexRescan || pindexResume->nHeight < pindexRescan->nHeight))
+                    pindexRescan = pindexResume;
+            }
+        }
+    }
+
+    LogPrintf("importkeys : added %u keys and %u scripts\n", nKeys, nScripts);
+    if (pindexRescan)
+    {
+        LogPrintf("importkeys : rescanning last %i blocks\n", chainActive.Height() - pindexRescan->nHeight + 1);
+        // The rescan takes the locks it needs by itself
+        pwalletMain->ScanForWalletTransactions(pindexRescan, true);
+        if (pwalletMain->WasRescanAborted())
+            throw JSONRPCError(RPC_MISC_ERROR, "Rescan aborted; the keys were added, call importkeys again to resume the rescan");
+    }
+
+    return results;
+}
+
+Value abortrescan(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "abortrescan\n"
+            "\nStops the wallet rescan started by importkeys, importprivkey or importwallet.\n"
+            "It is resumed by the next importkeys call, or on the next start.\n"
+            "\nResult:\n"
+            "true|false    (boolean) whether a rescan was running\n"
+            "\nExamples:\n"
+            + HelpExampleCli("abortrescan", "")
+            + HelpExampleRpc("abortrescan", "")
+        );
+
+    if (!pwalletMain->IsScanning())
+        return false;
+    pwalletMain->AbortRescan();
+    return true;
+}
+
 Value dumpprivkey(const Array& params, bool fHelp)
 {
     if (fHelp || params.size() != 1)
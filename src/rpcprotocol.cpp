@@ -5,6 +5,7 @@
 
 #include "rpcprotocol.h"
 
+#include "jsonstream.h"
 #include "util.h"
 
 #include <stdint.h>
@@ -54,7 +55,7 @@ static string rfc1123Time()
     return DateTimeStrFormat("%a, %d %b %Y %H:%M:%S +0000", GetTime());
 }
 
-string HTTPReply(int nStatus, const string& strMsg, bool keepalive)
+string HTTPReply(int nStatus, const string& strMsg, bool keepalive, const char *contentType)
 {
     if (nStatus == HTTP_UNAUTHORIZED)
         return strprintf("HTTP/1.0 401 Authorization Required\r\n"
@@ -79,23 +80,27 @@ string HTTPReply(int nStatus, const string& strMsg, bool keepalive)
     else if (nStatus == HTTP_FORBIDDEN) cStatus = "Forbidden";
     else if (nStatus == HTTP_NOT_FOUND) cStatus = "Not Found";
     else if (nStatus == HTTP_INTERNAL_SERVER_ERROR) cStatus = "Internal Server Error";
+    else if (nStatus == HTTP_SERVICE_UNAVAILABLE) cStatus = "Service Unavailable";
     else cStatus = "";
-    return strprintf(
+    string strReply = strprintf(
             "HTTP/1.1 %d %s\r\n"
             "Date: %s\r\n"
             "Connection: %s\r\n"
             "Content-Length: %u\r\n"
-            "Content-Type: application/json\r\n"
+            "Content-Type: %s\r\n"
             "Server: bitcoin-json-rpc/%s\r\n"
-            "\r\n"
-            "%s",
+            "\r\n",
         nStatus,
         cStatus,
         rfc1123Time(),
         keepalive ? "keep-alive" : "close",
         strMsg.size(),
-        FormatFullVersion(),
-        strMsg);
+        contentType,
+        FormatFullVersion());
+    // large bodies are appended rather than passed through the formatter
+    strReply.reserve(strReply.size() + strMsg.size());
+    strReply += strMsg;
+    return strReply;
 }
 
 bool ReadHTTPRequestLine(std::basic_istream<char>& stream, int &proto,
@@ -238,10 +243,28 @@ Object JSONRPCReplyObj(const Value& result, const Value& error, const Value& id)
     return reply;
 }
 
+void JSONRPCAppendReply(string& strReply, const Value& result, const Value& error, const Value& id)
+{
+    CJSONWriter writer(strReply);
+    writer.BeginObject();
+    writer.Key("result");
+    if (error.type() != null_type)
+        writer.WriteNull();
+    else
+        writer.Write(result);
+    writer.Key("error");
+    writer.Write(error);
+    writer.Key("id");
+    writer.Write(id);
+    writer.EndObject();
+}
+
 string JSONRPCReply(const Value& result, const Value& error, const Value& id)
 {
-    Object reply = JSONRPCReplyObj(result, error, id);
-    return write_string(Value(reply), false) + "\n";
+    string strReply;
+    JSONRPCAppendReply(strReply, result, error, id);
+    strReply += "\n";
+    return strReply;
 }
 
 Object JSONRPCError(int code, const string& message)
@@ -10,6 +10,7 @@
 #include <map>
 #include <stdint.h>
 #include <string>
+#include <utility>
 #include <boost/iostreams/concepts.hpp>
 #include <boost/iostreams/stream.hpp>
 #include <boost/asio.hpp>
@@ -28,6 +29,7 @@ enum HTTPStatusCode
     HTTP_FORBIDDEN             = 403,
     HTTP_NOT_FOUND             = 404,
     HTTP_INTERNAL_SERVER_ERROR = 500,
+    HTTP_SERVICE_UNAVAILABLE   = 503,
 };
 
 // Bitcoin RPC error codes
@@ -126,15 +128,41 @@ private:
 };
 
 std::string HTTPPost(const std::string& strMsg, const std::map<std::string,std::string>& mapRequestHeaders);
-std::string HTTPReply(int nStatus, const std::string& strMsg, bool keepalive);
+std::string HTTPReply(int nStatus, const std::string& strMsg, bool keepalive,
+                      const char *contentType = "application/json");
 bool ReadHTTPRequestLine(std::basic_istream<char>& stream, int &proto,
                          std::string& http_method, std::string& http_uri);
 int ReadHTTPStatus(std::basic_istream<char>& stream, int &proto);
 int ReadHTTPHeaders(std::basic_istream<char>& stream, std::map<std::string, std::string>& mapHeadersRet);
 int ReadHTTPMessage(std::basic_istream<char>& stream, std::map<std::string, std::string>& mapHeadersRet,
                     std::string& strMessageRet, int nProto);
+
+/** Match condition for reading up to the end of the HTTP headers, an empty line
+ *  with or without carriage return: the position after it and true when found,
+ *  otherwise where to resume matching once more data arrived and false */
+template <typename Iterator>
+std::pair<Iterator, bool> MatchHTTPHeaderEnd(Iterator begin, Iterator end)
+{
+    for (Iterator it = begin; it != end; ++it)
+    {
+        if (*it != '\n')
+            continue;
+        Iterator next = it;
+        ++next;
+        if (next != end && *next == '\r')
+            ++next;
+        if (next == end)
+            return std::make_pair(it, false);
+        if (*next == '\n')
+            return std::make_pair(++next, true);
+    }
+    return std::make_pair(end, false);
+}
+
 std::string JSONRPCRequest(const std::string& strMethod, const json_spirit::Array& params, const json_spirit::Value& id);
 json_spirit::Object JSONRPCReplyObj(const json_spirit::Value& result, const json_spirit::Value& error, const json_spirit::Value& id);
+/** Append the reply JSONRPCReplyObj would build to strReply, without copying result */
+void JSONRPCAppendReply(std::string& strReply, const json_spirit::Value& result, const json_spirit::Value& error, const json_spirit::Value& id);
 std::string JSONRPCReply(const json_spirit::Value& result, const json_spirit::Value& error, const json_spirit::Value& id);
 json_spirit::Object JSONRPCError(int code, const std::string& message);
 
@@ -192,7 +192,10 @@ Value getrawtransaction(const Array& params, bool fHelp)
 
     Object result;
     result.push_back(Pair("hex", strHex));
-    TxToJSON(tx, hashBlock, result);
+    {
+        LOCK(cs_main);
+        TxToJSON(tx, hashBlock, result);
+    }
     return result;
 }
 
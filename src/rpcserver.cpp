@@ -7,6 +7,7 @@
 
 #include "base58.h"
 #include "init.h"
+#include "jsonstream.h"
 #include "main.h"
 #include "ui_interface.h"
 #include "util.h"
@@ -14,15 +15,20 @@
 #include "wallet.h"
 #endif
 
+#include <deque>
+
 #include <boost/algorithm/string.hpp>
 #include <boost/asio.hpp>
 #include <boost/asio/ssl.hpp>
 #include <boost/bind.hpp>
+#include <boost/enable_shared_from_this.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/foreach.hpp>
 #include <boost/iostreams/concepts.hpp>
 #include <boost/iostreams/stream.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
 #include "json/json_spirit_writer_template.h"
 
 using namespace std;
@@ -39,6 +45,7 @@ static ssl::context* rpc_ssl_context = NULL;
 static boost::thread_group* rpc_worker_group = NULL;
 static boost::asio::io_service::work *rpc_dummy_work = NULL;
 static std::vector< boost::shared_ptr<ip::tcp::acceptor> > rpc_acceptors;
+static int nRPCIdleTimeout = DEFAULT_RPC_IDLE_TIMEOUT;
 
 void RPCTypeCheck(const Array& params,
                   const list<Value_type>& typesExpected,
@@ -221,104 +228,116 @@ Value stop(const Array& params, bool fHelp)
 
 
 static const CRPCCommand vRPCCommands[] =
-{ //  name                      actor (function)         okSafeMode threadSafe reqWallet
-  //  ------------------------  -----------------------  ---------- ---------- ---------
+{ //  name                      actor (function)         okSafeMode threadSafe reqWallet readOnly
+  //  ------------------------  -----------------------  ---------- ---------- --------- --------
     /* Overall control/query calls */
-    { "getinfo",                &getinfo,                true,      false,      false }, /* uses wallet if enabled */
-    { "help",                   &help,                   true,      true,       false },
-    { "stop",                   &stop,                   true,      true,       false },
+    { "getinfo",                &getinfo,                true,      false,      false,     true  }, /* uses wallet if enabled */
+    { "help",                   &help,                   true,      true,       false,     true  },
+    { "stop",                   &stop,                   true,      true,       false,     false },
+    { "getrpcinfo",             &getrpcinfo,             true,      true,       false,     true  },
 
     /* P2P networking */
-    { "getnetworkinfo",         &getnetworkinfo,         true,      false,      false },
-    { "addnode",                &addnode,                true,      true,       false },
-    { "getaddednodeinfo",       &getaddednodeinfo,       true,      true,       false },
-    { "getconnectioncount",     &getconnectioncount,     true,      false,      false },
-    { "getnettotals",           &getnettotals,           true,      true,       false },
-    { "getpeerinfo",            &getpeerinfo,            true,      false,      false },
-    { "ping",                   &ping,                   true,      false,      false },
+    { "getnetworkinfo",         &getnetworkinfo,         true,      false,      false,     true  },
+    { "addnode",                &addnode,                true,      true,       false,     false },
+    { "getaddednodeinfo",       &getaddednodeinfo,       true,      true,       false,     true  },
+    { "getconnectioncount",     &getconnectioncount,     true,      false,      false,     true  },
+    { "getnettotals",           &getnettotals,           true,      true,       false,     true  },
+    { "getpeerinfo",            &getpeerinfo,            true,      false,      false,     true  },
+    { "ping",                   &ping,                   true,      false,      false,     false },
 
     /* Block chain and UTXO */
-    { "getblockchaininfo",      &getblockchaininfo,      true,      false,      false },
-    { "getbestblockhash",       &getbestblockhash,       true,      false,      false },
-    { "getblockcount",          &getblockcount,          true,      false,      false },
-    { "getblock",               &getblock,               false,     false,      false },
-    { "getblockhash",           &getblockhash,           false,     false,      false },
-    { "getdifficulty",          &getdifficulty,          true,      false,      false },
-    { "getrawmempool",          &getrawmempool,          true,      false,      false },
-    { "gettxout",               &gettxout,               true,      false,      false },
-    { "gettxoutsetinfo",        &gettxoutsetinfo,        true,      false,      false },
-    { "verifychain",            &verifychain,            true,      false,      false },
+    { "getblockchaininfo",      &getblockchaininfo,      true,      false,      false,     true  },
+    { "getbestblockhash",       &getbestblockhash,       true,      false,      false,     true  },
+    { "getblockcount",          &getblockcount,          true,      false,      false,     true  },
+    { "getblock",               &getblock,               false,     true,       false,     true  },
+    { "getblockhash",           &getblockhash,           false,     true,       false,     true  },
+    { "getblockfilter",         &getblockfilter,         false,     false,      false,     true  },
+    { "getdifficulty",          &getdifficulty,          true,      false,      false,     true  },
+    { "getaddressdeltas",       &getaddressdeltas,       true,      false,      false,     true  },
+    { "getaddressutxos",        &getaddressutxos,        true,      false,      false,     true  },
+    { "getaddressbalance",      &getaddressbalance,      true,      false,      false,     true  },
+    { "getspentinfo",           &getspentinfo,           true,      false,      false,     true  },
+    { "getrawmempool",          &getrawmempool,          true,      false,      false,     true  },
+    { "gettxout",               &gettxout,               true,      true,       false,     true  },
+    { "gettxoutsetinfo",        &gettxoutsetinfo,        true,      false,      false,     false },
+    { "verifychain",            &verifychain,            true,      false,      false,     false },
+    { "getdbstats",             &getdbstats,             true,      false,      false,     true  },
+    { "compactdb",              &compactdb,              true,      true,       false,     false },
 
     /* Mining */
-    { "getblocktemplate",       &getblocktemplate,       true,      false,      false },
-    { "getmininginfo",          &getmininginfo,          true,      false,      false },
-    { "getnetworkhashps",       &getnetworkhashps,       true,      false,      false },
-    { "submitblock",            &submitblock,            false,     false,      false },
+    { "getblocktemplate",       &getblocktemplate,       true,      false,      false,     false },
+    { "getmininginfo",          &getmininginfo,          true,      false,      false,     true  },
+    { "getnetworkhashps",       &getnetworkhashps,       true,      false,      false,     true  },
+    { "submitblock",            &submitblock,            false,     false,      false,     false },
 
     /* Raw transactions */
-    { "createrawtransaction",   &createrawtransaction,   false,     false,      false },
-    { "decoderawtransaction",   &decoderawtransaction,   false,     false,      false },
-    { "decodescript",           &decodescript,           false,     false,      false },
-    { "getrawtransaction",      &getrawtransaction,      false,     false,      false },
-    { "sendrawtransaction",     &sendrawtransaction,     false,     false,      false },
-    { "signrawtransaction",     &signrawtransaction,     false,     false,      false }, /* uses wallet if enabled */
+    { "createrawtransaction",   &createrawtransaction,   false,     false,      false,     true  },
+    { "decoderawtransaction",   &decoderawtransaction,   false,     false,      false,     true  },
+    { "decodescript",           &decodescript,           false,     false,      false,     true  },
+    { "getrawtransaction",      &getrawtransaction,      false,     true,       false,     true  },
+    { "sendrawtransaction",     &sendrawtransaction,     false,     false,      false,     false },
+    { "signrawtransaction",     &signrawtransaction,     false,     false,      false,     false }, /* uses wallet if enabled */
 
     /* Utility functions */
-    { "createmultisig",         &createmultisig,         true,      true ,      false },
-    { "validateaddress",        &validateaddress,        true,      false,      false }, /* uses wallet if enabled */
-    { "verifymessage",          &verifymessage,          false,     false,      false },
+    { "createmultisig",         &createmultisig,         true,      true ,      false,     true  },
+    { "validateaddress",        &validateaddress,        true,      false,      false,     true  }, /* uses wallet if enabled */
+    { "verifymessage",          &verifymessage,          false,     false,      false,     true  },
 
 #ifdef ENABLE_WALLET
     /* Wallet */
-    { "addmultisigaddress",     &addmultisigaddress,     false,     false,      true },
-    { "backupwallet",           &backupwallet,           true,      false,      true },
-    { "dumpprivkey",            &dumpprivkey,            true,      false,      true },
-    { "dumpwallet",             &dumpwallet,             true,      false,      true },
-    { "encryptwallet",          &encryptwallet,          false,     false,      true },
-    { "getaccountaddress",      &getaccountaddress,      true,      false,      true },
-    { "getaccount",             &getaccount,             false,     false,      true },
-    { "getaddressesbyaccount",  &getaddressesbyaccount,  true,      false,      true },
-    { "getbalance",             &getbalance,             false,     false,      true },
-    { "getnewaddress",          &getnewaddress,          true,      false,      true },
-    { "getrawchangeaddress",    &getrawchangeaddress,    true,      false,      true },
-    { "getreceivedbyaccount",   &getreceivedbyaccount,   false,     false,      true },
-    { "getreceivedbyaddress",   &getreceivedbyaddress,   false,     false,      true },
-    { "gettransaction",         &gettransaction,         false,     false,      true },
-    { "getunconfirmedbalance",  &getunconfirmedbalance,  false,     false,      true },
-    { "getwalletinfo",          &getwalletinfo,          true,      false,      true },
-    { "importprivkey",          &importprivkey,          false,     false,      true },
-    { "importwallet",           &importwallet,           false,     false,      true },
-    { "keypoolrefill",          &keypoolrefill,          true,      false,      true },
-    { "listaccounts",           &listaccounts,           false,     false,      true },
-    { "listaddressgroupings",   &listaddressgroupings,   false,     false,      true },
-    { "listlockunspent",        &listlockunspent,        false,     false,      true },
-    { "listreceivedbyaccount",  &listreceivedbyaccount,  false,     false,      true },
-    { "listreceivedbyaddress",  &listreceivedbyaddress,  false,     false,      true },
-    { "listsinceblock",         &listsinceblock,         false,     false,      true },
-    { "listtransactions",       &listtransactions,       false,     false,      true },
-    { "listunspent",            &listunspent,            false,     false,      true },
-    { "lockunspent",            &lockunspent,            false,     false,      true },
-    { "move",                   &movecmd,                false,     false,      true },
-    { "sendfrom",               &sendfrom,               false,     false,      true },
-    { "sendmany",               &sendmany,               false,     false,      true },
-    { "sendtoaddress",          &sendtoaddress,          false,     false,      true },
-    { "setaccount",             &setaccount,             true,      false,      true },
-    { "settxfee",               &settxfee,               false,     false,      true },
-    { "signmessage",            &signmessage,            false,     false,      true },
-    { "walletlock",             &walletlock,             true,      false,      true },
-    { "walletpassphrasechange", &walletpassphrasechange, false,     false,      true },
-    { "walletpassphrase",       &walletpassphrase,       true,      false,      true },
+    { "addmultisigaddress",     &addmultisigaddress,     false,     false,      true,      false },
+    { "backupwallet",           &backupwallet,           true,      false,      true,      false },
+    { "dumpprivkey",            &dumpprivkey,            true,      false,      true,      true  },
+    { "dumpwallet",             &dumpwallet,             true,      false,      true,      false },
+    { "encryptwallet",          &encryptwallet,          false,     false,      true,      false },
+    { "getaccountaddress",      &getaccountaddress,      true,      false,      true,      false },
+    { "getaccount",             &getaccount,             false,     false,      true,      true  },
+    { "getaddressesbyaccount",  &getaddressesbyaccount,  true,      false,      true,      true  },
+    { "getbalance",             &getbalance,             false,     false,      true,      true  },
+    { "getnewaddress",          &getnewaddress,          true,      false,      true,      false },
+    { "getrawchangeaddress",    &getrawchangeaddress,    true,      false,      true,      false },
+    { "getreceivedbyaccount",   &getreceivedbyaccount,   false,     false,      true,      true  },
+    { "getreceivedbyaddress",   &getreceivedbyaddress,   false,     false,      true,      true  },
+    { "gettransaction",         &gettransaction,         false,     false,      true,      true  },
+    { "getunconfirmedbalance",  &getunconfirmedbalance,  false,     false,      true,      true  },
+    { "getwalletinfo",          &getwalletinfo,          true,      false,      true,      true  },
+    { "importprivkey",          &importprivkey,          false,     true,       true,      false },
+    { "importwallet",           &importwallet,           false,     false,      true,      false },
+    { "importkeys",             &importkeys,             false,     true,       true,      false },
+    { "abortrescan",            &abortrescan,            true,      true,       true,      false },
+    { "keypoolrefill",          &keypoolrefill,          true,      false,      true,      false },
+    { "listaccounts",           &listaccounts,           false,     false,      true,      true  },
+    { "listaddressgroupings",   &listaddressgroupings,   false,     false,      true,      true  },
+    { "listlockunspent",        &listlockunspent,        false,     false,      true,      true  },
+    { "listreceivedbyaccount",  &listreceivedbyaccount,  false,     false,      true,      true  },
+    { "listreceivedbyaddress",  &listreceivedbyaddress,  false,     false,      true,      true  },
+    { "listsinceblock",         &listsinceblock,         false,     false,      true,      true  },
+    { "listtransactions",       &listtransactions,       false,     false,      true,      true  },
+    { "listunspent",            &listunspent,            false,     false,      true,      true  },
+    { "lockunspent",            &lockunspent,            false,     false,      true,      false },
+    { "move",                   &movecmd,                false,     false,      true,      false },
+    { "sendfrom",               &sendfrom,               false,     false,      true,      false },
+    { "sendmany",               &sendmany,               false,     false,      true,      false },
+    { "sendtoaddress",          &sendtoaddress,          false,     false,      true,      false },
+    { "setaccount",             &setaccount,             true,      false,      true,      false },
+    { "settxfee",               &settxfee,               false,     false,      true,      false },
+    { "signmessage",            &signmessage,            false,     false,      true,      false },
+    { "walletlock",             &walletlock,             true,      false,      true,      false },
+    { "walletpassphrasechange", &walletpassphrasechange, false,     false,      true,      false },
+    { "walletpassphrase",       &walletpassphrase,       true,      false,      true,      false },
 
     /* Wallet-enabled mining */
-    { "getgenerate",            &getgenerate,            true,      false,      false },
-    { "gethashespersec",        &gethashespersec,        true,      false,      false },
-    { "getwork",                &getwork,                true,      false,      true  },
-    { "setgenerate",            &setgenerate,            true,      true,       false },
+    { "getgenerate",            &getgenerate,            true,      false,      false,     true  },
+    { "gethashespersec",        &gethashespersec,        true,      false,      false,     true  },
+    { "getwork",                &getwork,                true,      false,      true,      false },
+    { "setgenerate",            &setgenerate,            true,      true,       false,     false },
 
     /* PoSV */
-    { "getstakinginfo",         &getstakinginfo,         true,      false,      false },
-    { "reservebalance",         &reservebalance,         false,     false,      false },
-    { "getinterest",            &getinterest,            false,     false,      true },
+    { "getstakinginfo",         &getstakinginfo,         true,      false,      false,     true  },
+    { "reservebalance",         &reservebalance,         false,     false,      false,     false },
+    { "getinterest",            &getinterest,            false,     false,      true,      true  },
+    { "getstakepolicy",         &getstakepolicy,         true,      false,      true,      true  },
+    { "consolidatecoins",       &consolidatecoins,       false,     false,      true,      false },
 #endif // ENABLE_WALLET
 };
 
@@ -353,15 +372,15 @@ bool HTTPAuthorized(map<string, string>& mapHeaders)
     return TimingResistantEqual(strUserPass, strRPCUserColonPass);
 }
 
-void ErrorReply(std::ostream& stream, const Object& objError, const Value& id)
+std::string ErrorReply(const Object& objError, const Value& id)
 {
-    // Send error reply from json-rpc error object
+    // Error reply from json-rpc error object
     int nStatus = HTTP_INTERNAL_SERVER_ERROR;
     int code = find_value(objError, "code").get_int();
     if (code == RPC_INVALID_REQUEST) nStatus = HTTP_BAD_REQUEST;
     else if (code == RPC_METHOD_NOT_FOUND) nStatus = HTTP_NOT_FOUND;
     string strReply = JSONRPCReply(Value::null, objError, id);
-    stream << HTTPReply(nStatus, strReply, false) << std::flush;
+    return HTTPReply(nStatus, strReply, false);
 }
 
 bool ClientAllowed(const boost::asio::ip::address& address)
@@ -387,61 +406,360 @@ bool ClientAllowed(const boost::asio::ip::address& address)
     return false;
 }
 
-class AcceptedConnection
+bool CRPCWorkQueue::Enqueue(const boost::function<void()>& func, bool fRequest)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    if (!fRunning || queue.size() >= nMaxDepth)
+    {
+        if (fRequest)
+            nRejected++;
+        return false;
+    }
+    queue.push_back(std::make_pair(GetTimeMicros(), func));
+    nPeakDepth = std::max(nPeakDepth, queue.size());
+    cond.notify_one();
+    return true;
+}
+
+void CRPCWorkQueue::Run()
+{
+    while (true)
+    {
+        boost::function<void()> func;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (fRunning && queue.empty())
+                cond.wait(lock);
+            if (!fRunning)
+                break;
+            int64_t nWait = GetTimeMicros() - queue.front().first;
+            nTotalWait += nWait;
+            nMaxWait = std::max(nMaxWait, nWait);
+            nProcessed++;
+            func.swap(queue.front().second);
+            queue.pop_front();
+        }
+        func();
+    }
+}
+
+void CRPCWorkQueue::Interrupt()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    fRunning = false;
+    cond.notify_all();
+}
+
+Object CRPCWorkQueue::GetStats()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    Object obj;
+    obj.push_back(Pair("threads", nThreads));
+    obj.push_back(Pair("depth", (uint64_t)queue.size()));
+    obj.push_back(Pair("maxdepth", (uint64_t)nMaxDepth));
+    obj.push_back(Pair("peakdepth", (uint64_t)nPeakDepth));
+    obj.push_back(Pair("processed", nProcessed));
+    obj.push_back(Pair("rejected", nRejected));
+    obj.push_back(Pair("avgwaitms", nProcessed ? (double)nTotalWait / nProcessed / 1000 : 0.0));
+    obj.push_back(Pair("maxwaitms", (double)nMaxWait / 1000));
+    return obj;
+}
+
+static CRPCWorkQueue* rpc_work_queue = NULL;
+
+// Calls and latency of each RPC method
+struct CRPCMethodStats
 {
+    uint64_t nCalls;
+    uint64_t nErrors;
+    int64_t nTotalTime; // microseconds
+    int64_t nMaxTime;
+
+    CRPCMethodStats() : nCalls(0), nErrors(0), nTotalTime(0), nMaxTime(0) {}
+};
+
+static CCriticalSection cs_rpcStats;
+static std::map<std::string, CRPCMethodStats> mapRPCStats;
+
+// Records one call of a method when it goes out of scope
+class CRPCCallTimer
+{
+private:
+    const std::string& strMethod;
+    int64_t nStart;
+
 public:
-    virtual ~AcceptedConnection() {}
+    bool fSuccess;
 
-    virtual std::iostream& stream() = 0;
-    virtual std::string peer_address_to_string() const = 0;
-    virtual void close() = 0;
+    CRPCCallTimer(const std::string& strMethodIn) : strMethod(strMethodIn), nStart(GetTimeMicros()), fSuccess(false) {}
+    ~CRPCCallTimer()
+    {
+        int64_t nTime = GetTimeMicros() - nStart;
+        LOCK(cs_rpcStats);
+        CRPCMethodStats& stats = mapRPCStats[strMethod];
+        stats.nCalls++;
+        if (!fSuccess)
+            stats.nErrors++;
+        stats.nTotalTime += nTime;
+        stats.nMaxTime = std::max(stats.nMaxTime, nTime);
+    }
 };
 
+std::string ServiceRequest(const std::string& strURI, std::map<std::string, std::string>& mapHeaders,
+                           const std::string& strRequest, const std::string& strPeer, bool& fKeepAlive);
+
+static bool IsRESTRequest(const std::string& strURI)
+{
+    return strURI.compare(0, 6, "/rest/") == 0 && GetBoolArg("-rest", DEFAULT_REST_ENABLE);
+}
+
+// Reply to a request refused without running anything: an unknown URI, or
+// missing or wrong credentials. fDelay is set when the reply should be held
+// back to deter brute-forcing short passwords.
+static bool RefuseRequest(const std::string& strURI, std::map<std::string, std::string>& mapHeaders,
+                          const std::string& strPeer, std::string& strReply, bool& fDelay)
+{
+    fDelay = false;
+    if (IsRESTRequest(strURI))
+        return false; // public chain data only, no authorization needed
+    if (strURI != "/")
+        strReply = HTTPReply(HTTP_NOT_FOUND, "", false);
+    else if (mapHeaders.count("authorization") == 0)
+        strReply = HTTPReply(HTTP_UNAUTHORIZED, "", false);
+    else if (!HTTPAuthorized(mapHeaders))
+    {
+        LogPrintf("ThreadRPCServer incorrect password attempt from %s\n", strPeer);
+        /* If this results in a DoS the user really
+           shouldn't have their RPC port exposed. */
+        fDelay = mapArgs["-rpcpassword"].size() < 20;
+        strReply = HTTPReply(HTTP_UNAUTHORIZED, "", false);
+    }
+    else
+        return false;
+    return true;
+}
+
+typedef asio::buffers_iterator<asio::streambuf::const_buffers_type> HTTPHeaderIterator;
+
+/**
+ * One client connection. The connection reads requests on the I/O thread
+ * without blocking it, hands each complete request to the work queue and
+ * writes the reply once a worker has produced it.
+ */
 template <typename Protocol>
-class AcceptedConnectionImpl : public AcceptedConnection
+class RPCConnection : public boost::enable_shared_from_this< RPCConnection<Protocol> >
 {
 public:
-    AcceptedConnectionImpl(
-            asio::io_service& io_service,
-            ssl::context &context,
-            bool fUseSSL) :
-        sslStream(io_service, context),
-        _d(sslStream, fUseSSL),
-        _stream(_d)
+    typename Protocol::endpoint peer;
+    asio::ssl::stream<typename Protocol::socket> sslStream;
+
+    RPCConnection(asio::io_service& io_service, ssl::context& context, bool fUseSSLIn) :
+        sslStream(io_service, context), fUseSSL(fUseSSLIn), buf(RPC_MAX_HEADER_SIZE), fKeepAlive(false),
+        timer(io_service)
     {
     }
 
-    virtual std::iostream& stream()
+    void Start()
     {
-        return _stream;
+        StartIdleTimer();
+        if (fUseSSL)
+            sslStream.async_handshake(ssl::stream_base::server,
+                boost::bind(&RPCConnection::HandleHandshake, this->shared_from_this(), asio::placeholders::error));
+        else
+            ReadHeader();
     }
 
-    virtual std::string peer_address_to_string() const
+    void Close()
     {
-        return peer.address().to_string();
+        boost::system::error_code ec;
+        timer.cancel(ec);
+        sslStream.lowest_layer().shutdown(socket_base::shutdown_both, ec);
+        sslStream.lowest_layer().close(ec);
     }
 
-    virtual void close()
+    // Write a reply, skipping the work queue; for the I/O thread only
+    void WriteReply(const std::string& strReplyIn, bool fKeepAliveIn)
     {
-        _stream.close();
+        strReply = strReplyIn;
+        fKeepAlive = fKeepAliveIn;
+        if (fUseSSL)
+            asio::async_write(sslStream, asio::buffer(strReply),
+                boost::bind(&RPCConnection::HandleWrite, this->shared_from_this(), asio::placeholders::error));
+        else
+            asio::async_write(sslStream.next_layer(), asio::buffer(strReply),
+                boost::bind(&RPCConnection::HandleWrite, this->shared_from_this(), asio::placeholders::error));
     }
 
-    typename Protocol::endpoint peer;
-    asio::ssl::stream<typename Protocol::socket> sslStream;
-
 private:
-    SSLIOStreamDevice<Protocol> _d;
-    iostreams::stream< SSLIOStreamDevice<Protocol> > _stream;
-};
+    bool fUseSSL;
+    asio::streambuf buf;
+    std::map<std::string, std::string> mapHeaders;
+    std::string strURI;
+    std::vector<char> vchBody;
+    std::string strReply;
+    bool fKeepAlive;
+    deadline_timer timer; // idle timeout while reading a request, or the delay of a refusal
+
+    // Close the connection unless a complete request arrives in time
+    void StartIdleTimer()
+    {
+        timer.expires_from_now(boost::posix_time::seconds(nRPCIdleTimeout));
+        timer.async_wait(boost::bind(&RPCConnection::HandleIdleTimeout, this->shared_from_this(), asio::placeholders::error));
+    }
+
+    void HandleIdleTimeout(const boost::system::error_code& error)
+    {
+        // cancelled, or armed again after this expiry was queued
+        if (error || timer.expires_at() > deadline_timer::traits_type::now())
+            return;
+        LogPrint("rpc", "Closing idle RPC connection from %s\n", peer.address().to_string());
+        Close();
+    }
+
+    void HandleRefusalDelay(const boost::system::error_code& error, const std::string& strRefusal)
+    {
+        if (error)
+            return;
+        WriteReply(strRefusal, false);
+    }
+
+    void HandleHandshake(const boost::system::error_code& error)
+    {
+        if (error)
+        {
+            Close();
+            return;
+        }
+        ReadHeader();
+    }
+
+    void ReadHeader()
+    {
+        StartIdleTimer();
+        if (fUseSSL)
+            asio::async_read_until(sslStream, buf, MatchHTTPHeaderEnd<HTTPHeaderIterator>,
+                boost::bind(&RPCConnection::HandleHeader, this->shared_from_this(), asio::placeholders::error));
+        else
+            asio::async_read_until(sslStream.next_layer(), buf, MatchHTTPHeaderEnd<HTTPHeaderIterator>,
+                boost::bind(&RPCConnection::HandleHeader, this->shared_from_this(), asio::placeholders::error));
+    }
+
+    void HandleHeader(const boost::system::error_code& error)
+    {
+        // closed by the client, or headers too long
+        if (error)
+        {
+            Close();
+            return;
+        }
+
+        std::istream stream(&buf);
+        int nProto = 0;
+        string strMethod;
+        if (!ReadHTTPRequestLine(stream, nProto, strMethod, strURI))
+        {
+            Close();
+            return;
+        }
+        mapHeaders.clear();
+        int nLen = ReadHTTPHeaders(stream, mapHeaders);
+        if (nLen < 0 || nLen > (int)MAX_SIZE)
+        {
+            Close();
+            return;
+        }
+        string sConHdr = mapHeaders["connection"];
+        if ((sConHdr != "close") && (sConHdr != "keep-alive"))
+            mapHeaders["connection"] = nProto >= 1 ? "keep-alive" : "close";
+
+        // part of the body may have arrived with the headers
+        vchBody.resize(nLen);
+        size_t nBuffered = std::min((size_t)nLen, buf.size());
+        if (nBuffered > 0)
+            stream.read(&vchBody[0], nBuffered);
+        if (nBuffered < (size_t)nLen)
+        {
+            if (fUseSSL)
+                asio::async_read(sslStream, asio::buffer(&vchBody[nBuffered], nLen - nBuffered),
+                    boost::bind(&RPCConnection::HandleBody, this->shared_from_this(), asio::placeholders::error));
+            else
+                asio::async_read(sslStream.next_layer(), asio::buffer(&vchBody[nBuffered], nLen - nBuffered),
+                    boost::bind(&RPCConnection::HandleBody, this->shared_from_this(), asio::placeholders::error));
+        }
+        else
+            Dispatch();
+    }
+
+    void HandleBody(const boost::system::error_code& error)
+    {
+        if (error)
+        {
+            Close();
+            return;
+        }
+        Dispatch();
+    }
 
-void ServiceConnection(AcceptedConnection *conn);
+    void Dispatch()
+    {
+        boost::system::error_code ec;
+        timer.cancel(ec);
+
+        // Refuse unauthorized requests here, so that they take no slot in the
+        // work queue and their delay holds neither a worker nor this thread
+        string strRefusal;
+        bool fDelay;
+        if (RefuseRequest(strURI, mapHeaders, peer.address().to_string(), strRefusal, fDelay))
+        {
+            vchBody.clear();
+            if (fDelay)
+            {
+                timer.expires_from_now(boost::posix_time::milliseconds(250));
+                timer.async_wait(boost::bind(&RPCConnection::HandleRefusalDelay, this->shared_from_this(),
+                                             asio::placeholders::error, strRefusal));
+            }
+            else
+                WriteReply(strRefusal, false);
+            return;
+        }
+
+        if (!rpc_work_queue->Enqueue(boost::bind(&RPCConnection::Execute, this->shared_from_this())))
+        {
+            LogPrint("rpc", "RPC work queue is full, rejecting a request from %s\n", peer.address().to_string());
+            string strError = JSONRPCReply(Value::null, JSONRPCError(RPC_MISC_ERROR, "Work queue depth exceeded"), Value::null);
+            WriteReply(HTTPReply(HTTP_SERVICE_UNAVAILABLE, strError, false), false);
+        }
+    }
+
+    // Runs on a worker thread
+    void Execute()
+    {
+        bool fKeepAliveNew = true;
+        string strReplyNew = ServiceRequest(strURI, mapHeaders, string(vchBody.begin(), vchBody.end()),
+                                            peer.address().to_string(), fKeepAliveNew);
+        vchBody.clear();
+        // hand the reply back to the I/O thread
+        sslStream.get_io_service().post(boost::bind(&RPCConnection::WriteReply, this->shared_from_this(), strReplyNew, fKeepAliveNew));
+    }
+
+    void HandleWrite(const boost::system::error_code& error)
+    {
+        strReply.clear();
+        if (error || !fKeepAlive || ShutdownRequested())
+        {
+            Close();
+            return;
+        }
+        ReadHeader();
+    }
+};
 
 // Forward declaration required for RPCListen
 template <typename Protocol, typename SocketAcceptorService>
 static void RPCAcceptHandler(boost::shared_ptr< basic_socket_acceptor<Protocol, SocketAcceptorService> > acceptor,
                              ssl::context& context,
                              bool fUseSSL,
-                             boost::shared_ptr< AcceptedConnection > conn,
+                             boost::shared_ptr< RPCConnection<Protocol> > conn,
                              const boost::system::error_code& error);
 
 /**
@@ -453,7 +771,7 @@ static void RPCListen(boost::shared_ptr< basic_socket_acceptor<Protocol, SocketA
                    const bool fUseSSL)
 {
     // Accept connection
-    boost::shared_ptr< AcceptedConnectionImpl<Protocol> > conn(new AcceptedConnectionImpl<Protocol>(acceptor->get_io_service(), context, fUseSSL));
+    boost::shared_ptr< RPCConnection<Protocol> > conn(new RPCConnection<Protocol>(acceptor->get_io_service(), context, fUseSSL));
 
     acceptor->async_accept(
             conn->sslStream.lowest_layer(),
@@ -474,34 +792,32 @@ template <typename Protocol, typename SocketAcceptorService>
 static void RPCAcceptHandler(boost::shared_ptr< basic_socket_acceptor<Protocol, SocketAcceptorService> > acceptor,
                              ssl::context& context,
                              const bool fUseSSL,
-                             boost::shared_ptr< AcceptedConnection > conn,
+                             boost::shared_ptr< RPCConnection<Protocol> > conn,
                              const boost::system::error_code& error)
 {
     // Immediately start accepting new connections, except when we're cancelled or our socket is closed.
     if (error != asio::error::operation_aborted && acceptor->is_open())
         RPCListen(acceptor, context, fUseSSL);
 
-    AcceptedConnectionImpl<ip::tcp>* tcp_conn = dynamic_cast< AcceptedConnectionImpl<ip::tcp>* >(conn.get());
-
     if (error)
     {
         // TODO: Actually handle errors
         LogPrintf("%s: Error: %s\n", __func__, error.message());
+        conn->Close();
     }
     // Restrict callers by IP.  It is important to
-    // do this before starting client thread, to filter out
+    // do this before reading the request, to filter out
     // certain DoS and misbehaving clients.
-    else if (tcp_conn && !ClientAllowed(tcp_conn->peer.address()))
+    else if (!ClientAllowed(conn->peer.address()))
     {
         // Only send a 403 if we're not using SSL to prevent a DoS during the SSL handshake.
         if (!fUseSSL)
-            conn->stream() << HTTPReply(HTTP_FORBIDDEN, "", false) << std::flush;
-        conn->close();
-    }
-    else {
-        ServiceConnection(conn.get());
-        conn->close();
+            conn->WriteReply(HTTPReply(HTTP_FORBIDDEN, "", false), false);
+        else
+            conn->Close();
     }
+    else
+        conn->Start();
 }
 
 void StartRPCThreads()
@@ -619,9 +935,16 @@ void StartRPCThreads()
         return;
     }
 
+    // One thread does all network I/O; the workers run the calls
+    int nWorkers = std::max((int)GetArg("-rpcthreads", DEFAULT_RPC_THREADS), 1);
+    int nQueueDepth = std::max((int)GetArg("-rpcworkqueue", DEFAULT_RPC_WORK_QUEUE), 1);
+    nRPCIdleTimeout = std::max((int)GetArg("-rpcidletimeout", DEFAULT_RPC_IDLE_TIMEOUT), 1);
+    LogPrintf("RPC server: %d worker threads, work queue depth %d\n", nWorkers, nQueueDepth);
+    rpc_work_queue = new CRPCWorkQueue(nQueueDepth, nWorkers);
     rpc_worker_group = new boost::thread_group();
-    for (int i = 0; i < GetArg("-rpcthreads", 4); i++)
-        rpc_worker_group->create_thread(boost::bind(&asio::io_service::run, rpc_io_service));
+    rpc_worker_group->create_thread(boost::bind(&asio::io_service::run, rpc_io_service));
+    for (int i = 0; i < nWorkers; i++)
+        rpc_worker_group->create_thread(boost::bind(&CRPCWorkQueue::Run, rpc_work_queue));
 }
 
 void StartDummyRPCThread()
@@ -660,11 +983,14 @@ void StopRPCThreads()
     }
     deadlineTimers.clear();
 
+    if (rpc_work_queue != NULL)
+        rpc_work_queue->Interrupt();
     rpc_io_service->stop();
     if (rpc_worker_group != NULL)
         rpc_worker_group->join_all();
     delete rpc_dummy_work; rpc_dummy_work = NULL;
     delete rpc_worker_group; rpc_worker_group = NULL;
+    delete rpc_work_queue; rpc_work_queue = NULL;
     delete rpc_ssl_context; rpc_ssl_context = NULL;
     delete rpc_io_service; rpc_io_service = NULL;
 }
@@ -730,119 +1056,257 @@ void JSONRequest::parse(const Value& valRequest)
 }
 
 
-static Object JSONRPCExecOne(const Value& req)
+// Run one request of a batch and serialize its reply, on the thread that ran it
+static void JSONRPCExecOne(const Value& req, string& strReply)
 {
-    Object rpc_result;
-
     JSONRequest jreq;
     try {
         jreq.parse(req);
 
         Value result = tableRPC.execute(jreq.strMethod, jreq.params);
-        rpc_result = JSONRPCReplyObj(result, Value::null, jreq.id);
+        JSONRPCAppendReply(strReply, result, Value::null, jreq.id);
     }
     catch (Object& objError)
     {
-        rpc_result = JSONRPCReplyObj(Value::null, objError, jreq.id);
+        JSONRPCAppendReply(strReply, Value::null, objError, jreq.id);
     }
     catch (std::exception& e)
     {
-        rpc_result = JSONRPCReplyObj(Value::null,
-                                     JSONRPCError(RPC_PARSE_ERROR, e.what()), jreq.id);
+        JSONRPCAppendReply(strReply, Value::null,
+                           JSONRPCError(RPC_PARSE_ERROR, e.what()), jreq.id);
     }
-
-    return rpc_result;
 }
 
-static string JSONRPCExecBatch(const Array& vReq)
+// Requests that may run at the same time as the others of their batch
+static bool IsReadOnlyRequest(const Value& req)
 {
-    Array ret;
-    for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
-        ret.push_back(JSONRPCExecOne(vReq[reqIdx]));
-
-    return write_string(Value(ret), false) + "\n";
+    // malformed requests and unknown methods only produce an error
+    if (req.type() != obj_type)
+        return true;
+    const Value& valMethod = find_value(req.get_obj(), "method");
+    if (valMethod.type() != str_type)
+        return true;
+    const CRPCCommand *pcmd = tableRPC[valMethod.get_str()];
+    return pcmd == NULL || pcmd->readOnly;
 }
 
-void ServiceConnection(AcceptedConnection *conn)
+/**
+ * A run of read-only requests of a batch, executed by the thread serving the
+ * batch together with any workers that pick up its helper tasks. Each thread
+ * takes the next request until none are left, so the batch completes even
+ * if no worker is free to help.
+ */
+class CRPCBatchJob
 {
-    bool fRun = true;
-    while (fRun && !ShutdownRequested())
-    {
-        int nProto = 0;
-        map<string, string> mapHeaders;
-        string strRequest, strMethod, strURI;
-
-        // Read HTTP request line
-        if (!ReadHTTPRequestLine(conn->stream(), nProto, strMethod, strURI))
-            break;
+private:
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    const Array& vReq;
+    std::vector<std::string>& vRet;
+    unsigned int nNext;
+    unsigned int nEnd;
+    unsigned int nRunning;
 
-        // Read HTTP message headers and body
-        ReadHTTPMessage(conn->stream(), mapHeaders, strRequest, nProto);
+public:
+    CRPCBatchJob(const Array& vReqIn, std::vector<std::string>& vRetIn, unsigned int nBegin, unsigned int nEndIn) :
+        vReq(vReqIn), vRet(vRetIn), nNext(nBegin), nEnd(nEndIn), nRunning(0) {}
 
-        if (strURI != "/") {
-            conn->stream() << HTTPReply(HTTP_NOT_FOUND, "", false) << std::flush;
-            break;
+    void Run()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (nNext < nEnd)
+        {
+            unsigned int i = nNext++;
+            nRunning++;
+            lock.unlock();
+            JSONRPCExecOne(vReq[i], vRet[i]);
+            lock.lock();
+            nRunning--;
         }
+        if (nRunning == 0)
+            cond.notify_all();
+    }
+
+    // Wait for the requests taken by other threads
+    void Wait()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (nNext < nEnd || nRunning > 0)
+            cond.wait(lock);
+    }
+};
 
-        // Check authorization
-        if (mapHeaders.count("authorization") == 0)
+unsigned int JSONRPCBatchRunEnd(const Array& vReq, unsigned int nBegin)
+{
+    // requests that change state run alone, in the order given
+    if (!IsReadOnlyRequest(vReq[nBegin]))
+        return nBegin + 1;
+    unsigned int nEnd = nBegin + 1;
+    while (nEnd < vReq.size() && IsReadOnlyRequest(vReq[nEnd]))
+        nEnd++;
+    return nEnd;
+}
+
+string JSONRPCExecBatch(const Array& vReq)
+{
+    std::vector<std::string> vRet(vReq.size());
+    unsigned int nBegin = 0;
+    while (nBegin < vReq.size())
+    {
+        unsigned int nEnd = JSONRPCBatchRunEnd(vReq, nBegin);
+        if (nEnd == nBegin + 1)
         {
-            conn->stream() << HTTPReply(HTTP_UNAUTHORIZED, "", false) << std::flush;
-            break;
+            JSONRPCExecOne(vReq[nBegin], vRet[nBegin]);
+            nBegin++;
+            continue;
         }
-        if (!HTTPAuthorized(mapHeaders))
+
+        boost::shared_ptr<CRPCBatchJob> job(new CRPCBatchJob(vReq, vRet, nBegin, nEnd));
+        if (rpc_work_queue != NULL)
         {
-            LogPrintf("ThreadRPCServer incorrect password attempt from %s\n", conn->peer_address_to_string());
-            /* Deter brute-forcing short passwords.
-               If this results in a DoS the user really
-               shouldn't have their RPC port exposed. */
-            if (mapArgs["-rpcpassword"].size() < 20)
-                MilliSleep(250);
-
-            conn->stream() << HTTPReply(HTTP_UNAUTHORIZED, "", false) << std::flush;
-            break;
+            unsigned int nHelpers = std::min(nEnd - nBegin, (unsigned int)rpc_work_queue->GetThreads()) - 1;
+            for (unsigned int i = 0; i < nHelpers; i++)
+                if (!rpc_work_queue->Enqueue(boost::bind(&CRPCBatchJob::Run, job), false))
+                    break;
         }
-        if (mapHeaders["connection"] == "close")
-            fRun = false;
+        job->Run();
+        job->Wait();
+        nBegin = nEnd;
+    }
 
-        JSONRequest jreq;
-        try
-        {
-            // Parse request
-            Value valRequest;
-            if (!read_string(strRequest, valRequest))
-                throw JSONRPCError(RPC_PARSE_ERROR, "Parse error");
+    // the replies are already serialized, join them into the array
+    size_t nSize = 3;
+    for (unsigned int reqIdx = 0; reqIdx < vRet.size(); reqIdx++)
+        nSize += vRet[reqIdx].size() + 1;
+    string strReply;
+    strReply.reserve(nSize);
+    strReply += '[';
+    for (unsigned int reqIdx = 0; reqIdx < vRet.size(); reqIdx++)
+    {
+        if (reqIdx > 0)
+            strReply += ',';
+        strReply += vRet[reqIdx];
+        string().swap(vRet[reqIdx]);
+    }
+    strReply += "]\n";
+    return strReply;
+}
 
-            string strReply;
+std::string ServiceRequest(const std::string& strURI, std::map<std::string, std::string>& mapHeaders,
+                           const std::string& strRequest, const std::string& strPeer, bool& fKeepAlive)
+{
+    fKeepAlive = false;
+    if (IsRESTRequest(strURI))
+    {
+        fKeepAlive = mapHeaders["connection"] != "close";
+        return HTTPReq_REST(strURI, fKeepAlive);
+    }
 
-            // singleton request
-            if (valRequest.type() == obj_type) {
-                jreq.parse(valRequest);
+    // Check authorization
+    string strRefusal;
+    bool fDelay;
+    if (RefuseRequest(strURI, mapHeaders, strPeer, strRefusal, fDelay))
+    {
+        if (fDelay)
+            MilliSleep(250);
+        return strRefusal;
+    }
+    bool fRun = mapHeaders["connection"] != "close";
 
-                Value result = tableRPC.execute(jreq.strMethod, jreq.params);
+    JSONRequest jreq;
+    try
+    {
+        // Parse request
+        Value valRequest;
+        if (!ReadJSON(strRequest, valRequest))
+            throw JSONRPCError(RPC_PARSE_ERROR, "Parse error");
+
+        string strReply;
+
+        // singleton request
+        if (valRequest.type() == obj_type) {
+            jreq.parse(valRequest);
+
+            Value result = tableRPC.execute(jreq.strMethod, jreq.params);
+
+            // Send reply
+            strReply = JSONRPCReply(result, Value::null, jreq.id);
+
+        // array of requests
+        } else if (valRequest.type() == array_type) {
+            const Array& vReq = valRequest.get_array();
+            unsigned int nMaxBatch = GetArg("-rpcmaxbatch", DEFAULT_RPC_MAX_BATCH);
+            if (vReq.size() > nMaxBatch)
+                throw JSONRPCError(RPC_INVALID_REQUEST, strprintf("Batch of %u requests exceeds the limit of %u", vReq.size(), nMaxBatch));
+            strReply = JSONRPCExecBatch(vReq);
+        } else
+            throw JSONRPCError(RPC_PARSE_ERROR, "Top-level object parse error");
+
+        fKeepAlive = fRun;
+        return HTTPReply(HTTP_OK, strReply, fRun);
+    }
+    catch (Object& objError)
+    {
+        return ErrorReply(objError, jreq.id);
+    }
+    catch (std::exception& e)
+    {
+        return ErrorReply(JSONRPCError(RPC_PARSE_ERROR, e.what()), jreq.id);
+    }
+}
 
-                // Send reply
-                strReply = JSONRPCReply(result, Value::null, jreq.id);
+Value getrpcinfo(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getrpcinfo\n"
+            "\nReturns the state of the RPC work queue and the calls and latency of each method.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"workqueue\": {            (json object, absent without -server)\n"
+            "    \"threads\": n,           (numeric) worker threads running the requests (-rpcthreads)\n"
+            "    \"depth\": n,             (numeric) requests waiting for a worker thread\n"
+            "    \"maxdepth\": n,          (numeric) requests that may wait, further ones get HTTP 503 (-rpcworkqueue)\n"
+            "    \"peakdepth\": n,         (numeric) most requests that were waiting at once\n"
+            "    \"processed\": n,         (numeric) requests run so far\n"
+            "    \"rejected\": n,          (numeric) requests rejected with HTTP 503\n"
+            "    \"avgwaitms\": x.x,       (numeric) average time a request waited for a worker thread\n"
+            "    \"maxwaitms\": x.x        (numeric) longest time a request waited for a worker thread\n"
+            "  },\n"
+            "  \"methods\": {\n"
+            "    \"method\": {             (json object) one for each method called so far\n"
+            "      \"calls\": n,           (numeric) number of calls\n"
+            "      \"errors\": n,          (numeric) calls that failed\n"
+            "      \"avgms\": x.x,         (numeric) average time of a call\n"
+            "      \"maxms\": x.x          (numeric) longest call\n"
+            "    }, ...\n"
+            "  }\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getrpcinfo", "")
+            + HelpExampleRpc("getrpcinfo", "")
+        );
 
-            // array of requests
-            } else if (valRequest.type() == array_type)
-                strReply = JSONRPCExecBatch(valRequest.get_array());
-            else
-                throw JSONRPCError(RPC_PARSE_ERROR, "Top-level object parse error");
+    Object obj;
+    if (rpc_work_queue != NULL)
+        obj.push_back(Pair("workqueue", rpc_work_queue->GetStats()));
 
-            conn->stream() << HTTPReply(HTTP_OK, strReply, fRun) << std::flush;
-        }
-        catch (Object& objError)
-        {
-            ErrorReply(conn->stream(), objError, jreq.id);
-            break;
-        }
-        catch (std::exception& e)
+    Object methods;
+    {
+        LOCK(cs_rpcStats);
+        for (std::map<std::string, CRPCMethodStats>::const_iterator it = mapRPCStats.begin(); it != mapRPCStats.end(); ++it)
         {
-            ErrorReply(conn->stream(), JSONRPCError(RPC_PARSE_ERROR, e.what()), jreq.id);
-            break;
+            const CRPCMethodStats& stats = it->second;
+            Object entry;
+            entry.push_back(Pair("calls", stats.nCalls));
+            entry.push_back(Pair("errors", stats.nErrors));
+            entry.push_back(Pair("avgms", stats.nCalls ? (double)stats.nTotalTime / stats.nCalls / 1000 : 0.0));
+            entry.push_back(Pair("maxms", (double)stats.nMaxTime / 1000));
+            methods.push_back(Pair(it->first, entry));
         }
     }
+    obj.push_back(Pair("methods", methods));
+    return obj;
 }
 
 json_spirit::Value CRPCTable::execute(const std::string &strMethod, const json_spirit::Array &params) const
@@ -862,6 +1326,7 @@ json_spirit::Value CRPCTable::execute(const std::string &strMethod, const json_s
         !pcmd->okSafeMode)
         throw JSONRPCError(RPC_FORBIDDEN_BY_SAFE_MODE, string("Safe mode: ") + strWarning);
 
+    CRPCCallTimer timer(pcmd->name);
     try
     {
         // Execute
@@ -884,6 +1349,7 @@ json_spirit::Value CRPCTable::execute(const std::string &strMethod, const json_s
             }
 #endif // !ENABLE_WALLET
         }
+        timer.fSuccess = true;
         return result;
     }
     catch (std::exception& e)
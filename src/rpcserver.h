@@ -9,16 +9,76 @@
 #include "uint256.h"
 #include "rpcprotocol.h"
 
+#include <deque>
 #include <list>
 #include <map>
 #include <stdint.h>
 #include <string>
+#include <utility>
+
+#include <boost/function.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
 
 #include "json/json_spirit_reader_template.h"
 #include "json/json_spirit_utils.h"
 #include "json/json_spirit_writer_template.h"
 
+class CBlock;
 class CBlockIndex;
+class CTransaction;
+
+/** Default for -rpcthreads, the number of threads running RPC calls */
+static const int DEFAULT_RPC_THREADS = 4;
+/** Default for -rpcworkqueue, the number of RPC requests that may wait for a thread */
+static const int DEFAULT_RPC_WORK_QUEUE = 16;
+/** Default for -rpcmaxbatch, the number of requests a JSON-RPC batch may hold */
+static const unsigned int DEFAULT_RPC_MAX_BATCH = 5000;
+/** Default for -rpcidletimeout, the seconds a connection may take to send a complete request */
+static const int DEFAULT_RPC_IDLE_TIMEOUT = 30;
+/** Longest HTTP request line and headers accepted */
+static const size_t RPC_MAX_HEADER_SIZE = 64 * 1024;
+/** Default for -rest, serving the unauthenticated REST interface on the RPC port */
+static const bool DEFAULT_REST_ENABLE = false;
+
+/** Bounded queue of RPC requests, run by the -rpcthreads worker threads.
+ *  Requests that do not fit are rejected, so that a burst of calls or a few
+ *  slow ones cannot pile up unbounded work.
+ */
+class CRPCWorkQueue
+{
+private:
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    std::deque<std::pair<int64_t, boost::function<void()> > > queue; // enqueue time, work
+    size_t nMaxDepth;
+    int nThreads;
+    bool fRunning;
+
+    // statistics
+    size_t nPeakDepth;
+    uint64_t nProcessed;
+    uint64_t nRejected;
+    int64_t nTotalWait; // microseconds spent queued
+    int64_t nMaxWait;
+
+public:
+    CRPCWorkQueue(size_t nMaxDepthIn, int nThreadsIn) : nMaxDepth(nMaxDepthIn), nThreads(nThreadsIn), fRunning(true),
+        nPeakDepth(0), nProcessed(0), nRejected(0), nTotalWait(0), nMaxWait(0) {}
+
+    // fRequest is false for work that helps a request already running, and is not counted when rejected
+    bool Enqueue(const boost::function<void()>& func, bool fRequest = true);
+    // Run queued work until interrupted; the body of each worker thread
+    void Run();
+    void Interrupt();
+
+    int GetThreads() const
+    {
+        return nThreads;
+    }
+
+    json_spirit::Object GetStats();
+};
 
 /* Start RPC threads */
 void StartRPCThreads();
@@ -30,6 +90,19 @@ void StartDummyRPCThread();
 /* Stop RPC threads */
 void StopRPCThreads();
 
+/* Handle a /rest/ request and return the complete HTTP reply. fKeepAlive is
+ * the client's wish on entry and what the reply promises on return.
+ */
+std::string HTTPReq_REST(const std::string& strURI, bool& fKeepAlive); // in rest.cpp
+
+/* Execute a JSON-RPC batch and return the array of replies, in request order.
+ * Read-only requests between state-changing ones run in parallel on free
+ * workers; each state-changing request runs alone.
+ */
+std::string JSONRPCExecBatch(const json_spirit::Array& vReq);
+/* End of the run of the batch starting at nBegin that executes together */
+unsigned int JSONRPCBatchRunEnd(const json_spirit::Array& vReq, unsigned int nBegin);
+
 /*
   Type-check arguments; throws JSONRPCError if wrong type given. Does not check that
   the right number of arguments are passed, just that any passed are the correct type.
@@ -60,6 +133,7 @@ public:
     bool okSafeMode;
     bool threadSafe;
     bool reqWallet;
+    bool readOnly; // may run at the same time as the other requests of a batch
 };
 
 /**
@@ -107,9 +181,13 @@ extern std::string HexBits(unsigned int nBits);
 extern std::string HelpRequiringPassphrase();
 extern std::string HelpExampleCli(std::string methodname, std::string args);
 extern std::string HelpExampleRpc(std::string methodname, std::string args);
+extern void TxToJSON(const CTransaction& tx, const uint256 hashBlock, json_spirit::Object& entry); // in rpcrawtransaction.cpp
+extern json_spirit::Object blockToJSON(const CBlock& block, const CBlockIndex* blockindex); // in rpcblockchain.cpp
+extern json_spirit::Object blockheaderToJSON(const CBlockIndex* blockindex);
 
 extern void EnsureWalletIsUnlocked();
 
+extern json_spirit::Value getrpcinfo(const json_spirit::Array& params, bool fHelp); // in rpcserver.cpp
 extern json_spirit::Value getconnectioncount(const json_spirit::Array& params, bool fHelp); // in rpcnet.cpp
 extern json_spirit::Value getpeerinfo(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value ping(const json_spirit::Array& params, bool fHelp);
@@ -121,6 +199,8 @@ extern json_spirit::Value dumpprivkey(const json_spirit::Array& params, bool fHe
 extern json_spirit::Value importprivkey(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value dumpwallet(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value importwallet(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value importkeys(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value abortrescan(const json_spirit::Array& params, bool fHelp);
 
 extern json_spirit::Value getgenerate(const json_spirit::Array& params, bool fHelp); // in rpcmining.cpp
 extern json_spirit::Value setgenerate(const json_spirit::Array& params, bool fHelp);
@@ -185,13 +265,22 @@ extern json_spirit::Value settxfee(const json_spirit::Array& params, bool fHelp)
 extern json_spirit::Value getrawmempool(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getblockhash(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getblock(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getblockfilter(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getaddressdeltas(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getaddressutxos(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getaddressbalance(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getspentinfo(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value gettxoutsetinfo(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value gettxout(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value verifychain(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getdbstats(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value compactdb(const json_spirit::Array& params, bool fHelp);
 
 // PoSV
 extern json_spirit::Value getstakinginfo(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value reservebalance(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getinterest(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getstakepolicy(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value consolidatecoins(const json_spirit::Array& params, bool fHelp);
 
 #endif
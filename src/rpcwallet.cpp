@@ -8,6 +8,7 @@
 #include "init.h"
 #include "net.h"
 #include "netbase.h"
+#include "stakepolicy.h"
 #include "util.h"
 #include "wallet.h"
 #include "walletdb.h"
@@ -711,7 +712,8 @@ Value movecmd(const Array& params, bool fHelp)
     debit.nTime = nNow;
     debit.strOtherAccount = strTo;
     debit.strComment = strComment;
-    walletdb.WriteAccountingEntry(debit);
+    if (!walletdb.WriteAccountingEntry(debit))
+        throw JSONRPCError(RPC_DATABASE_ERROR, "database error");
 
     // Credit
     CAccountingEntry credit;
@@ -721,11 +723,16 @@ Value movecmd(const Array& params, bool fHelp)
     credit.nTime = nNow;
     credit.strOtherAccount = strFrom;
     credit.strComment = strComment;
-    walletdb.WriteAccountingEntry(credit);
+    if (!walletdb.WriteAccountingEntry(credit))
+        throw JSONRPCError(RPC_DATABASE_ERROR, "database error");
 
     if (!walletdb.TxnCommit())
         throw JSONRPCError(RPC_DATABASE_ERROR, "database error");
 
+    // only a stored move shows in the activity log
+    pwalletMain->LoadAccountingEntry(debit);
+    pwalletMain->LoadAccountingEntry(credit);
+
     return true;
 }
 
@@ -1192,15 +1199,19 @@ void AcentryToJSON(const CAccountingEntry& acentry, const string& strAccount, Ar
 
 Value listtransactions(const Array& params, bool fHelp)
 {
-    if (fHelp || params.size() > 3)
+    if (fHelp || params.size() > 4)
         throw runtime_error(
-            "listtransactions ( \"account\" count from )\n"
+            "listtransactions ( \"account\" count from before )\n"
             "\nReturns up to 'count' most recent transactions skipping the first 'from' transactions for account 'account'.\n"
             "\nArguments:\n"
             "1. \"account\"    (string, optional) The account name. If not included, it will list all transactions for all accounts.\n"
             "                                     If \"\" is set, it will list transactions for the default account.\n"
             "2. count          (numeric, optional, default=10) The number of transactions to return\n"
             "3. from           (numeric, optional, default=0) The number of transactions to skip\n"
+            "4. before         (numeric, optional) Only list transactions with an \"orderpos\" below this one. To page back\n"
+            "                                      through the history, pass the smallest \"orderpos\" of the previous page.\n"
+            "                                      The entries of one transaction are then never split between pages, so\n"
+            "                                      a page may hold a few more than 'count'.\n"
 
             "\nResult:\n"
             "[\n"
@@ -1232,6 +1243,7 @@ Value listtransactions(const Array& params, bool fHelp)
             "    \"otheraccount\": \"accountname\",  (string) For the 'move' category of transactions, the account the funds came \n"
             "                                          from (for receiving funds, positive amounts), or went to (for sending funds,\n"
             "                                          negative amounts).\n"
+            "    \"orderpos\": n,           (numeric) The position of the transaction in the wallet's history\n"
             "  }\n"
             "]\n"
 
@@ -1242,6 +1254,8 @@ Value listtransactions(const Array& params, bool fHelp)
             + HelpExampleCli("listtransactions", "\"tabby\"") +
             "\nList transactions 100 to 120 from the tabby account\n"
             + HelpExampleCli("listtransactions", "\"tabby\" 20 100") +
+            "\nList the 100 transactions before position 5000\n"
+            + HelpExampleCli("listtransactions", "\"*\" 100 0 5000") +
             "\nAs a json rpc call\n"
             + HelpExampleRpc("listtransactions", "\"tabby\", 20, 100")
         );
@@ -1260,26 +1274,38 @@ Value listtransactions(const Array& params, bool fHelp)
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative count");
     if (nFrom < 0)
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative from");
+    bool fBefore = params.size() > 3;
+    int64_t nBefore = fBefore ? params[3].get_int64() : 0;
 
     Array ret;
-
-    std::list<CAccountingEntry> acentries;
-    CWallet::TxItems txOrdered = pwalletMain->OrderedTxItems(acentries, strAccount);
-
-    // iterate backwards until we have nCount items to return:
-    for (CWallet::TxItems::reverse_iterator it = txOrdered.rbegin(); it != txOrdered.rend(); ++it)
+    if (nCount == 0)
+        return ret;
+
+    // iterate backwards from the newest item, or from the cursor, until we
+    // have nCount items to return; older items are not visited
+    const CWallet::TxItems& txOrdered = pwalletMain->wtxOrdered;
+    CWallet::TxItems::const_reverse_iterator it = txOrdered.rbegin();
+    if (fBefore)
+        it = CWallet::TxItems::const_reverse_iterator(txOrdered.lower_bound(nBefore));
+    for (; it != txOrdered.rend(); ++it)
     {
+        unsigned int nBegin = ret.size();
         CWalletTx *const pwtx = (*it).second.first;
         if (pwtx != 0)
             ListTransactions(*pwtx, strAccount, 0, true, ret);
         CAccountingEntry *const pacentry = (*it).second.second;
         if (pacentry != 0)
             AcentryToJSON(*pacentry, strAccount, ret);
+        for (unsigned int i = nBegin; i < ret.size(); i++)
+            ret[i].get_obj().push_back(Pair("orderpos", (*it).first));
 
         if ((int)ret.size() >= (nCount+nFrom)) break;
     }
     // ret is newest to oldest
 
+    // keep the rest of the oldest transaction when paging by cursor
+    if (fBefore && (int)ret.size() > nCount + nFrom)
+        nCount = ret.size() - nFrom;
     if (nFrom > (int)ret.size())
         nFrom = ret.size();
     if ((nFrom + nCount) > (int)ret.size())
@@ -1355,9 +1381,7 @@ Value listaccounts(const Array& params, bool fHelp)
         }
     }
 
-    list<CAccountingEntry> acentries;
-    CWalletDB(pwalletMain->strWalletFile).ListAccountCreditDebit("*", acentries);
-    BOOST_FOREACH(const CAccountingEntry& entry, acentries)
+    BOOST_FOREACH(const CAccountingEntry& entry, pwalletMain->laccentries)
         mapAccountBalances[entry.strAccount] += entry.nCreditDebit;
 
     Object ret;
@@ -1428,12 +1452,17 @@ Value listsinceblock(const Array& params, bool fHelp)
 
     Array transactions;
 
-    for (map<uint256, CWalletTx>::iterator it = pwalletMain->mapWallet.begin(); it != pwalletMain->mapWallet.end(); it++)
+    // A transaction may confirm long after it entered the wallet, so all of them
+    // are checked; they are listed oldest first, like listtransactions
+    const CWallet::TxItems& txOrdered = pwalletMain->wtxOrdered;
+    for (CWallet::TxItems::const_iterator it = txOrdered.begin(); it != txOrdered.end(); ++it)
     {
-        CWalletTx tx = (*it).second;
+        const CWalletTx *pwtx = (*it).second.first;
+        if (pwtx == 0)
+            continue;
 
-        if (depth == -1 || tx.GetDepthInMainChain() < depth)
-            ListTransactions(tx, "*", 0, true, transactions);
+        if (depth == -1 || pwtx->GetDepthInMainChain() < depth)
+            ListTransactions(*pwtx, "*", 0, true, transactions);
     }
 
     CBlockIndex *pblockLast = chainActive[chainActive.Height() + 1 - target_confirms];
@@ -1835,6 +1864,137 @@ Value getinterest(const Array& params, bool fHelp)
     return  ValueFromAmount(nInterest);
 }
 
+// PoSV: output consolidation policy
+Value getstakepolicy(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getstakepolicy\n"
+            "\nReturns the output consolidation policy, the consolidations it would make now\n"
+            "and the outcome of the runs so far.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"enabled\" : true|false,        (boolean) if consolidation runs in the background (-consolidate)\n"
+            "  \"targetoutput\" : x.xxx,        (numeric) output size aimed for, in btc (-stakecombinethreshold)\n"
+            "  \"consolidatebelow\" : x.xxx,    (numeric) outputs smaller than this are combined, in btc\n"
+            "  \"mininputs\" : n,               (numeric) small outputs an address needs before they are combined\n"
+            "  \"maxinputs\" : n,               (numeric) inputs of a consolidation transaction\n"
+            "  \"splitage\" : n,                (numeric) staked outputs younger than this many seconds are split\n"
+            "  \"outputs\" : n,                 (numeric) stakeable outputs in the wallet\n"
+            "  \"smalloutputs\" : n,            (numeric) how many of them are below consolidatebelow\n"
+            "  \"plan\" : [                     (array of json objects) the consolidations a run would make now\n"
+            "    {\n"
+            "      \"address\" : \"address\",     (string) the address whose outputs are combined\n"
+            "      \"inputs\" : n,              (numeric) number of outputs combined\n"
+            "      \"amount\" : x.xxx,          (numeric) their value, in btc\n"
+            "      \"weightlost\" : n           (numeric) staking weight they have now, in coin-days\n"
+            "    }\n"
+            "    ,...\n"
+            "  ],\n"
+            "  \"lastrun\" : ttt,               (numeric) time of the last run in seconds since epoch, 0 if none\n"
+            "  \"runs\" : n,                    (numeric) runs so far\n"
+            "  \"transactions\" : n,            (numeric) consolidation transactions made\n"
+            "  \"inputs\" : n,                  (numeric) outputs combined\n"
+            "  \"fees\" : x.xxx,                (numeric) fees paid, in btc\n"
+            "  \"lastresult\" : \"result\",       (string) outcome of the last run\n"
+            "  \"lasttxids\" : [\"txid\",...]     (array of string) transactions of the last run\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getstakepolicy", "")
+            + HelpExampleRpc("getstakepolicy", "")
+        );
+
+    CStakePolicy policy;
+    CStakePolicyStats stats;
+    {
+        LOCK(cs_stakepolicy);
+        policy = stakePolicy;
+        stats = stakePolicyStats;
+    }
+
+    vector<CStakeOutput> vOutputs;
+    vector<CConsolidation> vPlan;
+    {
+        LOCK2(cs_main, pwalletMain->cs_wallet);
+        GetStakeOutputs(pwalletMain, vOutputs);
+    }
+    PlanConsolidation(policy, vOutputs, vPlan);
+
+    unsigned int nSmall = 0;
+    BOOST_FOREACH(const CStakeOutput& output, vOutputs)
+        if (output.nValue < policy.nSmallOutput)
+            nSmall++;
+
+    Array plan;
+    BOOST_FOREACH(const CConsolidation& consolidation, vPlan)
+    {
+        Object entry;
+        CTxDestination address;
+        if (ExtractDestination(consolidation.scriptPubKey, address))
+            entry.push_back(Pair("address", CBitcoinAddress(address).ToString()));
+        entry.push_back(Pair("inputs", (int)consolidation.vInputs.size()));
+        entry.push_back(Pair("amount", ValueFromAmount(consolidation.nValue)));
+        entry.push_back(Pair("weightlost", consolidation.nWeightLost));
+        plan.push_back(entry);
+    }
+
+    Array txids;
+    BOOST_FOREACH(const uint256& hash, stats.vLastTxids)
+        txids.push_back(hash.GetHex());
+
+    Object result;
+    result.push_back(Pair("enabled", policy.fEnabled));
+    result.push_back(Pair("targetoutput", ValueFromAmount(policy.nTargetOutput)));
+    result.push_back(Pair("consolidatebelow", ValueFromAmount(policy.nSmallOutput)));
+    result.push_back(Pair("mininputs", (int)policy.nMinInputs));
+    result.push_back(Pair("maxinputs", (int)policy.nMaxInputs));
+    result.push_back(Pair("splitage", (int64_t)nStakeSplitAge));
+    result.push_back(Pair("outputs", (int)vOutputs.size()));
+    result.push_back(Pair("smalloutputs", (int)nSmall));
+    result.push_back(Pair("plan", plan));
+    result.push_back(Pair("lastrun", stats.nLastRun));
+    result.push_back(Pair("runs", (int)stats.nRuns));
+    result.push_back(Pair("transactions", (int)stats.nTransactions));
+    result.push_back(Pair("inputs", (int)stats.nInputs));
+    result.push_back(Pair("fees", ValueFromAmount(stats.nFees)));
+    result.push_back(Pair("lastresult", stats.strLastResult));
+    result.push_back(Pair("lasttxids", txids));
+    return result;
+}
+
+Value consolidatecoins(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() > 1)
+        throw runtime_error(
+            "consolidatecoins ( force )\n"
+            "\nCarries out the plan shown by getstakepolicy now: the small outputs of each address\n"
+            "are combined into one output to that address, at most " + strprintf("%u", CONSOLIDATE_MAX_TRANSACTIONS) + " transactions at a time.\n"
+            + HelpRequiringPassphrase() + "\n"
+            "\nArguments:\n"
+            "1. force      (boolean, optional, default=false) Also run while the memory pool is busy\n"
+            "\nResult:\n"
+            "[\"txid\",...]  (array of string) the consolidation transactions\n"
+            "\nExamples:\n"
+            + HelpExampleCli("consolidatecoins", "")
+            + HelpExampleCli("consolidatecoins", "true")
+            + HelpExampleRpc("consolidatecoins", "true")
+        );
+
+    EnsureWalletIsUnlocked();
+
+    bool fForce = params.size() > 0 && params[0].get_bool();
+    vector<uint256> vTxids;
+    string strResult;
+    bool fSuccess = RunConsolidation(pwalletMain, fForce, vTxids, strResult);
+    if (!fSuccess && vTxids.empty())
+        throw JSONRPCError(RPC_WALLET_ERROR, "Error: " + strResult);
+
+    Array result;
+    BOOST_FOREACH(const uint256& hash, vTxids)
+        result.push_back(hash.GetHex());
+    return result;
+}
+
 Value lockunspent(const Array& params, bool fHelp)
 {
     if (fHelp || params.size() < 1 || params.size() > 2)
@@ -1996,6 +2156,7 @@ Value getwalletinfo(const Array& params, bool fHelp)
             "  \"keypoololdest\": xxxxxx,    (numeric) the timestamp (seconds since GMT epoch) of the oldest pre-generated key in the key pool\n"
             "  \"keypoolsize\": xxxx,        (numeric) how many new keys are pre-generated\n"
             "  \"unlocked_until\": ttt,      (numeric) the timestamp in seconds since epoch (midnight Jan 1 1970 GMT) that the wallet is unlocked for transfers, or 0 if the wallet is locked\n"
+            "  \"rescanprogress\": xx,       (numeric) percentage done of the running rescan, only present while rescanning\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getwalletinfo", "")
@@ -2010,5 +2171,7 @@ Value getwalletinfo(const Array& params, bool fHelp)
     obj.push_back(Pair("keypoolsize",   (int)pwalletMain->GetKeyPoolSize()));
     if (pwalletMain->IsCrypted())
         obj.push_back(Pair("unlocked_until", nWalletUnlockTime));
+    if (pwalletMain->IsScanning())
+        obj.push_back(Pair("rescanprogress", pwalletMain->GetScanProgress()));
     return obj;
 }
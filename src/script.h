@@ -7,6 +7,7 @@
 #define H_BITCOIN_SCRIPT
 
 #include "key.h"
+#include "prevector.h"
 #include "util.h"
 
 #include <stdexcept>
@@ -397,8 +398,12 @@ inline std::string StackString(const std::vector<std::vector<unsigned char> >& v
 
 
 
+/** Storage for scripts: pay-to-pubkey-hash and pay-to-script-hash scripts
+ *  fit inline, so most outputs need no allocation of their own */
+typedef prevector<28, unsigned char> CScriptBase;
+
 /** Serialized script, used inside transaction inputs and outputs */
-class CScript : public std::vector<unsigned char>
+class CScript : public CScriptBase
 {
 protected:
     CScript& push_int64(int64_t n)
@@ -415,14 +420,13 @@ protected:
     }
 public:
     CScript() { }
-    CScript(const CScript& b) : std::vector<unsigned char>(b.begin(), b.end()) { }
-    CScript(const_iterator pbegin, const_iterator pend) : std::vector<unsigned char>(pbegin, pend) { }
-#ifndef _MSC_VER
-    CScript(const unsigned char* pbegin, const unsigned char* pend) : std::vector<unsigned char>(pbegin, pend) { }
-#endif
+    CScript(const CScript& b) : CScriptBase(b.begin(), b.end()) { }
+    CScript(const_iterator pbegin, const_iterator pend) : CScriptBase(pbegin, pend) { }
+    CScript(std::vector<unsigned char>::const_iterator pbegin, std::vector<unsigned char>::const_iterator pend) : CScriptBase(pbegin, pend) { }
 
     CScript& operator+=(const CScript& b)
     {
+        reserve(size() + b.size()); // b may be *this
         insert(end(), b.begin(), b.end());
         return *this;
     }
@@ -711,6 +715,23 @@ public:
     }
 };
 
+inline unsigned int GetSerializeSize(const CScript& v, int nType, int nVersion)
+{
+    return GetSerializeSize((const CScriptBase&)v, nType, nVersion);
+}
+
+template<typename Stream>
+void Serialize(Stream& os, const CScript& v, int nType, int nVersion)
+{
+    Serialize(os, (const CScriptBase&)v, nType, nVersion);
+}
+
+template<typename Stream>
+void Unserialize(Stream& is, CScript& v, int nType, int nVersion)
+{
+    Unserialize(is, (CScriptBase&)v, nType, nVersion);
+}
+
 /** Compact serializer for scripts.
  *
  *  It detects common cases and encodes them much more efficiently.
@@ -0,0 +1,835 @@
+// Copyright (c) 2014 The Reddcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "secp256k1.h"
+
+#include <stdint.h>
+#include <string.h>
+
+namespace {
+
+// Read a DER length at pch[pos], as OpenSSL's asn1_get_length does.
+// nLen is set to -1 for the indefinite form.
+bool ReadDERLength(const unsigned char* pch, size_t nEnd, size_t& pos, long& nLen)
+{
+    if (pos >= nEnd)
+        return false;
+    unsigned char c = pch[pos++];
+    if (c == 0x80)
+    {
+        nLen = -1;
+        return true;
+    }
+    if (!(c & 0x80))
+    {
+        nLen = c;
+        return true;
+    }
+    // long form, at most as many bytes as a long has on LP64 platforms
+    size_t nBytes = c & 0x7f;
+    if (nBytes > 8 || nBytes > nEnd - pos)
+        return false;
+    uint64_t n = 0;
+    while (nBytes--)
+    {
+        if (n >> 55)
+            return false;
+        n = (n << 8) | pch[pos++];
+    }
+    if (n > 0x7fffffffffffffffULL)
+        return false;
+    nLen = (long)n;
+    return true;
+}
+
+// Read a non-negative INTEGER into a 32-byte big endian number, zero if it is
+// larger
+bool ReadDERInteger(const unsigned char* pch, size_t nEnd, size_t& pos, unsigned char out[32])
+{
+    if (pos >= nEnd || pch[pos++] != 0x02)
+        return false;
+    long nLen;
+    if (!ReadDERLength(pch, nEnd, pos, nLen) || nLen < 0 || (size_t)nLen > nEnd - pos)
+        return false;
+    size_t nStart = pos, nSize = nLen;
+    pos += nSize;
+    // negative in two's complement
+    if (nSize > 0 && (pch[nStart] & 0x80))
+        return false;
+    while (nSize > 0 && pch[nStart] == 0)
+    {
+        nStart++;
+        nSize--;
+    }
+    memset(out, 0, 32);
+    if (nSize <= 32)
+        memcpy(out + 32 - nSize, pch + nStart, nSize);
+    return true;
+}
+
+} // namespace
+
+bool ECDSASignatureParseLax(const unsigned char* pchSig, size_t nSigLen, unsigned char r[32], unsigned char s[32])
+{
+    size_t pos = 0;
+    if (nSigLen < 1 || pchSig[pos++] != 0x30)
+        return false;
+    long nLen;
+    if (!ReadDERLength(pchSig, nSigLen, pos, nLen))
+        return false;
+    bool fIndefinite = (nLen < 0);
+    if (!fIndefinite && (size_t)nLen > nSigLen - pos)
+        return false;
+    size_t nEnd = fIndefinite ? nSigLen : pos + nLen;
+
+    if (!ReadDERInteger(pchSig, nEnd, pos, r) || !ReadDERInteger(pchSig, nEnd, pos, s))
+        return false;
+
+    if (fIndefinite)
+        return nEnd - pos >= 2 && pchSig[pos] == 0 && pchSig[pos + 1] == 0;
+    return pos == nEnd;
+}
+
+#if defined(HAVE_NATIVE_SECP256K1)
+
+namespace {
+
+typedef unsigned __int128 uint128_t;
+
+//
+// Field elements: integers modulo p = 2^256 - 2^32 - 977, as four 64-bit
+// little endian limbs, always fully reduced.
+//
+struct Fe
+{
+    uint64_t n[4];
+};
+
+const uint64_t FE_C = 0x1000003D1ULL; // 2^256 - p
+
+const Fe FE_P = {{0xFFFFFFFEFFFFFC2FULL, 0xFFFFFFFFFFFFFFFFULL, 0xFFFFFFFFFFFFFFFFULL, 0xFFFFFFFFFFFFFFFFULL}};
+
+void FeSetInt(Fe& r, uint64_t a)
+{
+    r.n[0] = a;
+    r.n[1] = r.n[2] = r.n[3] = 0;
+}
+
+bool FeIsZero(const Fe& a)
+{
+    return (a.n[0] | a.n[1] | a.n[2] | a.n[3]) == 0;
+}
+
+bool FeEqual(const Fe& a, const Fe& b)
+{
+    return ((a.n[0] ^ b.n[0]) | (a.n[1] ^ b.n[1]) | (a.n[2] ^ b.n[2]) | (a.n[3] ^ b.n[3])) == 0;
+}
+
+bool FeIsOdd(const Fe& a)
+{
+    return a.n[0] & 1;
+}
+
+// Add 2^256 - p to a, returning the carry out of 256 bits
+uint64_t FeAddC(Fe& a, uint64_t c)
+{
+    uint128_t t = (uint128_t)a.n[0] + c;
+    a.n[0] = (uint64_t)t;
+    t >>= 64;
+    for (int i = 1; i < 4; i++)
+    {
+        t += a.n[i];
+        a.n[i] = (uint64_t)t;
+        t >>= 64;
+    }
+    return (uint64_t)t;
+}
+
+// Reduce a value below 2^256 into [0, p)
+void FeReduce(Fe& a)
+{
+    Fe t = a;
+    if (FeAddC(t, FE_C))
+        a = t;
+}
+
+// Big endian bytes; false if the value is not below p
+bool FeSetB32(Fe& r, const unsigned char* b)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        uint64_t v = 0;
+        for (int j = 0; j < 8; j++)
+            v = (v << 8) | b[(3 - i) * 8 + j];
+        r.n[i] = v;
+    }
+    Fe t = r;
+    return FeAddC(t, FE_C) == 0;
+}
+
+void FeAdd(Fe& r, const Fe& a, const Fe& b)
+{
+    uint128_t t = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        t += (uint128_t)a.n[i] + b.n[i];
+        r.n[i] = (uint64_t)t;
+        t >>= 64;
+    }
+    if (t)
+        FeAddC(r, FE_C); // a + b - p, below p
+    else
+        FeReduce(r);
+}
+
+void FeSub(Fe& r, const Fe& a, const Fe& b)
+{
+    uint64_t borrow = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        uint128_t t = (uint128_t)a.n[i] - b.n[i] - borrow;
+        r.n[i] = (uint64_t)t;
+        borrow = (uint64_t)(t >> 64) & 1;
+    }
+    if (borrow)
+    {
+        // a - b + 2^256 - (2^256 - p)
+        borrow = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            uint128_t t = (uint128_t)r.n[i] - (i == 0 ? FE_C : 0) - borrow;
+            r.n[i] = (uint64_t)t;
+            borrow = (uint64_t)(t >> 64) & 1;
+        }
+    }
+}
+
+void FeNeg(Fe& r, const Fe& a)
+{
+    Fe zero;
+    FeSetInt(zero, 0);
+    FeSub(r, zero, a);
+}
+
+void FeMul(Fe& r, const Fe& a, const Fe& b)
+{
+    uint64_t t[8] = {0};
+    for (int i = 0; i < 4; i++)
+    {
+        uint128_t c = 0;
+        for (int j = 0; j < 4; j++)
+        {
+            c += (uint128_t)a.n[i] * b.n[j] + t[i + j];
+            t[i + j] = (uint64_t)c;
+            c >>= 64;
+        }
+        t[i + 4] = (uint64_t)c;
+    }
+
+    // t = lo + hi * 2^256 = lo + hi * (2^256 - p)  (mod p)
+    uint128_t c = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        c += (uint128_t)t[i + 4] * FE_C + t[i];
+        r.n[i] = (uint64_t)c;
+        c >>= 64;
+    }
+    // fold the (at most 34-bit) carry in the same way
+    c *= FE_C;
+    for (int i = 0; i < 4; i++)
+    {
+        c += r.n[i];
+        r.n[i] = (uint64_t)c;
+        c >>= 64;
+    }
+    if (c)
+        FeAddC(r, FE_C);
+    FeReduce(r);
+}
+
+void FeSqr(Fe& r, const Fe& a)
+{
+    FeMul(r, a, a);
+}
+
+// r = a^e for a 256-bit big endian exponent, four bits at a time
+void FePow(Fe& r, const Fe& a, const unsigned char e[32])
+{
+    Fe table[16];
+    FeSetInt(table[0], 1);
+    for (int i = 1; i < 16; i++)
+        FeMul(table[i], table[i - 1], a);
+    FeSetInt(r, 1);
+    for (int i = 0; i < 64; i++)
+    {
+        for (int j = 0; j < 4; j++)
+            FeSqr(r, r);
+        int nibble = (e[i / 2] >> (i & 1 ? 0 : 4)) & 15;
+        if (nibble)
+            FeMul(r, r, table[nibble]);
+    }
+}
+
+const unsigned char FE_P_MINUS_2[32] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFE, 0xFF, 0xFF, 0xFC, 0x2D,
+};
+const unsigned char FE_P_PLUS_1_DIV_4[32] = {
+    0x3F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xBF, 0xFF, 0xFF, 0x0C,
+};
+
+void FeInv(Fe& r, const Fe& a)
+{
+    FePow(r, a, FE_P_MINUS_2);
+}
+
+// A square root of a, if there is one (p = 3 mod 4)
+bool FeSqrt(Fe& r, const Fe& a)
+{
+    FePow(r, a, FE_P_PLUS_1_DIV_4);
+    Fe t;
+    FeSqr(t, r);
+    return FeEqual(t, a);
+}
+
+//
+// Scalars: integers modulo the group order
+// n = 2^256 - 0x14551231950B75FC4402DA1732FC9BEBF
+//
+struct Scalar
+{
+    uint64_t n[4];
+};
+
+const Scalar SC_N = {{0xBFD25E8CD0364141ULL, 0xBAAEDCE6AF48A03BULL, 0xFFFFFFFFFFFFFFFEULL, 0xFFFFFFFFFFFFFFFFULL}};
+const uint64_t SC_NC[3] = {0x402DA1732FC9BEBFULL, 0x4551231950B75FC4ULL, 0x1ULL}; // 2^256 - n
+
+const unsigned char SC_N_MINUS_2[32] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFE,
+    0xBA, 0xAE, 0xDC, 0xE6, 0xAF, 0x48, 0xA0, 0x3B, 0xBF, 0xD2, 0x5E, 0x8C, 0xD0, 0x36, 0x41, 0x3F,
+};
+
+bool ScIsZero(const Scalar& a)
+{
+    return (a.n[0] | a.n[1] | a.n[2] | a.n[3]) == 0;
+}
+
+// Whether a >= n
+bool ScOverflow(const Scalar& a)
+{
+    for (int i = 3; i >= 0; i--)
+    {
+        if (a.n[i] != SC_N.n[i])
+            return a.n[i] > SC_N.n[i];
+    }
+    return true;
+}
+
+void ScReduce(Scalar& a)
+{
+    if (ScOverflow(a))
+    {
+        // a - n = a + (2^256 - n) - 2^256
+        uint128_t t = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            t += (uint128_t)a.n[i] + (i < 3 ? SC_NC[i] : 0);
+            a.n[i] = (uint64_t)t;
+            t >>= 64;
+        }
+    }
+}
+
+void ScSetB32(Scalar& r, const unsigned char* b)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        uint64_t v = 0;
+        for (int j = 0; j < 8; j++)
+            v = (v << 8) | b[(3 - i) * 8 + j];
+        r.n[i] = v;
+    }
+}
+
+void ScMul(Scalar& r, const Scalar& a, const Scalar& b)
+{
+    uint64_t t[8] = {0};
+    for (int i = 0; i < 4; i++)
+    {
+        uint128_t c = 0;
+        for (int j = 0; j < 4; j++)
+        {
+            c += (uint128_t)a.n[i] * b.n[j] + t[i + j];
+            t[i + j] = (uint64_t)c;
+            c >>= 64;
+        }
+        t[i + 4] = (uint64_t)c;
+    }
+
+    // Fold t = lo + hi * 2^256 into lo + hi * (2^256 - n) until it fits
+    while (t[4] | t[5] | t[6] | t[7])
+    {
+        uint64_t u[8] = {t[0], t[1], t[2], t[3], 0, 0, 0, 0};
+        for (int i = 0; i < 4; i++)
+        {
+            uint128_t c = 0;
+            for (int j = 0; j < 3; j++)
+            {
+                c += (uint128_t)t[i + 4] * SC_NC[j] + u[i + j];
+                u[i + j] = (uint64_t)c;
+                c >>= 64;
+            }
+            for (int k = i + 3; c && k < 8; k++)
+            {
+                c += u[k];
+                u[k] = (uint64_t)c;
+                c >>= 64;
+            }
+        }
+        memcpy(t, u, sizeof(t));
+    }
+    memcpy(r.n, t, sizeof(r.n));
+    ScReduce(r);
+}
+
+void ScInv(Scalar& r, const Scalar& a)
+{
+    Scalar table[16];
+    table[0].n[0] = 1;
+    table[0].n[1] = table[0].n[2] = table[0].n[3] = 0;
+    for (int i = 1; i < 16; i++)
+        ScMul(table[i], table[i - 1], a);
+    r = table[0];
+    for (int i = 0; i < 64; i++)
+    {
+        for (int j = 0; j < 4; j++)
+            ScMul(r, r, r);
+        int nibble = (SC_N_MINUS_2[i / 2] >> (i & 1 ? 0 : 4)) & 15;
+        if (nibble)
+            ScMul(r, r, table[nibble]);
+    }
+}
+
+// Width-w non-adjacent form: digits are zero or odd with |d| < 2^(w-1).
+// Returns the number of digits.
+int ScWNAF(int* wnaf, const Scalar& a, int w)
+{
+    uint64_t k[5] = {a.n[0], a.n[1], a.n[2], a.n[3], 0};
+    int nDigits = 0;
+    while (k[0] | k[1] | k[2] | k[3] | k[4])
+    {
+        int d = 0;
+        if (k[0] & 1)
+        {
+            d = k[0] & ((1 << w) - 1);
+            if (d >= (1 << (w - 1)))
+                d -= (1 << w);
+            // k -= d
+            if (d > 0)
+            {
+                uint64_t borrow = d;
+                for (int i = 0; i < 5 && borrow; i++)
+                {
+                    uint64_t old = k[i];
+                    k[i] -= borrow;
+                    borrow = k[i] > old;
+                }
+            }
+            else
+            {
+                uint64_t carry = -d;
+                for (int i = 0; i < 5 && carry; i++)
+                {
+                    k[i] += carry;
+                    carry = k[i] < carry;
+                }
+            }
+        }
+        wnaf[nDigits++] = d;
+        for (int i = 0; i < 4; i++)
+            k[i] = (k[i] >> 1) | (k[i + 1] << 63);
+        k[4] >>= 1;
+    }
+    return nDigits;
+}
+
+//
+// Group elements: y^2 = x^3 + 7
+//
+struct Ge
+{
+    Fe x, y;
+};
+
+struct Gej
+{
+    Fe x, y, z;
+    bool fInfinity;
+};
+
+void GejDouble(Gej& r, const Gej& a)
+{
+    if (a.fInfinity)
+    {
+        r = a;
+        return;
+    }
+    // dbl-2009-l
+    Fe A, B, C, D, E, F, t;
+    FeSqr(A, a.x);
+    FeSqr(B, a.y);
+    FeSqr(C, B);
+    FeAdd(t, a.x, B);
+    FeSqr(D, t);
+    FeSub(D, D, A);
+    FeSub(D, D, C);
+    FeAdd(D, D, D);
+    FeAdd(E, A, A);
+    FeAdd(E, E, A);
+    FeSqr(F, E);
+    FeMul(r.z, a.y, a.z);
+    FeAdd(r.z, r.z, r.z);
+    FeAdd(t, D, D);
+    FeSub(r.x, F, t);
+    FeSub(t, D, r.x);
+    FeMul(r.y, E, t);
+    FeAdd(C, C, C);
+    FeAdd(C, C, C);
+    FeAdd(C, C, C);
+    FeSub(r.y, r.y, C);
+    r.fInfinity = false;
+}
+
+void GejSetGe(Gej& r, const Ge& a)
+{
+    r.x = a.x;
+    r.y = a.y;
+    FeSetInt(r.z, 1);
+    r.fInfinity = false;
+}
+
+// r = a + b with b in affine coordinates
+void GejAddGe(Gej& r, const Gej& a, const Ge& b)
+{
+    if (a.fInfinity)
+    {
+        GejSetGe(r, b);
+        return;
+    }
+    // madd-2007-bl
+    Fe Z1Z1, U2, S2, H, HH, I, J, R, V, t;
+    FeSqr(Z1Z1, a.z);
+    FeMul(U2, b.x, Z1Z1);
+    FeMul(S2, b.y, a.z);
+    FeMul(S2, S2, Z1Z1);
+    FeSub(H, U2, a.x);
+    FeSub(R, S2, a.y);
+    if (FeIsZero(H))
+    {
+        if (FeIsZero(R))
+        {
+            GejDouble(r, a);
+            return;
+        }
+        r.fInfinity = true;
+        return;
+    }
+    FeAdd(R, R, R);
+    FeSqr(HH, H);
+    FeAdd(I, HH, HH);
+    FeAdd(I, I, I);
+    FeMul(J, H, I);
+    FeMul(V, a.x, I);
+    Fe Y1 = a.y;
+    FeAdd(t, a.z, H);
+    FeSqr(r.z, t);
+    FeSub(r.z, r.z, Z1Z1);
+    FeSub(r.z, r.z, HH);
+    FeSqr(r.x, R);
+    FeSub(r.x, r.x, J);
+    FeSub(r.x, r.x, V);
+    FeSub(r.x, r.x, V);
+    FeSub(t, V, r.x);
+    FeMul(r.y, R, t);
+    FeMul(t, Y1, J);
+    FeAdd(t, t, t);
+    FeSub(r.y, r.y, t);
+    r.fInfinity = false;
+}
+
+// r = a + b, both in Jacobian coordinates
+void GejAdd(Gej& r, const Gej& a, const Gej& b)
+{
+    if (a.fInfinity)
+    {
+        r = b;
+        return;
+    }
+    if (b.fInfinity)
+    {
+        r = a;
+        return;
+    }
+    // add-2007-bl
+    Fe Z1Z1, Z2Z2, U1, U2, S1, S2, H, I, J, R, V, t;
+    FeSqr(Z1Z1, a.z);
+    FeSqr(Z2Z2, b.z);
+    FeMul(U1, a.x, Z2Z2);
+    FeMul(U2, b.x, Z1Z1);
+    FeMul(S1, a.y, b.z);
+    FeMul(S1, S1, Z2Z2);
+    FeMul(S2, b.y, a.z);
+    FeMul(S2, S2, Z1Z1);
+    FeSub(H, U2, U1);
+    FeSub(R, S2, S1);
+    if (FeIsZero(H))
+    {
+        if (FeIsZero(R))
+        {
+            GejDouble(r, a);
+            return;
+        }
+        r.fInfinity = true;
+        return;
+    }
+    FeAdd(R, R, R);
+    FeAdd(I, H, H);
+    FeSqr(I, I);
+    FeMul(J, H, I);
+    FeMul(V, U1, I);
+    FeAdd(t, a.z, b.z);
+    FeSqr(t, t);
+    FeSub(t, t, Z1Z1);
+    FeSub(t, t, Z2Z2);
+    FeMul(r.z, t, H);
+    FeSqr(r.x, R);
+    FeSub(r.x, r.x, J);
+    FeSub(r.x, r.x, V);
+    FeSub(r.x, r.x, V);
+    FeSub(t, V, r.x);
+    FeMul(r.y, R, t);
+    FeMul(t, S1, J);
+    FeAdd(t, t, t);
+    FeSub(r.y, r.y, t);
+    r.fInfinity = false;
+}
+
+// Convert points (none at infinity) to affine with a single inversion
+void GejToGeBatch(Ge* r, const Gej* a, int n)
+{
+    Fe prod[64];
+    prod[0] = a[0].z;
+    for (int i = 1; i < n; i++)
+        FeMul(prod[i], prod[i - 1], a[i].z);
+    Fe inv;
+    FeInv(inv, prod[n - 1]);
+    for (int i = n - 1; i >= 0; i--)
+    {
+        Fe zi, zi2, zi3;
+        if (i > 0)
+        {
+            FeMul(zi, inv, prod[i - 1]);
+            FeMul(inv, inv, a[i].z);
+        }
+        else
+            zi = inv;
+        FeSqr(zi2, zi);
+        FeMul(zi3, zi2, zi);
+        FeMul(r[i].x, a[i].x, zi2);
+        FeMul(r[i].y, a[i].y, zi3);
+    }
+}
+
+// Odd multiples a, 3a, 5a, ... of a point, in affine coordinates
+void OddMultiples(Ge* r, const Ge& a, int n)
+{
+    Gej pre[64], a2;
+    GejSetGe(pre[0], a);
+    GejDouble(a2, pre[0]);
+    for (int i = 1; i < n; i++)
+        GejAdd(pre[i], pre[i - 1], a2);
+    GejToGeBatch(r, pre, n);
+}
+
+const int WINDOW_G = 8;  // 64 precomputed multiples of the generator
+const int WINDOW_A = 5;  // 8 multiples of the public key, made per verification
+
+// y^2 = x^3 + 7
+bool GeIsOnCurve(const Ge& a)
+{
+    Fe y2, x3, seven;
+    FeSqr(y2, a.y);
+    FeSqr(x3, a.x);
+    FeMul(x3, x3, a.x);
+    FeSetInt(seven, 7);
+    FeAdd(x3, x3, seven);
+    return FeEqual(y2, x3);
+}
+
+class CGeneratorTable
+{
+public:
+    Ge table[1 << (WINDOW_G - 2)];
+
+    CGeneratorTable()
+    {
+        static const unsigned char gx[32] = {
+            0x79, 0xBE, 0x66, 0x7E, 0xF9, 0xDC, 0xBB, 0xAC, 0x55, 0xA0, 0x62, 0x95, 0xCE, 0x87, 0x0B, 0x07,
+            0x02, 0x9B, 0xFC, 0xDB, 0x2D, 0xCE, 0x28, 0xD9, 0x59, 0xF2, 0x81, 0x5B, 0x16, 0xF8, 0x17, 0x98,
+        };
+        static const unsigned char gy[32] = {
+            0x48, 0x3A, 0xDA, 0x77, 0x26, 0xA3, 0xC4, 0x65, 0x5D, 0xA4, 0xFB, 0xFC, 0x0E, 0x11, 0x08, 0xA8,
+            0xFD, 0x17, 0xB4, 0x48, 0xA6, 0x85, 0x54, 0x19, 0x9C, 0x47, 0xD0, 0x8F, 0xFB, 0x10, 0xD4, 0xB8,
+        };
+        Ge g;
+        FeSetB32(g.x, gx);
+        FeSetB32(g.y, gy);
+        OddMultiples(table, g, 1 << (WINDOW_G - 2));
+    }
+};
+
+// Built during static initialization, before any verifying thread runs
+const CGeneratorTable generatorTable;
+
+// Look up d * P in a table of odd multiples
+void TableGet(Ge& r, const Ge* table, int d)
+{
+    if (d > 0)
+        r = table[(d - 1) / 2];
+    else
+    {
+        r.x = table[(-d - 1) / 2].x;
+        FeNeg(r.y, table[(-d - 1) / 2].y);
+    }
+}
+
+bool ParsePubKey(Ge& r, const unsigned char* pch, size_t nLen)
+{
+    if (nLen == 33 && (pch[0] == 0x02 || pch[0] == 0x03))
+    {
+        if (!FeSetB32(r.x, pch + 1))
+            return false;
+        Fe x3, seven;
+        FeSqr(x3, r.x);
+        FeMul(x3, x3, r.x);
+        FeSetInt(seven, 7);
+        FeAdd(x3, x3, seven);
+        if (!FeSqrt(r.y, x3))
+            return false;
+        if (FeIsOdd(r.y) != (pch[0] == 0x03))
+        {
+            if (FeIsZero(r.y))
+                return false;
+            FeNeg(r.y, r.y);
+        }
+        return true;
+    }
+    if (nLen == 65 && (pch[0] == 0x04 || pch[0] == 0x06 || pch[0] == 0x07))
+    {
+        if (!FeSetB32(r.x, pch + 1) || !FeSetB32(r.y, pch + 33))
+            return false;
+        // the hybrid form also encodes the parity of y
+        if (pch[0] != 0x04 && FeIsOdd(r.y) != (pch[0] == 0x07))
+            return false;
+        return GeIsOnCurve(r);
+    }
+    return false;
+}
+
+} // namespace
+
+// The parsed key holds exactly the table a verification needs
+typedef char pubkey_table_size_check[sizeof(CSecp256k1PubKey) == sizeof(Ge) * (1 << (WINDOW_A - 2)) ? 1 : -1];
+
+bool CSecp256k1PubKey::Parse(const unsigned char* pch, size_t nLen)
+{
+    Ge pubkey, tableA[1 << (WINDOW_A - 2)];
+    if (!ParsePubKey(pubkey, pch, nLen))
+        return false;
+    OddMultiples(tableA, pubkey, 1 << (WINDOW_A - 2));
+    memcpy(table, tableA, sizeof(table));
+    return true;
+}
+
+bool CSecp256k1PubKey::Verify(const unsigned char pchHash[32], const unsigned char r[32], const unsigned char s[32]) const
+{
+    Scalar sr, ss, e;
+    ScSetB32(sr, r);
+    ScSetB32(ss, s);
+    if (ScIsZero(sr) || ScOverflow(sr) || ScIsZero(ss) || ScOverflow(ss))
+        return false;
+    ScSetB32(e, pchHash);
+    ScReduce(e);
+
+    // R = (e / s) G + (r / s) Q
+    Scalar sinv, u1, u2;
+    ScInv(sinv, ss);
+    ScMul(u1, e, sinv);
+    ScMul(u2, sr, sinv);
+
+    int wnaf1[260], wnaf2[260];
+    int n1 = ScWNAF(wnaf1, u1, WINDOW_G);
+    int n2 = ScWNAF(wnaf2, u2, WINDOW_A);
+    Ge tableA[1 << (WINDOW_A - 2)];
+    memcpy(tableA, table, sizeof(table));
+
+    Gej R;
+    R.fInfinity = true;
+    Ge t;
+    for (int i = (n1 > n2 ? n1 : n2) - 1; i >= 0; i--)
+    {
+        GejDouble(R, R);
+        if (i < n1 && wnaf1[i])
+        {
+            TableGet(t, generatorTable.table, wnaf1[i]);
+            GejAddGe(R, R, t);
+        }
+        if (i < n2 && wnaf2[i])
+        {
+            TableGet(t, tableA, wnaf2[i]);
+            GejAddGe(R, R, t);
+        }
+    }
+    if (R.fInfinity)
+        return false;
+
+    // x(R) mod n == r, checked as r * Z^2 == X without an inversion. As
+    // x(R) < p, x(R) mod n is either x(R) or x(R) - n.
+    Fe xr, z2, t2;
+    FeSetB32(xr, r);
+    FeSqr(z2, R.z);
+    FeMul(t2, xr, z2);
+    if (FeEqual(t2, R.x))
+        return true;
+    // r + n < p only if r < p - n
+    static const Fe FE_P_MINUS_N = {{0x402DA1722FC9BAEEULL, 0x4551231950B75FC4ULL, 1, 0}};
+    bool fSmall = false;
+    for (int i = 3; i >= 0; i--)
+    {
+        if (xr.n[i] != FE_P_MINUS_N.n[i])
+        {
+            fSmall = xr.n[i] < FE_P_MINUS_N.n[i];
+            break;
+        }
+    }
+    if (!fSmall)
+        return false;
+    Fe n;
+    memcpy(n.n, SC_N.n, sizeof(n.n));
+    FeAdd(xr, xr, n);
+    FeMul(t2, xr, z2);
+    return FeEqual(t2, R.x);
+}
+
+bool Secp256k1Verify(const unsigned char* pchPubKey, size_t nPubKeyLen, const unsigned char pchHash[32],
+                     const unsigned char r[32], const unsigned char s[32])
+{
+    CSecp256k1PubKey pubkey;
+    if (!pubkey.Parse(pchPubKey, nPubKeyLen))
+        return false;
+    return pubkey.Verify(pchHash, r, s);
+}
+
+#endif // HAVE_NATIVE_SECP256K1
@@ -0,0 +1,62 @@
+// Copyright (c) 2014 The Reddcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SECP256K1_H
+#define BITCOIN_SECP256K1_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+// The native verifier needs 64x64->128 bit multiplication
+#if defined(__SIZEOF_INT128__)
+#define HAVE_NATIVE_SECP256K1 1
+#endif
+
+/** Parse a DER signature the way OpenSSL 1.0.1's d2i_ECDSA_SIG does, which
+ *  is what signatures in the block chain have been checked against:
+ *
+ *  - BER long form lengths are accepted, with leading zero bytes, and so is
+ *    an indefinite length SEQUENCE closed by an end-of-contents marker;
+ *  - the SEQUENCE must hold exactly the two INTEGERs;
+ *  - INTEGERs are big endian numbers and zero padding is ignored, but one
+ *    with the sign bit set is rejected: OpenSSL reads it as negative and no
+ *    negative r or s verifies;
+ *  - bytes after the SEQUENCE are ignored.
+ *
+ *  On success r and s get the 32-byte big endian values. Numbers that do not
+ *  fit in 32 bytes are out of range for ECDSA and come back as zero, so that
+ *  verification fails as it would with OpenSSL.
+ */
+bool ECDSASignatureParseLax(const unsigned char* pchSig, size_t nSigLen, unsigned char r[32], unsigned char s[32]);
+
+#if defined(HAVE_NATIVE_SECP256K1)
+/** A public key parsed for verification with Secp256k1Verify's algorithm.
+ *  Holds the (decompressed) point and the small multiples of it used for
+ *  every signature, so that a key verified repeatedly is only set up once.
+ */
+class CSecp256k1PubKey
+{
+private:
+    // P, 3P, ..., 15P in affine coordinates: four 64-bit limbs of x, then y
+    uint64_t table[8][8];
+
+public:
+    // Parse a key in compressed, uncompressed or hybrid form, checked as
+    // OpenSSL's o2i_ECPublicKey does
+    bool Parse(const unsigned char* pch, size_t nLen);
+
+    bool Verify(const unsigned char pchHash[32], const unsigned char r[32], const unsigned char s[32]) const;
+};
+
+/** Verify an ECDSA signature over secp256k1 without OpenSSL.
+ *
+ *  pchPubKey is a serialized public key, parsed as CSecp256k1PubKey::Parse
+ *  does. r and s are the parsed signature values and pchHash the 32-byte
+ *  message hash.
+ */
+bool Secp256k1Verify(const unsigned char* pchPubKey, size_t nPubKeyLen, const unsigned char pchHash[32],
+                     const unsigned char r[32], const unsigned char s[32]);
+#endif
+
+#endif // BITCOIN_SECP256K1_H
@@ -0,0 +1,380 @@
+// Copyright (c) 2014 The Reddcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#if defined(HAVE_CONFIG_H)
+#include "bitcoin-config.h"
+#endif
+
+#include "sha256.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+#include <cpuid.h>
+#define HAVE_X86_CPUID 1
+#endif
+
+#if defined(ENABLE_SSE41)
+namespace sha256_sse41
+{
+void Transform_4way(unsigned char* out, const unsigned char* in);
+}
+#endif
+
+#if defined(ENABLE_AVX2)
+namespace sha256_avx2
+{
+void Transform_8way(unsigned char* out, const unsigned char* in);
+}
+#endif
+
+#if defined(ENABLE_SHANI)
+namespace sha256_shani
+{
+void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks);
+}
+#endif
+
+namespace
+{
+
+uint32_t inline ReadBE32(const unsigned char* ptr)
+{
+    return ((uint32_t)ptr[0] << 24) | ((uint32_t)ptr[1] << 16) | ((uint32_t)ptr[2] << 8) | (uint32_t)ptr[3];
+}
+
+void inline WriteBE32(unsigned char* ptr, uint32_t x)
+{
+    ptr[0] = x >> 24;
+    ptr[1] = x >> 16;
+    ptr[2] = x >> 8;
+    ptr[3] = x;
+}
+
+void inline WriteBE64(unsigned char* ptr, uint64_t x)
+{
+    WriteBE32(ptr, x >> 32);
+    WriteBE32(ptr + 4, x);
+}
+
+const uint32_t pInitState[8] =
+{0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+//
+// Portable implementation
+//
+uint32_t inline Ch(uint32_t x, uint32_t y, uint32_t z) { return z ^ (x & (y ^ z)); }
+uint32_t inline Maj(uint32_t x, uint32_t y, uint32_t z) { return (x & y) | (z & (x | y)); }
+uint32_t inline Sigma0(uint32_t x) { return (x >> 2 | x << 30) ^ (x >> 13 | x << 19) ^ (x >> 22 | x << 10); }
+uint32_t inline Sigma1(uint32_t x) { return (x >> 6 | x << 26) ^ (x >> 11 | x << 21) ^ (x >> 25 | x << 7); }
+uint32_t inline sigma0(uint32_t x) { return (x >> 7 | x << 25) ^ (x >> 18 | x << 14) ^ (x >> 3); }
+uint32_t inline sigma1(uint32_t x) { return (x >> 17 | x << 15) ^ (x >> 19 | x << 13) ^ (x >> 10); }
+
+const uint32_t K[64] =
+{
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+void TransformGeneric(uint32_t* s, const unsigned char* chunk, size_t blocks)
+{
+    while (blocks--)
+    {
+        uint32_t w[64];
+        for (int i = 0; i < 16; i++)
+            w[i] = ReadBE32(chunk + 4 * i);
+        for (int i = 16; i < 64; i++)
+            w[i] = sigma1(w[i - 2]) + w[i - 7] + sigma0(w[i - 15]) + w[i - 16];
+
+        uint32_t a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+        for (int i = 0; i < 64; i++)
+        {
+            uint32_t t1 = h + Sigma1(e) + Ch(e, f, g) + K[i] + w[i];
+            uint32_t t2 = Sigma0(a) + Maj(a, b, c);
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        s[0] += a;
+        s[1] += b;
+        s[2] += c;
+        s[3] += d;
+        s[4] += e;
+        s[5] += f;
+        s[6] += g;
+        s[7] += h;
+        chunk += 64;
+    }
+}
+
+typedef void (*TransformType)(uint32_t*, const unsigned char*, size_t);
+typedef void (*TransformD64Type)(unsigned char*, const unsigned char*);
+
+TransformType Transform = TransformGeneric;
+
+// Padding of a 64-byte message, and of a 32-byte one after its data
+const unsigned char pPadding64[64] =
+{
+    0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x02, 0x00,
+};
+const unsigned char pPadding32[32] =
+{
+    0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x01, 0x00,
+};
+
+// Double SHA-256 of one 64-byte input with the selected compression function
+void TransformD64(unsigned char* out, const unsigned char* in)
+{
+    uint32_t s[8];
+    memcpy(s, pInitState, sizeof(s));
+    Transform(s, in, 1);
+    Transform(s, pPadding64, 1);
+
+    unsigned char buf[64];
+    for (int i = 0; i < 8; i++)
+        WriteBE32(buf + 4 * i, s[i]);
+    memcpy(buf + 32, pPadding32, 32);
+    memcpy(s, pInitState, sizeof(s));
+    Transform(s, buf, 1);
+    for (int i = 0; i < 8; i++)
+        WriteBE32(out + 4 * i, s[i]);
+}
+
+TransformD64Type TransformD64_4way = NULL;
+TransformD64Type TransformD64_8way = NULL;
+
+// Known answers for the self-test: SHA-256 of the empty string, of "abc",
+// and of the 448-bit message from FIPS 180-2
+const struct {
+    const char* pszInput;
+    unsigned char hash[32];
+} selfTests[] = {
+    { "",
+      {0xe3, 0xb0, 0xc4, 0x42, 0x98, 0xfc, 0x1c, 0x14, 0x9a, 0xfb, 0xf4, 0xc8, 0x99, 0x6f, 0xb9, 0x24,
+       0x27, 0xae, 0x41, 0xe4, 0x64, 0x9b, 0x93, 0x4c, 0xa4, 0x95, 0x99, 0x1b, 0x78, 0x52, 0xb8, 0x55} },
+    { "abc",
+      {0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea, 0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+       0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad} },
+    { "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+      {0x24, 0x8d, 0x6a, 0x61, 0xd2, 0x06, 0x38, 0xb8, 0xe5, 0xc0, 0x26, 0x93, 0x0c, 0x3e, 0x60, 0x39,
+       0xa3, 0x3c, 0xe4, 0x59, 0x64, 0xff, 0x21, 0x67, 0xf6, 0xec, 0xed, 0xd4, 0x19, 0xdb, 0x06, 0xc1} },
+};
+
+bool SelfTestTransform()
+{
+    for (unsigned int i = 0; i < sizeof(selfTests) / sizeof(selfTests[0]); i++)
+    {
+        unsigned char hash[32];
+        CSHA256().Write((const unsigned char*)selfTests[i].pszInput, strlen(selfTests[i].pszInput)).Finalize(hash);
+        if (memcmp(hash, selfTests[i].hash, 32) != 0)
+            return false;
+    }
+    return true;
+}
+
+// Check SHA256D64 against double hashing with CSHA256, for every batch size
+// up to two full rounds of the widest implementation
+bool SelfTestD64()
+{
+    unsigned char in[64 * 17];
+    for (unsigned int i = 0; i < sizeof(in); i++)
+        in[i] = (unsigned char)(i * 7 + 1);
+    for (size_t nBlocks = 1; nBlocks <= 17; nBlocks++)
+    {
+        unsigned char out[32 * 17];
+        SHA256D64(out, in, nBlocks);
+        for (size_t i = 0; i < nBlocks; i++)
+        {
+            unsigned char hash[32];
+            CSHA256().Write(in + 64 * i, 64).Finalize(hash);
+            CSHA256().Write(hash, 32).Finalize(hash);
+            if (memcmp(hash, out + 32 * i, 32) != 0)
+                return false;
+        }
+    }
+    return true;
+}
+
+#if defined(HAVE_X86_CPUID)
+// Whether the OS saves the AVX registers on context switches
+bool AVXEnabled()
+{
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return (a & 6) == 6;
+}
+#endif
+
+} // namespace
+
+CSHA256::CSHA256() : bytes(0)
+{
+    memcpy(s, pInitState, sizeof(s));
+}
+
+CSHA256& CSHA256::Write(const unsigned char* data, size_t len)
+{
+    const unsigned char* end = data + len;
+    size_t bufsize = bytes % 64;
+    if (bufsize && bufsize + len >= 64)
+    {
+        // Fill the buffer, and process it.
+        memcpy(buf + bufsize, data, 64 - bufsize);
+        bytes += 64 - bufsize;
+        data += 64 - bufsize;
+        Transform(s, buf, 1);
+        bufsize = 0;
+    }
+    if (end - data >= 64)
+    {
+        // Process full chunks directly from the source.
+        size_t blocks = (end - data) / 64;
+        Transform(s, data, blocks);
+        data += 64 * blocks;
+        bytes += 64 * blocks;
+    }
+    if (end > data)
+    {
+        // Fill the buffer with what remains.
+        memcpy(buf + bufsize, data, end - data);
+        bytes += end - data;
+    }
+    return *this;
+}
+
+void CSHA256::Finalize(unsigned char hash[OUTPUT_SIZE])
+{
+    static const unsigned char pad[64] = {0x80};
+    unsigned char sizedesc[8];
+    WriteBE64(sizedesc, bytes << 3);
+    Write(pad, 1 + ((119 - (bytes % 64)) % 64));
+    Write(sizedesc, 8);
+    for (int i = 0; i < 8; i++)
+        WriteBE32(hash + 4 * i, s[i]);
+}
+
+CSHA256& CSHA256::Reset()
+{
+    bytes = 0;
+    memcpy(s, pInitState, sizeof(s));
+    return *this;
+}
+
+void SHA256TransformBlocks(uint32_t* state, const unsigned char* pchData, size_t nBlocks)
+{
+    Transform(state, pchData, nBlocks);
+}
+
+void SHA256D64(unsigned char* pchOut, const unsigned char* pchIn, size_t nBlocks)
+{
+    if (TransformD64_8way)
+    {
+        while (nBlocks >= 8)
+        {
+            TransformD64_8way(pchOut, pchIn);
+            pchOut += 256;
+            pchIn += 512;
+            nBlocks -= 8;
+        }
+    }
+    if (TransformD64_4way)
+    {
+        while (nBlocks >= 4)
+        {
+            TransformD64_4way(pchOut, pchIn);
+            pchOut += 128;
+            pchIn += 256;
+            nBlocks -= 4;
+        }
+    }
+    while (nBlocks)
+    {
+        TransformD64(pchOut, pchIn);
+        pchOut += 32;
+        pchIn += 64;
+        nBlocks--;
+    }
+}
+
+bool SHA256SelfTest()
+{
+    return SelfTestTransform() && SelfTestD64();
+}
+
+std::string SHA256AutoDetect()
+{
+    std::string strRet = "generic";
+    Transform = TransformGeneric;
+    TransformD64_4way = NULL;
+    TransformD64_8way = NULL;
+
+#if defined(HAVE_X86_CPUID)
+    uint32_t eax, ebx, ecx, edx;
+    bool fSSE41 = false, fAVX2 = false, fSHANI = false;
+    if (__get_cpuid_max(0, NULL) >= 1)
+    {
+        __cpuid(1, eax, ebx, ecx, edx);
+        fSSE41 = (ecx >> 19) & 1;
+        bool fAVX = ((ecx >> 27) & 1) && ((ecx >> 28) & 1) && AVXEnabled();
+        if (__get_cpuid_max(0, NULL) >= 7)
+        {
+            __cpuid_count(7, 0, eax, ebx, ecx, edx);
+            fAVX2 = fAVX && ((ebx >> 5) & 1);
+            fSHANI = (ebx >> 29) & 1;
+        }
+    }
+
+#if defined(ENABLE_SHANI)
+    if (fSHANI && fSSE41)
+    {
+        Transform = sha256_shani::Transform;
+        strRet = "shani(1way)";
+    }
+#endif
+#if defined(ENABLE_SSE41)
+    if (fSSE41)
+    {
+        TransformD64_4way = sha256_sse41::Transform_4way;
+        strRet += ",sse41(4way)";
+    }
+#endif
+#if defined(ENABLE_AVX2)
+    if (fAVX2)
+    {
+        TransformD64_8way = sha256_avx2::Transform_8way;
+        strRet += ",avx2(8way)";
+    }
+#endif
+    (void)fSSE41; (void)fAVX2; (void)fSHANI;
+#endif // HAVE_X86_CPUID
+
+    if (!SelfTestTransform())
+    {
+        Transform = TransformGeneric;
+        strRet = "generic";
+        TransformD64_4way = NULL;
+        TransformD64_8way = NULL;
+        if (!SelfTestTransform())
+            return "generic (self-test failed)";
+    }
+    if (!SelfTestD64())
+    {
+        TransformD64_4way = NULL;
+        TransformD64_8way = NULL;
+        strRet += " (parallel self-test failed)";
+    }
+    return strRet;
+}
@@ -0,0 +1,52 @@
+// Copyright (c) 2014 The Reddcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SHA256_H
+#define BITCOIN_SHA256_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+
+/** A hasher class for SHA-256.
+ *
+ * The compression function is picked at runtime by SHA256AutoDetect; until
+ * that has been called the portable implementation is used.
+ */
+class CSHA256
+{
+private:
+    uint32_t s[8];
+    unsigned char buf[64];
+    uint64_t bytes;
+
+public:
+    static const size_t OUTPUT_SIZE = 32;
+
+    CSHA256();
+    CSHA256& Write(const unsigned char* data, size_t len);
+    void Finalize(unsigned char hash[OUTPUT_SIZE]);
+    CSHA256& Reset();
+};
+
+/** Select the fastest SHA-256 implementation this CPU supports and check it
+ *  against known answers, falling back to the portable code if the check
+ *  fails. Returns a description of the implementations in use. */
+std::string SHA256AutoDetect();
+
+/** Check the implementations selected by SHA256AutoDetect against known
+ *  answers. False means no implementation, not even the portable one, hashes
+ *  correctly, so nothing can be trusted. */
+bool SHA256SelfTest();
+
+/** Run the SHA-256 compression function over nBlocks 64-byte blocks at
+ *  pchData, updating the eight native-endian words of state. */
+void SHA256TransformBlocks(uint32_t* state, const unsigned char* pchData, size_t nBlocks);
+
+/** Double SHA-256 of each of nBlocks 64-byte inputs at pchIn, writing the
+ *  32-byte results to pchOut. This is the inner loop of merkle tree
+ *  construction, and hashes several inputs in parallel where the CPU can. */
+void SHA256D64(unsigned char* pchOut, const unsigned char* pchIn, size_t nBlocks);
+
+#endif // BITCOIN_SHA256_H
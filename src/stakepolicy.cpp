@@ -0,0 +1,306 @@
+// Copyright (c) 2014 The Reddcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "stakepolicy.h"
+
+#include "bignum.h"
+#include "kernel.h"
+#include "main.h"
+#include "ui_interface.h"
+#include "util.h"
+#include "wallet.h"
+
+#include <algorithm>
+#include <map>
+
+#include <boost/foreach.hpp>
+
+using namespace std;
+
+typedef vector<unsigned char> valtype;
+
+CCriticalSection cs_stakepolicy;
+CStakePolicy stakePolicy;
+CStakePolicyStats stakePolicyStats;
+
+CStakePolicy::CStakePolicy()
+{
+    fEnabled = false;
+    nTargetOutput = 2000000 * COIN;
+    nSmallOutput = nTargetOutput / 100;
+    nMinInputs = DEFAULT_CONSOLIDATE_MIN_INPUTS;
+    nMaxInputs = CONSOLIDATE_MAX_INPUTS;
+}
+
+struct CompareStakeOutputWeight
+{
+    bool operator()(const CStakeOutput* a, const CStakeOutput* b) const
+    {
+        if (a->nWeight != b->nWeight)
+            return a->nWeight < b->nWeight;
+        return a->outpoint < b->outpoint;
+    }
+};
+
+// Least weight lost per combined output first
+struct CompareConsolidationCost
+{
+    bool operator()(const CConsolidation& a, const CConsolidation& b) const
+    {
+        uint64_t nCostA = a.nWeightLost * b.vInputs.size();
+        uint64_t nCostB = b.nWeightLost * a.vInputs.size();
+        if (nCostA != nCostB)
+            return nCostA < nCostB;
+        return a.vInputs.size() > b.vInputs.size();
+    }
+};
+
+void PlanConsolidation(const CStakePolicy& policy, const vector<CStakeOutput>& vOutputs, vector<CConsolidation>& vPlan)
+{
+    vPlan.clear();
+
+    map<CScript, vector<const CStakeOutput*> > mapSmall;
+    BOOST_FOREACH(const CStakeOutput& output, vOutputs)
+        if (output.nValue < policy.nSmallOutput)
+            mapSmall[output.scriptPubKey].push_back(&output);
+
+    for (map<CScript, vector<const CStakeOutput*> >::iterator it = mapSmall.begin(); it != mapSmall.end(); ++it)
+    {
+        vector<const CStakeOutput*>& vSmall = it->second;
+        if (vSmall.size() < policy.nMinInputs)
+            continue;
+
+        // young outputs have little or no weight yet, combining them costs the least
+        sort(vSmall.begin(), vSmall.end(), CompareStakeOutputWeight());
+
+        CConsolidation consolidation;
+        consolidation.scriptPubKey = it->first;
+        BOOST_FOREACH(const CStakeOutput* pout, vSmall)
+        {
+            if (consolidation.vInputs.size() >= policy.nMaxInputs)
+                break;
+            if (consolidation.nValue + pout->nValue > policy.nTargetOutput)
+                break;
+            consolidation.vInputs.push_back(pout->outpoint);
+            consolidation.nValue += pout->nValue;
+            consolidation.nWeightLost += pout->nWeight;
+        }
+        if (consolidation.vInputs.size() >= policy.nMinInputs)
+            vPlan.push_back(consolidation);
+    }
+
+    sort(vPlan.begin(), vPlan.end(), CompareConsolidationCost());
+}
+
+void GetStakeOutputs(const CWallet* pwallet, vector<CStakeOutput>& vOutputs)
+{
+    vOutputs.clear();
+
+    vector<COutput> vCoins;
+    pwallet->AvailableCoins(vCoins, true);
+    int64_t nNow = GetTime();
+    BOOST_FOREACH(const COutput& out, vCoins)
+    {
+        if (out.nDepth < 1)
+            continue;
+
+        // only outputs that can stake, like CreateCoinStake
+        const CTxOut& txout = out.tx->vout[out.i];
+        txnouttype whichType;
+        vector<valtype> vSolutions;
+        if (!Solver(txout.scriptPubKey, whichType, vSolutions))
+            continue;
+        if (whichType != TX_PUBKEY && whichType != TX_PUBKEYHASH)
+            continue;
+
+        unsigned int nTimeTx = out.tx->nTime;
+        if (!nTimeTx)
+        {
+            map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(out.tx->hashBlock);
+            if (mi == mapBlockIndex.end())
+                continue;
+            nTimeTx = mi->second->nTime;
+        }
+
+        CStakeOutput output;
+        output.outpoint = COutPoint(out.tx->GetHash(), out.i);
+        output.scriptPubKey = txout.scriptPubKey;
+        output.nValue = txout.nValue;
+        int64_t nTimeWeight = GetCoinAgeWeight((int64_t)nTimeTx, nNow);
+        output.nWeight = nTimeWeight > 0 ? (CBigNum(txout.nValue) * nTimeWeight / COIN / (24 * 60 * 60)).getuint64() : 0;
+        vOutputs.push_back(output);
+    }
+}
+
+bool CreateConsolidationTransaction(CWallet* pwallet, const CConsolidation& consolidation, CWalletTx& wtxNew, int64_t& nFeeRet, string& strFailReason)
+{
+    wtxNew.BindWallet(pwallet);
+
+    vector<const CWalletTx*> vwtxPrev;
+    double dPriorityInputs = 0;
+    BOOST_FOREACH(const COutPoint& prevout, consolidation.vInputs)
+    {
+        map<uint256, CWalletTx>::const_iterator mi = pwallet->mapWallet.find(prevout.hash);
+        if (mi == pwallet->mapWallet.end() || prevout.n >= mi->second.vout.size())
+        {
+            strFailReason = _("Output to consolidate is not in the wallet");
+            return false;
+        }
+        vwtxPrev.push_back(&mi->second);
+        dPriorityInputs += (double)mi->second.vout[prevout.n].nValue * (mi->second.GetDepthInMainChain() + 1);
+    }
+
+    nFeeRet = nTransactionFee;
+    while (true)
+    {
+        wtxNew.vin.clear();
+        wtxNew.vout.clear();
+        wtxNew.fFromMe = true;
+
+        CTxOut txout(consolidation.nValue - nFeeRet, consolidation.scriptPubKey);
+        if (txout.nValue <= 0 || txout.IsDust(CTransaction::nMinRelayTxFee))
+        {
+            strFailReason = _("Transaction amount too small");
+            return false;
+        }
+        wtxNew.vout.push_back(txout);
+
+        BOOST_FOREACH(const COutPoint& prevout, consolidation.vInputs)
+            wtxNew.vin.push_back(CTxIn(prevout));
+
+        for (unsigned int nIn = 0; nIn < vwtxPrev.size(); nIn++)
+            if (!SignSignature(*pwallet, *vwtxPrev[nIn], wtxNew, nIn))
+            {
+                strFailReason = _("Signing transaction failed");
+                return false;
+            }
+
+        // Limit size
+        unsigned int nBytes = ::GetSerializeSize(*(CTransaction*)&wtxNew, SER_NETWORK, PROTOCOL_VERSION);
+        if (nBytes >= MAX_STANDARD_TX_SIZE)
+        {
+            strFailReason = _("Transaction too large");
+            return false;
+        }
+        double dPriority = wtxNew.ComputePriority(dPriorityInputs, nBytes);
+
+        // Check that enough fee is included
+        int64_t nPayFee = nTransactionFee * (1 + (int64_t)nBytes / 1000);
+        int64_t nMinFee = GetMinFee(wtxNew, nBytes, AllowFree(dPriority), GMF_SEND);
+        if (nFeeRet < max(nPayFee, nMinFee))
+        {
+            nFeeRet = max(nPayFee, nMinFee);
+            continue;
+        }
+
+        wtxNew.fTimeReceivedIsTxTime = true;
+        return true;
+    }
+}
+
+bool RunConsolidation(CWallet* pwallet, bool fForce, vector<uint256>& vTxidsRet, string& strResult)
+{
+    vTxidsRet.clear();
+
+    CStakePolicy policy;
+    {
+        LOCK(cs_stakepolicy);
+        policy = stakePolicy;
+    }
+
+    bool fSuccess = true;
+    unsigned int nInputs = 0;
+    int64_t nFees = 0;
+    {
+        LOCK2(cs_main, pwallet->cs_wallet);
+        if (pwallet->IsLocked())
+        {
+            strResult = "wallet is locked";
+            fSuccess = false;
+        }
+        else if (fWalletUnlockStakingOnly)
+        {
+            strResult = "wallet is unlocked for staking only";
+            fSuccess = false;
+        }
+        else if (!fForce && mempool.size() > CONSOLIDATE_MAX_MEMPOOL_TX)
+        {
+            strResult = strprintf("deferred, %u transactions in the memory pool", mempool.size());
+            fSuccess = false;
+        }
+        else
+        {
+            vector<CStakeOutput> vOutputs;
+            GetStakeOutputs(pwallet, vOutputs);
+            vector<CConsolidation> vPlan;
+            PlanConsolidation(policy, vOutputs, vPlan);
+
+            BOOST_FOREACH(const CConsolidation& consolidation, vPlan)
+            {
+                if (vTxidsRet.size() >= CONSOLIDATE_MAX_TRANSACTIONS)
+                    break;
+
+                CWalletTx wtx;
+                int64_t nFee;
+                string strFailReason;
+                if (!CreateConsolidationTransaction(pwallet, consolidation, wtx, nFee, strFailReason))
+                {
+                    strResult = strFailReason;
+                    fSuccess = false;
+                    continue;
+                }
+                // there is no change, the reserve key is never used
+                CReserveKey reservekey(pwallet);
+                if (!pwallet->CommitTransaction(wtx, reservekey))
+                {
+                    strResult = "the transaction was rejected";
+                    fSuccess = false;
+                    continue;
+                }
+                vTxidsRet.push_back(wtx.GetHash());
+                nInputs += consolidation.vInputs.size();
+                nFees += nFee;
+            }
+            if (fSuccess)
+                strResult = strprintf("combined %u outputs in %u transactions", nInputs, vTxidsRet.size());
+        }
+    }
+
+    if (!fSuccess || !vTxidsRet.empty())
+        LogPrintf("RunConsolidation : %s\n", strResult);
+
+    LOCK(cs_stakepolicy);
+    stakePolicyStats.nLastRun = GetTime();
+    stakePolicyStats.nRuns++;
+    stakePolicyStats.nTransactions += vTxidsRet.size();
+    stakePolicyStats.nInputs += nInputs;
+    stakePolicyStats.nFees += nFees;
+    stakePolicyStats.strLastResult = strResult;
+    stakePolicyStats.vLastTxids = vTxidsRet;
+    return fSuccess;
+}
+
+void ThreadStakePolicy(CWallet* pwallet)
+{
+    // Make this thread recognisable as the consolidation thread
+    RenameThread("reddcoin-consolidate");
+
+    int64_t nNextRun = GetTime() + CONSOLIDATE_INTERVAL;
+    while (true)
+    {
+        MilliSleep(60 * 1000);
+
+        if (GetTime() < nNextRun || IsInitialBlockDownload())
+            continue;
+        // fees are flat per kB, but a quiet memory pool gets the
+        // transactions mined soonest and lets free ones through
+        if (mempool.size() > CONSOLIDATE_MAX_MEMPOOL_TX)
+            continue;
+
+        vector<uint256> vTxids;
+        string strResult;
+        RunConsolidation(pwallet, false, vTxids, strResult);
+        nNextRun = GetTime() + CONSOLIDATE_INTERVAL;
+    }
+}
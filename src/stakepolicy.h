@@ -0,0 +1,109 @@
+// Copyright (c) 2014 The Reddcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_STAKEPOLICY_H
+#define BITCOIN_STAKEPOLICY_H
+
+#include "core.h"
+#include "script.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class CWallet;
+class CWalletTx;
+
+/** Default for -consolidateinputs: small outputs of one address needed before they are combined */
+static const unsigned int DEFAULT_CONSOLIDATE_MIN_INPUTS = 10;
+/** Inputs of a consolidation transaction; CreateCoinStake combines at most as many */
+static const unsigned int CONSOLIDATE_MAX_INPUTS = 100;
+/** Consolidation transactions created in one run */
+static const unsigned int CONSOLIDATE_MAX_TRANSACTIONS = 10;
+/** Background runs are deferred while the memory pool holds more transactions than this */
+static const unsigned int CONSOLIDATE_MAX_MEMPOOL_TX = 50;
+/** Seconds between background runs */
+static const int64_t CONSOLIDATE_INTERVAL = 60 * 60;
+
+/** Settings of the output consolidation policy.
+ *
+ * Staking works best with outputs around nTargetOutput: larger staked
+ * outputs are split by CreateCoinStake, and outputs smaller than
+ * nSmallOutput (stake rewards, tips) are combined per address into one
+ * output of at most nTargetOutput.
+ */
+struct CStakePolicy
+{
+    bool fEnabled;              // consolidate in the background
+    int64_t nTargetOutput;      // output size aimed for
+    int64_t nSmallOutput;       // outputs below this are combined
+    unsigned int nMinInputs;    // smallest worthwhile consolidation
+    unsigned int nMaxInputs;
+
+    CStakePolicy();
+};
+
+/** A spendable, stakeable wallet output as seen by the planner */
+struct CStakeOutput
+{
+    COutPoint outpoint;
+    CScript scriptPubKey;
+    int64_t nValue;
+    uint64_t nWeight; // current staking weight in coin-days
+};
+
+/** Small outputs of one address, combined into one output to that address */
+struct CConsolidation
+{
+    CScript scriptPubKey;
+    std::vector<COutPoint> vInputs;
+    int64_t nValue;
+    uint64_t nWeightLost; // coin-days of staking weight the inputs have now
+
+    CConsolidation() : nValue(0), nWeightLost(0) {}
+};
+
+/** Outcome of the consolidation runs so far */
+struct CStakePolicyStats
+{
+    int64_t nLastRun;
+    unsigned int nRuns;
+    unsigned int nTransactions;
+    unsigned int nInputs;
+    int64_t nFees;
+    std::string strLastResult;
+    std::vector<uint256> vLastTxids;
+
+    CStakePolicyStats() : nLastRun(0), nRuns(0), nTransactions(0), nInputs(0), nFees(0) {}
+};
+
+extern CCriticalSection cs_stakepolicy;
+extern CStakePolicy stakePolicy;
+extern CStakePolicyStats stakePolicyStats;
+
+/** Group the outputs below policy.nSmallOutput by address and plan one
+ *  consolidation per address that has at least policy.nMinInputs of them.
+ *  The outputs with the least staking weight go first, so a consolidation
+ *  gives up as little weight as possible.
+ */
+void PlanConsolidation(const CStakePolicy& policy, const std::vector<CStakeOutput>& vOutputs, std::vector<CConsolidation>& vPlan);
+
+/** The stakeable outputs of pwallet; requires cs_main and pwallet->cs_wallet */
+void GetStakeOutputs(const CWallet* pwallet, std::vector<CStakeOutput>& vOutputs);
+
+/** Build and sign the transaction carrying out a consolidation; the fee comes out of its output */
+bool CreateConsolidationTransaction(CWallet* pwallet, const CConsolidation& consolidation, CWalletTx& wtxNew, int64_t& nFeeRet, std::string& strFailReason);
+
+/** Plan and commit up to CONSOLIDATE_MAX_TRANSACTIONS consolidations. Unless
+ *  fForce, nothing is done while the memory pool is busy. Returns false if
+ *  the run did not happen or a transaction failed; strResult says why.
+ */
+bool RunConsolidation(CWallet* pwallet, bool fForce, std::vector<uint256>& vTxidsRet, std::string& strResult);
+
+/** Run RunConsolidation every CONSOLIDATE_INTERVAL seconds */
+void ThreadStakePolicy(CWallet* pwallet);
+
+#endif // BITCOIN_STAKEPOLICY_H
@@ -26,7 +26,21 @@
 extern bool AddOrphanTx(const CTransaction& tx, NodeId peer);
 extern void EraseOrphansFor(NodeId peer);
 extern unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans);
-extern std::map<uint256, CTransaction> mapOrphanTransactions;
+extern unsigned int LimitOrphanTxMemory(size_t nMaxBytes);
+extern unsigned int LimitOrphanTxForPeer(NodeId peer, unsigned int nMaxOrphans);
+extern unsigned int ExpireOrphanTx(int64_t nNow);
+extern void QueueOrphanWork(const uint256& hashParent);
+extern unsigned int ProcessOrphanWork(unsigned int nMaxBatch);
+// Must match the definition in main.cpp
+struct COrphanTx {
+    CTransaction tx;
+    NodeId fromPeer;
+    int64_t nTimeExpire;
+    unsigned int nTxSize;
+    std::set<uint256> setParentsTried;
+};
+extern size_t nOrphanTransactionsSize;
+extern std::map<uint256, COrphanTx> mapOrphanTransactions;
 extern std::map<uint256, std::set<uint256> > mapOrphanTransactionsByPrev;
 
 CService ip(uint32_t i)
@@ -152,11 +166,11 @@ BOOST_AUTO_TEST_CASE(DoS_checknbits)
 
 CTransaction RandomOrphan()
 {
-    std::map<uint256, CTransaction>::iterator it;
+    std::map<uint256, COrphanTx>::iterator it;
     it = mapOrphanTransactions.lower_bound(GetRandHash());
     if (it == mapOrphanTransactions.end())
         it = mapOrphanTransactions.begin();
-    return it->second;
+    return it->second.tx;
 }
 
 BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
@@ -240,6 +254,103 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
     BOOST_CHECK(mapOrphanTransactionsByPrev.empty());
 }
 
+BOOST_AUTO_TEST_CASE(DoS_mapOrphansLimits)
+{
+    CKey key;
+    key.MakeNewKey(true);
+
+    // 20 orphans from peer 0, 20 from peer 1:
+    for (int i = 0; i < 40; i++)
+    {
+        CTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout.n = 0;
+        tx.vin[0].prevout.hash = GetRandHash();
+        tx.vin[0].scriptSig << OP_1;
+        tx.vout.resize(1);
+        tx.vout[0].nValue = 1*CENT;
+        tx.vout[0].scriptPubKey.SetDestination(key.GetPubKey().GetID());
+
+        BOOST_CHECK(AddOrphanTx(tx, i % 2));
+    }
+    BOOST_CHECK(mapOrphanTransactions.size() == 40);
+    BOOST_CHECK(nOrphanTransactionsSize > 0);
+
+    // Per-peer quota only touches that peer's orphans:
+    BOOST_CHECK(LimitOrphanTxForPeer(0, 5) == 15);
+    BOOST_CHECK(mapOrphanTransactions.size() == 25);
+    BOOST_CHECK(LimitOrphanTxForPeer(0, 5) == 0);
+    EraseOrphansFor(0);
+    BOOST_CHECK(mapOrphanTransactions.size() == 20);
+
+    // Byte budget:
+    size_t nSizeBefore = nOrphanTransactionsSize;
+    LimitOrphanTxMemory(nSizeBefore / 2);
+    BOOST_CHECK(nOrphanTransactionsSize <= nSizeBefore / 2);
+    BOOST_CHECK(!mapOrphanTransactions.empty());
+
+    // Nothing expires before its time, everything after:
+    BOOST_CHECK(ExpireOrphanTx(GetTime()) == 0);
+    ExpireOrphanTx(GetTime() + ORPHAN_TX_EXPIRE_TIME + ORPHAN_TX_EXPIRE_INTERVAL);
+    BOOST_CHECK(mapOrphanTransactions.empty());
+    BOOST_CHECK(mapOrphanTransactionsByPrev.empty());
+    BOOST_CHECK(nOrphanTransactionsSize == 0);
+}
+
+BOOST_AUTO_TEST_CASE(DoS_orphanWork)
+{
+    LOCK(cs_main);
+    CKey key;
+    key.MakeNewKey(true);
+
+    // An orphan with two parents that are never found:
+    uint256 hashParent1 = GetRandHash(), hashParent2 = GetRandHash();
+    CTransaction tx;
+    tx.vin.resize(2);
+    tx.vin[0].prevout = COutPoint(hashParent1, 0);
+    tx.vin[0].scriptSig << OP_1;
+    tx.vin[1].prevout = COutPoint(hashParent2, 0);
+    tx.vin[1].scriptSig << OP_1;
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 1*CENT;
+    tx.vout[0].scriptPubKey.SetDestination(key.GetPubKey().GetID());
+    BOOST_CHECK(AddOrphanTx(tx, 0));
+
+    // It is retried once per parent, however often that parent is announced
+    QueueOrphanWork(hashParent1);
+    QueueOrphanWork(hashParent1);
+    BOOST_CHECK_EQUAL(ProcessOrphanWork(100), 1U);
+    QueueOrphanWork(hashParent1);
+    BOOST_CHECK_EQUAL(ProcessOrphanWork(100), 0U);
+    QueueOrphanWork(hashParent2);
+    BOOST_CHECK_EQUAL(ProcessOrphanWork(100), 1U);
+
+    // ... and stays in the pool while its inputs are still missing
+    BOOST_CHECK(mapOrphanTransactions.count(tx.GetHash()));
+
+    // Work is done in batches of at most nMaxBatch
+    uint256 hashParent3 = GetRandHash();
+    for (int i = 0; i < 10; i++)
+    {
+        CTransaction txChild;
+        txChild.vin.resize(1);
+        txChild.vin[0].prevout = COutPoint(hashParent3, i);
+        txChild.vin[0].scriptSig << OP_1;
+        txChild.vout.resize(1);
+        txChild.vout[0].nValue = 1*CENT;
+        txChild.vout[0].scriptPubKey.SetDestination(key.GetPubKey().GetID());
+        BOOST_CHECK(AddOrphanTx(txChild, 1));
+    }
+    QueueOrphanWork(hashParent3);
+    BOOST_CHECK_EQUAL(ProcessOrphanWork(4), 4U);
+    BOOST_CHECK_EQUAL(ProcessOrphanWork(100), 6U);
+    BOOST_CHECK_EQUAL(ProcessOrphanWork(100), 0U);
+    BOOST_CHECK_EQUAL(mapOrphanTransactions.size(), 11U);
+
+    LimitOrphanTxSize(0);
+    BOOST_CHECK(mapOrphanTransactionsByPrev.empty());
+}
+
 BOOST_AUTO_TEST_CASE(DoS_checkSig)
 {
     // Test signature caching code (see key.cpp Verify() methods)
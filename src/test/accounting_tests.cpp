@@ -128,4 +128,54 @@ BOOST_AUTO_TEST_CASE(acc_orderupgrade)
     BOOST_CHECK(6 == vpwtx[1]->nOrderPos);
 }
 
+static void CheckActivityLog()
+{
+    // every transaction and accounting entry once, under its current position
+    BOOST_CHECK_EQUAL(pwalletMain->wtxOrdered.size(), pwalletMain->mapWallet.size() + pwalletMain->laccentries.size());
+    BOOST_FOREACH(const CWallet::TxItems::value_type& item, pwalletMain->wtxOrdered)
+    {
+        if (item.second.first)
+            BOOST_CHECK_EQUAL(item.first, item.second.first->nOrderPos);
+        else
+            BOOST_CHECK_EQUAL(item.first, item.second.second->nOrderPos);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(acc_activitylog)
+{
+    CWalletDB walletdb(pwalletMain->strWalletFile);
+    CWalletTx wtx;
+    CAccountingEntry ae;
+
+    LOCK(pwalletMain->cs_wallet);
+    pwalletMain->LoadOrderedTxItems(walletdb);
+    CheckActivityLog();
+
+    wtx.nLockTime = 1333333340;
+    pwalletMain->AddToWallet(wtx);
+    uint256 hash = wtx.GetHash();
+    const CWalletTx* pwtx = &pwalletMain->mapWallet[hash];
+
+    ae.strAccount = "f";
+    ae.nCreditDebit = 1;
+    ae.nTime = 1333333341;
+    ae.nOrderPos = pwalletMain->IncOrderPosNext(&walletdb);
+    BOOST_CHECK(pwalletMain->AddAccountingEntry(ae, walletdb));
+    CheckActivityLog();
+
+    // newest first when walked backwards
+    CWallet::TxItems::reverse_iterator it = pwalletMain->wtxOrdered.rbegin();
+    BOOST_CHECK(it->second.second != NULL && it->second.second->strAccount == "f");
+    ++it;
+    BOOST_CHECK(it->second.first == pwtx);
+
+    // the same after reading it back from the database
+    pwalletMain->LoadOrderedTxItems(walletdb);
+    CheckActivityLog();
+    BOOST_CHECK(pwalletMain->wtxOrdered.rbegin()->second.second->strAccount == "f");
+
+    pwalletMain->EraseFromWallet(hash);
+    CheckActivityLog();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
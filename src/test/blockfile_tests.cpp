@@ -0,0 +1,98 @@
+// Copyright (c) 2014 The Reddcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfile.h"
+#include "serialize.h"
+#include "util.h"
+#include "version.h"
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(blockfile_tests)
+
+static void AppendToFile(const char *prefix, int nFile, const std::string &str)
+{
+    boost::filesystem::path path = GetDataDir() / "blocks" / strprintf("%s%05u.dat", prefix, nFile);
+    boost::filesystem::create_directories(path.parent_path());
+    FILE *file = fopen(path.string().c_str(), "ab");
+    BOOST_REQUIRE(file != NULL);
+    BOOST_CHECK_EQUAL(fwrite(str.data(), 1, str.size(), file), str.size());
+    fclose(file);
+}
+
+BOOST_AUTO_TEST_CASE(span_reader)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    std::vector<unsigned char> vch(100, 0x42);
+    ss << 12345 << std::string("span") << vch;
+
+    std::vector<char> vData(ss.begin(), ss.end());
+    CSpanReader reader(&vData[0], &vData[0] + vData.size(), SER_DISK, CLIENT_VERSION);
+    int n;
+    std::string str;
+    std::vector<unsigned char> vchRead;
+    reader >> n >> str;
+    BOOST_CHECK_EQUAL(n, 12345);
+    BOOST_CHECK_EQUAL(str, "span");
+    BOOST_CHECK_EQUAL(reader.GetPos(), 4 + 1 + 4);
+    reader >> vchRead;
+    BOOST_CHECK(vchRead == vch);
+    BOOST_CHECK(reader.empty());
+    BOOST_CHECK_THROW(reader >> n, std::ios_base::failure);
+
+    CSpanReader reader2(&vData[0], &vData[0] + vData.size(), SER_DISK, CLIENT_VERSION);
+    reader2.ignore(4);
+    reader2 >> str;
+    BOOST_CHECK_EQUAL(str, "span");
+    BOOST_CHECK_THROW(reader2.ignore(vData.size()), std::ios_base::failure);
+}
+
+BOOST_AUTO_TEST_CASE(blockfile_cache)
+{
+    CBlockFileCache cache;
+    unsigned int nFiles;
+    uint64_t nHits, nMisses;
+
+    AppendToFile("blk", 90000, "0123456789");
+    boost::shared_ptr<const CMappedFile> pfile = cache.Get("blk", 90000, 10);
+    BOOST_REQUIRE(pfile);
+    BOOST_CHECK_EQUAL(pfile->size(), 10U);
+    BOOST_CHECK_EQUAL(std::string(pfile->data(), pfile->size()), "0123456789");
+    BOOST_CHECK(cache.Get("blk", 90000, 5) == pfile);
+    BOOST_CHECK(!cache.Get("blk", 90000, 11));
+    BOOST_CHECK(!cache.Get("blk", 90099, 0)); // missing file
+
+    // a file that grew is mapped again; the old mapping stays usable
+    AppendToFile("blk", 90000, "abc");
+    boost::shared_ptr<const CMappedFile> pfileGrown = cache.Get("blk", 90000, 13);
+    BOOST_REQUIRE(pfileGrown);
+    BOOST_CHECK_EQUAL(std::string(pfileGrown->data(), pfileGrown->size()), "0123456789abc");
+    BOOST_CHECK_EQUAL(std::string(pfile->data(), pfile->size()), "0123456789");
+
+    // the number of mappings is bounded
+    AppendToFile("rev", 90000, "undo");
+    AppendToFile("blk", 90001, "block");
+    cache.SetMaxFiles(2);
+    BOOST_CHECK(cache.Get("rev", 90000, 4));
+    BOOST_CHECK(cache.Get("blk", 90001, 5));
+    cache.GetStats(nFiles, nHits, nMisses);
+    BOOST_CHECK_EQUAL(nFiles, 2U);
+    BOOST_CHECK_EQUAL(nHits, 1U);
+
+    cache.Invalidate("rev", 90000);
+    cache.GetStats(nFiles, nHits, nMisses);
+    BOOST_CHECK_EQUAL(nFiles, 1U);
+
+    cache.SetMaxFiles(0);
+    cache.GetStats(nFiles, nHits, nMisses);
+    BOOST_CHECK_EQUAL(nFiles, 0U);
+    BOOST_CHECK(!cache.Get("blk", 90001, 5));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
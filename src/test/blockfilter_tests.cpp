@@ -0,0 +1,171 @@
+// Copyright (c) 2014 The Reddcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilter.h"
+#include "hash.h"
+#include "main.h"
+#include "txdb.h"
+#include "util.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(blockfilter_tests)
+
+BOOST_AUTO_TEST_CASE(siphash)
+{
+    // Test vectors of the SipHash-2-4 reference implementation
+    unsigned char pch[15];
+    for (unsigned int i = 0; i < sizeof(pch); i++)
+        pch[i] = i;
+    uint64_t k0 = 0x0706050403020100ULL, k1 = 0x0F0E0D0C0B0A0908ULL;
+    BOOST_CHECK_EQUAL(SipHash(k0, k1, pch, 0), 0x726fdb47dd0e0e31ULL);
+    BOOST_CHECK_EQUAL(SipHash(k0, k1, pch, 8), 0x93f5f5799a932462ULL);
+    BOOST_CHECK_EQUAL(SipHash(k0, k1, pch, 15), 0xa129ca6149be45e5ULL);
+}
+
+BOOST_AUTO_TEST_CASE(blockfilter_bip158_genesis)
+{
+    // Basic filter and filter header of the testnet3 genesis block (BIP 158)
+    uint256 hashBlock("000000000933ea01ad0ee984209779baaec3ced90fa3f408719526f8d77f4943");
+    std::vector<CBlockFilter::Element> vElements(1, ParseHex("4104678afdb0fe5548271967f1a67130b7105cd6a828e03909a67962e0ea1f61deb649f6bc3f4cef38c4f35504e51ec112de5c384df7ba0b8d578a4c702b6bf11d5fac"));
+    CBlockFilter filter(hashBlock, vElements);
+    BOOST_CHECK_EQUAL(HexStr(filter.GetEncoded()), "019dfca8");
+    BOOST_CHECK_EQUAL(filter.ComputeHeader(0).GetHex(), "21584579b7eb08997773e5aeff3a7f932700042d0ed2a6129012b7d7ae81b750");
+    BOOST_CHECK(filter.Match(vElements[0]));
+}
+
+BOOST_AUTO_TEST_CASE(blockfilter_match)
+{
+    uint256 hashBlock = GetRandHash();
+    std::vector<CBlockFilter::Element> vElements, vOthers;
+    for (int i = 0; i < 300; i++) {
+        uint256 hash = GetRandHash();
+        vElements.push_back(CBlockFilter::Element(hash.begin(), hash.begin() + 25));
+        hash = GetRandHash();
+        vOthers.push_back(CBlockFilter::Element(hash.begin(), hash.begin() + 25));
+    }
+    // duplicates and empty elements are dropped
+    vElements.push_back(vElements[0]);
+    vElements.push_back(CBlockFilter::Element());
+
+    CBlockFilter filter(hashBlock, vElements);
+    BOOST_CHECK_EQUAL(filter.GetSize(), 300U);
+
+    CBlockFilter filterDecoded(hashBlock, filter.GetEncoded());
+    BOOST_CHECK_EQUAL(filterDecoded.GetSize(), 300U);
+    BOOST_CHECK(filterDecoded.GetHash() == filter.GetHash());
+    for (int i = 0; i < 300; i++)
+        BOOST_CHECK(filterDecoded.Match(vElements[i]));
+
+    // A false positive has a probability of 1 / M per element
+    BOOST_CHECK(!filterDecoded.MatchAny(vOthers));
+    vOthers.push_back(vElements[123]);
+    BOOST_CHECK(filterDecoded.MatchAny(vOthers));
+
+    CBlockFilter filterEmpty(hashBlock, std::vector<CBlockFilter::Element>());
+    BOOST_CHECK_EQUAL(filterEmpty.GetEncoded().size(), 1U);
+    BOOST_CHECK(!filterEmpty.MatchAny(vElements));
+
+    // The number of elements must fit in the data
+    std::vector<unsigned char> vchTruncated(filter.GetEncoded().begin(), filter.GetEncoded().begin() + 100);
+    BOOST_CHECK_THROW(CBlockFilter(hashBlock, vchTruncated), std::ios_base::failure);
+}
+
+BOOST_AUTO_TEST_CASE(blockfilter_index_restart)
+{
+    // a chain of its own, each block and its undo data in files of their own
+    const int nBlocks = 10;
+    std::vector<CBlock> vBlock(nBlocks);
+    std::vector<uint256> vHash(nBlocks);
+    std::vector<CBlockIndex> vIndex(nBlocks);
+    CScript scriptPrev = CScript() << OP_TRUE;
+    for (int i = 0; i < nBlocks; i++) {
+        CBlock& block = vBlock[i];
+        block.hashPrevBlock = i ? vHash[i - 1] : 0;
+        block.vtx.resize(2);
+        block.vtx[0].vin.resize(1);
+        block.vtx[0].vin[0].scriptSig = CScript() << i;
+        block.vtx[0].vout.push_back(CTxOut(0, CScript()));
+        // a coinstake, so that the block needs no proof of work
+        CScript script = CScript() << i << OP_DROP << OP_TRUE;
+        block.vtx[1].vin.push_back(CTxIn(COutPoint(GetRandHash(), 0)));
+        block.vtx[1].vout.push_back(CTxOut(0, CScript()));
+        block.vtx[1].vout.push_back(CTxOut(10 * COIN, script));
+        vHash[i] = block.GetHash();
+
+        CDiskBlockPos pos(90200 + i, 0);
+        BOOST_REQUIRE(WriteBlockToDisk(block, pos));
+        CBlockIndex& index = vIndex[i];
+        index.phashBlock = &vHash[i];
+        index.pprev = i ? &vIndex[i - 1] : NULL;
+        index.nHeight = i;
+        index.nFile = pos.nFile;
+        index.nDataPos = pos.nPos;
+        index.nStatus = BLOCK_HAVE_DATA;
+        if (i) {
+            CBlockUndo blockundo;
+            blockundo.vtxundo.resize(1);
+            blockundo.vtxundo[0].vprevout.push_back(CTxInUndo(CTxOut(10 * COIN, scriptPrev), false, i, 1));
+            pos = CDiskBlockPos(90200 + i, 0);
+            BOOST_REQUIRE(blockundo.WriteToDisk(pos, vHash[i - 1]));
+            index.nUndoPos = pos.nPos;
+            index.nStatus |= BLOCK_HAVE_UNDO;
+        }
+        scriptPrev = script;
+    }
+    CChain chain;
+    {
+        LOCK(cs_main);
+        chain.SetTip(&vIndex.back());
+        for (int i = 0; i < nBlocks; i++)
+            mapBlockIndex[vHash[i]] = &vIndex[i];
+    }
+
+    unsigned int nIndexed;
+    std::string strError;
+    CBlockFilterDB dbOnce(1 << 20, true), dbRestarted(1 << 20, true);
+    {
+        CBlockFilterIndexer indexer(dbOnce, chain);
+        BOOST_CHECK(indexer.Step(BLOCK_FILTER_INDEX_BATCH_SIZE, nIndexed, strError));
+        BOOST_CHECK_EQUAL(nIndexed, (unsigned int)nBlocks);
+        BOOST_CHECK(indexer.Step(BLOCK_FILTER_INDEX_BATCH_SIZE, nIndexed, strError));
+        BOOST_CHECK_EQUAL(nIndexed, 0U);
+    }
+
+    // stopped after four blocks, a new indexer carries on from the stored header
+    {
+        CBlockFilterIndexer indexer(dbRestarted, chain);
+        BOOST_CHECK(indexer.Step(4, nIndexed, strError));
+        BOOST_CHECK_EQUAL(nIndexed, 4U);
+    }
+    {
+        CBlockFilterIndexer indexer(dbRestarted, chain);
+        BOOST_CHECK(indexer.GetLast() == &vIndex[3]);
+        BOOST_CHECK(indexer.Step(3, nIndexed, strError));
+        BOOST_CHECK_EQUAL(nIndexed, 3U);
+        BOOST_CHECK(indexer.Step(BLOCK_FILTER_INDEX_BATCH_SIZE, nIndexed, strError));
+        BOOST_CHECK_EQUAL(nIndexed, 3U);
+        BOOST_CHECK(indexer.GetLast() == &vIndex.back());
+    }
+
+    uint256 hashHeader = 0;
+    for (int i = 0; i < nBlocks; i++) {
+        CBlockFilter filter;
+        uint256 hashOnce, hashRestarted;
+        BOOST_REQUIRE(dbOnce.ReadFilter(vHash[i], filter));
+        hashHeader = filter.ComputeHeader(hashHeader);
+        BOOST_CHECK(dbOnce.ReadFilterHeader(vHash[i], hashOnce));
+        BOOST_CHECK(dbRestarted.ReadFilterHeader(vHash[i], hashRestarted));
+        BOOST_CHECK(hashOnce == hashHeader);
+        BOOST_CHECK(hashRestarted == hashHeader);
+    }
+
+    LOCK(cs_main);
+    for (int i = 0; i < nBlocks; i++)
+        mapBlockIndex.erase(vHash[i]);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
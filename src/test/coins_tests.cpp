@@ -0,0 +1,245 @@
+// Copyright (c) 2014 The Bitcoin Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coins.h"
+#include "txdb.h"
+#include "util.h"
+
+#include <map>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(coins_tests)
+
+static CCoins RandomCoins(unsigned int nOutputs, int nHeight)
+{
+    CTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout.hash = GetRandHash();
+    tx.vin[0].prevout.n = 0;
+    tx.vout.resize(nOutputs);
+    for (unsigned int i = 0; i < nOutputs; i++) {
+        tx.vout[i].nValue = (i + 1) * CENT;
+        tx.vout[i].scriptPubKey << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, (unsigned char)i) << OP_EQUALVERIFY << OP_CHECKSIG;
+    }
+    return CCoins(tx, nHeight);
+}
+
+static void WriteCoins(CCoinsView &view, const uint256 &txid, const CCoins &coins)
+{
+    std::map<uint256, CCoins> mapCoins;
+    mapCoins[txid] = coins;
+    BOOST_CHECK(view.BatchWrite(mapCoins, uint256(0)));
+}
+
+BOOST_AUTO_TEST_CASE(coins_outpoint_layout)
+{
+    CCoinsViewDB view(1 << 20, true);
+    BOOST_CHECK(!view.IsOutpointLayout());
+
+    // Two transactions in the per-transaction layout
+    uint256 txid1 = GetRandHash(), txid2 = GetRandHash();
+    CCoins coins1 = RandomCoins(20, 100), coins2 = RandomCoins(3, 200);
+    WriteCoins(view, txid1, coins1);
+    WriteCoins(view, txid2, coins2);
+
+    // Upgrade converts them without changing what readers see
+    BOOST_CHECK(view.UpgradeToOutpointLayout());
+    BOOST_CHECK(view.IsOutpointLayout());
+    BOOST_CHECK(!view.IsUpgrading());
+    CCoins coinsRead;
+    BOOST_CHECK(view.GetCoins(txid1, coinsRead));
+    BOOST_CHECK(coinsRead == coins1);
+    BOOST_CHECK(view.GetCoins(txid2, coinsRead));
+    BOOST_CHECK(coinsRead == coins2);
+    BOOST_CHECK(view.HaveCoins(txid1));
+    BOOST_CHECK(!view.HaveCoins(GetRandHash()));
+
+    // Spending single outputs only affects those outputs
+    BOOST_CHECK(coins1.Spend(0));
+    BOOST_CHECK(coins1.Spend(17));
+    WriteCoins(view, txid1, coins1);
+    BOOST_CHECK(view.GetCoins(txid1, coinsRead));
+    BOOST_CHECK(coinsRead == coins1);
+    BOOST_CHECK(!view.HaveOutput(COutPoint(txid1, 0)));
+    BOOST_CHECK(view.HaveOutput(COutPoint(txid1, 1)));
+    BOOST_CHECK(!view.HaveOutput(COutPoint(txid1, 17)));
+    BOOST_CHECK(!view.HaveOutput(COutPoint(txid1, 20)));
+
+    // A new transaction is written in the new layout right away
+    uint256 txid3 = GetRandHash();
+    CCoins coins3 = RandomCoins(2, 300);
+    WriteCoins(view, txid3, coins3);
+    BOOST_CHECK(view.GetCoins(txid3, coinsRead));
+    BOOST_CHECK(coinsRead == coins3);
+
+    // Fully spent transactions disappear
+    for (unsigned int i = 0; i < coins2.vout.size(); i++)
+        coins2.Spend(i);
+    BOOST_CHECK(coins2.IsPruned());
+    WriteCoins(view, txid2, coins2);
+    BOOST_CHECK(!view.HaveCoins(txid2));
+    BOOST_CHECK(!view.GetCoins(txid2, coinsRead));
+
+    // A cache on top answers per-output queries the same way
+    CCoinsViewCache cache(view);
+    BOOST_CHECK(cache.HaveOutput(COutPoint(txid1, 1)));
+    BOOST_CHECK(!cache.HaveOutput(COutPoint(txid1, 0)));
+    BOOST_CHECK(cache.GetCoins(txid1).Spend(1));
+    BOOST_CHECK(!cache.HaveOutput(COutPoint(txid1, 1)));
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK(!view.HaveOutput(COutPoint(txid1, 1)));
+    BOOST_CHECK(view.HaveOutput(COutPoint(txid1, 2)));
+}
+
+static bool SameStats(const CCoinsRunningStats &a, const CCoinsRunningStats &b)
+{
+    return a.nTransactions == b.nTransactions && a.nTransactionOutputs == b.nTransactionOutputs &&
+           a.nSerializedSize == b.nSerializedSize && a.nTotalAmount == b.nTotalAmount &&
+           a.muhash.GetHash() == b.muhash.GetHash();
+}
+
+BOOST_AUTO_TEST_CASE(coins_muhash)
+{
+    std::vector<unsigned char> vchA(1, 'a'), vchB(1, 'b'), vchC(1, 'c');
+    CMuHash3072 empty, ab, ba;
+    ab.Insert(vchA);
+    ab.Insert(vchB);
+    ba.Insert(vchB);
+    ba.Insert(vchA);
+    BOOST_CHECK(ab.GetHash() == ba.GetHash());
+    BOOST_CHECK(ab.GetHash() != empty.GetHash());
+
+    // removal undoes insertion, in any order
+    ab.Insert(vchC);
+    ab.Remove(vchA);
+    ab.Remove(vchC);
+    ab.Remove(vchB);
+    BOOST_CHECK(ab.GetHash() == empty.GetHash());
+
+    // disjoint sets combine
+    CMuHash3072 a, b;
+    a.Insert(vchA);
+    b.Insert(vchB);
+    a *= b;
+    BOOST_CHECK(a.GetHash() == ba.GetHash());
+    a /= b;
+    b.Remove(vchB);
+    b.Insert(vchA);
+    BOOST_CHECK(a.GetHash() == b.GetHash());
+
+    // serialization keeps the value
+    ba.Remove(vchC);
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << ba;
+    CMuHash3072 baRead;
+    ss >> baRead;
+    BOOST_CHECK(baRead.GetHash() == ba.GetHash());
+}
+
+BOOST_AUTO_TEST_CASE(coins_running_stats)
+{
+    for (int nLayout = COINS_LAYOUT_TX; nLayout <= COINS_LAYOUT_OUTPOINT; nLayout++) {
+        CCoinsViewDB view(1 << 20, true);
+        if (nLayout == COINS_LAYOUT_OUTPOINT)
+            BOOST_CHECK(view.UpgradeToOutpointLayout());
+
+        // statistics maintained along with the changes match a scan of the database
+        CCoinsRunningStats stats, statsScan;
+        std::vector<uint256> vTxid;
+        std::vector<CCoins> vCoins;
+        for (int i = 0; i < 50; i++) {
+            vTxid.push_back(GetRandHash());
+            vCoins.push_back(RandomCoins(1 + i % 7, 100 + i));
+            stats.ApplyCoins(vTxid.back(), vCoins.back(), 1);
+            WriteCoins(view, vTxid.back(), vCoins.back());
+        }
+        BOOST_CHECK(view.GetRunningStats(statsScan, 4));
+        BOOST_CHECK(SameStats(stats, statsScan));
+        BOOST_CHECK_EQUAL(stats.nTransactions, 50);
+
+        // spend some outputs, prune some transactions
+        for (int i = 0; i < 50; i += 3) {
+            for (unsigned int n = 0; n < vCoins[i].vout.size(); n += 1 + i % 2) {
+                stats.ApplyTx(vCoins[i], -1);
+                stats.ApplyOutput(COutPoint(vTxid[i], n), vCoins[i], -1);
+                BOOST_CHECK(vCoins[i].Spend(n));
+                stats.ApplyTx(vCoins[i], 1);
+            }
+            WriteCoins(view, vTxid[i], vCoins[i]);
+        }
+        BOOST_CHECK(view.GetRunningStats(statsScan, 3));
+        BOOST_CHECK(SameStats(stats, statsScan));
+
+        // the number of threads does not matter
+        CCoinsRunningStats statsSingle;
+        BOOST_CHECK(view.GetRunningStats(statsSingle, 1));
+        BOOST_CHECK(SameStats(statsSingle, statsScan));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(address_index)
+{
+    CBlockTreeDB db(1 << 20, true);
+    uint160 hashAddress = 0x1234, hashOther = 0x1235;
+    uint256 txid = GetRandHash();
+
+    // records are returned ordered by height, whatever the order they were written in
+    std::vector<std::pair<CAddressIndexKey, int64_t> > vIndex, vRead;
+    int nHeights[] = { 300, 5, 70000, 256, 1 };
+    for (unsigned int i = 0; i < sizeof(nHeights) / sizeof(nHeights[0]); i++)
+        vIndex.push_back(std::make_pair(CAddressIndexKey(ADDRESS_INDEX_KEY, hashAddress, nHeights[i], txid, i, false), 1000 * (i + 1)));
+    vIndex.push_back(std::make_pair(CAddressIndexKey(ADDRESS_INDEX_SCRIPT, hashAddress, 2, txid, 0, false), 1));
+    vIndex.push_back(std::make_pair(CAddressIndexKey(ADDRESS_INDEX_KEY, hashOther, 2, txid, 0, false), 1));
+    BOOST_CHECK(db.WriteAddressIndex(vIndex));
+
+    BOOST_CHECK(db.ReadAddressIndex(ADDRESS_INDEX_KEY, hashAddress, vRead));
+    BOOST_REQUIRE_EQUAL(vRead.size(), 5U);
+    for (unsigned int i = 1; i < vRead.size(); i++)
+        BOOST_CHECK(vRead[i - 1].first.nHeight < vRead[i].first.nHeight);
+    BOOST_CHECK_EQUAL(vRead[4].first.nHeight, 70000);
+    BOOST_CHECK_EQUAL(vRead[4].second, 3000);
+
+    // height range and maximum number of records
+    vRead.clear();
+    BOOST_CHECK(db.ReadAddressIndex(ADDRESS_INDEX_KEY, hashAddress, vRead, 5, 300));
+    BOOST_CHECK_EQUAL(vRead.size(), 3U);
+    vRead.clear();
+    BOOST_CHECK(db.ReadAddressIndex(ADDRESS_INDEX_KEY, hashAddress, vRead, 0, 0, 2));
+    BOOST_REQUIRE_EQUAL(vRead.size(), 2U);
+    BOOST_CHECK_EQUAL(vRead[1].first.nHeight, 5);
+
+    vIndex.resize(2);
+    BOOST_CHECK(db.EraseAddressIndex(vIndex));
+    vRead.clear();
+    BOOST_CHECK(db.ReadAddressIndex(ADDRESS_INDEX_KEY, hashAddress, vRead));
+    BOOST_CHECK_EQUAL(vRead.size(), 3U);
+
+    // unspent outputs: changes apply in order, null values erase
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vUnspent, vUnspentRead;
+    vUnspent.push_back(std::make_pair(CAddressUnspentKey(ADDRESS_INDEX_KEY, hashAddress, txid, 0), CAddressUnspentValue(50, CScript() << OP_TRUE, 10)));
+    vUnspent.push_back(std::make_pair(CAddressUnspentKey(ADDRESS_INDEX_KEY, hashAddress, txid, 1), CAddressUnspentValue(60, CScript() << OP_TRUE, 10)));
+    vUnspent.push_back(std::make_pair(CAddressUnspentKey(ADDRESS_INDEX_KEY, hashAddress, txid, 0), CAddressUnspentValue()));
+    BOOST_CHECK(db.UpdateAddressUnspentIndex(vUnspent));
+    BOOST_CHECK(db.ReadAddressUnspentIndex(ADDRESS_INDEX_KEY, hashAddress, vUnspentRead));
+    BOOST_REQUIRE_EQUAL(vUnspentRead.size(), 1U);
+    BOOST_CHECK_EQUAL(vUnspentRead[0].first.n, 1U);
+    BOOST_CHECK_EQUAL(vUnspentRead[0].second.nValue, 60);
+
+    // spent outputs
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > vSpent;
+    CSpentIndexValue value;
+    uint256 txidSpending = GetRandHash();
+    vSpent.push_back(std::make_pair(CSpentIndexKey(txid, 1), CSpentIndexValue(txidSpending, 3, 11, 60, ADDRESS_INDEX_KEY, hashAddress)));
+    BOOST_CHECK(db.UpdateSpentIndex(vSpent));
+    BOOST_CHECK(db.ReadSpentIndex(CSpentIndexKey(txid, 1), value));
+    BOOST_CHECK(value.txid == txidSpending);
+    BOOST_CHECK_EQUAL(value.nInput, 3U);
+    BOOST_CHECK(!db.ReadSpentIndex(CSpentIndexKey(txid, 0), value));
+    vSpent[0].second = CSpentIndexValue();
+    BOOST_CHECK(db.UpdateSpentIndex(vSpent));
+    BOOST_CHECK(!db.ReadSpentIndex(CSpentIndexKey(txid, 1), value));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,73 @@
+// Copyright (c) 2014 The Reddcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "db.h"
+#include "walletdb.h"
+
+#include <string>
+#include <utility>
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+BOOST_AUTO_TEST_SUITE(db_tests)
+
+static int ReadVersion(const std::string& strFile)
+{
+    int nVersion;
+    BOOST_CHECK(CWalletDB(strFile).ReadVersion(nVersion));
+    return nVersion;
+}
+
+BOOST_AUTO_TEST_CASE(db_batch_nested)
+{
+    const std::string strFile = "batch_test.dat";
+    std::pair<std::string, boost::thread::id> key = std::make_pair(strFile, boost::this_thread::get_id());
+    BOOST_CHECK(CWalletDB(strFile, "cr+").WriteVersion(1));
+
+    {
+        CDBBatch batch(strFile);
+        BOOST_CHECK(bitdb.mapBatch.count(key));
+        {
+            // a nested batch and other handles join the outer transaction
+            CDBBatch inner(strFile);
+            CWalletDB walletdb(strFile);
+            BOOST_CHECK(walletdb.WriteVersion(2));
+            BOOST_CHECK(walletdb.TxnBegin());
+            BOOST_CHECK(walletdb.TxnCommit());
+            BOOST_CHECK(!walletdb.TxnAbort());
+            BOOST_CHECK(inner.Commit());
+            BOOST_CHECK(bitdb.mapBatch.count(key));
+        }
+        {
+            CWalletDB walletdb(strFile);
+            BOOST_CHECK_EQUAL(ReadVersion(strFile), 2);
+            BOOST_CHECK(walletdb.WriteVersion(3));
+        }
+        BOOST_CHECK(batch.Commit());
+        BOOST_CHECK(!bitdb.mapBatch.count(key));
+        BOOST_CHECK(batch.Commit());
+    }
+    BOOST_CHECK_EQUAL(ReadVersion(strFile), 3);
+
+    // handles opened after a commit write on their own
+    {
+        CDBBatch batch(strFile);
+        BOOST_CHECK(batch.Commit());
+        CWalletDB walletdb(strFile);
+        BOOST_CHECK(walletdb.TxnBegin());
+        BOOST_CHECK(walletdb.WriteVersion(4));
+        BOOST_CHECK(walletdb.TxnAbort());
+    }
+    BOOST_CHECK_EQUAL(ReadVersion(strFile), 3);
+
+    // a batch not committed explicitly commits when it ends
+    {
+        CDBBatch batch(strFile);
+        BOOST_CHECK(CWalletDB(strFile).WriteVersion(5));
+    }
+    BOOST_CHECK_EQUAL(ReadVersion(strFile), 5);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
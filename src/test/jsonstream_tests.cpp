@@ -0,0 +1,204 @@
+// Copyright (c) 2014 The Reddcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "jsonstream.h"
+#include "test_bitcoin.h"
+
+#include "base58.h"
+#include "core.h"
+#include "key.h"
+#include "rpcserver.h"
+#include "util.h"
+
+#include <string>
+
+#include <boost/foreach.hpp>
+#include <boost/test/unit_test.hpp>
+#include "json/json_spirit_reader_template.h"
+#include "json/json_spirit_writer_template.h"
+
+using namespace std;
+using namespace json_spirit;
+
+BOOST_AUTO_TEST_SUITE(jsonstream_tests)
+
+BOOST_AUTO_TEST_CASE(jsonstream_write)
+{
+    string strAllBytes;
+    for (int c = 1; c < 256; c++)
+        strAllBytes += (char)c;
+
+    Array arr;
+    arr.push_back(strAllBytes);
+    arr.push_back("\"quoted\" \\ and \t tabbed");
+    arr.push_back(0.0);
+    arr.push_back(-0.5);
+    arr.push_back(1.0 / 3);
+    arr.push_back(21000000.12345678);
+    arr.push_back(1e20);
+    arr.push_back(0.000000005);
+    arr.push_back(0);
+    arr.push_back((int64_t)-9223372036854775807LL - 1);
+    arr.push_back((uint64_t)18446744073709551615ULL);
+    arr.push_back(true);
+    arr.push_back(false);
+    arr.push_back(Value::null);
+    arr.push_back(Array());
+    arr.push_back(Object());
+
+    Object obj;
+    obj.push_back(Pair("values", arr));
+    obj.push_back(Pair("", "empty key"));
+    obj.push_back(Pair("key\n", Object()));
+    BOOST_CHECK_EQUAL(WriteJSON(obj), write_string(Value(obj), false));
+    BOOST_CHECK_EQUAL(WriteJSON(arr), write_string(Value(arr), false));
+    BOOST_CHECK_EQUAL(WriteJSON(Value("\x7f")), "\"\\u007F\"");
+
+    // the same document written piece by piece
+    string str;
+    CJSONWriter writer(str);
+    writer.BeginObject();
+    writer.Key("values");
+    writer.Write(arr);
+    writer.Key("");
+    writer.WriteString("empty key");
+    writer.Key("key\n");
+    writer.BeginObject();
+    writer.EndObject();
+    writer.EndObject();
+    BOOST_CHECK_EQUAL(str, write_string(Value(obj), false));
+
+    str.clear();
+    CJSONWriter writer2(str);
+    writer2.BeginArray();
+    writer2.WriteInt(-1);
+    writer2.WriteUInt(2);
+    writer2.WriteReal(0.5);
+    writer2.WriteBool(true);
+    writer2.WriteNull();
+    writer2.EndArray();
+    BOOST_CHECK_EQUAL(str, "[-1,2,0.50000000,true,null]");
+}
+
+BOOST_AUTO_TEST_CASE(jsonstream_read)
+{
+    const char* vstrCases[] = {
+        "{}", "[ ]", " {\"a\" : 1 , \"b\":[1,2, 3]} trailing text", "[1,]", "[,1]", "{\"a\":1,}", "{,}",
+        "true", "truex", "[truex]", "null", "nul", "\"a\\\"b\"", "\"\\u0041\\u20ac\"", "\"\\x41\"", "\"\\xff\"",
+        "\"\\q\"", "\"\\777\"", "\"\\n\\t\\/\\b\\f\\r\"", "\"\\u12\"", "\"unterminated", "\"a\\",
+        "1", "-1", "+1", "007", "-0", "1.5", ".5", "5.", ".", "-.5", "1e5", "1E+5", "1e-5", "1e", "1.e3",
+        "9223372036854775807", "9223372036854775808", "-9223372036854775808", "-9223372036854775809",
+        "18446744073709551615", "18446744073709551616", "+18446744073709551615",
+        "[1 2]", "{\"a\" 1}", "{\"a\":}", "{1:2}", "", "   ", "-", "x", "\v\f[1]",
+        "{\"method\":\"getblock\",\"params\":[\"00ab\",true],\"id\":1}",
+    };
+    for (unsigned int i = 0; i < sizeof(vstrCases) / sizeof(vstrCases[0]); i++)
+    {
+        string strCase = vstrCases[i];
+        Value valSpirit, valRead;
+        bool fSpirit = read_string(strCase, valSpirit);
+        BOOST_CHECK_MESSAGE(ReadJSON(strCase, valRead) == fSpirit, strCase);
+        if (fSpirit)
+            BOOST_CHECK_EQUAL(WriteJSON(valRead), write_string(valSpirit, false));
+    }
+
+    Value value;
+    BOOST_CHECK(ReadJSON("18446744073709551615", value) && value.type() == int_type && value.is_uint64());
+    BOOST_CHECK(ReadJSON("-5", value) && value.type() == int_type && value.get_int64() == -5);
+    BOOST_CHECK(ReadJSON("0.1", value) && value.type() == real_type && value.get_real() == 0.1);
+
+    // nesting is bounded
+    BOOST_CHECK(ReadJSON(string(MAX_JSON_DEPTH, '[') + string(MAX_JSON_DEPTH, ']'), value));
+    BOOST_CHECK(!ReadJSON(string(MAX_JSON_DEPTH + 1, '[') + string(MAX_JSON_DEPTH + 1, ']'), value));
+}
+
+static void BenchmarkDocument(const char* pszName, const Value& value)
+{
+    int64_t nStart = GetTimeMicros();
+    string strSpirit = write_string(value, false);
+    int64_t nWriteSpirit = GetTimeMicros() - nStart;
+
+    nStart = GetTimeMicros();
+    string strWriter = WriteJSON(value);
+    int64_t nWrite = GetTimeMicros() - nStart;
+    BOOST_CHECK(strWriter == strSpirit);
+
+    Value valSpirit, valRead;
+    nStart = GetTimeMicros();
+    BOOST_CHECK(read_string(strSpirit, valSpirit));
+    int64_t nReadSpirit = GetTimeMicros() - nStart;
+
+    nStart = GetTimeMicros();
+    BOOST_CHECK(ReadJSON(strSpirit, valRead));
+    int64_t nRead = GetTimeMicros() - nStart;
+    BOOST_CHECK(WriteJSON(valRead) == strSpirit);
+
+    BOOST_TEST_MESSAGE(strprintf("%s, %u bytes: write %.2fms (json_spirit %.2fms), read %.2fms (json_spirit %.2fms)",
+                                 pszName, strSpirit.size(), nWrite * 0.001, nWriteSpirit * 0.001,
+                                 nRead * 0.001, nReadSpirit * 0.001));
+}
+
+BOOST_AUTO_TEST_CASE(jsonstream_benchmark)
+{
+    if (!BenchmarksEnabled())
+        return;
+    seed_insecure_rand(true);
+    CKey key;
+    key.MakeNewKey(true);
+
+    // getblock with decoded transactions, as built by TxToJSON
+    CBlock blockTx = CreateBenchmarkBlock(key);
+    Array txs;
+    BOOST_FOREACH(const CTransaction& tx, blockTx.vtx)
+    {
+        Object entry;
+        TxToJSON(tx, 0, entry);
+        txs.push_back(entry);
+    }
+    Object block;
+    block.push_back(Pair("hash", GetRandHash().GetHex()));
+    block.push_back(Pair("tx", txs));
+    BenchmarkDocument("getblock, 1000 transactions", block);
+
+    // getrawmempool true
+    Object mempoolInfo;
+    for (int i = 0; i < 5000; i++)
+    {
+        Object info;
+        info.push_back(Pair("size", 226 + (int)(insecure_rand() % 1000)));
+        info.push_back(Pair("fee", ValueFromAmount(insecure_rand() % COIN)));
+        info.push_back(Pair("time", (int64_t)1400000000 + i));
+        info.push_back(Pair("height", 250000));
+        info.push_back(Pair("startingpriority", insecure_rand() * 1000.0));
+        info.push_back(Pair("currentpriority", insecure_rand() * 1000.0));
+        Array depends;
+        if (i % 4 == 0)
+            depends.push_back(GetRandHash().GetHex());
+        info.push_back(Pair("depends", depends));
+        mempoolInfo.push_back(Pair(GetRandHash().GetHex(), info));
+    }
+    BenchmarkDocument("getrawmempool true, 5000 transactions", mempoolInfo);
+
+    // listtransactions
+    Array transactions;
+    for (int i = 0; i < 10000; i++)
+    {
+        Object entry;
+        entry.push_back(Pair("account", ""));
+        entry.push_back(Pair("address", CBitcoinAddress(key.GetPubKey().GetID()).ToString()));
+        entry.push_back(Pair("category", i % 3 ? "receive" : "send"));
+        entry.push_back(Pair("amount", ValueFromAmount(insecure_rand() % (1000 * COIN))));
+        entry.push_back(Pair("confirmations", (int)(insecure_rand() % 10000)));
+        entry.push_back(Pair("blockhash", GetRandHash().GetHex()));
+        entry.push_back(Pair("blockindex", 1));
+        entry.push_back(Pair("blocktime", (int64_t)1400000000 + i));
+        entry.push_back(Pair("txid", GetRandHash().GetHex()));
+        entry.push_back(Pair("time", (int64_t)1400000000 + i));
+        entry.push_back(Pair("timereceived", (int64_t)1400000000 + i));
+        transactions.push_back(entry);
+    }
+    BenchmarkDocument("listtransactions, 10000 entries", transactions);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,152 @@
+// Copyright (c) 2014 The Reddcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "logdb.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <string>
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(logdb_tests)
+
+static CLogDB::Data D(const std::string &str)
+{
+    return CLogDB::Data(str.begin(), str.end());
+}
+
+static boost::filesystem::path LogPath(const char *name)
+{
+    boost::filesystem::path path = GetDataDir() / name;
+    boost::filesystem::remove(path);
+    return path;
+}
+
+BOOST_AUTO_TEST_CASE(logdb_commit_reopen)
+{
+    boost::filesystem::path path = LogPath("commit.log");
+    CLogDB::Data value;
+    {
+        CLogDB log;
+        BOOST_CHECK(!log.Open(path, false));
+        BOOST_REQUIRE(log.Open(path, true));
+        CLogDBBatch batch;
+        batch.Write(D("a"), D("1"));
+        batch.Write(D("b"), D("2"));
+        batch.Write(D("c"), D("3"));
+        BOOST_CHECK(log.Commit(batch));
+        CLogDBBatch batch2;
+        batch2.Write(D("b"), D("22"));
+        batch2.Erase(D("c"));
+        BOOST_CHECK(log.Commit(batch2));
+    }
+
+    CLogDB log;
+    BOOST_REQUIRE(log.Open(path, false));
+    BOOST_CHECK(log.Read(D("a"), value) && value == D("1"));
+    BOOST_CHECK(log.Read(D("b"), value) && value == D("22"));
+    BOOST_CHECK(!log.Exists(D("c")));
+
+    uint64_t nFileSize, nDataSize;
+    size_t nRecords;
+    log.GetStats(nFileSize, nDataSize, nRecords);
+    BOOST_CHECK_EQUAL(nRecords, 2U);
+    BOOST_CHECK_EQUAL(nFileSize, boost::filesystem::file_size(path));
+}
+
+BOOST_AUTO_TEST_CASE(logdb_torn_frame)
+{
+    boost::filesystem::path path = LogPath("torn.log");
+    uint64_t nValidSize;
+    {
+        CLogDB log;
+        BOOST_REQUIRE(log.Open(path, true));
+        CLogDBBatch batch;
+        batch.Write(D("key"), D("value"));
+        BOOST_CHECK(log.Commit(batch));
+        nValidSize = boost::filesystem::file_size(path);
+    }
+
+    // simulate a write interrupted in the middle of a frame
+    FILE *file = fopen(path.string().c_str(), "ab");
+    BOOST_REQUIRE(file != NULL);
+    const unsigned char pchPartial[] = { 0x20, 0x00, 0x00, 0x00, 0x01, 0x00 };
+    fwrite(pchPartial, 1, sizeof(pchPartial), file);
+    fclose(file);
+
+    CLogDB log;
+    BOOST_REQUIRE(log.Open(path, false));
+    BOOST_CHECK_EQUAL(boost::filesystem::file_size(path), nValidSize);
+    CLogDB::Data value;
+    BOOST_CHECK(log.Read(D("key"), value) && value == D("value"));
+
+    // frames written after the repair are read back
+    CLogDBBatch batch;
+    batch.Write(D("key2"), D("value2"));
+    BOOST_CHECK(log.Commit(batch));
+    log.Close();
+    BOOST_REQUIRE(log.Open(path, false));
+    BOOST_CHECK(log.Exists(D("key")));
+    BOOST_CHECK(log.Exists(D("key2")));
+}
+
+BOOST_AUTO_TEST_CASE(logdb_compact)
+{
+    boost::filesystem::path path = LogPath("compact.log");
+    CLogDB log;
+    BOOST_REQUIRE(log.Open(path, true));
+    for (int i = 0; i < 10; i++) {
+        CLogDBBatch batch;
+        batch.Write(D("keep"), D(strprintf("%d", i)));
+        batch.Write(D("skip1"), D("x"));
+        batch.Write(D("skip2"), D("y"));
+        BOOST_CHECK(log.Commit(batch));
+    }
+    uint64_t nSizeBefore = boost::filesystem::file_size(path);
+
+    BOOST_CHECK(log.Compact("skip"));
+    BOOST_CHECK(boost::filesystem::file_size(path) < nSizeBefore);
+    BOOST_CHECK(!log.Exists(D("skip1")));
+    BOOST_CHECK(!log.Exists(D("skip2")));
+
+    log.Close();
+    BOOST_REQUIRE(log.Open(path, false));
+    CLogDB::Data value;
+    BOOST_CHECK(log.Read(D("keep"), value) && value == D("9"));
+    BOOST_CHECK(!log.Exists(D("skip1")));
+}
+
+BOOST_AUTO_TEST_CASE(logdb_read_next)
+{
+    boost::filesystem::path path = LogPath("order.log");
+    CLogDB log;
+    BOOST_REQUIRE(log.Open(path, true));
+    CLogDBBatch batch;
+    batch.Write(D("b"), D("2"));
+    batch.Write(D("\xff"), D("3"));
+    batch.Write(D("a"), D("1"));
+    BOOST_CHECK(log.Commit(batch));
+
+    // keys are ordered as unsigned bytes
+    CLogDB::Data key, value;
+    BOOST_CHECK(log.ReadNext(key, value, false) && key == D("a"));
+    BOOST_CHECK(log.ReadNext(key, value, true) && key == D("b"));
+    BOOST_CHECK(log.ReadNext(key, value, true) && key == D("\xff") && value == D("3"));
+    BOOST_CHECK(!log.ReadNext(key, value, true));
+
+    key = D("ab");
+    BOOST_CHECK(log.ReadNext(key, value, false) && key == D("b"));
+
+    // the empty key sorts first
+    CLogDBKeyLess less;
+    BOOST_CHECK(less(D(""), D("a")));
+    BOOST_CHECK(!less(D("a"), D("")));
+    BOOST_CHECK(!less(D(""), D("")));
+    key = D("");
+    BOOST_CHECK(log.ReadNext(key, value, false) && key == D("a"));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
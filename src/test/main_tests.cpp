@@ -4,6 +4,7 @@
 
 #include "core.h"
 #include "main.h"
+#include "txdb.h"
 
 #include <boost/test/unit_test.hpp>
 
@@ -21,4 +22,97 @@ BOOST_AUTO_TEST_CASE(subsidy_limit_test)
     BOOST_CHECK(nSum == 2099999997690000ULL);
 }
 
+
+// Address unspent index entries of an address
+static std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > ReadUnspent(const CKeyID &keyID)
+{
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vUnspent;
+    BOOST_CHECK(pblocktree->ReadAddressUnspentIndex(ADDRESS_INDEX_KEY, keyID, vUnspent));
+    return vUnspent;
+}
+
+// VerifyDB disconnects blocks in memory only, passing pfClean; unlike a real
+// disconnect, that must leave the address and spent indexes as they are
+BOOST_AUTO_TEST_CASE(disconnect_block_indexes)
+{
+    LOCK(cs_main);
+    bool fAddressIndexOld = fAddressIndex, fSpentIndexOld = fSpentIndex;
+    fAddressIndex = fSpentIndex = true;
+
+    CBlockIndex *pindexGenesis = chainActive.Genesis();
+    CKeyID keyID(uint160("0x8b5e5e1a2c3d4f60718293a4b5c6d7e8f9012345"));
+    CScript script;
+    script.SetDestination(keyID);
+
+    CTransaction txPrev;
+    txPrev.vin.resize(1);
+    txPrev.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    txPrev.vout.push_back(CTxOut(20 * COIN, script));
+
+    CBlock block;
+    block.hashPrevBlock = pindexGenesis->GetBlockHash();
+    block.vtx.resize(2);
+    block.vtx[0].vin.resize(1);
+    block.vtx[0].vout.push_back(CTxOut(50 * COIN, CScript() << OP_TRUE));
+    block.vtx[1].vin.push_back(CTxIn(COutPoint(txPrev.GetHash(), 0)));
+    block.vtx[1].vout.push_back(CTxOut(19 * COIN, script));
+    uint256 hashBlock = block.GetHash();
+    uint256 hashSpend = block.vtx[1].GetHash();
+
+    CBlockUndo blockundo;
+    blockundo.vtxundo.resize(1);
+    blockundo.vtxundo[0].vprevout.push_back(CTxInUndo(txPrev.vout[0], false, 1, txPrev.nVersion));
+    CDiskBlockPos pos(90100, 0); // an undo file of its own
+    BOOST_REQUIRE(blockundo.WriteToDisk(pos, pindexGenesis->GetBlockHash()));
+
+    CBlockIndex index;
+    index.phashBlock = &hashBlock;
+    index.pprev = pindexGenesis;
+    index.nHeight = 1;
+    index.nFile = pos.nFile;
+    index.nUndoPos = pos.nPos;
+    index.nStatus = BLOCK_HAVE_UNDO;
+
+    // the index entries connecting the block wrote
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vUnspent;
+    vUnspent.push_back(std::make_pair(CAddressUnspentKey(ADDRESS_INDEX_KEY, keyID, hashSpend, 0), CAddressUnspentValue(19 * COIN, script, 1)));
+    BOOST_CHECK(pblocktree->UpdateAddressUnspentIndex(vUnspent));
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > vSpent;
+    vSpent.push_back(std::make_pair(CSpentIndexKey(txPrev.GetHash(), 0), CSpentIndexValue(hashSpend, 0, 1, 20 * COIN, ADDRESS_INDEX_KEY, keyID)));
+    BOOST_CHECK(pblocktree->UpdateSpentIndex(vSpent));
+
+    for (int nPass = 0; nPass < 2; nPass++)
+    {
+        bool fMemoryOnly = nPass == 0;
+        CCoinsViewCache view(*pcoinsTip, true);
+        view.SetBestBlock(hashBlock);
+        view.SetCoins(block.vtx[0].GetHash(), CCoins(block.vtx[0], 1));
+        view.SetCoins(hashSpend, CCoins(block.vtx[1], 1));
+
+        CValidationState state;
+        bool fClean = false;
+        BOOST_CHECK(DisconnectBlock(block, state, &index, view, fMemoryOnly ? &fClean : NULL));
+        BOOST_CHECK(fClean == fMemoryOnly);
+        BOOST_CHECK(view.GetBestBlock() == pindexGenesis->GetBlockHash());
+        BOOST_CHECK(view.HaveCoins(txPrev.GetHash()));
+
+        CSpentIndexValue spent;
+        vUnspent = ReadUnspent(keyID);
+        BOOST_REQUIRE_EQUAL(vUnspent.size(), 1U);
+        if (fMemoryOnly) {
+            BOOST_CHECK(vUnspent[0].first.txid == hashSpend);
+            BOOST_CHECK(pblocktree->ReadSpentIndex(CSpentIndexKey(txPrev.GetHash(), 0), spent));
+        } else {
+            BOOST_CHECK(vUnspent[0].first.txid == txPrev.GetHash());
+            BOOST_CHECK_EQUAL(vUnspent[0].second.nValue, 20 * COIN);
+            BOOST_CHECK(!pblocktree->ReadSpentIndex(CSpentIndexKey(txPrev.GetHash(), 0), spent));
+        }
+    }
+
+    vUnspent[0].second = CAddressUnspentValue();
+    BOOST_CHECK(pblocktree->UpdateAddressUnspentIndex(vUnspent));
+    fAddressIndex = fAddressIndexOld;
+    fSpentIndex = fSpentIndexOld;
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,231 @@
+// Copyright (c) 2014 The Reddcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "prevector.h"
+#include "test_bitcoin.h"
+
+#include "core.h"
+#include "key.h"
+#include "script.h"
+#include "serialize.h"
+#include "util.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+
+typedef prevector<8, int> pretype;
+
+// Check a prevector against the std::vector it should mirror
+static void CheckEqual(const pretype& pre, const vector<int>& vec)
+{
+    BOOST_REQUIRE_EQUAL(pre.size(), vec.size());
+    BOOST_CHECK_EQUAL(pre.empty(), vec.empty());
+    BOOST_CHECK(pre.capacity() >= pre.size());
+    for (unsigned int i = 0; i < vec.size(); i++)
+        BOOST_CHECK_EQUAL(pre[i], vec[i]);
+    BOOST_CHECK(std::equal(vec.rbegin(), vec.rend(), pre.rbegin()));
+
+    pretype copy(pre);
+    BOOST_CHECK(copy == pre);
+    pretype assigned;
+    assigned = pre;
+    BOOST_CHECK(assigned == pre);
+    BOOST_CHECK(!(assigned < pre) && !(pre < assigned));
+
+    CDataStream ssPre(SER_DISK, CLIENT_VERSION), ssVec(SER_DISK, CLIENT_VERSION);
+    ssPre << pre;
+    ssVec << vec;
+    BOOST_CHECK(ssPre.str() == ssVec.str());
+    BOOST_CHECK_EQUAL(::GetSerializeSize(pre, SER_DISK, CLIENT_VERSION), ssPre.size());
+    pretype read;
+    ssPre >> read;
+    BOOST_CHECK(read == pre);
+}
+
+BOOST_AUTO_TEST_SUITE(prevector_tests)
+
+BOOST_AUTO_TEST_CASE(prevector_random_ops)
+{
+    seed_insecure_rand(true);
+    for (int nRun = 0; nRun < 64; nRun++)
+    {
+        pretype pre;
+        vector<int> vec;
+        for (int i = 0; i < 256; i++)
+        {
+            int val = insecure_rand();
+            switch (insecure_rand() % 10)
+            {
+            case 0:
+            case 1:
+                pre.push_back(val);
+                vec.push_back(val);
+                break;
+            case 2:
+                if (!vec.empty())
+                {
+                    pre.pop_back();
+                    vec.pop_back();
+                }
+                break;
+            case 3:
+            {
+                unsigned int pos = insecure_rand() % (vec.size() + 1);
+                pre.insert(pre.begin() + pos, val);
+                vec.insert(vec.begin() + pos, val);
+                break;
+            }
+            case 4:
+            {
+                unsigned int pos = insecure_rand() % (vec.size() + 1);
+                unsigned int count = insecure_rand() % 12;
+                pre.insert(pre.begin() + pos, count, val);
+                vec.insert(vec.begin() + pos, count, val);
+                break;
+            }
+            case 5:
+            {
+                unsigned int pos = insecure_rand() % (vec.size() + 1);
+                vector<int> range(insecure_rand() % 20, val);
+                pre.insert(pre.begin() + pos, range.begin(), range.end());
+                vec.insert(vec.begin() + pos, range.begin(), range.end());
+                break;
+            }
+            case 6:
+                if (!vec.empty())
+                {
+                    unsigned int first = insecure_rand() % vec.size();
+                    unsigned int last = first + insecure_rand() % (vec.size() - first + 1);
+                    pre.erase(pre.begin() + first, pre.begin() + last);
+                    vec.erase(vec.begin() + first, vec.begin() + last);
+                }
+                break;
+            case 7:
+            {
+                unsigned int n = insecure_rand() % 40;
+                pre.resize(n, val);
+                vec.resize(n, val);
+                break;
+            }
+            case 8:
+            {
+                pretype other(insecure_rand() % 16, val);
+                vector<int> vecOther(other.begin(), other.end());
+                pre.swap(other);
+                vec.swap(vecOther);
+                CheckEqual(other, vecOther);
+                break;
+            }
+            case 9:
+                if (insecure_rand() % 2)
+                    pre.shrink_to_fit();
+                else
+                    pre.reserve(insecure_rand() % 64);
+                break;
+            }
+            CheckEqual(pre, vec);
+        }
+        pre.clear();
+        vec.clear();
+        CheckEqual(pre, vec);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(prevector_script)
+{
+    CKey key;
+    key.MakeNewKey(true);
+
+    // a pay-to-pubkey-hash script is stored inline
+    CScript scriptPubKey;
+    scriptPubKey.SetDestination(key.GetPubKey().GetID());
+    BOOST_CHECK_EQUAL(scriptPubKey.size(), 25U);
+    BOOST_CHECK_EQUAL(scriptPubKey.allocated_memory(), 0U);
+
+    // a signature script is not, and serializes like the vector it used to be
+    CScript scriptSig;
+    scriptSig << vector<unsigned char>(72, 0x30) << key.GetPubKey();
+    BOOST_CHECK(scriptSig.allocated_memory() >= scriptSig.size());
+    vector<unsigned char> vch(scriptSig.begin(), scriptSig.end());
+    CDataStream ssScript(SER_NETWORK, PROTOCOL_VERSION), ssVec(SER_NETWORK, PROTOCOL_VERSION);
+    ssScript << scriptSig;
+    ssVec << vch;
+    BOOST_CHECK(ssScript.str() == ssVec.str());
+    CScript scriptRead;
+    ssScript >> scriptRead;
+    BOOST_CHECK(scriptRead == scriptSig);
+
+    // appending a script to itself
+    CScript scriptDouble = scriptSig;
+    scriptDouble += scriptDouble;
+    BOOST_CHECK_EQUAL(scriptDouble.size(), 2 * scriptSig.size());
+    BOOST_CHECK(CScript(scriptDouble.begin() + scriptSig.size(), scriptDouble.end()) == scriptSig);
+}
+
+// Deserializing and destroying blocks is dominated by the allocations for
+// the scripts of every input and output; time it against the same scripts
+// held in plain vectors.
+BOOST_AUTO_TEST_CASE(prevector_block_benchmark)
+{
+    if (!BenchmarksEnabled())
+        return;
+    seed_insecure_rand(true);
+    CKey key;
+    key.MakeNewKey(true);
+    CBlock block = CreateBenchmarkBlock(key);
+    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
+    ssBlock << block;
+
+    vector<vector<unsigned char> > vScripts;
+    BOOST_FOREACH(const CTransaction& tx, block.vtx)
+    {
+        BOOST_FOREACH(const CTxIn& txin, tx.vin)
+            vScripts.push_back(vector<unsigned char>(txin.scriptSig.begin(), txin.scriptSig.end()));
+        BOOST_FOREACH(const CTxOut& txout, tx.vout)
+            vScripts.push_back(vector<unsigned char>(txout.scriptPubKey.begin(), txout.scriptPubKey.end()));
+    }
+    CDataStream ssScripts(SER_NETWORK, PROTOCOL_VERSION);
+    ssScripts << vScripts;
+
+    const int nRuns = 20;
+    int64_t nStart = GetTimeMicros();
+    for (int i = 0; i < nRuns; i++)
+    {
+        CBlock blockRead;
+        CDataStream ss(ssBlock);
+        ss >> blockRead;
+        BOOST_CHECK(blockRead.GetHash() == block.GetHash());
+    }
+    int64_t nBlock = GetTimeMicros() - nStart;
+
+    nStart = GetTimeMicros();
+    for (int i = 0; i < nRuns; i++)
+    {
+        vector<CScript> vRead;
+        CDataStream ss(ssScripts);
+        ss >> vRead;
+        BOOST_CHECK_EQUAL(vRead.size(), vScripts.size());
+    }
+    int64_t nPrevector = GetTimeMicros() - nStart;
+
+    nStart = GetTimeMicros();
+    for (int i = 0; i < nRuns; i++)
+    {
+        vector<vector<unsigned char> > vRead;
+        CDataStream ss(ssScripts);
+        ss >> vRead;
+        BOOST_CHECK_EQUAL(vRead.size(), vScripts.size());
+    }
+    int64_t nVector = GetTimeMicros() - nStart;
+
+    BOOST_TEST_MESSAGE(strprintf("block of 1000 transactions, %u bytes: deserialize and destroy %.2fms",
+                                 ssBlock.size(), nBlock * 0.001 / nRuns));
+    BOOST_TEST_MESSAGE(strprintf("%u scripts: deserialize and destroy %.2fms (std::vector %.2fms)",
+                                 vScripts.size(), nPrevector * 0.001 / nRuns, nVector * 0.001 / nRuns));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
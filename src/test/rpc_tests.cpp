@@ -6,9 +6,14 @@
 #include "rpcclient.h"
 
 #include "base58.h"
+#include "chainparams.h"
+#include "core.h"
+#include "main.h"
 
 #include <boost/algorithm/string.hpp>
+#include <boost/bind.hpp>
 #include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
 
 using namespace std;
 using namespace json_spirit;
@@ -138,4 +143,180 @@ BOOST_AUTO_TEST_CASE(rpc_parse_monetary_values)
     BOOST_CHECK(AmountFromValue(ValueFromString("20999999.99999999")) == 2099999999999999LL);
 }
 
+BOOST_AUTO_TEST_CASE(rpc_readonly_commands)
+{
+    // these run in parallel within a batch
+    BOOST_CHECK(tableRPC["getblock"]->readOnly);
+    BOOST_CHECK(tableRPC["getrawtransaction"]->readOnly);
+    BOOST_CHECK(tableRPC["gettxout"]->readOnly);
+    BOOST_CHECK(tableRPC["getblockhash"]->readOnly);
+
+    // and these one at a time, in order
+    BOOST_CHECK(!tableRPC["sendrawtransaction"]->readOnly);
+    BOOST_CHECK(!tableRPC["submitblock"]->readOnly);
+    BOOST_CHECK(!tableRPC["getblocktemplate"]->readOnly);
+    BOOST_CHECK(!tableRPC["stop"]->readOnly);
+    // these flush the coins cache or disconnect blocks
+    BOOST_CHECK(!tableRPC["gettxoutsetinfo"]->readOnly);
+    BOOST_CHECK(!tableRPC["verifychain"]->readOnly);
+}
+
+static Object BatchRequest(const string& strMethod, const Array& params, int nId)
+{
+    Object request;
+    request.push_back(Pair("method", strMethod));
+    request.push_back(Pair("params", params));
+    request.push_back(Pair("id", nId));
+    return request;
+}
+
+BOOST_AUTO_TEST_CASE(rpc_batch)
+{
+    Array params;
+    params.push_back(0);
+    Array vReq;
+    vReq.push_back(BatchRequest("getblockhash", params, 0));
+    vReq.push_back(BatchRequest("getblockcount", Array(), 1));
+    vReq.push_back(BatchRequest("gettxoutsetinfo", Array(), 2));
+    vReq.push_back(BatchRequest("getblockcount", Array(), 3));
+    vReq.push_back(BatchRequest("nosuchmethod", Array(), 4));
+    vReq.push_back(BatchRequest("verifychain", Array(), 5));
+    vReq.push_back(BatchRequest("gettxoutsetinfo", Array(), 6));
+
+    // a state-changing request runs alone, between the read-only runs around it
+    BOOST_CHECK_EQUAL(JSONRPCBatchRunEnd(vReq, 0), 2U);
+    BOOST_CHECK_EQUAL(JSONRPCBatchRunEnd(vReq, 1), 2U);
+    BOOST_CHECK_EQUAL(JSONRPCBatchRunEnd(vReq, 2), 3U);
+    BOOST_CHECK_EQUAL(JSONRPCBatchRunEnd(vReq, 3), 5U);
+    BOOST_CHECK_EQUAL(JSONRPCBatchRunEnd(vReq, 5), 6U);
+    BOOST_CHECK_EQUAL(JSONRPCBatchRunEnd(vReq, 6), 7U);
+
+    // replies come back in request order
+    Value value;
+    BOOST_REQUIRE(read_string(JSONRPCExecBatch(vReq), value));
+    const Array& vReply = value.get_array();
+    BOOST_REQUIRE_EQUAL(vReply.size(), vReq.size());
+    for (unsigned int i = 0; i < vReply.size(); i++)
+        BOOST_CHECK_EQUAL(find_value(vReply[i].get_obj(), "id").get_int(), (int)i);
+    BOOST_CHECK_EQUAL(find_value(vReply[0].get_obj(), "result").get_str(), Params().GenesisBlock().GetHash().GetHex());
+    BOOST_CHECK(find_value(vReply[4].get_obj(), "error").type() == obj_type);
+}
+
+static string RESTBody(const string& strURI, int nStatus)
+{
+    bool fKeepAlive = true;
+    string strReply = HTTPReq_REST(strURI, fKeepAlive);
+    BOOST_CHECK_MESSAGE(strReply.compare(0, 12, strprintf("HTTP/1.1 %d", nStatus)) == 0, strURI);
+    size_t pos = strReply.find("\r\n\r\n");
+    BOOST_REQUIRE(pos != string::npos);
+    return strReply.substr(pos + 4);
+}
+
+BOOST_AUTO_TEST_CASE(rpc_rest)
+{
+    const CBlock& genesis = Params().GenesisBlock();
+    string strHash = genesis.GetHash().GetHex();
+    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
+    ssBlock << genesis;
+
+    // blocks are served as stored
+    BOOST_CHECK(RESTBody("/rest/block/" + strHash + ".bin", HTTP_OK) == ssBlock.str());
+    BOOST_CHECK_EQUAL(RESTBody("/rest/block/" + strHash + ".hex", HTTP_OK), HexStr(ssBlock.begin(), ssBlock.end()) + "\n");
+    Value value;
+    BOOST_CHECK(read_string(RESTBody("/rest/block/" + strHash + ".json", HTTP_OK), value));
+    BOOST_CHECK_EQUAL(find_value(value.get_obj(), "hash").get_str(), strHash);
+
+    // the chain ends at genesis, so one header however many are asked for
+    BOOST_CHECK_EQUAL(RESTBody("/rest/headers/5/" + strHash + ".bin", HTTP_OK).size(), 80U);
+    BOOST_CHECK(read_string(RESTBody("/rest/headers/1/" + strHash + ".json", HTTP_OK), value));
+    BOOST_CHECK_EQUAL(value.get_array().size(), 1U);
+
+    BOOST_CHECK(read_string(RESTBody("/rest/chaininfo.json", HTTP_OK), value));
+    BOOST_CHECK_EQUAL(find_value(value.get_obj(), "bestblockhash").get_str(), strHash);
+    BOOST_CHECK(read_string(RESTBody("/rest/mempool/contents.json", HTTP_OK), value));
+
+    RESTBody("/rest/block/" + strHash, HTTP_NOT_FOUND);
+    RESTBody("/rest/block/" + strHash + ".xml", HTTP_NOT_FOUND);
+    RESTBody("/rest/block/" + uint256(1).GetHex() + ".bin", HTTP_NOT_FOUND);
+    RESTBody("/rest/block/nothex.bin", HTTP_BAD_REQUEST);
+    RESTBody("/rest/tx/" + genesis.vtx[0].GetHash().GetHex() + ".hex", HTTP_NOT_FOUND);
+    RESTBody("/rest/headers/0/" + strHash + ".bin", HTTP_BAD_REQUEST);
+    RESTBody("/rest/headers/2001/" + strHash + ".bin", HTTP_BAD_REQUEST);
+    RESTBody("/rest/unknown", HTTP_NOT_FOUND);
+}
+
+BOOST_AUTO_TEST_CASE(rpc_header_end)
+{
+    typedef string::iterator Iterator;
+    std::pair<Iterator, bool> match;
+
+    string str = "POST / HTTP/1.1\r\nHost: x\r\n\r\n{}";
+    match = MatchHTTPHeaderEnd(str.begin(), str.end());
+    BOOST_CHECK(match.second);
+    BOOST_CHECK(string(match.first, str.end()) == "{}");
+
+    str = "POST / HTTP/1.0\nHost: x\n\n";
+    match = MatchHTTPHeaderEnd(str.begin(), str.end());
+    BOOST_CHECK(match.second);
+    BOOST_CHECK(match.first == str.end());
+
+    // a line break at the end of the data may start the empty line, so
+    // matching resumes there
+    str = "POST / HTTP/1.1\r\nHost: x\r\n\r\n";
+    Iterator itArrived = str.end() - 2;
+    match = MatchHTTPHeaderEnd(str.begin(), itArrived);
+    BOOST_CHECK(!match.second);
+    BOOST_CHECK(match.first == itArrived - 1);
+    match = MatchHTTPHeaderEnd(match.first, str.end());
+    BOOST_CHECK(match.second);
+    BOOST_CHECK(match.first == str.end());
+
+    str = "POST / HTTP/1.1\r\nHost: x";
+    match = MatchHTTPHeaderEnd(str.begin(), str.end());
+    BOOST_CHECK(!match.second);
+    BOOST_CHECK(match.first == str.end());
+}
+
+static void AppendWork(vector<int>* pvDone, int n)
+{
+    pvDone->push_back(n);
+}
+
+static uint64_t WorkQueueStat(CRPCWorkQueue& queue, const string& strName)
+{
+    return find_value(queue.GetStats(), strName).get_uint64();
+}
+
+BOOST_AUTO_TEST_CASE(rpc_work_queue)
+{
+    vector<int> vDone;
+    CRPCWorkQueue queue(3, 1);
+
+    // work beyond the depth is refused, and only requests count as rejected
+    for (int i = 0; i < 3; i++)
+        BOOST_CHECK(queue.Enqueue(boost::bind(AppendWork, &vDone, i)));
+    BOOST_CHECK(!queue.Enqueue(boost::bind(AppendWork, &vDone, 3)));
+    BOOST_CHECK(!queue.Enqueue(boost::bind(AppendWork, &vDone, 3), false));
+    BOOST_CHECK_EQUAL(WorkQueueStat(queue, "depth"), 3U);
+    BOOST_CHECK_EQUAL(WorkQueueStat(queue, "rejected"), 1U);
+
+    // a worker takes the work in order, then waits for more
+    boost::thread worker(boost::bind(&CRPCWorkQueue::Run, &queue));
+    for (int i = 0; i < 500 && WorkQueueStat(queue, "processed") < 3; i++)
+        MilliSleep(10);
+    BOOST_CHECK_EQUAL(WorkQueueStat(queue, "processed"), 3U);
+    BOOST_CHECK_EQUAL(WorkQueueStat(queue, "depth"), 0U);
+    BOOST_CHECK_EQUAL(WorkQueueStat(queue, "peakdepth"), 3U);
+
+    queue.Interrupt();
+    worker.join();
+    BOOST_REQUIRE_EQUAL(vDone.size(), 3U);
+    for (int i = 0; i < 3; i++)
+        BOOST_CHECK_EQUAL(vDone[i], i);
+
+    // nothing is taken once interrupted
+    BOOST_CHECK(!queue.Enqueue(boost::bind(AppendWork, &vDone, 4)));
+    BOOST_CHECK_EQUAL(WorkQueueStat(queue, "rejected"), 2U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
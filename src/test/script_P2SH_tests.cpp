@@ -22,7 +22,7 @@ extern uint256 SignatureHash(CScript scriptCode, const CTransaction& txTo, unsig
 static std::vector<unsigned char>
 Serialize(const CScript& s)
 {
-    std::vector<unsigned char> sSerialized(s);
+    std::vector<unsigned char> sSerialized(s.begin(), s.end());
     return sSerialized;
 }
 
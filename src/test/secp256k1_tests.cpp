@@ -0,0 +1,405 @@
+// Copyright (c) 2014 The Reddcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "secp256k1.h"
+#include "test_bitcoin.h"
+
+#include "data/script_invalid.json.h"
+#include "data/script_valid.json.h"
+
+#include "base58.h"
+#include "key.h"
+#include "main.h"
+#include "script.h"
+#include "util.h"
+
+#include <string>
+#include <vector>
+
+#include <boost/foreach.hpp>
+#include <boost/test/unit_test.hpp>
+#include <openssl/ecdsa.h>
+#include <openssl/obj_mac.h>
+#include "json/json_spirit_writer_template.h"
+
+using namespace std;
+using namespace json_spirit;
+
+// From script_tests.cpp
+extern CScript ParseScript(string s);
+extern Array read_json(const std::string& jsondata);
+
+static const char* const pszVerifiers[] = { "openssl", "secp256k1" };
+
+// Restores the verifier in use when a test case ends
+struct VerifierSetup {
+    string strSaved;
+    VerifierSetup() : strSaved(ECC_GetVerifier()) {}
+    ~VerifierSetup() { ECC_SetVerifier(strSaved); }
+};
+
+static bool VerifyWith(const char* pszVerifier, const CPubKey& pubkey, const uint256& hash, const vector<unsigned char>& vchSig)
+{
+    BOOST_REQUIRE(ECC_SetVerifier(pszVerifier));
+    return pubkey.Verify(hash, vchSig);
+}
+
+BOOST_FIXTURE_TEST_SUITE(secp256k1_tests, VerifierSetup)
+
+BOOST_AUTO_TEST_CASE(secp256k1_parse_lax)
+{
+    static const struct {
+        const char* pszSig;
+        bool fValid;
+        int nR;
+        int nS;
+    } tests[] = {
+        // minimal DER
+        { "3006020101020102", true, 1, 2 },
+        // long form and padded lengths
+        { "308106020101020102", true, 1, 2 },
+        { "30820006020101020102", true, 1, 2 },
+        { "300702810101020102", true, 1, 2 },
+        { "30080282000101020102", true, 1, 2 },
+        // zero padding is ignored, but a set sign bit makes the integer
+        // negative, which OpenSSL never verifies
+        { "30080203000001020102", true, 1, 2 },
+        { "300702020081020102", true, 0x81, 2 },
+        { "3006020181020102", false, 0, 0 },
+        { "3006020101020181", false, 0, 0 },
+        { "30070202ff81020102", false, 0, 0 },
+        // indefinite length sequence, with and without end-of-contents
+        { "30800201010201020000", true, 1, 2 },
+        { "308002010102010200", false, 0, 0 },
+        // trailing bytes after the sequence
+        { "3006020101020102ffff", true, 1, 2 },
+        // sequence length must match its contents
+        { "3007020101020102", false, 0, 0 },
+        { "300702010102010200", false, 0, 0 },
+        { "3005020101020102", false, 0, 0 },
+        // wrong tags, truncation
+        { "3106020101020102", false, 0, 0 },
+        { "3006030101020102", false, 0, 0 },
+        { "30060201010201", false, 0, 0 },
+        { "30", false, 0, 0 },
+        { "", false, 0, 0 },
+        // empty integers are zero
+        { "30050200020102", true, 0, 2 },
+    };
+    for (unsigned int i = 0; i < sizeof(tests) / sizeof(tests[0]); i++)
+    {
+        string strHex(tests[i].pszSig);
+        vector<unsigned char> vchSig = ParseHex(strHex);
+        unsigned char r[32], s[32];
+        bool fValid = !vchSig.empty() && ECDSASignatureParseLax(&vchSig[0], vchSig.size(), r, s);
+        BOOST_CHECK_MESSAGE(fValid == tests[i].fValid, strHex);
+        if (fValid && tests[i].fValid)
+        {
+            unsigned char rExpected[32] = {0}, sExpected[32] = {0};
+            rExpected[31] = tests[i].nR;
+            sExpected[31] = tests[i].nS;
+            BOOST_CHECK_MESSAGE(memcmp(r, rExpected, 32) == 0 && memcmp(s, sExpected, 32) == 0, strHex);
+        }
+    }
+
+    // numbers wider than 32 bytes are out of range and come back as zero
+    vector<unsigned char> vchSig = ParseHex("3026022101"
+        "0000000000000000000000000000000000000000000000000000000000000001020102");
+    unsigned char r[32], s[32], zero[32] = {0};
+    BOOST_CHECK(ECDSASignatureParseLax(&vchSig[0], vchSig.size(), r, s));
+    BOOST_CHECK(memcmp(r, zero, 32) == 0);
+    BOOST_CHECK(s[31] == 2);
+}
+
+BOOST_AUTO_TEST_CASE(secp256k1_pubkey_cache_openssl)
+{
+    BOOST_REQUIRE(ECC_SetVerifier("openssl"));
+    ECC_SetPubKeyCacheSize(0);
+    ECC_SetPubKeyCacheSize(4);
+
+    // compressed keys are decompressed once, then verify from the cache
+    CKey key;
+    key.MakeNewKey(true);
+    CPubKey pubkey = key.GetPubKey();
+    uint256 hash = GetRandHash();
+    vector<unsigned char> vchSig;
+    BOOST_CHECK(key.Sign(hash, vchSig));
+    unsigned int nEntries;
+    uint64_t nHits, nMisses, nHitsBefore, nMissesBefore;
+    ECC_GetPubKeyCacheStats(nEntries, nHitsBefore, nMissesBefore);
+    for (int i = 0; i < 3; i++)
+        BOOST_CHECK(pubkey.Verify(hash, vchSig));
+    BOOST_CHECK(!pubkey.Verify(GetRandHash(), vchSig));
+    BOOST_CHECK(pubkey.IsFullyValid());
+    ECC_GetPubKeyCacheStats(nEntries, nHits, nMisses);
+    BOOST_CHECK_EQUAL(nEntries, 1U);
+    BOOST_CHECK_EQUAL(nHits - nHitsBefore, 4U);
+    BOOST_CHECK_EQUAL(nMisses - nMissesBefore, 1U);
+
+    ECC_SetPubKeyCacheSize(DEFAULT_PUBKEY_CACHE_SIZE);
+}
+
+#if defined(HAVE_NATIVE_SECP256K1)
+
+// A signature with r and s re-encoded using the given number of padding
+// bytes and long form lengths, as older software sometimes produced
+static vector<unsigned char> Reencode(const vector<unsigned char>& vchSig, int nPad, bool fLongForm)
+{
+    unsigned char r[32], s[32];
+    BOOST_REQUIRE(ECDSASignatureParseLax(&vchSig[0], vchSig.size(), r, s));
+    vector<unsigned char> vchBody;
+    for (int i = 0; i < 2; i++)
+    {
+        vchBody.push_back(0x02);
+        if (fLongForm)
+            vchBody.push_back(0x81);
+        vchBody.push_back(32 + nPad);
+        vchBody.insert(vchBody.end(), nPad, 0);
+        vchBody.insert(vchBody.end(), i ? s : r, (i ? s : r) + 32);
+    }
+    vector<unsigned char> vchOut;
+    vchOut.push_back(0x30);
+    if (fLongForm)
+        vchOut.push_back(0x81);
+    vchOut.push_back(vchBody.size());
+    vchOut.insert(vchOut.end(), vchBody.begin(), vchBody.end());
+    return vchOut;
+}
+
+// OpenSSL's own answer for the signature as given, without ECDSASignatureParseLax
+static bool VerifyRawDER(const CPubKey& pubkey, const uint256& hash, const vector<unsigned char>& vchSig)
+{
+    if (vchSig.empty())
+        return false;
+    EC_KEY* pkey = EC_KEY_new_by_curve_name(NID_secp256k1);
+    const unsigned char* pbegin = pubkey.begin();
+    bool fOk = o2i_ECPublicKey(&pkey, &pbegin, pubkey.size()) != NULL &&
+               ECDSA_verify(0, (const unsigned char*)&hash, sizeof(hash), &vchSig[0], vchSig.size(), pkey) == 1;
+    EC_KEY_free(pkey);
+    return fOk;
+}
+
+// OpenSSL 1.0.0p, 1.0.1k and later only verify signatures in strict DER
+static bool IsOpenSSLStrictDER(const CPubKey& pubkey, const uint256& hash, const vector<unsigned char>& vchSig)
+{
+    static int nStrict = -1;
+    if (nStrict < 0)
+        nStrict = !VerifyRawDER(pubkey, hash, Reencode(vchSig, 2, false));
+    return nStrict;
+}
+
+// Both verifiers must give the same answer, whatever the input, and it must
+// be the one OpenSSL gives when handed the raw signature. An OpenSSL that
+// only takes strict DER refuses more, but must not accept anything we refuse.
+static void CheckSame(const CPubKey& pubkey, const uint256& hash, const vector<unsigned char>& vchSig, bool fExpected, bool fStrictDER)
+{
+    bool fOpenSSL = VerifyWith("openssl", pubkey, hash, vchSig);
+    bool fNative = VerifyWith("secp256k1", pubkey, hash, vchSig);
+    bool fRaw = VerifyRawDER(pubkey, hash, vchSig);
+    string strInput = HexStr(pubkey.begin(), pubkey.end()) + " " + HexStr(vchSig);
+    BOOST_CHECK_MESSAGE(fOpenSSL == fNative, strInput);
+    if (fStrictDER)
+        BOOST_CHECK_MESSAGE(!fRaw || fNative, strInput);
+    else
+        BOOST_CHECK_MESSAGE(fRaw == fNative, strInput);
+    if (fExpected)
+        BOOST_CHECK(fNative);
+}
+
+BOOST_AUTO_TEST_CASE(secp256k1_key_vectors)
+{
+    static const char* const pszSecrets[] = {
+        "5HxWvvfubhXpYYpS3tJkw6fq9jE9j18THftkZjHHfmFiWtmAbrj",
+        "5KC4ejrDjv152FGwP386VD1i2NYc5KkfSMyv1nGy1VGDxGHqVY3",
+        "Kwr371tjA9u2rFSMZjTNun2PXXP3WPZu2afRHTcta6KxEUdm1vEw",
+        "L3Hq7a8FEQwJkW1M2GNKDW28546Vp5miewcCzSqUD9kCAXrJdS3g",
+    };
+    for (unsigned int i = 0; i < sizeof(pszSecrets) / sizeof(pszSecrets[0]); i++)
+    {
+        CBitcoinSecret secret;
+        BOOST_REQUIRE(secret.SetString(pszSecrets[i]));
+        CKey key = secret.GetKey();
+        CPubKey pubkey = key.GetPubKey();
+        for (int n = 0; n < 16; n++)
+        {
+            string strMsg = strprintf("Very secret message %i: 11", n);
+            uint256 hashMsg = Hash(strMsg.begin(), strMsg.end());
+            vector<unsigned char> vchSig;
+            BOOST_CHECK(key.Sign(hashMsg, vchSig));
+            bool fStrictDER = IsOpenSSLStrictDER(pubkey, hashMsg, vchSig);
+            CheckSame(pubkey, hashMsg, vchSig, true, fStrictDER);
+            uint256 hashOther = Hash(strMsg.begin(), strMsg.end() - 1);
+            CheckSame(pubkey, hashOther, vchSig, false, fStrictDER);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(secp256k1_differential)
+{
+    seed_insecure_rand(true);
+    for (int i = 0; i < 200; i++)
+    {
+        CKey key;
+        key.MakeNewKey(i & 1);
+        CPubKey pubkey = key.GetPubKey();
+        uint256 hash = GetRandHash();
+        vector<unsigned char> vchSig;
+        BOOST_CHECK(key.Sign(hash, vchSig));
+        bool fStrictDER = IsOpenSSLStrictDER(pubkey, hash, vchSig);
+
+        CheckSame(pubkey, hash, vchSig, true, fStrictDER);
+        CheckSame(pubkey, hash, Reencode(vchSig, 1 + i % 3, i & 2), true, fStrictDER);
+
+        // without the padding, an r or s with the top bit set is negative
+        unsigned char r[32], s[32];
+        BOOST_REQUIRE(ECDSASignatureParseLax(&vchSig[0], vchSig.size(), r, s));
+        CheckSame(pubkey, hash, Reencode(vchSig, 0, false), !(r[0] & 0x80) && !(s[0] & 0x80), fStrictDER);
+
+        // trailing garbage is ignored, as it always has been
+        vector<unsigned char> vchTrailing(vchSig);
+        vchTrailing.push_back(insecure_rand());
+        CheckSame(pubkey, hash, vchTrailing, true, fStrictDER);
+
+        // flipped bits anywhere in the signature, hash or key
+        for (int j = 0; j < 8; j++)
+        {
+            vector<unsigned char> vchBad(vchSig);
+            vchBad[insecure_rand() % vchBad.size()] ^= 1 << (insecure_rand() % 8);
+            CheckSame(pubkey, hash, vchBad, false, fStrictDER);
+
+            uint256 hashBad = hash;
+            *(BEGIN(hashBad) + insecure_rand() % 32) ^= 1 << (insecure_rand() % 8);
+            CheckSame(pubkey, hashBad, vchSig, false, fStrictDER);
+
+            vector<unsigned char> vchPubKey(pubkey.begin(), pubkey.end());
+            vchPubKey[1 + insecure_rand() % (vchPubKey.size() - 1)] ^= 1 << (insecure_rand() % 8);
+            CheckSame(CPubKey(vchPubKey), hash, vchSig, false, fStrictDER);
+        }
+
+        // random bytes with a plausible header
+        vector<unsigned char> vchRandom(2 + insecure_rand() % 80);
+        for (unsigned int j = 0; j < vchRandom.size(); j++)
+            vchRandom[j] = insecure_rand();
+        vchRandom[0] = 0x30;
+        CheckSame(pubkey, hash, vchRandom, false, fStrictDER);
+
+        // the hybrid encoding of the same key
+        if (!pubkey.IsCompressed())
+        {
+            vector<unsigned char> vchHybrid(pubkey.begin(), pubkey.end());
+            vchHybrid[0] = 0x06 | (vchHybrid[64] & 1);
+            CheckSame(CPubKey(vchHybrid), hash, vchSig, true, fStrictDER);
+            vchHybrid[0] ^= 1;
+            CheckSame(CPubKey(vchHybrid), hash, vchSig, false, fStrictDER);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(secp256k1_script_vectors)
+{
+    Array valid = read_json(std::string(json_tests::script_valid, json_tests::script_valid + sizeof(json_tests::script_valid)));
+    Array invalid = read_json(std::string(json_tests::script_invalid, json_tests::script_invalid + sizeof(json_tests::script_invalid)));
+    for (unsigned int i = 0; i < sizeof(pszVerifiers) / sizeof(pszVerifiers[0]); i++)
+    {
+        BOOST_REQUIRE(ECC_SetVerifier(pszVerifiers[i]));
+        for (int nExpected = 0; nExpected < 2; nExpected++)
+        {
+            BOOST_FOREACH(Value& tv, nExpected ? valid : invalid)
+            {
+                Array test = tv.get_array();
+                if (test.size() < 2)
+                    continue;
+                CScript scriptSig = ParseScript(test[0].get_str());
+                CScript scriptPubKey = ParseScript(test[1].get_str());
+                CTransaction tx;
+                bool fResult = VerifyScript(scriptSig, scriptPubKey, tx, 0, SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_STRICTENC, SIGHASH_NONE);
+                BOOST_CHECK_MESSAGE(fResult == (nExpected == 1), string(pszVerifiers[i]) + ": " + write_string(tv, false));
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(secp256k1_pubkey_cache)
+{
+    BOOST_REQUIRE(ECC_SetVerifier("secp256k1"));
+    ECC_SetPubKeyCacheSize(4);
+
+    vector<CKey> vKey(6);
+    vector<CPubKey> vPubKey;
+    BOOST_FOREACH(CKey& key, vKey)
+    {
+        key.MakeNewKey(vPubKey.size() & 1);
+        vPubKey.push_back(key.GetPubKey());
+    }
+    uint256 hash = GetRandHash();
+    unsigned int nEntries;
+    uint64_t nHits, nMisses, nHitsBefore, nMissesBefore;
+    ECC_GetPubKeyCacheStats(nEntries, nHitsBefore, nMissesBefore);
+
+    // a key is parsed once, then found in the cache
+    vector<unsigned char> vchSig;
+    BOOST_CHECK(vKey[0].Sign(hash, vchSig));
+    for (int i = 0; i < 3; i++)
+        BOOST_CHECK(vPubKey[0].Verify(hash, vchSig));
+    BOOST_CHECK(vPubKey[0].IsFullyValid());
+    BOOST_CHECK(!vPubKey[1].Verify(hash, vchSig));
+    ECC_GetPubKeyCacheStats(nEntries, nHits, nMisses);
+    BOOST_CHECK_EQUAL(nEntries, 2U);
+    BOOST_CHECK_EQUAL(nHits - nHitsBefore, 3U);
+    BOOST_CHECK_EQUAL(nMisses - nMissesBefore, 2U);
+
+    // the cache stays bounded, and a key that was evicted still verifies
+    for (unsigned int i = 2; i < vPubKey.size(); i++)
+        BOOST_CHECK(vPubKey[i].IsFullyValid());
+    ECC_GetPubKeyCacheStats(nEntries, nHits, nMisses);
+    BOOST_CHECK_EQUAL(nEntries, 4U);
+    BOOST_CHECK(vPubKey[0].Verify(hash, vchSig));
+
+    // keys that do not parse are not kept
+    vector<unsigned char> vchInvalid(vPubKey[0].begin(), vPubKey[0].end());
+    vchInvalid[0] = 0x07 - (vchInvalid[64] & 1); // hybrid form with the wrong parity
+    BOOST_CHECK(!CPubKey(vchInvalid).IsFullyValid());
+    ECC_GetPubKeyCacheStats(nEntries, nHits, nMisses);
+    BOOST_CHECK_EQUAL(nEntries, 4U);
+
+    ECC_SetPubKeyCacheSize(0);
+    ECC_GetPubKeyCacheStats(nEntries, nHits, nMisses);
+    BOOST_CHECK_EQUAL(nEntries, 0U);
+    BOOST_CHECK(vPubKey[0].Verify(hash, vchSig));
+    ECC_GetPubKeyCacheStats(nEntries, nHits, nMisses);
+    BOOST_CHECK_EQUAL(nEntries, 0U);
+
+    ECC_SetPubKeyCacheSize(DEFAULT_PUBKEY_CACHE_SIZE);
+}
+
+BOOST_AUTO_TEST_CASE(secp256k1_benchmark)
+{
+    if (!BenchmarksEnabled())
+        return;
+
+    CKey key;
+    key.MakeNewKey(true);
+    CPubKey pubkey = key.GetPubKey();
+    vector<uint256> vHash(200);
+    vector<vector<unsigned char> > vSig(vHash.size());
+    for (unsigned int i = 0; i < vHash.size(); i++)
+    {
+        vHash[i] = GetRandHash();
+        BOOST_CHECK(key.Sign(vHash[i], vSig[i]));
+    }
+    for (unsigned int i = 0; i < sizeof(pszVerifiers) / sizeof(pszVerifiers[0]); i++)
+    {
+        BOOST_REQUIRE(ECC_SetVerifier(pszVerifiers[i]));
+        int64_t nStart = GetTimeMicros();
+        for (unsigned int j = 0; j < vHash.size(); j++)
+            BOOST_CHECK(pubkey.Verify(vHash[j], vSig[j]));
+        int64_t nTime = GetTimeMicros() - nStart;
+        BOOST_TEST_MESSAGE(strprintf("ECDSA verify (%s): %.1fus per signature",
+                                     pszVerifiers[i], (double)nTime / vHash.size()));
+    }
+}
+
+#endif // HAVE_NATIVE_SECP256K1
+
+BOOST_AUTO_TEST_SUITE_END()
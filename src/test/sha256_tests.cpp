@@ -0,0 +1,168 @@
+// Copyright (c) 2014 The Reddcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "sha256.h"
+#include "test_bitcoin.h"
+
+#include "core.h"
+#include "hash.h"
+#include "util.h"
+
+#include <string>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+#include <openssl/sha.h>
+
+using namespace std;
+
+// SHA-256 of the data, fed to CSHA256 in pieces of at most nStep bytes
+static string HexSHA256(const string& str, size_t nStep)
+{
+    CSHA256 hasher;
+    for (size_t i = 0; i < str.size(); i += nStep)
+        hasher.Write((const unsigned char*)str.data() + i, min(nStep, str.size() - i));
+    unsigned char hash[CSHA256::OUTPUT_SIZE];
+    hasher.Finalize(hash);
+    return HexStr(hash, hash + sizeof(hash));
+}
+
+BOOST_AUTO_TEST_SUITE(sha256_tests)
+
+BOOST_AUTO_TEST_CASE(sha256_testvectors)
+{
+    static const struct {
+        string strInput;
+        const char* pszHash;
+    } tests[] = {
+        { "", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855" },
+        { "abc", "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad" },
+        { "message digest", "f7846f55cf23e14eebeab5b4e1550cad5b509e3348fbc4efa3a1413d393cb650" },
+        { "secure hash algorithm", "f30ceb2bb2829e79e4ca9753d35a8ecc00262d164cc077080295381cbd643f0d" },
+        { "SHA256 is considered to be safe", "6819d915c73f4d1e77e4e1b52d1fa0f9cf9beaead3939f15874bd988e2a23630" },
+        { "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+          "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1" },
+        { "For this sample, this 63-byte string will be used as input data",
+          "f08a78cbbaee082b052ae0708f32fa1e50c5c421aa772ba5dbb406a2ea6be342" },
+        { "This is exactly 64 bytes long, not counting the terminating byte",
+          "ab64eff7e88e2e46165e29f2bce41826bd4c7b3552f6b382a9e7d3af47c245f8" },
+        { "As Bitcoin relies on 80 byte header hashes, we want to have an example for that.",
+          "7406e8de7d6e4fffc573daef05aefb8806e7790f55eab5576f31349743cca743" },
+        { string(1000000, 'a'), "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0" },
+    };
+    static const size_t steps[] = { 1, 7, 63, 64, 65, 1000000 };
+    for (unsigned int i = 0; i < sizeof(tests) / sizeof(tests[0]); i++)
+        for (unsigned int j = 0; j < sizeof(steps) / sizeof(steps[0]); j++)
+            BOOST_CHECK_EQUAL(HexSHA256(tests[i].strInput, steps[j]), tests[i].pszHash);
+
+    // what InitSanityCheck requires
+    BOOST_CHECK(SHA256SelfTest());
+}
+
+BOOST_AUTO_TEST_CASE(sha256_openssl)
+{
+    seed_insecure_rand(true);
+    for (int i = 0; i < 1000; i++)
+    {
+        string str(insecure_rand() % 300, 0);
+        for (unsigned int j = 0; j < str.size(); j++)
+            str[j] = insecure_rand();
+        unsigned char hash[32];
+        SHA256((const unsigned char*)str.data(), str.size(), hash);
+        BOOST_CHECK_EQUAL(HexSHA256(str, 1 + insecure_rand() % 100), HexStr(hash, hash + sizeof(hash)));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(sha256_d64)
+{
+    seed_insecure_rand(true);
+    vector<uint256> vIn(2 * 40), vOut(40);
+    for (unsigned int i = 0; i < vIn.size(); i++)
+        vIn[i] = GetRandHash();
+
+    // every batch size, so each of the 8-way, 4-way and single paths is used
+    for (unsigned int nBlocks = 0; nBlocks <= 40; nBlocks++)
+    {
+        vOut.assign(40, 0);
+        if (nBlocks > 0)
+            SHA256D64((unsigned char*)&vOut[0], (const unsigned char*)&vIn[0], nBlocks);
+        for (unsigned int i = 0; i < 40; i++)
+        {
+            uint256 hash = i < nBlocks ? Hash(BEGIN(vIn[2*i]), END(vIn[2*i]), BEGIN(vIn[2*i+1]), END(vIn[2*i+1])) : 0;
+            BOOST_CHECK(vOut[i] == hash);
+        }
+    }
+}
+
+// Merkle root computed one pair at a time, as before batching
+static uint256 ReferenceMerkleRoot(vector<uint256> vLevel)
+{
+    while (vLevel.size() > 1)
+    {
+        vector<uint256> vNext;
+        for (unsigned int i = 0; i < vLevel.size(); i += 2)
+        {
+            const uint256& right = vLevel[min(i + 1, (unsigned int)vLevel.size() - 1)];
+            vNext.push_back(Hash(BEGIN(vLevel[i]), END(vLevel[i]), BEGIN(right), END(right)));
+        }
+        vLevel.swap(vNext);
+    }
+    return vLevel.empty() ? 0 : vLevel[0];
+}
+
+BOOST_AUTO_TEST_CASE(sha256_merkle)
+{
+    CBlock block;
+    for (int nTx = 0; nTx <= 33; nTx++)
+    {
+        vector<uint256> vHashes;
+        BOOST_FOREACH(const CTransaction& tx, block.vtx)
+            vHashes.push_back(tx.GetHash());
+        BOOST_CHECK(block.BuildMerkleTree() == ReferenceMerkleRoot(vHashes));
+        for (int i = 0; i < nTx; i++)
+            BOOST_CHECK(CBlock::CheckMerkleBranch(vHashes[i], block.GetMerkleBranch(i), i) == block.vMerkleTree.back());
+
+        CTransaction tx;
+        tx.vin.push_back(CTxIn(COutPoint(GetRandHash(), nTx)));
+        tx.vout.push_back(CTxOut(nTx, CScript() << OP_TRUE));
+        block.vtx.push_back(tx);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(sha256_benchmark)
+{
+    if (!BenchmarksEnabled())
+        return;
+
+    const string strImpl = SHA256AutoDetect();
+
+    vector<unsigned char> vData(1 << 20, 0x5a);
+    unsigned char hash[32];
+    int64_t nStart = GetTimeMicros();
+    for (int i = 0; i < 16; i++)
+        CSHA256().Write(&vData[0], vData.size()).Finalize(hash);
+    int64_t nTime = GetTimeMicros() - nStart;
+    nStart = GetTimeMicros();
+    for (int i = 0; i < 16; i++)
+        SHA256(&vData[0], vData.size(), hash);
+    int64_t nTimeOpenSSL = GetTimeMicros() - nStart;
+    BOOST_TEST_MESSAGE(strprintf("SHA256 (%s), 16MB: %.2fms (OpenSSL %.2fms)",
+                                 strImpl, nTime * 0.001, nTimeOpenSSL * 0.001));
+
+    // one level of a merkle tree with 64k leaves
+    vector<uint256> vIn(1 << 16), vOut(1 << 15);
+    for (unsigned int i = 0; i < vIn.size(); i++)
+        vIn[i] = i;
+    nStart = GetTimeMicros();
+    SHA256D64((unsigned char*)&vOut[0], (const unsigned char*)&vIn[0], vOut.size());
+    nTime = GetTimeMicros() - nStart;
+    nStart = GetTimeMicros();
+    for (unsigned int i = 0; i < vOut.size(); i++)
+        BOOST_CHECK(vOut[i] == Hash(BEGIN(vIn[2*i]), END(vIn[2*i]), BEGIN(vIn[2*i+1]), END(vIn[2*i+1])));
+    int64_t nTimeSingle = GetTimeMicros() - nStart;
+    BOOST_TEST_MESSAGE(strprintf("SHA256D64, %u inputs: %.2fms (one at a time %.2fms)",
+                                 vOut.size(), nTime * 0.001, nTimeSingle * 0.001));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
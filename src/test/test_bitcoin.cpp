@@ -4,9 +4,11 @@
 
 #define BOOST_TEST_MODULE Bitcoin Test Suite
 
+#include "test_bitcoin.h"
 
-
+#include "key.h"
 #include "main.h"
+#include "sha256.h"
 #include "txdb.h"
 #include "ui_interface.h"
 #include "util.h"
@@ -25,12 +27,12 @@ extern bool fPrintToConsole;
 extern void noui_connect();
 
 struct TestingSetup {
-    CCoinsViewDB *pcoinsdbview;
     boost::filesystem::path pathTemp;
     boost::thread_group threadGroup;
 
     TestingSetup() {
         fPrintToDebugLog = false; // don't want to write to debug.log file
+        SHA256AutoDetect();
         noui_connect();
 #ifdef ENABLE_WALLET
         bitdb.MakeMock();
@@ -74,6 +76,32 @@ struct TestingSetup {
 
 BOOST_GLOBAL_FIXTURE(TestingSetup);
 
+bool BenchmarksEnabled()
+{
+    return getenv("TEST_BENCHMARK") != NULL;
+}
+
+CBlock CreateBenchmarkBlock(const CKey& key)
+{
+    CScript scriptPubKey;
+    scriptPubKey.SetDestination(key.GetPubKey().GetID());
+
+    CBlock block;
+    for (int i = 0; i < 1000; i++)
+    {
+        CTransaction tx;
+        for (int j = 0; j < 2; j++)
+        {
+            tx.vin.push_back(CTxIn(COutPoint(GetRandHash(), j)));
+            tx.vin.back().scriptSig << std::vector<unsigned char>(72, i) << key.GetPubKey();
+        }
+        for (int j = 0; j < 3; j++)
+            tx.vout.push_back(CTxOut(insecure_rand() % (1000 * COIN), scriptPubKey));
+        block.vtx.push_back(tx);
+    }
+    return block;
+}
+
 void Shutdown(void* parg)
 {
   exit(0);
@@ -0,0 +1,20 @@
+// Copyright (c) 2014 The Reddcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TEST_TEST_BITCOIN_H
+#define BITCOIN_TEST_TEST_BITCOIN_H
+
+#include "core.h"
+
+class CKey;
+
+/** Whether to run the benchmark test cases, which time code rather than
+ *  check it; they are skipped unless TEST_BENCHMARK is set in the environment */
+bool BenchmarksEnabled();
+
+/** A block of 1000 transactions paying to key, each spending two inputs with
+ *  a 72 byte signature and the public key into three pay-to-pubkey-hash outputs */
+CBlock CreateBenchmarkBlock(const CKey& key);
+
+#endif
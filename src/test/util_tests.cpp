@@ -340,4 +340,16 @@ BOOST_AUTO_TEST_CASE(gettime)
     BOOST_CHECK((GetTime() & ~0xFFFFFFFFLL) == 0);
 }
 
+BOOST_AUTO_TEST_CASE(resident_memory)
+{
+    int64_t nMemory = GetResidentMemory();
+    BOOST_CHECK(nMemory >= 0);
+#ifdef __linux__
+    BOOST_CHECK(nMemory > 0);
+    std::vector<char> vch(64 << 20, 1);
+    BOOST_CHECK(GetResidentMemory() >= nMemory + (32 << 20));
+    BOOST_CHECK_EQUAL(vch.back(), 1);
+#endif
+}
+
 BOOST_AUTO_TEST_SUITE_END()
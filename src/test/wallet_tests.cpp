@@ -3,6 +3,10 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "wallet.h"
+#include "test_bitcoin.h"
+
+#include "coinselection.h"
+#include "stakepolicy.h"
 
 #include <set>
 #include <stdint.h>
@@ -303,4 +307,329 @@ BOOST_AUTO_TEST_CASE(coin_selection_tests)
     empty_wallet();
 }
 
+BOOST_AUTO_TEST_CASE(coin_selection_bnb)
+{
+    vector<char> vfSelected;
+    int64_t nSelected;
+
+    vector<int64_t> vValue;
+    for (int i = 5; i > 0; i--)
+        vValue.push_back(i * CENT);
+
+    // 6 cents is made exactly, from two coins
+    BOOST_CHECK(SelectCoinsBnB(vValue, 6 * CENT, 0, vfSelected, nSelected));
+    BOOST_CHECK_EQUAL(nSelected, 6 * CENT);
+    BOOST_CHECK_EQUAL(count(vfSelected.begin(), vfSelected.end(), true), 2);
+
+    // all coins make 15 cents, 16 cents is out of reach
+    BOOST_CHECK(SelectCoinsBnB(vValue, 15 * CENT, 0, vfSelected, nSelected));
+    BOOST_CHECK_EQUAL(count(vfSelected.begin(), vfSelected.end(), true), 5);
+    BOOST_CHECK(!SelectCoinsBnB(vValue, 16 * CENT, 0, vfSelected, nSelected));
+
+    // without an exact match, the smallest excess within the tolerance is taken
+    vValue.clear();
+    vValue.push_back(10 * CENT);
+    vValue.push_back(7 * CENT);
+    vValue.push_back(4 * CENT);
+    BOOST_CHECK(!SelectCoinsBnB(vValue, 8 * CENT, 0, vfSelected, nSelected));
+    BOOST_CHECK(SelectCoinsBnB(vValue, 8 * CENT, 3 * CENT, vfSelected, nSelected));
+    BOOST_CHECK_EQUAL(nSelected, 10 * CENT);
+    BOOST_CHECK(SelectCoinsBnB(vValue, 14 * CENT, 1 * CENT, vfSelected, nSelected));
+    BOOST_CHECK_EQUAL(nSelected, 14 * CENT);
+    BOOST_CHECK(vfSelected[0] && !vfSelected[1] && vfSelected[2]);
+
+    // many coins of equal value are not tried in every order
+    vValue.assign(1000, COIN);
+    vValue.push_back(CENT);
+    BOOST_CHECK(SelectCoinsBnB(vValue, 500 * COIN + CENT, 0, vfSelected, nSelected, 2000));
+    BOOST_CHECK_EQUAL(nSelected, 500 * COIN + CENT);
+    BOOST_CHECK(!SelectCoinsBnB(vValue, 500 * COIN + 2 * CENT, 0, vfSelected, nSelected, 2000));
+
+    // the search gives up after the given number of tries
+    vValue.clear();
+    for (int i = 0; i < 40; i++)
+        vValue.push_back((1000 - i) * CENT);
+    BOOST_CHECK(!SelectCoinsBnB(vValue, 1923 * CENT, 0, vfSelected, nSelected, 10));
+    BOOST_CHECK(SelectCoinsBnB(vValue, 1923 * CENT, 0, vfSelected, nSelected));
+    BOOST_CHECK_EQUAL(nSelected, 1923 * CENT);
+}
+
+// Times coin selection over synthetic coin distributions: stake splits of
+// similar size, small tips, and values spread over several magnitudes
+BOOST_AUTO_TEST_CASE(coin_selection_benchmark)
+{
+    if (!BenchmarksEnabled())
+        return;
+
+    CoinSet setCoinsRet;
+    int64_t nValueRet;
+
+    LOCK(wallet.cs_wallet);
+    seed_insecure_rand(true);
+
+    const char* pszDistributions[] = { "stake splits", "tips", "spread" };
+    for (int nDist = 0; nDist < 3; nDist++)
+    {
+        empty_wallet();
+        int64_t nTotal = 0;
+        for (int i = 0; i < 20000; i++)
+        {
+            int64_t nValue;
+            if (nDist == 0)
+                nValue = 1000 * COIN + insecure_rand() % (10 * COIN);
+            else if (nDist == 1)
+                nValue = 1 + insecure_rand() % (100 * COIN);
+            else
+                nValue = (1 + insecure_rand() % 1000) * (int64_t)pow(10, insecure_rand() % 8);
+            add_coin(nValue);
+            nTotal += nValue;
+        }
+
+        int64_t vTargets[] = { 50 * COIN, 5000 * COIN, nTotal / 3, nTotal - CENT };
+        for (int nTarget = 0; nTarget < 4; nTarget++)
+        {
+            int64_t nStart = GetTimeMicros();
+            BOOST_CHECK(wallet.SelectCoinsMinConf(vTargets[nTarget], 1, 6, vCoins, setCoinsRet, nValueRet));
+            int64_t nElapsed = GetTimeMicros() - nStart;
+            BOOST_CHECK_GE(nValueRet, vTargets[nTarget]);
+            BOOST_TEST_MESSAGE(strprintf("coin selection, %s, target %s: %u coins, excess %s, %.2fms",
+                                         pszDistributions[nDist], FormatMoney(vTargets[nTarget]), setCoinsRet.size(),
+                                         FormatMoney(nValueRet - vTargets[nTarget]), nElapsed * 0.001));
+        }
+    }
+    empty_wallet();
+}
+
+static CStakeOutput StakeOutput(const CScript& scriptPubKey, int64_t nValue, uint64_t nWeight)
+{
+    static unsigned int n = 0;
+    CStakeOutput output;
+    output.outpoint = COutPoint(uint256(++n), 0);
+    output.scriptPubKey = scriptPubKey;
+    output.nValue = nValue;
+    output.nWeight = nWeight;
+    return output;
+}
+
+BOOST_AUTO_TEST_CASE(stake_policy_plan)
+{
+    CStakePolicy policy;
+    policy.nTargetOutput = 1000 * COIN;
+    policy.nSmallOutput = 100 * COIN;
+    policy.nMinInputs = 3;
+    policy.nMaxInputs = 5;
+
+    CScript scriptA, scriptB, scriptC;
+    scriptA << OP_1;
+    scriptB << OP_2;
+    scriptC << OP_3;
+
+    vector<CStakeOutput> vOutputs;
+    // address A: seven small outputs and one large one
+    for (int i = 0; i < 7; i++)
+        vOutputs.push_back(StakeOutput(scriptA, 10 * COIN, 70 - i * 10));
+    vOutputs.push_back(StakeOutput(scriptA, 500 * COIN, 0));
+    // address B: too few small outputs
+    vOutputs.push_back(StakeOutput(scriptB, 10 * COIN, 0));
+    vOutputs.push_back(StakeOutput(scriptB, 10 * COIN, 0));
+    // address C: outputs of 297 coins, four of which add up past the target;
+    // not small until nSmallOutput is raised below
+    for (int i = 0; i < 4; i++)
+        vOutputs.push_back(StakeOutput(scriptC, 99 * COIN * 3, 0));
+
+    vector<CConsolidation> vPlan;
+    PlanConsolidation(policy, vOutputs, vPlan);
+    BOOST_REQUIRE_EQUAL(vPlan.size(), 1U);
+
+    // at most nMaxInputs of A's outputs, the ones with the least weight
+    const CConsolidation& consolidation = vPlan[0];
+    BOOST_CHECK(consolidation.scriptPubKey == scriptA);
+    BOOST_CHECK_EQUAL(consolidation.vInputs.size(), 5U);
+    BOOST_CHECK_EQUAL(consolidation.nValue, 50 * COIN);
+    BOOST_CHECK_EQUAL(consolidation.nWeightLost, 150U);
+
+    // once C's outputs count as small, only the three that fit under the
+    // target are combined
+    policy.nSmallOutput = 300 * COIN;
+    PlanConsolidation(policy, vOutputs, vPlan);
+    BOOST_REQUIRE_EQUAL(vPlan.size(), 2U);
+    BOOST_CHECK(vPlan[0].scriptPubKey == scriptC);
+    BOOST_CHECK_EQUAL(vPlan[0].vInputs.size(), 3U);
+    BOOST_CHECK_EQUAL(vPlan[0].nWeightLost, 0U);
+    BOOST_CHECK(vPlan[1].scriptPubKey == scriptA);
+}
+
+BOOST_AUTO_TEST_CASE(is_mine_script_set)
+{
+    CWallet keystore;
+    LOCK(keystore.cs_wallet);
+
+    CKey key[3];
+    CPubKey pubkey[3];
+    for (int i = 0; i < 3; i++)
+    {
+        key[i].MakeNewKey(i != 1);
+        pubkey[i] = key[i].GetPubKey();
+    }
+    keystore.AddKeyPubKey(key[0], pubkey[0]);
+    keystore.AddKeyPubKey(key[1], pubkey[1]);
+
+    CScript multisigMine, multisigPartial, scriptHashPartial;
+    multisigMine << OP_2 << pubkey[0] << pubkey[1] << OP_2 << OP_CHECKMULTISIG;
+    multisigPartial << OP_2 << pubkey[0] << pubkey[2] << OP_2 << OP_CHECKMULTISIG;
+    keystore.AddCScript(multisigPartial);
+    scriptHashPartial.SetDestination(multisigPartial.GetID());
+
+    vector<CScript> vScripts;
+    for (int i = 0; i < 3; i++)
+    {
+        CScript script;
+        script.SetDestination(pubkey[i].GetID());
+        vScripts.push_back(script);
+        vScripts.push_back(CScript() << pubkey[i] << OP_CHECKSIG);
+    }
+    vScripts.push_back(multisigMine);
+    vScripts.push_back(multisigPartial);
+    vScripts.push_back(scriptHashPartial);
+    vScripts.push_back(CScript() << OP_RETURN);
+
+    // the set and Solver agree, before and after the missing key is added
+    BOOST_FOREACH(const CScript& script, vScripts)
+        BOOST_CHECK_EQUAL(keystore.IsMine(script), IsMine(keystore, script));
+    BOOST_CHECK(keystore.IsMine(vScripts[0]));
+    BOOST_CHECK(keystore.IsMine(vScripts[3]));
+    BOOST_CHECK(!keystore.IsMine(vScripts[4]));
+    BOOST_CHECK(keystore.IsMine(multisigMine));
+    BOOST_CHECK(!keystore.IsMine(scriptHashPartial));
+
+    keystore.AddKeyPubKey(key[2], pubkey[2]);
+    BOOST_FOREACH(const CScript& script, vScripts)
+        BOOST_CHECK_EQUAL(keystore.IsMine(script), IsMine(keystore, script));
+    BOOST_CHECK(keystore.IsMine(multisigPartial));
+    BOOST_CHECK(keystore.IsMine(scriptHashPartial));
+}
+
+
+// Balances summed over every wallet transaction, without any cache
+static void CheckBalances(const CWallet& w, int64_t nExpectedBalance, int64_t nExpectedUnconfirmed)
+{
+    int64_t nBalance = 0, nUnconfirmed = 0, nImmature = 0;
+    unsigned int nCoins = 0;
+    for (map<uint256, CWalletTx>::const_iterator it = w.mapWallet.begin(); it != w.mapWallet.end(); ++it)
+    {
+        const CWalletTx& wtx = it->second;
+        bool fTrusted = wtx.IsTrusted();
+        if (fTrusted)
+            nBalance += wtx.GetAvailableCredit(false);
+        if (!IsFinalTx(wtx) || (!fTrusted && wtx.GetDepthInMainChain() == 0))
+            nUnconfirmed += wtx.GetAvailableCredit(false);
+        nImmature += wtx.GetImmatureCredit(false);
+        for (unsigned int i = 0; i < wtx.vout.size(); i++)
+            if (wtx.GetDepthInMainChain() >= 0 && w.IsMine(wtx.vout[i]) && !w.IsSpent(it->first, i))
+                nCoins++;
+    }
+    BOOST_CHECK_EQUAL(w.GetBalance(), nBalance);
+    BOOST_CHECK_EQUAL(w.GetUnconfirmedBalance(), nUnconfirmed);
+    BOOST_CHECK_EQUAL(w.GetImmatureBalance(), nImmature);
+    BOOST_CHECK_EQUAL(nBalance, nExpectedBalance);
+    BOOST_CHECK_EQUAL(nUnconfirmed, nExpectedUnconfirmed);
+
+    // every unspent output of ours is listed, so none was dropped from setMyUnspent
+    vector<COutput> vAvailable;
+    w.AvailableCoins(vAvailable, false);
+    BOOST_CHECK_EQUAL(vAvailable.size(), nCoins);
+}
+
+// Connect a block containing only tx on top of the tip. The merkle root is the
+// transaction's hash, so an empty merkle branch at index 0 verifies.
+static CBlockIndex* ConnectFakeBlock(const CTransaction& tx, uint256& hashBlock)
+{
+    CBlockIndex* pindex = new CBlockIndex();
+    pindex->pprev = chainActive.Tip();
+    pindex->nHeight = chainActive.Height() + 1;
+    pindex->hashMerkleRoot = tx.GetHash();
+    hashBlock = GetRandHash();
+    pindex->phashBlock = &mapBlockIndex.insert(make_pair(hashBlock, pindex)).first->first;
+    chainActive.SetTip(pindex);
+    return pindex;
+}
+
+static void ConfirmTx(CWallet& w, const CTransaction& tx, const uint256& hashBlock)
+{
+    std::list<CTransaction> removed;
+    mempool.remove(tx, removed);
+    CWalletTx wtx(&w, tx);
+    wtx.hashBlock = hashBlock;
+    wtx.nIndex = 0;
+    w.AddToWallet(wtx);
+}
+
+BOOST_AUTO_TEST_CASE(balance_cache)
+{
+    CWallet w("wallet_balance_test.dat");
+    LOCK2(cs_main, w.cs_wallet);
+    CBlockIndex* pindexGenesis = chainActive.Tip();
+
+    CKey key;
+    key.MakeNewKey(true);
+    w.AddKeyPubKey(key, key.GetPubKey());
+    CScript scriptMine, scriptOther;
+    scriptMine.SetDestination(key.GetPubKey().GetID());
+    scriptOther << OP_TRUE;
+
+    // add: a payment to us enters the mempool, then a block
+    CTransaction tx1;
+    tx1.vin.resize(1);
+    tx1.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    tx1.vout.push_back(CTxOut(10 * COIN, scriptMine));
+    tx1.vout.push_back(CTxOut(5 * COIN, scriptOther));
+    mempool.addUnchecked(tx1.GetHash(), CTxMemPoolEntry(tx1, 0, 0, 0.0, 1));
+    w.SyncTransaction(tx1.GetHash(), tx1, NULL);
+    CheckBalances(w, 0, 10 * COIN);
+
+    uint256 hashBlock1, hashBlock2;
+    CBlockIndex* pindex1 = ConnectFakeBlock(tx1, hashBlock1);
+    ConfirmTx(w, tx1, hashBlock1);
+    CheckBalances(w, 10 * COIN, 0);
+    CheckBalances(w, 10 * COIN, 0); // settled
+
+    // spend: our change is trusted while unconfirmed, then confirmed
+    CTransaction tx2;
+    tx2.vin.resize(1);
+    tx2.vin[0].prevout = COutPoint(tx1.GetHash(), 0);
+    tx2.vout.push_back(CTxOut(3 * COIN, scriptOther));
+    tx2.vout.push_back(CTxOut(6 * COIN, scriptMine));
+    mempool.addUnchecked(tx2.GetHash(), CTxMemPoolEntry(tx2, COIN, 0, 0.0, 1));
+    w.SyncTransaction(tx2.GetHash(), tx2, NULL);
+    CheckBalances(w, 6 * COIN, 0);
+
+    CBlockIndex* pindex2 = ConnectFakeBlock(tx2, hashBlock2);
+    ConfirmTx(w, tx2, hashBlock2);
+    CheckBalances(w, 6 * COIN, 0);
+
+    // reorg: the spend is disconnected and conflicted, so the coin it spent is
+    // ours again; then the payment is disconnected and leaves the mempool too
+    chainActive.SetTip(pindex1);
+    w.SyncTransaction(tx2.GetHash(), tx2, NULL);
+    CheckBalances(w, 10 * COIN, 0);
+
+    chainActive.SetTip(pindexGenesis);
+    w.SyncTransaction(tx1.GetHash(), tx1, NULL);
+    CheckBalances(w, 0, 0);
+
+    // reconnecting the payment brings it back
+    mempool.addUnchecked(tx1.GetHash(), CTxMemPoolEntry(tx1, 0, 0, 0.0, 1));
+    w.SyncTransaction(tx1.GetHash(), tx1, NULL);
+    CheckBalances(w, 0, 10 * COIN);
+    chainActive.SetTip(pindex1);
+    ConfirmTx(w, tx1, hashBlock1);
+    CheckBalances(w, 10 * COIN, 0);
+
+    chainActive.SetTip(pindexGenesis);
+    mapBlockIndex.erase(hashBlock1);
+    mapBlockIndex.erase(hashBlock2);
+    delete pindex1;
+    delete pindex2;
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -10,6 +10,10 @@
 
 #include <stdint.h>
 
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread.hpp>
+
 using namespace std;
 
 void static BatchWriteCoins(CLevelDBBatch &batch, const uint256 &hash, const CCoins &coins) {
@@ -23,23 +27,128 @@ void static BatchWriteHashBestChain(CLevelDBBatch &batch, const uint256 &hash) {
     batch.Write('B', hash);
 }
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe) {
+// Key prefix shared by all 'o' records of txid
+static std::string OutputKeyPrefix(const uint256 &txid) {
+    CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+    ssKey << 'o' << txid;
+    return std::string(ssKey.begin(), ssKey.end());
+}
+
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", "chainstate", CLevelDBOptions::FromArgs("chainstate", nCacheSize), fMemory, fWipe) {
+    pstatsRunning = NULL;
+    nLayout = COINS_LAYOUT_TX;
+    db.Read('L', nLayout);
+    fUpgrading = db.Exists('U');
+    if (nLayout != COINS_LAYOUT_TX)
+        LogPrintf("Coin database stores one record per output%s\n", fUpgrading ? " (upgrade in progress)" : "");
+}
+
+bool CCoinsViewDB::ReadOutputs(const uint256 &txid, CCoins &coins) {
+    std::string strPrefix = OutputKeyPrefix(txid);
+    boost::scoped_ptr<leveldb::Iterator> pcursor(db.NewIterator(true));
+    bool fFound = false;
+    coins = CCoins();
+    try {
+        for (pcursor->Seek(strPrefix); pcursor->Valid() && pcursor->key().starts_with(strPrefix); pcursor->Next()) {
+            leveldb::Slice slKey = pcursor->key();
+            CSpanReader ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
+            CCoinsOutputKey key;
+            ssKey >> key;
+            leveldb::Slice slValue = pcursor->value();
+            CSpanReader ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
+            CCoinsOutputRecord record;
+            ssValue >> record;
+            record.ApplyTo(coins, key.n);
+            fFound = true;
+        }
+    } catch (std::exception &e) {
+        return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+    }
+    HandleError(pcursor->status());
+    return fFound;
+}
+
+void CCoinsViewDB::BatchWriteOutputs(CLevelDBBatch &batch, const uint256 &txid, const CCoins &coins) {
+    // Outputs never change once created, so only outputs that were created or
+    // spent (or whose transaction metadata changed in a reorg) since the last
+    // flush need to touch the database; unchanged ones are left alone.
+    std::string strPrefix = OutputKeyPrefix(txid);
+    std::map<unsigned int, std::string> mapStored;
+    boost::scoped_ptr<leveldb::Iterator> pcursor(db.NewIterator(true));
+    for (pcursor->Seek(strPrefix); pcursor->Valid() && pcursor->key().starts_with(strPrefix); pcursor->Next()) {
+        leveldb::Slice slKey = pcursor->key();
+        CSpanReader ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
+        CCoinsOutputKey key;
+        ssKey >> key;
+        mapStored[key.n] = pcursor->value().ToString();
+    }
+    HandleError(pcursor->status());
+
+    for (unsigned int i = 0; i < coins.vout.size(); i++) {
+        if (coins.vout[i].IsNull())
+            continue;
+        CCoinsOutputRecord record(coins, i);
+        std::map<unsigned int, std::string>::iterator it = mapStored.find(i);
+        if (it != mapStored.end()) {
+            CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+            ssValue << record;
+            bool fSame = it->second.size() == ssValue.size() && std::equal(ssValue.begin(), ssValue.end(), it->second.begin());
+            mapStored.erase(it);
+            if (fSame)
+                continue;
+        }
+        batch.Write(CCoinsOutputKey(txid, i), record);
+    }
+    // whatever is left on disk has been spent
+    for (std::map<unsigned int, std::string>::const_iterator it = mapStored.begin(); it != mapStored.end(); it++)
+        batch.Erase(CCoinsOutputKey(txid, it->first));
+    if (fUpgrading)
+        batch.Erase(make_pair('c', txid));
 }
 
 bool CCoinsViewDB::GetCoins(const uint256 &txid, CCoins &coins) {
+    if (nLayout == COINS_LAYOUT_OUTPOINT) {
+        if (ReadOutputs(txid, coins))
+            return true;
+        if (!fUpgrading)
+            return false;
+    }
     return db.Read(make_pair('c', txid), coins);
 }
 
 bool CCoinsViewDB::SetCoins(const uint256 &txid, const CCoins &coins) {
     CLevelDBBatch batch;
-    BatchWriteCoins(batch, txid, coins);
+    if (nLayout == COINS_LAYOUT_OUTPOINT)
+        BatchWriteOutputs(batch, txid, coins);
+    else
+        BatchWriteCoins(batch, txid, coins);
     return db.WriteBatch(batch);
 }
 
 bool CCoinsViewDB::HaveCoins(const uint256 &txid) {
+    if (nLayout == COINS_LAYOUT_OUTPOINT) {
+        std::string strPrefix = OutputKeyPrefix(txid);
+        boost::scoped_ptr<leveldb::Iterator> pcursor(db.NewIterator(true));
+        pcursor->Seek(strPrefix);
+        if (pcursor->Valid() && pcursor->key().starts_with(strPrefix))
+            return true;
+        HandleError(pcursor->status());
+        if (!fUpgrading)
+            return false;
+    }
     return db.Exists(make_pair('c', txid));
 }
 
+bool CCoinsViewDB::HaveOutput(const COutPoint &outpoint) {
+    if (nLayout == COINS_LAYOUT_OUTPOINT) {
+        if (db.Exists(CCoinsOutputKey(outpoint.hash, outpoint.n)))
+            return true;
+        if (!fUpgrading)
+            return false;
+    }
+    return CCoinsView::HaveOutput(outpoint);
+}
+
 uint256 CCoinsViewDB::GetBestBlock() {
     uint256 hashBestChain;
     if (!db.Read('B', hashBestChain))
@@ -57,15 +166,25 @@ bool CCoinsViewDB::BatchWrite(const std::map<uint256, CCoins> &mapCoins, const u
     LogPrint("coindb", "Committing %u changed transactions to coin database...\n", (unsigned int)mapCoins.size());
 
     CLevelDBBatch batch;
-    for (std::map<uint256, CCoins>::const_iterator it = mapCoins.begin(); it != mapCoins.end(); it++)
-        BatchWriteCoins(batch, it->first, it->second);
-    if (hashBlock != uint256(0))
+    for (std::map<uint256, CCoins>::const_iterator it = mapCoins.begin(); it != mapCoins.end(); it++) {
+        if (nLayout == COINS_LAYOUT_OUTPOINT)
+            BatchWriteOutputs(batch, it->first, it->second);
+        else
+            BatchWriteCoins(batch, it->first, it->second);
+    }
+    if (hashBlock != uint256(0)) {
         BatchWriteHashBestChain(batch, hashBlock);
+        // saved statistics must describe the best block, or not exist
+        if (pstatsRunning && pstatsRunning->hashBlock == hashBlock)
+            batch.Write('S', *pstatsRunning);
+        else
+            batch.Erase('S');
+    }
 
     return db.WriteBatch(batch);
 }
 
-CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe) {
+CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDBWrapper(GetDataDir() / "blocks" / "index", "blockindex", CLevelDBOptions::FromArgs("blockindex", nCacheSize), fMemory, fWipe) {
 }
 
 bool CBlockTreeDB::WriteBlockIndex(const CDiskBlockIndex& blockindex)
@@ -107,6 +226,26 @@ bool CBlockTreeDB::ReadLastBlockFile(int &nFile) {
     return Read('l', nFile);
 }
 
+// Feed one transaction's unspent outputs into the UTXO set statistics
+static void ApplyStats(CCoinsStats &stats, CHashWriter &ss, const uint256 &txid, const CCoins &coins) {
+    ss << txid;
+    ss << VARINT(coins.nVersion);
+    ss << (coins.fCoinBase ? 'c' : 'n');
+    ss << VARINT(coins.nHeight);
+    stats.nTransactions++;
+    for (unsigned int i=0; i<coins.vout.size(); i++) {
+        const CTxOut &out = coins.vout[i];
+        if (!out.IsNull()) {
+            stats.nTransactionOutputs++;
+            ss << VARINT(i+1);
+            ss << out;
+            stats.nTotalAmount += out.nValue;
+        }
+    }
+    stats.nSerializedSize += 32 + coins.GetSerializeSize(SER_DISK, CLIENT_VERSION);
+    ss << VARINT(0);
+}
+
 bool CCoinsViewDB::GetStats(CCoinsStats &stats) {
     leveldb::Iterator *pcursor = db.NewIterator();
     pcursor->SeekToFirst();
@@ -114,47 +253,195 @@ bool CCoinsViewDB::GetStats(CCoinsStats &stats) {
     CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
     stats.hashBlock = GetBestBlock();
     ss << stats.hashBlock;
-    int64_t nTotalAmount = 0;
+    // per-output records of one transaction are adjacent; collect them first
+    uint256 txidOutputs = 0;
+    CCoins coinsOutputs;
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
         try {
             leveldb::Slice slKey = pcursor->key();
-            CDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
+            CSpanReader ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
             char chType;
             ssKey >> chType;
+            leveldb::Slice slValue = pcursor->value();
+            CSpanReader ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
             if (chType == 'c') {
-                leveldb::Slice slValue = pcursor->value();
-                CDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
                 CCoins coins;
                 ssValue >> coins;
                 uint256 txhash;
                 ssKey >> txhash;
-                ss << txhash;
-                ss << VARINT(coins.nVersion);
-                ss << (coins.fCoinBase ? 'c' : 'n');
-                ss << VARINT(coins.nHeight);
-                stats.nTransactions++;
-                for (unsigned int i=0; i<coins.vout.size(); i++) {
-                    const CTxOut &out = coins.vout[i];
-                    if (!out.IsNull()) {
-                        stats.nTransactionOutputs++;
-                        ss << VARINT(i+1);
-                        ss << out;
-                        nTotalAmount += out.nValue;
-                    }
+                ApplyStats(stats, ss, txhash, coins);
+            } else if (chType == 'o') {
+                uint256 txhash;
+                unsigned int n;
+                ssKey >> txhash >> VARINT(n);
+                if (txhash != txidOutputs && !coinsOutputs.vout.empty())
+                    ApplyStats(stats, ss, txidOutputs, coinsOutputs);
+                if (txhash != txidOutputs) {
+                    txidOutputs = txhash;
+                    coinsOutputs = CCoins();
                 }
-                stats.nSerializedSize += 32 + slValue.size();
-                ss << VARINT(0);
+                CCoinsOutputRecord record;
+                ssValue >> record;
+                record.ApplyTo(coinsOutputs, n);
             }
             pcursor->Next();
         } catch (std::exception &e) {
             return error("%s : Deserialize or I/O error - %s", __func__, e.what());
         }
     }
+    if (!coinsOutputs.vout.empty())
+        ApplyStats(stats, ss, txidOutputs, coinsOutputs);
     delete pcursor;
     stats.nHeight = mapBlockIndex.find(GetBestBlock())->second->nHeight;
     stats.hashSerialized = ss.GetHash();
-    stats.nTotalAmount = nTotalAmount;
+    return true;
+}
+
+bool CCoinsViewDB::ReadRunningStats(CCoinsRunningStats &stats) {
+    return db.Read('S', stats);
+}
+
+// Feed the records with keys in [strBegin, strEnd) into the running statistics
+static bool ScanRunningStatsRange(CLevelDBWrapper &db, const std::string &strBegin, const std::string &strEnd, CCoinsRunningStats &stats) {
+    boost::scoped_ptr<leveldb::Iterator> pcursor(db.NewIterator());
+    // per-output records of one transaction are adjacent; collect them first
+    uint256 txidOutputs = 0;
+    CCoins coinsOutputs;
+    try {
+        for (pcursor->Seek(strBegin); pcursor->Valid(); pcursor->Next()) {
+            leveldb::Slice slKey = pcursor->key();
+            if (slKey.compare(strEnd) >= 0)
+                break;
+            CSpanReader ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            uint256 txid;
+            ssKey >> chType >> txid;
+            leveldb::Slice slValue = pcursor->value();
+            CSpanReader ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
+            if (chType == 'c') {
+                CCoins coins;
+                ssValue >> coins;
+                stats.ApplyCoins(txid, coins, 1);
+            } else if (chType == 'o') {
+                unsigned int n;
+                ssKey >> VARINT(n);
+                if (txid != txidOutputs) {
+                    if (!coinsOutputs.vout.empty())
+                        stats.ApplyCoins(txidOutputs, coinsOutputs, 1);
+                    txidOutputs = txid;
+                    coinsOutputs = CCoins();
+                }
+                CCoinsOutputRecord record;
+                ssValue >> record;
+                record.ApplyTo(coinsOutputs, n);
+            }
+        }
+        HandleError(pcursor->status());
+    } catch (std::exception &e) {
+        return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+    }
+    if (!coinsOutputs.vout.empty())
+        stats.ApplyCoins(txidOutputs, coinsOutputs, 1);
+    return true;
+}
+
+// Scan part nPart of nParts: the slice of the txid space (by first byte) it owns, in both layouts
+static void ScanRunningStatsPart(CLevelDBWrapper *pdb, int nPart, int nParts, CCoinsRunningStats *pstats, unsigned char *pfOk) {
+    static const char pchTypes[] = {'c', 'o'};
+    for (unsigned int i = 0; i < sizeof(pchTypes); i++) {
+        std::string strBegin(1, pchTypes[i]), strEnd(1, pchTypes[i]);
+        strBegin += (char)(256 * nPart / nParts);
+        if (nPart + 1 < nParts)
+            strEnd += (char)(256 * (nPart + 1) / nParts);
+        else
+            strEnd = std::string(1, pchTypes[i] + 1);
+        if (!ScanRunningStatsRange(*pdb, strBegin, strEnd, *pstats)) {
+            *pfOk = false;
+            return;
+        }
+    }
+    *pfOk = true;
+}
+
+bool CCoinsViewDB::GetRunningStats(CCoinsRunningStats &stats, int nThreads) {
+    nThreads = std::max(1, std::min(nThreads, 256));
+    int64_t nStart = GetTimeMillis();
+    std::vector<CCoinsRunningStats> vStats(nThreads);
+    std::vector<unsigned char> vfOk(nThreads, false);
+    boost::thread_group threadGroup;
+    for (int i = 1; i < nThreads; i++)
+        threadGroup.create_thread(boost::bind(&ScanRunningStatsPart, &db, i, nThreads, &vStats[i], &vfOk[i]));
+    ScanRunningStatsPart(&db, 0, nThreads, &vStats[0], &vfOk[0]);
+    threadGroup.join_all();
+
+    stats = CCoinsRunningStats();
+    stats.hashBlock = GetBestBlock();
+    for (int i = 0; i < nThreads; i++) {
+        if (!vfOk[i])
+            return false;
+        stats.Add(vStats[i]);
+    }
+    LogPrint("coindb", "Scanned coin database for statistics with %d threads in %dms\n", nThreads, GetTimeMillis() - nStart);
+    return true;
+}
+
+bool CCoinsViewDB::UpgradeToOutpointLayout() {
+    if (nLayout != COINS_LAYOUT_OUTPOINT) {
+        // Switch readers over first; until 'U' is erased they fall back to 'c' records
+        CLevelDBBatch batch;
+        batch.Write('L', (int)COINS_LAYOUT_OUTPOINT);
+        batch.Write('U', '1');
+        db.WriteBatch(batch, true);
+        nLayout = COINS_LAYOUT_OUTPOINT;
+        fUpgrading = true;
+    }
+    if (!fUpgrading)
+        return true;
+
+    LogPrintf("Upgrading coin database to one record per output...\n");
+    int64_t nStart = GetTimeMillis();
+    uint64_t nTransactions = 0, nOutputs = 0;
+    boost::scoped_ptr<leveldb::Iterator> pcursor(db.NewIterator());
+    CLevelDBBatch batch;
+    unsigned int nBatchSize = 0;
+    for (pcursor->Seek(std::string(1, 'c')); pcursor->Valid(); pcursor->Next()) {
+        boost::this_thread::interruption_point();
+        leveldb::Slice slKey = pcursor->key();
+        if (slKey.size() == 0 || slKey[0] != 'c')
+            break;
+        try {
+            CSpanReader ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            uint256 txid;
+            ssKey >> chType >> txid;
+            leveldb::Slice slValue = pcursor->value();
+            CSpanReader ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
+            CCoins coins;
+            ssValue >> coins;
+            for (unsigned int i = 0; i < coins.vout.size(); i++) {
+                if (coins.vout[i].IsNull())
+                    continue;
+                batch.Write(CCoinsOutputKey(txid, i), CCoinsOutputRecord(coins, i));
+                nOutputs++;
+            }
+            batch.Erase(make_pair('c', txid));
+        } catch (std::exception &e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+        nTransactions++;
+        if (++nBatchSize >= 10000) {
+            db.WriteBatch(batch);
+            batch.Clear();
+            nBatchSize = 0;
+            LogPrint("coindb", "Upgraded %u transactions (%u outputs)\n", nTransactions, nOutputs);
+        }
+    }
+    HandleError(pcursor->status());
+    batch.Erase('U');
+    db.WriteBatch(batch, true);
+    fUpgrading = false;
+    LogPrintf("Upgraded %u transactions (%u outputs) in %dms\n", nTransactions, nOutputs, GetTimeMillis() - nStart);
     return true;
 }
 
@@ -169,6 +456,140 @@ bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos>
     return WriteBatch(batch);
 }
 
+bool CBlockTreeDB::WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, int64_t> > &vect) {
+    CLevelDBBatch batch;
+    for (std::vector<std::pair<CAddressIndexKey, int64_t> >::const_iterator it = vect.begin(); it != vect.end(); it++)
+        batch.Write(it->first, it->second);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, int64_t> > &vect) {
+    CLevelDBBatch batch;
+    for (std::vector<std::pair<CAddressIndexKey, int64_t> >::const_iterator it = vect.begin(); it != vect.end(); it++)
+        batch.Erase(it->first);
+    return WriteBatch(batch);
+}
+
+// Key prefix shared by all records of type chType of an address
+static std::string AddressKeyPrefix(char chType, int nType, const uint160 &hashAddress) {
+    CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+    ssKey << chType << (unsigned char)nType << hashAddress;
+    return std::string(ssKey.begin(), ssKey.end());
+}
+
+bool CBlockTreeDB::ReadAddressIndex(int nType, const uint160 &hashAddress, std::vector<std::pair<CAddressIndexKey, int64_t> > &vect,
+                                    int nStartHeight, int nEndHeight, size_t nMax) {
+    std::string strPrefix = AddressKeyPrefix('a', nType, hashAddress);
+    CDataStream ssStart(SER_DISK, CLIENT_VERSION);
+    ssStart << CBigEndianInt(nStartHeight);
+
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+    try {
+        for (pcursor->Seek(strPrefix + std::string(ssStart.begin(), ssStart.end())); pcursor->Valid() && pcursor->key().starts_with(strPrefix); pcursor->Next()) {
+            if (nMax > 0 && vect.size() >= nMax)
+                break;
+            leveldb::Slice slKey = pcursor->key();
+            CSpanReader ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
+            CAddressIndexKey key;
+            ssKey >> key;
+            if (nEndHeight > 0 && key.nHeight > nEndHeight)
+                break;
+            leveldb::Slice slValue = pcursor->value();
+            CSpanReader ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
+            int64_t nValue;
+            ssValue >> nValue;
+            vect.push_back(make_pair(key, nValue));
+        }
+    } catch (std::exception &e) {
+        return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+    }
+    HandleError(pcursor->status());
+    return true;
+}
+
+bool CBlockTreeDB::SumAddressIndex(int nType, const uint160 &hashAddress, int64_t &nBalance, int64_t &nReceived, int &nTxOuts) {
+    std::string strPrefix = AddressKeyPrefix('a', nType, hashAddress);
+    nBalance = nReceived = 0;
+    nTxOuts = 0;
+
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+    try {
+        for (pcursor->Seek(strPrefix); pcursor->Valid() && pcursor->key().starts_with(strPrefix); pcursor->Next()) {
+            boost::this_thread::interruption_point();
+            leveldb::Slice slKey = pcursor->key();
+            CSpanReader ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
+            CAddressIndexKey key;
+            ssKey >> key;
+            leveldb::Slice slValue = pcursor->value();
+            CSpanReader ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
+            int64_t nValue;
+            ssValue >> nValue;
+            nBalance += nValue;
+            if (!key.fSpending) {
+                nReceived += nValue;
+                nTxOuts++;
+            } else {
+                nTxOuts--;
+            }
+        }
+    } catch (std::exception &e) {
+        return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+    }
+    HandleError(pcursor->status());
+    return true;
+}
+
+bool CBlockTreeDB::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect) {
+    CLevelDBBatch batch;
+    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it = vect.begin(); it != vect.end(); it++) {
+        if (it->second.IsNull())
+            batch.Erase(it->first);
+        else
+            batch.Write(it->first, it->second);
+    }
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadAddressUnspentIndex(int nType, const uint160 &hashAddress, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect, size_t nMax) {
+    std::string strPrefix = AddressKeyPrefix('u', nType, hashAddress);
+
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+    try {
+        for (pcursor->Seek(strPrefix); pcursor->Valid() && pcursor->key().starts_with(strPrefix); pcursor->Next()) {
+            if (nMax > 0 && vect.size() >= nMax)
+                break;
+            leveldb::Slice slKey = pcursor->key();
+            CSpanReader ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
+            CAddressUnspentKey key;
+            ssKey >> key;
+            leveldb::Slice slValue = pcursor->value();
+            CSpanReader ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
+            CAddressUnspentValue value;
+            ssValue >> value;
+            vect.push_back(make_pair(key, value));
+        }
+    } catch (std::exception &e) {
+        return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+    }
+    HandleError(pcursor->status());
+    return true;
+}
+
+bool CBlockTreeDB::UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > &vect) {
+    CLevelDBBatch batch;
+    for (std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >::const_iterator it = vect.begin(); it != vect.end(); it++) {
+        if (it->second.IsNull())
+            batch.Erase(it->first);
+        else
+            batch.Write(it->first, it->second);
+    }
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadSpentIndex(const CSpentIndexKey &key, CSpentIndexValue &value) {
+    return Read(key, value);
+}
+
 bool CBlockTreeDB::WriteFlag(const std::string &name, bool fValue) {
     return Write(std::make_pair('F', name), fValue ? '1' : '0');
 }
@@ -194,12 +615,12 @@ bool CBlockTreeDB::LoadBlockIndexGuts()
         boost::this_thread::interruption_point();
         try {
             leveldb::Slice slKey = pcursor->key();
-            CDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
+            CSpanReader ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
             char chType;
             ssKey >> chType;
             if (chType == 'b') {
                 leveldb::Slice slValue = pcursor->value();
-                CDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
+                CSpanReader ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
                 CDiskBlockIndex diskindex;
                 ssValue >> diskindex;
 
@@ -246,3 +667,38 @@ bool CBlockTreeDB::LoadBlockIndexGuts()
 
     return true;
 }
+
+CBlockFilterDB::CBlockFilterDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDBWrapper(GetDataDir() / "blocks" / "filter", "blockfilter", CLevelDBOptions::FromArgs("blockfilter", nCacheSize), fMemory, fWipe) {
+}
+
+bool CBlockFilterDB::WriteFilters(const std::vector<std::pair<CBlockFilter, uint256> > &vFilters, const uint256 &hashBest) {
+    CLevelDBBatch batch;
+    for (std::vector<std::pair<CBlockFilter, uint256> >::const_iterator it = vFilters.begin(); it != vFilters.end(); it++)
+        batch.Write(make_pair('f', it->first.GetBlockHash()), make_pair(it->first.GetEncoded(), it->second));
+    batch.Write('B', hashBest);
+    return WriteBatch(batch);
+}
+
+bool CBlockFilterDB::ReadFilter(const uint256 &hashBlock, CBlockFilter &filter) {
+    std::pair<std::vector<unsigned char>, uint256> record;
+    if (!Read(make_pair('f', hashBlock), record))
+        return false;
+    try {
+        filter = CBlockFilter(hashBlock, record.first);
+    } catch (std::exception &e) {
+        return error("%s : invalid filter for block %s", __func__, hashBlock.ToString());
+    }
+    return true;
+}
+
+bool CBlockFilterDB::ReadFilterHeader(const uint256 &hashBlock, uint256 &hashHeader) {
+    std::pair<std::vector<unsigned char>, uint256> record;
+    if (!Read(make_pair('f', hashBlock), record))
+        return false;
+    hashHeader = record.second;
+    return true;
+}
+
+bool CBlockFilterDB::ReadBestBlock(uint256 &hashBest) {
+    return Read('B', hashBest);
+}
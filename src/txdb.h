@@ -6,6 +6,7 @@
 #ifndef BITCOIN_TXDB_LEVELDB_H
 #define BITCOIN_TXDB_LEVELDB_H
 
+#include "blockfilter.h"
 #include "leveldbwrapper.h"
 #include "main.h"
 
@@ -25,21 +26,280 @@ static const int64_t nMaxDbCache = sizeof(void*) > 4 ? 4096 : 1024;
 // min. -dbcache in (MiB)
 static const int64_t nMinDbCache = 4;
 
+/** Layouts of the coin database */
+enum CoinsLayout
+{
+    COINS_LAYOUT_TX = 0,       // one 'c' record per transaction (CCoins)
+    COINS_LAYOUT_OUTPOINT = 1, // one 'o' record per unspent output (CCoinsOutputRecord)
+};
+
+/** Key of one unspent output in the COINS_LAYOUT_OUTPOINT layout.
+ *  All outputs of a transaction share the 'o'+txid prefix, so they are adjacent. */
+class CCoinsOutputKey
+{
+public:
+    uint256 txid;
+    unsigned int n;
+
+    CCoinsOutputKey() : txid(0), n(0) { }
+    CCoinsOutputKey(const uint256 &txidIn, unsigned int nIn) : txid(txidIn), n(nIn) { }
+
+    IMPLEMENT_SERIALIZE(
+        char chType = 'o';
+        READWRITE(chType);
+        READWRITE(txid);
+        READWRITE(VARINT(n));
+    )
+};
+
+/** Value of one unspent output in the COINS_LAYOUT_OUTPOINT layout: the
+ *  compressed output plus the metadata of the transaction it belongs to.
+ *
+ * Serialized format:
+ * - VARINT(nVersion)
+ * - VARINT(nHeight*4 + fCoinStake*2 + fCoinBase)
+ * - VARINT(nTime)
+ * - the CTxOut (via CTxOutCompressor)
+ */
+class CCoinsOutputRecord
+{
+public:
+    CTxOut txout;
+    bool fCoinBase;
+    bool fCoinStake;
+    int nHeight;
+    int nVersion;
+    int64_t nTime;
+
+    CCoinsOutputRecord() : txout(), fCoinBase(false), fCoinStake(false), nHeight(0), nVersion(0), nTime(0) { }
+    CCoinsOutputRecord(const CCoins &coins, unsigned int n) : txout(coins.vout[n]), fCoinBase(coins.fCoinBase), fCoinStake(coins.fCoinStake),
+        nHeight(coins.nHeight), nVersion(coins.nVersion), nTime(coins.nTime) { }
+
+    // store this output (and its transaction's metadata) into coins
+    void ApplyTo(CCoins &coins, unsigned int n) const {
+        coins.fCoinBase = fCoinBase;
+        coins.fCoinStake = fCoinStake;
+        coins.nHeight = nHeight;
+        coins.nVersion = nVersion;
+        coins.nTime = nTime;
+        if (coins.vout.size() <= n)
+            coins.vout.resize(n + 1);
+        coins.vout[n] = txout;
+    }
+
+    IMPLEMENT_SERIALIZE(({
+        READWRITE(VARINT(this->nVersion));
+        if (!fRead) {
+            unsigned int nCode = nHeight * 4 + (fCoinStake ? 2 : 0) + (fCoinBase ? 1 : 0);
+            READWRITE(VARINT(nCode));
+        } else {
+            unsigned int nCode = 0;
+            READWRITE(VARINT(nCode));
+            CCoinsOutputRecord* pthis = const_cast<CCoinsOutputRecord*>(this);
+            pthis->nHeight = nCode / 4;
+            pthis->fCoinStake = nCode & 2;
+            pthis->fCoinBase = nCode & 1;
+        }
+        READWRITE(VARINT(nTime));
+        READWRITE(REF(CTxOutCompressor(REF(txout))));
+    });)
+};
+
+/** Kinds of destination tracked by the address index */
+enum AddressIndexType
+{
+    ADDRESS_INDEX_KEY = 1,    // pay-to-pubkey and pay-to-pubkey-hash, by key ID
+    ADDRESS_INDEX_SCRIPT = 2, // pay-to-script-hash, by script ID
+};
+
+/** Serializes an int as 4 big endian bytes, so that keys sort by its value */
+class CBigEndianInt
+{
+private:
+    int &n;
+
+public:
+    CBigEndianInt(int &nIn) : n(nIn) { }
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const {
+        return 4;
+    }
+
+    template<typename Stream>
+    void Serialize(Stream &s, int nType, int nVersion) const {
+        unsigned char pch[4] = { (unsigned char)(n >> 24), (unsigned char)(n >> 16), (unsigned char)(n >> 8), (unsigned char)n };
+        s.write((char*)pch, 4);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream &s, int nType, int nVersion) {
+        unsigned char pch[4];
+        s.read((char*)pch, 4);
+        n = (pch[0] << 24) | (pch[1] << 16) | (pch[2] << 8) | pch[3];
+    }
+};
+
+/** Key of one address index record: an output paid to an address, or an input
+ *  spending one. The value is the amount, negative for inputs. Records of an
+ *  address are adjacent and ordered by height. */
+class CAddressIndexKey
+{
+public:
+    unsigned char nType;
+    uint160 hashAddress;
+    int nHeight;
+    uint256 txid;
+    unsigned int nIndex; // output index, or input index if fSpending
+    bool fSpending;
+
+    CAddressIndexKey() : nType(0), hashAddress(0), nHeight(0), txid(0), nIndex(0), fSpending(false) { }
+    CAddressIndexKey(int nTypeIn, const uint160 &hashAddressIn, int nHeightIn, const uint256 &txidIn, unsigned int nIndexIn, bool fSpendingIn) :
+        nType(nTypeIn), hashAddress(hashAddressIn), nHeight(nHeightIn), txid(txidIn), nIndex(nIndexIn), fSpending(fSpendingIn) { }
+
+    IMPLEMENT_SERIALIZE(
+        char chType = 'a';
+        READWRITE(chType);
+        READWRITE(nType);
+        READWRITE(hashAddress);
+        READWRITE(REF(CBigEndianInt(REF(nHeight))));
+        READWRITE(txid);
+        READWRITE(nIndex);
+        READWRITE(fSpending);
+    )
+};
+
+/** Key of one unspent output in the address index */
+class CAddressUnspentKey
+{
+public:
+    unsigned char nType;
+    uint160 hashAddress;
+    uint256 txid;
+    unsigned int n;
+
+    CAddressUnspentKey() : nType(0), hashAddress(0), txid(0), n(0) { }
+    CAddressUnspentKey(int nTypeIn, const uint160 &hashAddressIn, const uint256 &txidIn, unsigned int nIn) :
+        nType(nTypeIn), hashAddress(hashAddressIn), txid(txidIn), n(nIn) { }
+
+    IMPLEMENT_SERIALIZE(
+        char chType = 'u';
+        READWRITE(chType);
+        READWRITE(nType);
+        READWRITE(hashAddress);
+        READWRITE(txid);
+        READWRITE(n);
+    )
+};
+
+/** Value of one unspent output in the address index; null means erase */
+class CAddressUnspentValue
+{
+public:
+    int64_t nValue;
+    CScript scriptPubKey;
+    int nHeight;
+
+    CAddressUnspentValue() : nValue(-1), nHeight(0) { }
+    CAddressUnspentValue(int64_t nValueIn, const CScript &scriptPubKeyIn, int nHeightIn) :
+        nValue(nValueIn), scriptPubKey(scriptPubKeyIn), nHeight(nHeightIn) { }
+
+    bool IsNull() const { return nValue == -1; }
+
+    IMPLEMENT_SERIALIZE(
+        READWRITE(nValue);
+        READWRITE(scriptPubKey);
+        READWRITE(nHeight);
+    )
+};
+
+/** Key of one spent output in the spent index */
+class CSpentIndexKey
+{
+public:
+    uint256 txid;
+    unsigned int n;
+
+    CSpentIndexKey() : txid(0), n(0) { }
+    CSpentIndexKey(const uint256 &txidIn, unsigned int nIn) : txid(txidIn), n(nIn) { }
+
+    IMPLEMENT_SERIALIZE(
+        char chType = 'p';
+        READWRITE(chType);
+        READWRITE(txid);
+        READWRITE(n);
+    )
+};
+
+/** The input spending an output, and what the output was; null means erase */
+class CSpentIndexValue
+{
+public:
+    uint256 txid;
+    unsigned int nInput;
+    int nHeight;
+    int64_t nValue;
+    unsigned char nType; // AddressIndexType, 0 if the output pays no address
+    uint160 hashAddress;
+
+    CSpentIndexValue() : txid(0), nInput(0), nHeight(0), nValue(0), nType(0), hashAddress(0) { }
+    CSpentIndexValue(const uint256 &txidIn, unsigned int nInputIn, int nHeightIn, int64_t nValueIn, int nTypeIn, const uint160 &hashAddressIn) :
+        txid(txidIn), nInput(nInputIn), nHeight(nHeightIn), nValue(nValueIn), nType(nTypeIn), hashAddress(hashAddressIn) { }
+
+    bool IsNull() const { return txid == 0; }
+
+    IMPLEMENT_SERIALIZE(
+        READWRITE(txid);
+        READWRITE(nInput);
+        READWRITE(nHeight);
+        READWRITE(nValue);
+        READWRITE(nType);
+        READWRITE(hashAddress);
+    )
+};
+
 /** CCoinsView backed by the LevelDB coin database (chainstate/) */
 class CCoinsViewDB : public CCoinsView
 {
 protected:
     CLevelDBWrapper db;
+
+    // layout of the records in db (CoinsLayout)
+    int nLayout;
+
+    // whether 'c' records may still exist while converting to COINS_LAYOUT_OUTPOINT
+    bool fUpgrading;
+
+    // running statistics saved with every batch whose best block they match (not owned)
+    const CCoinsRunningStats *pstatsRunning;
+
+    bool ReadOutputs(const uint256 &txid, CCoins &coins);
+    void BatchWriteOutputs(CLevelDBBatch &batch, const uint256 &txid, const CCoins &coins);
 public:
     CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
 
     bool GetCoins(const uint256 &txid, CCoins &coins);
     bool SetCoins(const uint256 &txid, const CCoins &coins);
     bool HaveCoins(const uint256 &txid);
+    bool HaveOutput(const COutPoint &outpoint);
     uint256 GetBestBlock();
     bool SetBestBlock(const uint256 &hashBlock);
     bool BatchWrite(const std::map<uint256, CCoins> &mapCoins, const uint256 &hashBlock);
     bool GetStats(CCoinsStats &stats);
+
+    // Compute the running statistics by scanning the database, split over nThreads threads
+    bool GetRunningStats(CCoinsRunningStats &stats, int nThreads);
+    // Read the running statistics saved by the last BatchWrite that had them
+    bool ReadRunningStats(CCoinsRunningStats &stats);
+    void SetRunningStats(const CCoinsRunningStats *pstats) { pstatsRunning = pstats; }
+
+    CLevelDBWrapper &GetDB() { return db; }
+
+    bool IsOutpointLayout() const { return nLayout == COINS_LAYOUT_OUTPOINT; }
+    bool IsUpgrading() const { return fUpgrading; }
+
+    // Convert (or finish converting) all records to COINS_LAYOUT_OUTPOINT.
+    // Safe to interrupt; the conversion resumes on the next call.
+    bool UpgradeToOutpointLayout();
 };
 
 /** Access to the block database (blocks/index/) */
@@ -61,9 +321,38 @@ public:
     bool ReadReindexing(bool &fReindex);
     bool ReadTxIndex(const uint256 &txid, CDiskTxPos &pos);
     bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &list);
+    bool WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, int64_t> > &vect);
+    bool EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, int64_t> > &vect);
+    // Records of an address with nStartHeight <= height <= nEndHeight (0: no bound), at most nMax (0: all)
+    bool ReadAddressIndex(int nType, const uint160 &hashAddress, std::vector<std::pair<CAddressIndexKey, int64_t> > &vect,
+                          int nStartHeight = 0, int nEndHeight = 0, size_t nMax = 0);
+    // Sums all records of an address without keeping them in memory
+    bool SumAddressIndex(int nType, const uint160 &hashAddress, int64_t &nBalance, int64_t &nReceived, int &nTxOuts);
+    // Applies the changes in order; null values erase
+    bool UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect);
+    bool ReadAddressUnspentIndex(int nType, const uint160 &hashAddress, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect, size_t nMax = 0);
+    // Applies the changes in order; null values erase
+    bool UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > &vect);
+    bool ReadSpentIndex(const CSpentIndexKey &key, CSpentIndexValue &value);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
     bool LoadBlockIndexGuts();
 };
 
+/** Access to the compact block filter index (blocks/filter/) */
+class CBlockFilterDB : public CLevelDBWrapper
+{
+public:
+    CBlockFilterDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+private:
+    CBlockFilterDB(const CBlockFilterDB&);
+    void operator=(const CBlockFilterDB&);
+public:
+    // Filter and filter header of each block, and the last block indexed, in one batch
+    bool WriteFilters(const std::vector<std::pair<CBlockFilter, uint256> > &vFilters, const uint256 &hashBest);
+    bool ReadFilter(const uint256 &hashBlock, CBlockFilter &filter);
+    bool ReadFilterHeader(const uint256 &hashBlock, uint256 &hashHeader);
+    bool ReadBestBlock(uint256 &hashBest);
+};
+
 #endif // BITCOIN_TXDB_LEVELDB_H
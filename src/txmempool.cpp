@@ -212,3 +212,9 @@ bool CCoinsViewMemPool::HaveCoins(const uint256 &txid) {
     return mempool.exists(txid) || base->HaveCoins(txid);
 }
 
+bool CCoinsViewMemPool::HaveOutput(const COutPoint &outpoint) {
+    // Same precedence as GetCoins: the base view first, then the pool
+    CCoins coins;
+    return GetCoins(outpoint.hash, coins) && coins.IsAvailable(outpoint.n);
+}
+
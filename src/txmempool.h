@@ -108,6 +108,7 @@ public:
     CCoinsViewMemPool(CCoinsView &baseIn, CTxMemPool &mempoolIn);
     bool GetCoins(const uint256 &txid, CCoins &coins);
     bool HaveCoins(const uint256 &txid);
+    bool HaveOutput(const COutPoint &outpoint);
 };
 
 #endif /* BITCOIN_TXMEMPOOL_H */
@@ -1135,6 +1135,33 @@ int RaiseFileDescriptorLimit(int nMinFD) {
 #endif
 }
 
+// Resident memory of this process in bytes, or 0 if it cannot be determined.
+// Where /proc is not available, this is the peak resident memory.
+int64_t GetResidentMemory() {
+#if defined(WIN32)
+    return 0;
+#elif defined(__linux__)
+    FILE *file = fopen("/proc/self/statm", "r");
+    if (!file)
+        return 0;
+    long nSize = 0, nResident = 0;
+    int nRead = fscanf(file, "%ld %ld", &nSize, &nResident);
+    fclose(file);
+    if (nRead != 2)
+        return 0;
+    return (int64_t)nResident * sysconf(_SC_PAGESIZE);
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#if defined(MAC_OSX)
+    return usage.ru_maxrss;
+#else
+    return (int64_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
 // this function tries to make a particular range of a file allocated (corresponding to disk space)
 // it is advisory, and the range specified in the arguments will never contain live data
 void AllocateFileRange(FILE *file, unsigned int offset, unsigned int length) {
@@ -6,10 +6,16 @@
 #include "wallet.h"
 
 #include "base58.h"
+#include "blockfilter.h"
 #include "checkpoints.h"
 #include "coincontrol.h"
+#include "coinselection.h"
+#include "hash.h"
+#include "init.h"
 #include "net.h"
 
+#include <limits>
+
 #include <boost/algorithm/string/replace.hpp>
 #include <openssl/rand.h>
 
@@ -86,11 +92,96 @@ CPubKey CWallet::GenerateNewKey()
     return pubkey;
 }
 
+CScriptHasher::CScriptHasher()
+{
+    k0 = GetRand(std::numeric_limits<uint64_t>::max());
+    k1 = GetRand(std::numeric_limits<uint64_t>::max());
+}
+
+size_t CScriptHasher::operator()(const CScript& script) const
+{
+    return SipHash(k0, k1, script.empty() ? NULL : &script[0], script.size());
+}
+
+void CWallet::AddMyKeyScripts(const CPubKey& pubkey)
+{
+    LOCK(cs_KeyStore);
+    CScript script;
+    script.SetDestination(pubkey.GetID());
+    setMyScripts.insert(script);
+    setMyScripts.insert(CScript() << pubkey << OP_CHECKSIG);
+    UpdatePendingScripts();
+}
+
+void CWallet::AddMyRedeemScript(const CScript& redeemScript)
+{
+    LOCK(cs_KeyStore);
+    setPendingScripts.insert(redeemScript.GetID());
+    UpdatePendingScripts();
+}
+
+// A redeem script becomes ours once we have all its keys, or all keys of the script it pays to
+void CWallet::UpdatePendingScripts()
+{
+    AssertLockHeld(cs_KeyStore);
+    bool fChanged = true;
+    while (fChanged && !setPendingScripts.empty())
+    {
+        fChanged = false;
+        for (std::set<CScriptID>::iterator it = setPendingScripts.begin(); it != setPendingScripts.end(); )
+        {
+            CScript redeemScript;
+            if (GetCScript(*it, redeemScript) && ::IsMine(*this, redeemScript))
+            {
+                CScript script;
+                script.SetDestination(*it);
+                setMyScripts.insert(script);
+                setMyScripts.insert(redeemScript);
+                setPendingScripts.erase(it++);
+                fChanged = true;
+            }
+            else
+                it++;
+        }
+    }
+}
+
+// Whether scriptPubKey has one of the forms setMyScripts holds all of our scripts of
+static bool IsKeyOrScriptHashTemplate(const CScript& scriptPubKey)
+{
+    switch (scriptPubKey.size())
+    {
+    case 23:
+        return scriptPubKey.IsPayToScriptHash();
+    case 25:
+        return scriptPubKey[0] == OP_DUP && scriptPubKey[1] == OP_HASH160 && scriptPubKey[2] == 20 &&
+               scriptPubKey[23] == OP_EQUALVERIFY && scriptPubKey[24] == OP_CHECKSIG;
+    case 35:
+        return scriptPubKey[0] == 33 && scriptPubKey[34] == OP_CHECKSIG;
+    case 67:
+        return scriptPubKey[0] == 65 && scriptPubKey[66] == OP_CHECKSIG;
+    }
+    return false;
+}
+
+bool CWallet::IsMine(const CScript& scriptPubKey) const
+{
+    {
+        LOCK(cs_KeyStore);
+        if (setMyScripts.count(scriptPubKey))
+            return true;
+    }
+    if (IsKeyOrScriptHashTemplate(scriptPubKey))
+        return false;
+    return ::IsMine(*this, scriptPubKey);
+}
+
 bool CWallet::AddKeyPubKey(const CKey& secret, const CPubKey &pubkey)
 {
     AssertLockHeld(cs_wallet); // mapKeyMetadata
     if (!CCryptoKeyStore::AddKeyPubKey(secret, pubkey))
         return false;
+    AddMyKeyScripts(pubkey);
     if (!fFileBacked)
         return true;
     if (!IsCrypted()) {
@@ -106,6 +197,7 @@ bool CWallet::AddCryptedKey(const CPubKey &vchPubKey,
 {
     if (!CCryptoKeyStore::AddCryptedKey(vchPubKey, vchCryptedSecret))
         return false;
+    AddMyKeyScripts(vchPubKey);
     if (!fFileBacked)
         return true;
     {
@@ -132,15 +224,27 @@ bool CWallet::LoadKeyMetadata(const CPubKey &pubkey, const CKeyMetadata &meta)
     return true;
 }
 
+bool CWallet::LoadKey(const CKey& key, const CPubKey &pubkey)
+{
+    if (!CCryptoKeyStore::AddKeyPubKey(key, pubkey))
+        return false;
+    AddMyKeyScripts(pubkey);
+    return true;
+}
+
 bool CWallet::LoadCryptedKey(const CPubKey &vchPubKey, const std::vector<unsigned char> &vchCryptedSecret)
 {
-    return CCryptoKeyStore::AddCryptedKey(vchPubKey, vchCryptedSecret);
+    if (!CCryptoKeyStore::AddCryptedKey(vchPubKey, vchCryptedSecret))
+        return false;
+    AddMyKeyScripts(vchPubKey);
+    return true;
 }
 
 bool CWallet::AddCScript(const CScript& redeemScript)
 {
     if (!CCryptoKeyStore::AddCScript(redeemScript))
         return false;
+    AddMyRedeemScript(redeemScript);
     if (!fFileBacked)
         return true;
     return CWalletDB(strWalletFile).WriteCScript(Hash160(redeemScript), redeemScript);
@@ -159,7 +263,10 @@ bool CWallet::LoadCScript(const CScript& redeemScript)
         return true;
     }
 
-    return CCryptoKeyStore::AddCScript(redeemScript);
+    if (!CCryptoKeyStore::AddCScript(redeemScript))
+        return false;
+    AddMyRedeemScript(redeemScript);
+    return true;
 }
 
 bool CWallet::Unlock(const SecureString& strWalletPassphrase)
@@ -445,6 +552,9 @@ bool CWallet::EncryptWallet(const SecureString& strWalletPassphrase)
         // Need to completely rewrite the wallet file; if we don't, bdb might keep
         // bits of the unencrypted private key in slack space in the database file.
         CDB::Rewrite(strWalletFile);
+        // The Berkeley DB file a log store was imported from has them in full
+        if (bitdb.fLogStore)
+            bitdb.RemoveImported(strWalletFile);
 
     }
     NotifyStatusChanged(this);
@@ -464,29 +574,39 @@ int64_t CWallet::IncOrderPosNext(CWalletDB *pwalletdb)
     return nRet;
 }
 
-CWallet::TxItems CWallet::OrderedTxItems(std::list<CAccountingEntry>& acentries, std::string strAccount)
+void CWallet::LoadOrderedTxItems(CWalletDB& walletdb)
 {
     AssertLockHeld(cs_wallet); // mapWallet
-    CWalletDB walletdb(strWalletFile);
+    wtxOrdered.clear();
+    laccentries.clear();
 
-    // First: get all CWalletTx and CAccountingEntry into a sorted-by-order multimap.
-    TxItems txOrdered;
-
-    // Note: maintaining indices in the database of (account,time) --> txid and (account, time) --> acentry
-    // would make this much faster for applications that do this a lot.
     for (map<uint256, CWalletTx>::iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
     {
         CWalletTx* wtx = &((*it).second);
-        txOrdered.insert(make_pair(wtx->nOrderPos, TxPair(wtx, (CAccountingEntry*)0)));
+        wtxOrdered.insert(make_pair(wtx->nOrderPos, TxPair(wtx, (CAccountingEntry*)0)));
     }
-    acentries.clear();
-    walletdb.ListAccountCreditDebit(strAccount, acentries);
-    BOOST_FOREACH(CAccountingEntry& entry, acentries)
+    walletdb.ListAccountCreditDebit("*", laccentries);
+    BOOST_FOREACH(CAccountingEntry& entry, laccentries)
     {
-        txOrdered.insert(make_pair(entry.nOrderPos, TxPair((CWalletTx*)0, &entry)));
+        wtxOrdered.insert(make_pair(entry.nOrderPos, TxPair((CWalletTx*)0, &entry)));
     }
+}
+
+bool CWallet::AddAccountingEntry(const CAccountingEntry& acentry, CWalletDB& walletdb)
+{
+    if (!walletdb.WriteAccountingEntry(acentry))
+        return false;
 
-    return txOrdered;
+    LoadAccountingEntry(acentry);
+    return true;
+}
+
+void CWallet::LoadAccountingEntry(const CAccountingEntry& acentry)
+{
+    LOCK(cs_wallet);
+    laccentries.push_back(acentry);
+    CAccountingEntry& entry = laccentries.back();
+    wtxOrdered.insert(make_pair(entry.nOrderPos, TxPair((CWalletTx*)0, &entry)));
 }
 
 void CWallet::MarkDirty()
@@ -495,6 +615,10 @@ void CWallet::MarkDirty()
         LOCK(cs_wallet);
         BOOST_FOREACH(PAIRTYPE(const uint256, CWalletTx)& item, mapWallet)
             item.second.MarkDirty();
+        // Which outputs are ours may have changed as well
+        fMyUnspentValid = false;
+        fBalanceCacheValid = false;
+        nWalletUpdated++;
     }
 }
 
@@ -504,9 +628,13 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
 
     if (fFromLoadWallet)
     {
-        mapWallet[hash] = wtxIn;
-        mapWallet[hash].BindWallet(this);
+        CWalletTx& wtx = mapWallet[hash];
+        wtx = wtxIn;
+        wtx.BindWallet(this);
         AddToSpends(hash);
+        fMyUnspentValid = false;
+        fBalanceCacheValid = false;
+        nWalletUpdated++;
     }
     else
     {
@@ -520,6 +648,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
         {
             wtx.nTimeReceived = GetAdjustedTime();
             wtx.nOrderPos = IncOrderPosNext();
+            wtxOrdered.insert(make_pair(wtx.nOrderPos, TxPair(&wtx, (CAccountingEntry*)0)));
 
             wtx.nTimeSmart = wtx.nTimeReceived;
             if (wtxIn.hashBlock != 0)
@@ -531,9 +660,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
                     {
                         // Tolerate times up to the last timestamp in the wallet not more than 5 minutes into the future
                         int64_t latestTolerated = latestNow + 300;
-                        std::list<CAccountingEntry> acentries;
-                        TxItems txOrdered = OrderedTxItems(acentries);
-                        for (TxItems::reverse_iterator it = txOrdered.rbegin(); it != txOrdered.rend(); ++it)
+                        for (TxItems::reverse_iterator it = wtxOrdered.rbegin(); it != wtxOrdered.rend(); ++it)
                         {
                             CWalletTx *const pwtx = (*it).second.first;
                             if (pwtx == &wtx)
@@ -594,6 +721,11 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
         //// debug print
         LogPrintf("AddToWallet %s  %s%s\n", wtxIn.GetHash().ToString(), (fInsertedNew ? "new" : ""), (fUpdated ? "update" : ""));
 
+        // Outputs it creates, or no longer spends after a reorg, may be unspent
+        AddToMyUnspent(wtx);
+        MarkBalanceDirty(wtx);
+        nWalletUpdated++;
+
         // Write to disk
         if (fInsertedNew || fUpdated)
             if (!wtx.WriteToDisk())
@@ -663,18 +795,108 @@ void CWallet::SyncTransaction(const uint256 &hash, const CTransaction& tx, const
     }
 }
 
+void CWallet::SyncBlock(const CBlock &block)
+{
+    LOCK2(cs_main, cs_wallet);
+    // Write all transactions of the block in a single database commit
+    boost::scoped_ptr<CDBBatch> batch(fFileBacked ? new CDBBatch(strWalletFile) : NULL);
+    CWalletInterface::SyncBlock(block);
+}
+
 void CWallet::EraseFromWallet(const uint256 &hash)
 {
     if (!fFileBacked)
         return;
     {
         LOCK(cs_wallet);
-        if (mapWallet.erase(hash))
+        map<uint256, CWalletTx>::iterator mi = mapWallet.find(hash);
+        if (mi != mapWallet.end())
+        {
+            pair<TxItems::iterator, TxItems::iterator> range = wtxOrdered.equal_range(mi->second.nOrderPos);
+            for (TxItems::iterator it = range.first; it != range.second; ++it)
+            {
+                if (it->second.first == &mi->second)
+                {
+                    wtxOrdered.erase(it);
+                    break;
+                }
+            }
+            mapWallet.erase(mi);
             CWalletDB(strWalletFile).EraseTx(hash);
+        }
+        setBalanceDirty.insert(hash);
+        nWalletUpdated++;
     }
     return;
 }
 
+void CWallet::AddToMyUnspent(const CWalletTx& wtx)
+{
+    AssertLockHeld(cs_wallet);
+    if (!fMyUnspentValid)
+        return; // rebuilt from mapWallet on first use
+
+    uint256 hash = wtx.GetHash();
+    for (unsigned int i = 0; i < wtx.vout.size(); i++)
+        if (IsMine(wtx.vout[i]))
+            setMyUnspent.insert(COutPoint(hash, i));
+
+    if (wtx.IsCoinBase())
+        return;
+    BOOST_FOREACH(const CTxIn& txin, wtx.vin)
+    {
+        map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(txin.prevout.hash);
+        if (mi != mapWallet.end() && txin.prevout.n < mi->second.vout.size() &&
+            IsMine(mi->second.vout[txin.prevout.n]))
+            setMyUnspent.insert(txin.prevout);
+    }
+}
+
+// Outpoint is spent by a wallet transaction in the main chain
+bool CWallet::IsSpentInMainChain(const COutPoint& outpoint) const
+{
+    pair<TxSpends::const_iterator, TxSpends::const_iterator> range = mapTxSpends.equal_range(outpoint);
+    for (TxSpends::const_iterator it = range.first; it != range.second; ++it)
+    {
+        map<uint256, CWalletTx>::const_iterator mit = mapWallet.find(it->second);
+        if (mit != mapWallet.end() && mit->second.GetDepthInMainChain() >= 1)
+            return true;
+    }
+    return false;
+}
+
+// Wallet transactions that may have unspent outputs of ours, in mapWallet order
+void CWallet::GetMyUnspentTxes(std::vector<WalletTxIterator>& vTxes) const
+{
+    AssertLockHeld(cs_wallet);
+    if (!fMyUnspentValid)
+    {
+        setMyUnspent.clear();
+        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+            for (unsigned int i = 0; i < it->second.vout.size(); i++)
+                if (IsMine(it->second.vout[i]))
+                    setMyUnspent.insert(COutPoint(it->first, i));
+        fMyUnspentValid = true;
+    }
+
+    vTxes.clear();
+    WalletTxIterator mi = mapWallet.end();
+    std::set<COutPoint>::iterator it = setMyUnspent.begin();
+    while (it != setMyUnspent.end())
+    {
+        if (mi == mapWallet.end() || mi->first != it->hash)
+            mi = mapWallet.find(it->hash);
+        if (mi == mapWallet.end() || IsSpentInMainChain(*it))
+        {
+            setMyUnspent.erase(it++);
+            continue;
+        }
+        if (vTxes.empty() || vTxes.back() != mi)
+            vTxes.push_back(mi);
+        ++it;
+    }
+}
+
 
 bool CWallet::IsMine(const CTxIn &txin) const
 {
@@ -874,12 +1096,139 @@ bool CWalletTx::WriteToDisk()
 // Scan the block chain (starting in pindexStart) for transactions
 // from or to us. If fUpdate is true, found transactions that already
 // exist in the wallet will be updated.
+void CWallet::GetScanFilter(std::set<uint160>& setFilter) const
+{
+    std::set<CKeyID> setKeys;
+    GetKeys(setKeys);
+    BOOST_FOREACH(const CKeyID& keyid, setKeys)
+        setFilter.insert(keyid);
+
+    LOCK(cs_KeyStore);
+    BOOST_FOREACH(const PAIRTYPE(const CScriptID, CScript)& item, mapScripts)
+        setFilter.insert(item.first);
+}
+
+// Bare multisig outputs are only covered if their script was added to the wallet
+void CWallet::GetScanScripts(std::vector<std::vector<unsigned char> >& vScripts) const
+{
+    std::set<CKeyID> setKeys;
+    GetKeys(setKeys);
+    BOOST_FOREACH(const CKeyID& keyid, setKeys)
+    {
+        CScript script;
+        script.SetDestination(keyid);
+        vScripts.push_back(std::vector<unsigned char>(script.begin(), script.end()));
+        CPubKey pubkey;
+        if (GetPubKey(keyid, pubkey))
+        {
+            script = CScript() << pubkey << OP_CHECKSIG;
+            vScripts.push_back(std::vector<unsigned char>(script.begin(), script.end()));
+        }
+    }
+
+    LOCK(cs_KeyStore);
+    BOOST_FOREACH(const PAIRTYPE(const CScriptID, CScript)& item, mapScripts)
+    {
+        CScript script;
+        script.SetDestination(item.first);
+        vScripts.push_back(std::vector<unsigned char>(script.begin(), script.end()));
+        vScripts.push_back(std::vector<unsigned char>(item.second.begin(), item.second.end()));
+    }
+}
+
+// Superset of IsMine(): whether the script pushes one of our keys, key hashes or script hashes
+static bool ScriptMayBeMine(const CScript& script, const std::set<uint160>& setFilter)
+{
+    CScript::const_iterator pc = script.begin();
+    opcodetype opcode;
+    std::vector<unsigned char> vch;
+    while (pc < script.end())
+    {
+        if (!script.GetOp(pc, opcode, vch))
+            return false;
+        if (vch.size() == 20)
+        {
+            if (setFilter.count(uint160(vch)))
+                return true;
+        }
+        else if (vch.size() == 33 || vch.size() == 65)
+        {
+            if (setFilter.count(Hash160(vch)))
+                return true;
+        }
+    }
+    return false;
+}
+
+struct CRescanBlock
+{
+    CBlock block;
+    std::vector<uint256> vHashes;
+    std::vector<char> vfMayBeMine; // some output may be ours
+};
+
+// Read every nParts'th block of a rescan batch, starting at nPart. Blocks whose
+// compact filter matches none of vScripts are skipped.
+static void ReadRescanBlocks(const std::vector<CBlockIndex*>* pvIndex, std::vector<CRescanBlock>* pvBlocks,
+                             const std::set<uint160>* psetFilter, const std::vector<std::vector<unsigned char> >* pvScripts,
+                             int nPart, int nParts)
+{
+    for (unsigned int i = nPart; i < pvIndex->size(); i += nParts)
+    {
+        CRescanBlock& scan = (*pvBlocks)[i];
+        CBlockFilter filter;
+        if (ReadBlockFilter((*pvIndex)[i]->GetBlockHash(), filter))
+        {
+            bool fMatch = true;
+            try {
+                fMatch = filter.MatchAny(*pvScripts);
+            } catch (std::exception &e) {
+                LogPrintf("ReadRescanBlocks() : invalid filter for block %s\n", (*pvIndex)[i]->GetBlockHash().ToString());
+            }
+            if (!fMatch)
+                continue;
+        }
+        if (!ReadBlockFromDisk(scan.block, (*pvIndex)[i]))
+            scan.block.vtx.clear();
+        scan.vHashes.reserve(scan.block.vtx.size());
+        scan.vfMayBeMine.reserve(scan.block.vtx.size());
+        BOOST_FOREACH(const CTransaction& tx, scan.block.vtx)
+        {
+            scan.vHashes.push_back(tx.GetHash());
+            bool fMayBeMine = false;
+            for (unsigned int j = 0; !fMayBeMine && j < tx.vout.size(); j++)
+                fMayBeMine = ScriptMayBeMine(tx.vout[j].scriptPubKey, *psetFilter);
+            scan.vfMayBeMine.push_back(fMayBeMine);
+        }
+    }
+}
+
+// Scan the active chain from pindexStart for transactions of ours. Blocks are
+// read and filtered in batches on several threads without holding any lock;
+// cs_main and cs_wallet are only taken to add the transactions that passed the
+// filter. With -blockfilterindex, blocks whose compact filter shows they pay
+// to and spend none of our scripts are not read at all.
+// Progress is saved in the wallet from time to time, so that a rescan
+// interrupted by a shutdown or crash is resumed on the next start.
 int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
 {
     int ret = 0;
     int64_t nNow = GetTime();
-
-    CBlockIndex* pindex = pindexStart;
+    int nThreads = GetArg("-rescanthreads", DEFAULT_RESCAN_THREADS);
+    if (nThreads <= 0)
+        nThreads += boost::thread::hardware_concurrency();
+    nThreads = std::max(1, std::min(nThreads, MAX_RESCAN_THREADS));
+
+    // A transaction is of interest if it pays to one of our keys or scripts,
+    // or if it is or spends one of our transactions
+    std::set<uint160> setFilter;
+    std::vector<std::vector<unsigned char> > vScripts;
+    std::set<uint256> setTxids;
+    uint64_t nScanWalletUpdated;
+
+    CBlockIndex* pindex = pindexStart; // next block to scan
+    CBlockIndex* pindexLast = NULL;    // last block scanned
+    double dProgressStart, dProgressTip;
     {
         LOCK2(cs_main, cs_wallet);
 
@@ -887,30 +1236,153 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
         // our wallet birthday (as adjusted for block time variability)
         while (pindex && nTimeFirstKey && (pindex->nTime < (nTimeFirstKey - 7200)))
             pindex = chainActive.Next(pindex);
+        if (!pindex)
+            return ret;
+        pindexLast = pindex->pprev;
+
+        dProgressStart = Checkpoints::GuessVerificationProgress(pindex, false);
+        dProgressTip = Checkpoints::GuessVerificationProgress(chainActive.Tip(), false);
+
+        GetScanFilter(setFilter);
+        GetScanScripts(vScripts);
+        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+            setTxids.insert(it->first);
+        nScanWalletUpdated = nWalletUpdated;
+
+        if (fFileBacked)
+            CWalletDB(strWalletFile).WriteRescanBlock(chainActive.GetLocator(pindex));
+    }
+
+    fScanningWallet = true;
+    fAbortRescan = false;
+    nScanProgress = 0;
+    ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
+    LogPrint("wallet", "Rescanning from block %d with %d threads\n", pindex->nHeight, nThreads);
 
-        ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
-        double dProgressStart = Checkpoints::GuessVerificationProgress(pindex, false);
-        double dProgressTip = Checkpoints::GuessVerificationProgress(chainActive.Tip(), false);
-        while (pindex)
+    bool fInterrupted = false;
+    std::vector<CBlockIndex*> vIndex;
+    std::vector<CRescanBlock> vBlocks;
+    while (true)
+    {
+        if (ShutdownRequested() || fAbortRescan)
         {
-            if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
-                ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(pindex, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
+            fInterrupted = true;
+            break;
+        }
 
-            CBlock block;
-            ReadBlockFromDisk(block, pindex);
-            BOOST_FOREACH(CTransaction& tx, block.vtx)
+        vIndex.clear();
+        {
+            LOCK(cs_main);
+            if (pindexLast)
             {
-                if (AddToWalletIfInvolvingMe(tx.GetHash(), tx, &block, fUpdate))
+                // continue from the fork point if the chain was reorganized meanwhile
+                while (!chainActive.Contains(pindexLast))
+                    pindexLast = pindexLast->pprev;
+                pindex = chainActive.Next(pindexLast);
+            }
+            for (; pindex && vIndex.size() < WALLET_RESCAN_BATCH_SIZE; pindex = chainActive.Next(pindex))
+                vIndex.push_back(pindex);
+        }
+        if (vIndex.empty())
+            break;
+
+        vBlocks.clear();
+        vBlocks.resize(vIndex.size());
+        int nParts = std::min(nThreads, (int)vIndex.size());
+        boost::thread_group threadGroup;
+        for (int i = 1; i < nParts; i++)
+            threadGroup.create_thread(boost::bind(&ReadRescanBlocks, &vIndex, &vBlocks, &setFilter, &vScripts, i, nParts));
+        ReadRescanBlocks(&vIndex, &vBlocks, &setFilter, &vScripts, 0, nParts);
+        threadGroup.join_all();
+
+        {
+            LOCK(cs_wallet);
+            if (nWalletUpdated != nScanWalletUpdated)
+            {
+                // transactions were added to the wallet by someone else
+                for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+                    setTxids.insert(it->first);
+                nScanWalletUpdated = nWalletUpdated;
+            }
+        }
+
+        // Match inputs in chain order, so that spends of outputs found earlier in
+        // the scan are seen
+        std::vector<std::pair<unsigned int, unsigned int> > vMatches; // block, transaction
+        for (unsigned int i = 0; i < vBlocks.size(); i++)
+        {
+            const CRescanBlock& scan = vBlocks[i];
+            for (unsigned int j = 0; j < scan.block.vtx.size(); j++)
+            {
+                const CTransaction& tx = scan.block.vtx[j];
+                bool fMatch = scan.vfMayBeMine[j] || setTxids.count(scan.vHashes[j]);
+                for (unsigned int k = 0; !fMatch && k < tx.vin.size(); k++)
+                    fMatch = setTxids.count(tx.vin[k].prevout.hash);
+                if (fMatch)
+                {
+                    vMatches.push_back(make_pair(i, j));
+                    setTxids.insert(scan.vHashes[j]);
+                }
+            }
+        }
+
+        if (!vMatches.empty())
+        {
+            LOCK2(cs_main, cs_wallet);
+            boost::scoped_ptr<CDBBatch> batch(fFileBacked ? new CDBBatch(strWalletFile) : NULL);
+            bool fOthers = nWalletUpdated != nScanWalletUpdated;
+            for (unsigned int m = 0; m < vMatches.size(); m++)
+            {
+                const CRescanBlock& scan = vBlocks[vMatches[m].first];
+                if (!chainActive.Contains(vIndex[vMatches[m].first]))
+                    continue; // disconnected meanwhile, which the wallet has been told about
+                unsigned int j = vMatches[m].second;
+                if (AddToWalletIfInvolvingMe(scan.vHashes[j], scan.block.vtx[j], &scan.block, fUpdate))
                     ret++;
             }
-            pindex = chainActive.Next(pindex);
-            if (GetTime() >= nNow + 60) {
-                nNow = GetTime();
-                LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, Checkpoints::GuessVerificationProgress(pindex));
+            // changes by others are picked up at the start of the next batch
+            if (!fOthers)
+                nScanWalletUpdated = nWalletUpdated;
+        }
+
+        pindexLast = vIndex.back();
+        if (dProgressTip - dProgressStart > 0.0)
+        {
+            nScanProgress = std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(pindexLast, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100)));
+            ShowProgress(_("Rescanning..."), nScanProgress);
+        }
+        if (GetTime() >= nNow + 60) {
+            nNow = GetTime();
+            LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindexLast->nHeight, Checkpoints::GuessVerificationProgress(pindexLast));
+            if (fFileBacked)
+            {
+                LOCK(cs_main);
+                CWalletDB(strWalletFile).WriteRescanBlock(chainActive.GetLocator(pindexLast));
+            }
+        }
+    }
+
+    if (fFileBacked)
+    {
+        CWalletDB walletdb(strWalletFile);
+        if (fInterrupted)
+        {
+            // the record written when the rescan started stays otherwise
+            if (pindexLast)
+            {
+                LOCK(cs_main);
+                walletdb.WriteRescanBlock(chainActive.GetLocator(pindexLast));
             }
+            LogPrintf("Rescan %s, it will be resumed on the next start\n", fAbortRescan ? "aborted" : "interrupted");
         }
-        ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
+        else
+            walletdb.EraseRescanBlock();
     }
+    if (!fInterrupted)
+        fAbortRescan = false; // requested too late to matter
+    nScanProgress = 100;
+    fScanningWallet = false;
+    ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
     return ret;
 }
 
@@ -919,9 +1391,16 @@ void CWallet::ReacceptWalletTransactions()
     LOCK2(cs_main, cs_wallet);
     BOOST_FOREACH(PAIRTYPE(const uint256, CWalletTx)& item, mapWallet)
     {
-        const uint256& wtxid = item.first;
         CWalletTx& wtx = item.second;
-        assert(wtx.GetHash() == wtxid);
+
+        // Skip transactions claiming a block of the active chain without
+        // verifying their merkle branch, which is only needed for their depth
+        if (wtx.hashBlock != 0 && wtx.nIndex != -1)
+        {
+            map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(wtx.hashBlock);
+            if (mi != mapBlockIndex.end() && chainActive.Contains(mi->second))
+                continue;
+        }
 
         int nDepth = wtx.GetDepthInMainChain();
 
@@ -1007,49 +1486,190 @@ void CWallet::ResendWalletTransactions()
 //
 
 
-int64_t CWallet::GetBalance() const
+// The balances of a transaction and of the wallet transactions it spends may
+// have changed
+void CWallet::MarkBalanceDirty(const CTransaction& tx)
+{
+    AssertLockHeld(cs_wallet);
+    setBalanceDirty.insert(tx.GetHash());
+    if (tx.IsCoinBase())
+        return;
+    BOOST_FOREACH(const CTxIn& txin, tx.vin)
+        if (mapWallet.count(txin.prevout.hash))
+            setBalanceDirty.insert(txin.prevout.hash);
+}
+
+// Balances of a transaction that is in a block and mature stay the same until
+// one of its outputs gets a new spender, or it or a spender is disconnected, all
+// of which go through AddToWallet. Those of transactions that are unconfirmed,
+// immature or have unconfirmed spenders change with the mempool and the tip.
+bool CWallet::IsBalanceSettled(const CWalletTx& wtx) const
 {
-    int64_t nTotal = 0;
+    if (!IsFinalTx(wtx) || wtx.GetDepthInMainChain() < 1 || wtx.GetBlocksToMaturity() > 0)
+        return false;
+    uint256 hash = wtx.GetHash();
+    for (unsigned int i = 0; i < wtx.vout.size(); i++)
     {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableCredit();
-        }
+        COutPoint outpoint(hash, i);
+        if (mapTxSpends.count(outpoint) && !IsSpentInMainChain(outpoint))
+            return false;
     }
+    return true;
+}
 
-    return nTotal;
+void CWallet::GetTxBalances(const CWalletTx& wtx, CWalletBalances& balances) const
+{
+    bool fFinal = IsFinalTx(wtx);
+    bool fTrusted = wtx.IsTrusted();
+    int64_t nAvailableCredit = wtx.GetAvailableCredit();
+    balances = CWalletBalances();
+    if (fTrusted)
+        balances.nAvailable = nAvailableCredit;
+    if (!fFinal || (!fTrusted && wtx.GetDepthInMainChain() == 0))
+        balances.nUnconfirmed = nAvailableCredit;
+    balances.nImmature = wtx.GetImmatureCredit();
+    if (wtx.IsCoinStake() && wtx.GetBlocksToMaturity() > 0 && wtx.GetDepthInMainChain() > 0)
+        balances.nStake = GetCredit(wtx);
 }
 
-int64_t CWallet::GetUnconfirmedBalance() const
+// Bring the balances up to date: recompute the transactions touched since the
+// previous read and the unsettled ones, and reuse the sum of the settled ones
+void CWallet::UpdateBalanceCache() const
 {
-    int64_t nTotal = 0;
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+    if (!fBalanceCacheValid)
     {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        mapBalanceSettled.clear();
+        balanceSettled = CWalletBalances();
+        setBalanceUnsettled.clear();
+        setBalanceDirty.clear();
+        std::vector<WalletTxIterator> vTxes;
+        GetMyUnspentTxes(vTxes);
+        BOOST_FOREACH(const WalletTxIterator& it, vTxes)
+            setBalanceUnsettled.insert(it->first);
+        fBalanceCacheValid = true;
+    }
+
+    BOOST_FOREACH(const uint256& hash, setBalanceDirty)
+    {
+        std::map<uint256, CWalletBalances>::iterator mi = mapBalanceSettled.find(hash);
+        if (mi != mapBalanceSettled.end())
         {
-            const CWalletTx* pcoin = &(*it).second;
-            if (!IsFinalTx(*pcoin) || (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0))
-                nTotal += pcoin->GetAvailableCredit();
+            balanceSettled -= mi->second;
+            mapBalanceSettled.erase(mi);
+        }
+        setBalanceUnsettled.insert(hash);
+    }
+    setBalanceDirty.clear();
+
+    balanceCached = balanceSettled;
+    std::set<uint256>::iterator it = setBalanceUnsettled.begin();
+    while (it != setBalanceUnsettled.end())
+    {
+        WalletTxIterator mi = mapWallet.find(*it);
+        if (mi == mapWallet.end())
+        {
+            setBalanceUnsettled.erase(it++);
+            continue;
+        }
+        CWalletBalances balances;
+        GetTxBalances(mi->second, balances);
+        balanceCached += balances;
+        if (IsBalanceSettled(mi->second))
+        {
+            if (!balances.IsNull())
+            {
+                mapBalanceSettled[*it] = balances;
+                balanceSettled += balances;
+            }
+            setBalanceUnsettled.erase(it++);
         }
+        else
+            ++it;
     }
-    return nTotal;
+}
+
+int64_t CWallet::GetBalance() const
+{
+    LOCK2(cs_main, cs_wallet);
+    UpdateBalanceCache();
+    return balanceCached.nAvailable;
+}
+
+int64_t CWallet::GetUnconfirmedBalance() const
+{
+    LOCK2(cs_main, cs_wallet);
+    UpdateBalanceCache();
+    return balanceCached.nUnconfirmed;
 }
 
 int64_t CWallet::GetImmatureBalance() const
 {
-    int64_t nTotal = 0;
+    LOCK2(cs_main, cs_wallet);
+    UpdateBalanceCache();
+    return balanceCached.nImmature;
+}
+
+// Spendable coins only change with the chain tip and the wallet: transactions
+// of ours entering the mempool or conflicting with a block reach the wallet
+// through SyncTransaction. So the cache outlives unrelated mempool traffic, and
+// only its unconfirmed coins are checked to still be in the mempool.
+void CWallet::UpdateAvailableCoinsCache() const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+    uint256 hashTip = chainActive.Tip() ? chainActive.Tip()->GetBlockHash() : uint256(0);
+    if (fAvailableCoinsCached && hashAvailableCoinsTip == hashTip && nAvailableCoinsWalletUpdated == nWalletUpdated)
     {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        unsigned int j = 0;
+        for (unsigned int i = 0; i < vAvailableCoinsCached.size(); i++)
         {
-            const CWalletTx* pcoin = &(*it).second;
-            nTotal += pcoin->GetImmatureCredit();
+            const COutput& out = vAvailableCoinsCached[i];
+            if (out.nDepth == 0 && !mempool.exists(out.tx->GetHash()))
+                continue;
+            if (j != i)
+                vAvailableCoinsCached[j] = out;
+            j++;
         }
+        vAvailableCoinsCached.erase(vAvailableCoinsCached.begin() + j, vAvailableCoinsCached.end());
+        return;
     }
-    return nTotal;
+
+    vAvailableCoinsCached.clear();
+    bool fCacheable = true;
+    std::vector<WalletTxIterator> vTxes;
+    GetMyUnspentTxes(vTxes);
+    BOOST_FOREACH(const WalletTxIterator& it, vTxes)
+    {
+        const uint256& wtxid = it->first;
+        const CWalletTx* pcoin = &(*it).second;
+
+        if (!IsFinalTx(*pcoin))
+        {
+            // Finality of a time locked transaction changes with the clock alone
+            fCacheable = false;
+            continue;
+        }
+
+        if (!pcoin->IsTrusted())
+            continue;
+
+        if ((pcoin->IsCoinBase() || pcoin->IsCoinStake()) && pcoin->GetBlocksToMaturity() > 0)
+            continue;
+
+        int nDepth = pcoin->GetDepthInMainChain();
+        if (nDepth < 0)
+            continue;
+
+        for (unsigned int i = 0; i < pcoin->vout.size(); i++)
+            if (!(IsSpent(wtxid, i)) && IsMine(pcoin->vout[i]) && pcoin->vout[i].nValue > 0)
+                vAvailableCoinsCached.push_back(COutput(pcoin, i, nDepth));
+    }
+
+    fAvailableCoinsCached = fCacheable;
+    hashAvailableCoinsTip = hashTip;
+    nAvailableCoinsWalletUpdated = nWalletUpdated;
 }
 
 // populate vCoins with vector of spendable COutputs
@@ -1059,7 +1679,27 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
 
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        if (fOnlyConfirmed)
+        {
+            UpdateAvailableCoinsCache();
+            bool fSelected = coinControl && coinControl->HasSelected();
+            if (setLockedCoins.empty() && !fSelected)
+            {
+                vCoins = vAvailableCoinsCached;
+                return;
+            }
+            BOOST_FOREACH(const COutput& out, vAvailableCoinsCached)
+            {
+                uint256 hash = out.tx->GetHash();
+                if (!IsLockedCoin(hash, out.i) && (!fSelected || coinControl->IsSelected(hash, out.i)))
+                    vCoins.push_back(out);
+            }
+            return;
+        }
+
+        std::vector<WalletTxIterator> vTxes;
+        GetMyUnspentTxes(vTxes);
+        BOOST_FOREACH(const WalletTxIterator& it, vTxes)
         {
             const uint256& wtxid = it->first;
             const CWalletTx* pcoin = &(*it).second;
@@ -1067,9 +1707,6 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
             if (!IsFinalTx(*pcoin))
                 continue;
 
-            if (fOnlyConfirmed && !pcoin->IsTrusted())
-                continue;
-
             if ((pcoin->IsCoinBase() || pcoin->IsCoinStake()) && pcoin->GetBlocksToMaturity() > 0)
                 continue;
 
@@ -1079,8 +1716,8 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
 
             for (unsigned int i = 0; i < pcoin->vout.size(); i++) {
                 if (!(IsSpent(wtxid, i)) && IsMine(pcoin->vout[i]) &&
-                    !IsLockedCoin((*it).first, i) && pcoin->vout[i].nValue > 0 &&
-                    (!coinControl || !coinControl->HasSelected() || coinControl->IsSelected((*it).first, i)))
+                    !IsLockedCoin(wtxid, i) && pcoin->vout[i].nValue > 0 &&
+                    (!coinControl || !coinControl->HasSelected() || coinControl->IsSelected(wtxid, i)))
                         vCoins.push_back(COutput(pcoin, i, nDepth));
             }
         }
@@ -1093,7 +1730,9 @@ void CWallet::AvailableCoinsMinConf(vector<COutput>& vCoins, int nConf) const
 
     {
         LOCK(cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        std::vector<WalletTxIterator> vTxes;
+        GetMyUnspentTxes(vTxes);
+        BOOST_FOREACH(const WalletTxIterator& it, vTxes)
         {
             const uint256& wtxid = it->first;
             const CWalletTx* pcoin = &(*it).second;
@@ -1113,7 +1752,7 @@ void CWallet::AvailableCoinsMinConf(vector<COutput>& vCoins, int nConf) const
 
             for (unsigned int i = 0; i < pcoin->vout.size(); i++)
                 if (!(IsSpent(wtxid, i)) && IsMine(pcoin->vout[i]) &&
-                    !IsLockedCoin((*it).first, i) && pcoin->vout[i].nValue > 0)
+                    !IsLockedCoin(wtxid, i) && pcoin->vout[i].nValue > 0)
                     vCoins.push_back(COutput(pcoin, i, nDepth));
         }
     }
@@ -1122,64 +1761,17 @@ void CWallet::AvailableCoinsMinConf(vector<COutput>& vCoins, int nConf) const
 // PoSV: total coins staked (non-spendable until maturity)
 int64_t CWallet::GetStake() const
 {
-    int64_t nTotal = 0;
-    LOCK(cs_wallet);
-    for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-    {
-        const CWalletTx* pcoin = &(*it).second;
-        if (pcoin->IsCoinStake() && pcoin->GetBlocksToMaturity() > 0 && pcoin->GetDepthInMainChain() > 0)
-            nTotal += CWallet::GetCredit(*pcoin);
-    }
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    UpdateBalanceCache();
+    return balanceCached.nStake;
 }
 
-static void ApproximateBestSubset(vector<pair<int64_t, pair<const CWalletTx*,unsigned int> > >vValue, int64_t nTotalLower, int64_t nTargetValue,
-                                  vector<char>& vfBest, int64_t& nBest, int iterations = 1000)
+static int InsecureRandInt(int nMax)
 {
-    vector<char> vfIncluded;
-
-    vfBest.assign(vValue.size(), true);
-    nBest = nTotalLower;
-
-    seed_insecure_rand();
-
-    for (int nRep = 0; nRep < iterations && nBest != nTargetValue; nRep++)
-    {
-        vfIncluded.assign(vValue.size(), false);
-        int64_t nTotal = 0;
-        bool fReachedTarget = false;
-        for (int nPass = 0; nPass < 2 && !fReachedTarget; nPass++)
-        {
-            for (unsigned int i = 0; i < vValue.size(); i++)
-            {
-                //The solver here uses a randomized algorithm,
-                //the randomness serves no real security purpose but is just
-                //needed to prevent degenerate behavior and it is important
-                //that the rng fast. We do not use a constant random sequence,
-                //because there may be some privacy improvement by making
-                //the selection random.
-                if (nPass == 0 ? insecure_rand()&1 : !vfIncluded[i])
-                {
-                    nTotal += vValue[i].first;
-                    vfIncluded[i] = true;
-                    if (nTotal >= nTargetValue)
-                    {
-                        fReachedTarget = true;
-                        if (nTotal < nBest)
-                        {
-                            nBest = nTotal;
-                            vfBest = vfIncluded;
-                        }
-                        nTotal -= vValue[i].first;
-                        vfIncluded[i] = false;
-                    }
-                }
-            }
-        }
-    }
+    return insecure_rand() % nMax;
 }
 
-bool CWallet::SelectCoinsMinConf(int64_t nTargetValue, int nConfMine, int nConfTheirs, vector<COutput> vCoins,
+bool CWallet::SelectCoinsMinConf(int64_t nTargetValue, int nConfMine, int nConfTheirs, const vector<COutput>& vCoins,
                                  set<pair<const CWalletTx*,unsigned int> >& setCoinsRet, int64_t& nValueRet) const
 {
     setCoinsRet.clear();
@@ -1192,9 +1784,13 @@ bool CWallet::SelectCoinsMinConf(int64_t nTargetValue, int nConfMine, int nConfT
     vector<pair<int64_t, pair<const CWalletTx*,unsigned int> > > vValue;
     int64_t nTotalLower = 0;
 
-    random_shuffle(vCoins.begin(), vCoins.end(), GetRandInt);
+    // Among coins of equal value, the exact match and the lowest larger coin
+    // are picked at random
+    seed_insecure_rand();
+    pair<const CWalletTx*,unsigned int> coinExact(NULL, 0);
+    unsigned int nExact = 0, nLowestLarger = 0;
 
-    BOOST_FOREACH(COutput output, vCoins)
+    BOOST_FOREACH(const COutput& output, vCoins)
     {
         const CWalletTx *pcoin = output.tx;
 
@@ -1208,9 +1804,8 @@ bool CWallet::SelectCoinsMinConf(int64_t nTargetValue, int nConfMine, int nConfT
 
         if (n == nTargetValue)
         {
-            setCoinsRet.insert(coin.second);
-            nValueRet += coin.first;
-            return true;
+            if (insecure_rand() % ++nExact == 0)
+                coinExact = coin.second;
         }
         else if (n < nTargetValue + CENT)
         {
@@ -1220,7 +1815,20 @@ bool CWallet::SelectCoinsMinConf(int64_t nTargetValue, int nConfMine, int nConfT
         else if (n < coinLowestLarger.first)
         {
             coinLowestLarger = coin;
+            nLowestLarger = 1;
         }
+        else if (n == coinLowestLarger.first)
+        {
+            if (insecure_rand() % ++nLowestLarger == 0)
+                coinLowestLarger = coin;
+        }
+    }
+
+    if (coinExact.first)
+    {
+        setCoinsRet.insert(coinExact);
+        nValueRet += nTargetValue;
+        return true;
     }
 
     if (nTotalLower == nTargetValue)
@@ -1242,14 +1850,24 @@ bool CWallet::SelectCoinsMinConf(int64_t nTargetValue, int nConfMine, int nConfT
         return true;
     }
 
-    // Solve subset sum by stochastic approximation
-    sort(vValue.rbegin(), vValue.rend(), CompareValueOnly());
+    // Sort by descending value; coins of equal value stay in random order
+    random_shuffle(vValue.begin(), vValue.end(), InsecureRandInt);
+    stable_sort(vValue.rbegin(), vValue.rend(), CompareValueOnly());
+    vector<int64_t> vAmounts;
+    vAmounts.reserve(vValue.size());
+    for (unsigned int i = 0; i < vValue.size(); i++)
+        vAmounts.push_back(vValue[i].first);
+
+    // Look for a subset adding up to exactly the target, which needs no change,
+    // then solve subset sum by stochastic approximation
     vector<char> vfBest;
     int64_t nBest;
-
-    ApproximateBestSubset(vValue, nTotalLower, nTargetValue, vfBest, nBest, 1000);
-    if (nBest != nTargetValue && nTotalLower >= nTargetValue + CENT)
-        ApproximateBestSubset(vValue, nTotalLower, nTargetValue + CENT, vfBest, nBest, 1000);
+    if (!SelectCoinsBnB(vAmounts, nTargetValue, 0, vfBest, nBest))
+    {
+        ApproximateBestSubset(vAmounts, nTotalLower, nTargetValue, vfBest, nBest, 1000);
+        if (nBest != nTargetValue && nTotalLower >= nTargetValue + CENT)
+            ApproximateBestSubset(vAmounts, nTotalLower, nTargetValue + CENT, vfBest, nBest, 1000);
+    }
 
     // If we have a bigger coin and (either the stochastic approximation didn't find a good solution,
     //                                   or the next bigger coin is closer), return the bigger coin
@@ -1845,17 +2463,17 @@ bool CWallet::CommitTransaction(CWalletTx& wtxNew, CReserveKey& reservekey)
         LOCK2(cs_main, cs_wallet);
         LogPrintf("CommitTransaction:\n%s", wtxNew.ToString());
         {
-            // This is only to keep the database open to defeat the auto-flush for the
-            // duration of this scope.  This is the only place where this optimization
-            // maybe makes sense; please don't do it anywhere else.
-            CWalletDB* pwalletdb = fFileBacked ? new CWalletDB(strWalletFile,"r") : NULL;
+            // Write the key pool change, the new transaction and the spent coins
+            // in a single database commit
+            boost::scoped_ptr<CDBBatch> batch(fFileBacked ? new CDBBatch(strWalletFile) : NULL);
 
             // Take key pair from key pool so it won't be used again
             reservekey.KeepKey();
 
             // Add tx to wallet, because if it has change it's also ours,
             // otherwise just for transaction history.
-            AddToWallet(wtxNew);
+            if (!AddToWallet(wtxNew))
+                return error("CommitTransaction() : writing the transaction failed");
 
             // Notify that old coins are spent
             set<CWalletTx*> setCoins;
@@ -1866,8 +2484,8 @@ bool CWallet::CommitTransaction(CWalletTx& wtxNew, CReserveKey& reservekey)
                 NotifyTransactionChanged(this, coin.GetHash(), CT_UPDATED);
             }
 
-            if (fFileBacked)
-                delete pwalletdb;
+            if (batch && !batch->Commit())
+                return error("CommitTransaction() : committing the transaction to the wallet failed");
         }
 
         // Track how many getdata requests our transaction gets
@@ -2054,16 +2672,8 @@ bool CWallet::GetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &
         if (fTxIndex) {
             CDiskTxPos postx;
             if (pblocktree->ReadTxIndex(hash, postx)) {
-                CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
-                CBlockHeader header;
-                try {
-                    file >> header;
-                    fseek(file, postx.nTxOffset, SEEK_CUR);
-                    file >> txOut;
-                } catch (std::exception &e) {
-                    return error("%s : Deserialize or I/O error - %s", __func__, e.what());
-                }
-                hashBlock = header.GetHash();
+                if (!ReadTransactionFromDisk(txOut, hashBlock, postx))
+                    return false;
                 if (txOut.GetHash() != hash)
                     return error("%s : txid mismatch", __func__);
                 return true;
@@ -2146,6 +2756,8 @@ bool CWallet::TopUpKeyPool(unsigned int kpSize)
         if (IsLocked())
             return false;
 
+        // Write the new keys in a single database commit
+        boost::scoped_ptr<CDBBatch> batch(fFileBacked ? new CDBBatch(strWalletFile) : NULL);
         CWalletDB walletdb(strWalletFile);
 
         // Top up key pool
@@ -2165,6 +2777,8 @@ bool CWallet::TopUpKeyPool(unsigned int kpSize)
             setKeyPool.insert(nEnd);
             LogPrintf("keypool added key %d, size=%u\n", nEnd, setKeyPool.size());
         }
+        if (batch && !batch->Commit())
+            throw runtime_error("TopUpKeyPool() : committing generated keys failed");
     }
     return true;
 }
@@ -25,15 +25,25 @@
 #include <utility>
 #include <vector>
 
+#include <boost/unordered_set.hpp>
+
 // Settings
 extern int64_t nTransactionFee;
 extern bool bSpendZeroConfChange;
 extern bool fWalletUnlockStakingOnly;
+extern unsigned int nStakeSplitAge;
+extern int64_t nStakeCombineThreshold;
 
 // -paytxfee default
 static const int64_t DEFAULT_TRANSACTION_FEE = 0;
 // -paytxfee will warn if called with a higher fee than this amount (in satoshis) per KB
 static const int nHighTransactionFeeWarning = 0.01 * COIN;
+/** Number of blocks a rescan reads ahead before adding what it found to the wallet */
+static const unsigned int WALLET_RESCAN_BATCH_SIZE = 200;
+/** -rescanthreads default (0 = one per core) */
+static const int DEFAULT_RESCAN_THREADS = 0;
+/** Maximum number of threads reading blocks during a rescan */
+static const int MAX_RESCAN_THREADS = 16;
 
 class CAccountingEntry;
 class CCoinControl;
@@ -97,6 +107,51 @@ public:
     StringMap destdata;
 };
 
+/** Balances of one or more wallet transactions */
+struct CWalletBalances
+{
+    int64_t nAvailable;
+    int64_t nUnconfirmed;
+    int64_t nImmature;
+    int64_t nStake;
+
+    CWalletBalances() : nAvailable(0), nUnconfirmed(0), nImmature(0), nStake(0) {}
+
+    bool IsNull() const
+    {
+        return nAvailable == 0 && nUnconfirmed == 0 && nImmature == 0 && nStake == 0;
+    }
+
+    CWalletBalances& operator+=(const CWalletBalances& b)
+    {
+        nAvailable += b.nAvailable;
+        nUnconfirmed += b.nUnconfirmed;
+        nImmature += b.nImmature;
+        nStake += b.nStake;
+        return *this;
+    }
+
+    CWalletBalances& operator-=(const CWalletBalances& b)
+    {
+        nAvailable -= b.nAvailable;
+        nUnconfirmed -= b.nUnconfirmed;
+        nImmature -= b.nImmature;
+        nStake -= b.nStake;
+        return *this;
+    }
+};
+
+/** Hashes scripts with SipHash, keyed randomly per instance */
+class CScriptHasher
+{
+private:
+    uint64_t k0, k1;
+
+public:
+    CScriptHasher();
+    size_t operator()(const CScript& script) const;
+};
+
 /** A CWallet is an extension of a keystore, which also maintains a set of transactions and balances,
  * and provides the ability to create new transactions.
  */
@@ -127,6 +182,59 @@ private:
 
     void SyncMetaData(std::pair<TxSpends::iterator, TxSpends::iterator>);
 
+    // Outputs of ours that may be unspent: a superset of the unspent ones, so that
+    // balances and coin listings need not visit every wallet transaction. Outputs are
+    // added when their transaction (or one spending them) is added or updated, and
+    // dropped lazily once spent in the main chain.
+    mutable std::set<COutPoint> setMyUnspent;
+    mutable bool fMyUnspentValid;
+    void AddToMyUnspent(const CWalletTx& wtx);
+    bool IsSpentInMainChain(const COutPoint& outpoint) const;
+    typedef std::map<uint256, CWalletTx>::const_iterator WalletTxIterator;
+    void GetMyUnspentTxes(std::vector<WalletTxIterator>& vTxes) const;
+
+    // Balances, kept up to date per transaction. A transaction is settled once
+    // its balances can only change when the wallet is told about it or about a
+    // transaction spending it; the others are recomputed on every read.
+    mutable bool fBalanceCacheValid;
+    mutable std::map<uint256, CWalletBalances> mapBalanceSettled; // non-null ones only
+    mutable CWalletBalances balanceSettled; // sum of mapBalanceSettled
+    mutable std::set<uint256> setBalanceUnsettled;
+    mutable std::set<uint256> setBalanceDirty; // touched since the last read
+    mutable CWalletBalances balanceCached;
+    uint64_t nWalletUpdated; // changes whenever balances may have changed
+    void MarkBalanceDirty(const CTransaction& tx);
+    bool IsBalanceSettled(const CWalletTx& wtx) const;
+    void GetTxBalances(const CWalletTx& wtx, CWalletBalances& balances) const;
+    void UpdateBalanceCache() const;
+
+    // Spendable confirmed coins (before locked coins and coin control are applied),
+    // as of one state of the chain tip and wallet
+    mutable std::vector<COutput> vAvailableCoinsCached;
+    mutable bool fAvailableCoinsCached;
+    mutable uint256 hashAvailableCoinsTip;
+    mutable uint64_t nAvailableCoinsWalletUpdated;
+    void UpdateAvailableCoinsCache() const;
+
+    // Hashes of our keys and scripts, to quickly rule out outputs that are not ours
+    void GetScanFilter(std::set<uint160>& setFilter) const;
+    // Output scripts that pay to our keys and scripts, to query compact block filters with
+    void GetScanScripts(std::vector<std::vector<unsigned char> >& vScripts) const;
+
+    // Output scripts that are ours: pay-to-pubkey-hash and pay-to-pubkey of every key,
+    // and pay-to-script-hash and the bare form of every redeem script we own all keys of.
+    // IsMine(const CScript&) only runs Solver for scripts of other forms.
+    boost::unordered_set<CScript, CScriptHasher> setMyScripts; // guarded by cs_KeyStore
+    std::set<CScriptID> setPendingScripts; // redeem scripts we do not own yet
+    void AddMyKeyScripts(const CPubKey& pubkey);
+    void AddMyRedeemScript(const CScript& redeemScript);
+    void UpdatePendingScripts();
+
+    // State of a running ScanForWalletTransactions, for other threads
+    volatile bool fScanningWallet;
+    volatile bool fAbortRescan;
+    volatile int nScanProgress; // percent
+
 public:
     /// Main wallet lock.
     /// This lock protects all the fields added by CWallet
@@ -167,6 +275,13 @@ public:
         nNextResend = 0;
         nLastResend = 0;
         nTimeFirstKey = 0;
+        fMyUnspentValid = false;
+        fBalanceCacheValid = false;
+        fAvailableCoinsCached = false;
+        nWalletUpdated = 0;
+        fScanningWallet = false;
+        fAbortRescan = false;
+        nScanProgress = 0;
     }
 
     std::map<uint256, CWalletTx> mapWallet;
@@ -189,7 +304,7 @@ public:
 
     void AvailableCoins(std::vector<COutput>& vCoins, bool fOnlyConfirmed=true, const CCoinControl *coinControl = NULL) const;
     void AvailableCoinsMinConf(std::vector<COutput>& vCoins, int nConf) const;
-    bool SelectCoinsMinConf(int64_t nTargetValue, int nConfMine, int nConfTheirs, std::vector<COutput> vCoins, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, int64_t& nValueRet) const;
+    bool SelectCoinsMinConf(int64_t nTargetValue, int nConfMine, int nConfTheirs, const std::vector<COutput>& vCoins, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, int64_t& nValueRet) const;
 
     bool IsSpent(const uint256& hash, unsigned int n) const;
 
@@ -205,7 +320,7 @@ public:
     // Adds a key to the store, and saves it to disk.
     bool AddKeyPubKey(const CKey& key, const CPubKey &pubkey);
     // Adds a key to the store, without saving it to disk (used by LoadWallet)
-    bool LoadKey(const CKey& key, const CPubKey &pubkey) { return CCryptoKeyStore::AddKeyPubKey(key, pubkey); }
+    bool LoadKey(const CKey& key, const CPubKey &pubkey);
     // Load metadata (used by LoadWallet)
     bool LoadKeyMetadata(const CPubKey &pubkey, const CKeyMetadata &metadata);
 
@@ -241,18 +356,34 @@ public:
     typedef std::pair<CWalletTx*, CAccountingEntry*> TxPair;
     typedef std::multimap<int64_t, TxPair > TxItems;
 
-    /** Get the wallet's activity log
-        @return multimap of ordered transactions and accounting entries
-        @warning Returned pointers are *only* valid within the scope of passed acentries
+    /** The wallet's activity log: all transactions and accounting entries by
+        order position. Kept up to date as they are added, so a page of the most
+        recent items can be read without visiting the rest.
      */
-    TxItems OrderedTxItems(std::list<CAccountingEntry>& acentries, std::string strAccount = "");
+    TxItems wtxOrdered;
+    std::list<CAccountingEntry> laccentries;
+
+    // Rebuild wtxOrdered and laccentries from mapWallet and the database
+    void LoadOrderedTxItems(CWalletDB& walletdb);
+    // Write an accounting entry and add it to the activity log
+    bool AddAccountingEntry(const CAccountingEntry& acentry, CWalletDB& walletdb);
+    // Add an entry already written to the activity log; within a database
+    // transaction, only once it is committed
+    void LoadAccountingEntry(const CAccountingEntry& acentry);
 
     void MarkDirty();
     bool AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet=false);
     void SyncTransaction(const uint256 &hash, const CTransaction& tx, const CBlock* pblock);
+    void SyncBlock(const CBlock &block);
     bool AddToWalletIfInvolvingMe(const uint256 &hash, const CTransaction& tx, const CBlock* pblock, bool fUpdate);
     void EraseFromWallet(const uint256 &hash);
     int ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate = false);
+    // Stop a running rescan; like one interrupted by shutdown, it is resumed on the next start
+    void AbortRescan() { fAbortRescan = true; }
+    // Whether the last rescan was stopped by AbortRescan
+    bool WasRescanAborted() const { return fAbortRescan; }
+    bool IsScanning() const { return fScanningWallet; }
+    int GetScanProgress() const { return nScanProgress; }
     void ReacceptWalletTransactions();
     void ResendWalletTransactions();
     int64_t GetBalance() const;
@@ -289,9 +420,10 @@ public:
 
     bool IsMine(const CTxIn& txin) const;
     int64_t GetDebit(const CTxIn& txin) const;
+    bool IsMine(const CScript& scriptPubKey) const;
     bool IsMine(const CTxOut& txout) const
     {
-        return ::IsMine(*this, txout.scriptPubKey);
+        return IsMine(txout.scriptPubKey);
     }
     int64_t GetCredit(const CTxOut& txout) const
     {
@@ -13,6 +13,7 @@
 
 #include <boost/filesystem.hpp>
 #include <boost/foreach.hpp>
+#include <boost/thread.hpp>
 
 using namespace std;
 using namespace boost;
@@ -123,6 +124,23 @@ bool CWalletDB::ReadBestBlock(CBlockLocator& locator)
     return Read(std::string("bestblock"), locator);
 }
 
+bool CWalletDB::WriteRescanBlock(const CBlockLocator& locator)
+{
+    nWalletDBUpdated++;
+    return Write(std::string("rescanblock"), locator);
+}
+
+bool CWalletDB::ReadRescanBlock(CBlockLocator& locator)
+{
+    return Read(std::string("rescanblock"), locator);
+}
+
+bool CWalletDB::EraseRescanBlock()
+{
+    nWalletDBUpdated++;
+    return Erase(std::string("rescanblock"));
+}
+
 bool CWalletDB::WriteOrderPosNext(int64_t nOrderPosNext)
 {
     nWalletDBUpdated++;
@@ -194,7 +212,7 @@ void CWalletDB::ListAccountCreditDebit(const string& strAccount, list<CAccountin
 {
     bool fAllAccounts = (strAccount == "*");
 
-    Dbc* pcursor = GetCursor();
+    CDBCursor* pcursor = GetCursor();
     if (!pcursor)
         throw runtime_error("CWalletDB::ListAccountCreditDebit() : cannot create DB cursor");
     unsigned int fFlags = DB_SET_RANGE;
@@ -211,7 +229,7 @@ void CWalletDB::ListAccountCreditDebit(const string& strAccount, list<CAccountin
             break;
         else if (ret != 0)
         {
-            pcursor->close();
+            delete pcursor;
             throw runtime_error("CWalletDB::ListAccountCreditDebit() : error scanning DB");
         }
 
@@ -230,7 +248,7 @@ void CWalletDB::ListAccountCreditDebit(const string& strAccount, list<CAccountin
         entries.push_back(acentry);
     }
 
-    pcursor->close();
+    delete pcursor;
 }
 
 
@@ -303,6 +321,9 @@ CWalletDB::ReorderTransactions(CWallet* pwallet)
         }
     }
 
+    // Order positions changed under the activity log
+    pwallet->LoadOrderedTxItems(*this);
+
     return DB_LOAD_OK;
 }
 
@@ -324,6 +345,45 @@ public:
     }
 };
 
+// Read a "tx" record, whose type has already been read from ssKey. fUpgrade is
+// set if the record should be written back: to repair it, or because it holds
+// fields that are no longer used (such as vtxPrev), which would otherwise be
+// parsed again on every start.
+static bool ReadWalletTx(CDataStream& ssKey, CDataStream& ssValue, uint256& hash, CWalletTx& wtx,
+                         bool& fUpgrade, string& strErr)
+{
+    unsigned int nSize = ssValue.size();
+    ssKey >> hash;
+    ssValue >> wtx;
+    CValidationState state;
+    if (!(CheckTransaction(wtx, state) && (wtx.GetHash() == hash) && state.IsValid()))
+        return false;
+
+    fUpgrade = false;
+    // Undo serialize changes in 31600
+    if (31404 <= wtx.fTimeReceivedIsTxTime && wtx.fTimeReceivedIsTxTime <= 31703)
+    {
+        if (!ssValue.empty())
+        {
+            char fTmp;
+            char fUnused;
+            ssValue >> fTmp >> fUnused >> wtx.strFromAccount;
+            strErr = strprintf("LoadWallet() upgrading tx ver=%d %d '%s' %s",
+                               wtx.fTimeReceivedIsTxTime, fTmp, wtx.strFromAccount, hash.ToString());
+            wtx.fTimeReceivedIsTxTime = fTmp;
+        }
+        else
+        {
+            strErr = strprintf("LoadWallet() repairing tx ver=%d %s", wtx.fTimeReceivedIsTxTime, hash.ToString());
+            wtx.fTimeReceivedIsTxTime = 0;
+        }
+        fUpgrade = true;
+    }
+    else if (::GetSerializeSize(wtx, SER_DISK, CLIENT_VERSION) < nSize)
+        fUpgrade = true;
+    return true;
+}
+
 bool
 ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
              CWalletScanState &wss, string& strType, string& strErr)
@@ -348,44 +408,17 @@ ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
         else if (strType == "tx")
         {
             uint256 hash;
-            ssKey >> hash;
             CWalletTx wtx;
-            ssValue >> wtx;
-            CValidationState state;
-            if (!(CheckTransaction(wtx, state) && (wtx.GetHash() == hash) && state.IsValid()))
+            bool fUpgrade;
+            if (!ReadWalletTx(ssKey, ssValue, hash, wtx, fUpgrade, strErr))
                 return false;
-
-            // Undo serialize changes in 31600
-            if (31404 <= wtx.fTimeReceivedIsTxTime && wtx.fTimeReceivedIsTxTime <= 31703)
-            {
-                if (!ssValue.empty())
-                {
-                    char fTmp;
-                    char fUnused;
-                    ssValue >> fTmp >> fUnused >> wtx.strFromAccount;
-                    strErr = strprintf("LoadWallet() upgrading tx ver=%d %d '%s' %s",
-                                       wtx.fTimeReceivedIsTxTime, fTmp, wtx.strFromAccount, hash.ToString());
-                    wtx.fTimeReceivedIsTxTime = fTmp;
-                }
-                else
-                {
-                    strErr = strprintf("LoadWallet() repairing tx ver=%d %s", wtx.fTimeReceivedIsTxTime, hash.ToString());
-                    wtx.fTimeReceivedIsTxTime = 0;
-                }
+            if (fUpgrade)
                 wss.vWalletUpgrade.push_back(hash);
-            }
 
             if (wtx.nOrderPos == -1)
                 wss.fAnyUnordered = true;
 
             pwallet->AddToWallet(wtx, true);
-            //// debug print
-            //LogPrintf("LoadWallet  %s\n", wtx.GetHash().ToString());
-            //LogPrintf(" %12d  %s  %s  %s\n",
-            //    wtx.vout[0].nValue,
-            //    DateTimeStrFormat("%Y-%m-%d %H:%M:%S", wtx.GetBlockTime()),
-            //    wtx.hashBlock.ToString(),
-            //    wtx.mapValue["message"]);
         }
         else if (strType == "acentry")
         {
@@ -579,12 +612,86 @@ static bool IsKeyType(string strType)
             strType == "mkey" || strType == "ckey");
 }
 
+// A "tx" record, read from the database and parsed later on a loading thread
+struct CWalletTxRecord
+{
+    CDataStream ssKey;
+    CDataStream ssValue;
+    uint256 hash;
+    CWalletTx wtx;
+    bool fValid;
+    bool fUpgrade;
+    string strErr;
+
+    CWalletTxRecord(const CDataStream& ssKeyIn, const CDataStream& ssValueIn) :
+        ssKey(ssKeyIn), ssValue(ssValueIn), fValid(false), fUpgrade(false) {}
+};
+
+static bool IsTxRecord(const CDataStream& ssKey)
+{
+    return ssKey.size() > 3 && ssKey[0] == 2 && ssKey[1] == 't' && ssKey[2] == 'x';
+}
+
+// Parse every nParts'th record of vRecords, starting at nPart
+static void ParseWalletTxRecords(vector<CWalletTxRecord>* pvRecords, int nPart, int nParts)
+{
+    for (unsigned int i = nPart; i < pvRecords->size(); i += nParts)
+    {
+        CWalletTxRecord& record = (*pvRecords)[i];
+        try {
+            string strType;
+            record.ssKey >> strType;
+            record.fValid = ReadWalletTx(record.ssKey, record.ssValue, record.hash, record.wtx, record.fUpgrade, record.strErr);
+        } catch (...) {
+            record.fValid = false;
+        }
+        record.ssKey.clear();
+        record.ssValue.clear();
+    }
+}
+
+// Parse a batch of "tx" records on several threads, then add them to the
+// wallet in the order they were read
+static void LoadWalletTxRecords(CWallet* pwallet, vector<CWalletTxRecord>& vRecords, CWalletScanState& wss,
+                                int nThreads, bool& fNoncriticalErrors)
+{
+    int nParts = std::max(1, std::min(nThreads, (int)(vRecords.size() / 1000)));
+    boost::thread_group threadGroup;
+    for (int i = 1; i < nParts; i++)
+        threadGroup.create_thread(boost::bind(&ParseWalletTxRecords, &vRecords, i, nParts));
+    ParseWalletTxRecords(&vRecords, 0, nParts);
+    threadGroup.join_all();
+
+    BOOST_FOREACH(CWalletTxRecord& record, vRecords)
+    {
+        if (!record.fValid)
+        {
+            // Rescan if there is a bad transaction record:
+            fNoncriticalErrors = true;
+            SoftSetBoolArg("-rescan", true);
+        }
+        else
+        {
+            if (record.fUpgrade)
+                wss.vWalletUpgrade.push_back(record.hash);
+            if (record.wtx.nOrderPos == -1)
+                wss.fAnyUnordered = true;
+            pwallet->AddToWallet(record.wtx, true);
+        }
+        if (!record.strErr.empty())
+            LogPrintf("%s\n", record.strErr);
+    }
+    vRecords.clear();
+}
+
 DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
 {
     pwallet->vchDefaultKey = CPubKey();
     CWalletScanState wss;
     bool fNoncriticalErrors = false;
     DBErrors result = DB_LOAD_OK;
+    unsigned int nTxRecords = 0;
+    int nThreads = std::max(1, std::min((int)boost::thread::hardware_concurrency(), MAX_WALLET_LOAD_THREADS));
 
     try {
         LOCK(pwallet->cs_wallet);
@@ -597,13 +704,19 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
         }
 
         // Get cursor
-        Dbc* pcursor = GetCursor();
+        CDBCursor* pcursor = GetCursor();
         if (!pcursor)
         {
             LogPrintf("Error getting wallet database cursor\n");
             return DB_CORRUPT;
         }
 
+        // Transactions, which make up most of a large wallet, are parsed on
+        // several threads, in batches added to the wallet as they fill up.
+        // Keys start with the length of the type, so "tx" records come before
+        // keys, names and most other records; loading a transaction does not
+        // depend on any of them.
+        vector<CWalletTxRecord> vTxRecords;
         while (true)
         {
             // Read next record
@@ -618,6 +731,15 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
                 return DB_CORRUPT;
             }
 
+            if (IsTxRecord(ssKey))
+            {
+                vTxRecords.push_back(CWalletTxRecord(ssKey, ssValue));
+                nTxRecords++;
+                if (vTxRecords.size() >= WALLET_LOAD_BATCH_SIZE)
+                    LoadWalletTxRecords(pwallet, vTxRecords, wss, nThreads, fNoncriticalErrors);
+                continue;
+            }
+
             // Try to be tolerant of single corrupt records:
             string strType, strErr;
             if (!ReadKeyValue(pwallet, ssKey, ssValue, wss, strType, strErr))
@@ -638,7 +760,8 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
             if (!strErr.empty())
                 LogPrintf("%s\n", strErr);
         }
-        pcursor->close();
+        delete pcursor;
+        LoadWalletTxRecords(pwallet, vTxRecords, wss, nThreads, fNoncriticalErrors);
     }
     catch (boost::thread_interrupted) {
         throw;
@@ -664,8 +787,13 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
     if ((wss.nKeys + wss.nCKeys) != wss.nKeyMeta)
         pwallet->nTimeFirstKey = 1; // 0 would be considered 'no value'
 
+    LogPrintf("Transactions: %u loaded (%u rewritten) using %d threads\n",
+           nTxRecords, wss.vWalletUpgrade.size(), nThreads);
+
+    TxnBegin();
     BOOST_FOREACH(uint256 hash, wss.vWalletUpgrade)
         WriteTx(hash, pwallet->mapWallet[hash]);
+    TxnCommit();
 
     // Rewrite encrypted wallets of versions 0.4.0 and 0.5.0rc:
     if (wss.fIsEncrypted && (wss.nFileVersion == 40000 || wss.nFileVersion == 50000))
@@ -676,6 +804,11 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
 
     if (wss.fAnyUnordered)
         result = ReorderTransactions(pwallet);
+    else
+    {
+        LOCK(pwallet->cs_wallet);
+        pwallet->LoadOrderedTxItems(*this);
+    }
 
     return result;
 }
@@ -698,7 +831,7 @@ DBErrors CWalletDB::FindWalletTx(CWallet* pwallet, vector<uint256>& vTxHash)
         }
 
         // Get cursor
-        Dbc* pcursor = GetCursor();
+        CDBCursor* pcursor = GetCursor();
         if (!pcursor)
         {
             LogPrintf("Error getting wallet database cursor\n");
@@ -728,7 +861,7 @@ DBErrors CWalletDB::FindWalletTx(CWallet* pwallet, vector<uint256>& vTxHash)
                 vTxHash.push_back(hash);
             }
         }
-        pcursor->close();
+        delete pcursor;
     }
     catch (boost::thread_interrupted) {
         throw;
@@ -837,12 +970,22 @@ bool BackupWallet(const CWallet& wallet, const string& strDest)
                 bitdb.CheckpointLSN(wallet.strWalletFile);
                 bitdb.mapFileUseCount.erase(wallet.strWalletFile);
 
+                // A wallet kept in a log store is backed up as a Berkeley DB file
+                std::string strFileSrc = wallet.strWalletFile;
+                if (bitdb.fLogStore)
+                {
+                    strFileSrc = wallet.strWalletFile + ".export";
+                    if (!bitdb.ExportLog(wallet.strWalletFile, strFileSrc))
+                        return false;
+                }
+
                 // Copy wallet.dat
-                filesystem::path pathSrc = GetDataDir() / wallet.strWalletFile;
+                filesystem::path pathSrc = GetDataDir() / strFileSrc;
                 filesystem::path pathDest(strDest);
                 if (filesystem::is_directory(pathDest))
                     pathDest /= wallet.strWalletFile;
 
+                bool fSuccess = true;
                 try {
 #if BOOST_VERSION >= 104000
                     filesystem::copy_file(pathSrc, pathDest, filesystem::copy_option::overwrite_if_exists);
@@ -850,11 +993,13 @@ bool BackupWallet(const CWallet& wallet, const string& strDest)
                     filesystem::copy_file(pathSrc, pathDest);
 #endif
                     LogPrintf("copied wallet.dat to %s\n", pathDest.string());
-                    return true;
                 } catch(const filesystem::filesystem_error &e) {
                     LogPrintf("error copying wallet.dat to %s - %s\n", pathDest.string(), e.what());
-                    return false;
+                    fSuccess = false;
                 }
+                if (bitdb.fLogStore)
+                    bitdb.dbenv.dbremove(NULL, strFileSrc.c_str(), NULL, DB_AUTO_COMMIT);
+                return fSuccess;
             }
         }
         MilliSleep(100);
@@ -25,6 +25,11 @@ class CWalletTx;
 class uint160;
 class uint256;
 
+/** Number of transaction records parsed together while loading a wallet */
+static const unsigned int WALLET_LOAD_BATCH_SIZE = 10000;
+/** Maximum number of threads parsing transaction records while loading a wallet */
+static const int MAX_WALLET_LOAD_THREADS = 8;
+
 /** Error statuses for the wallet database */
 enum DBErrors
 {
@@ -96,6 +101,11 @@ public:
     bool WriteBestBlock(const CBlockLocator& locator);
     bool ReadBestBlock(CBlockLocator& locator);
 
+    // Last block covered by an unfinished rescan
+    bool WriteRescanBlock(const CBlockLocator& locator);
+    bool ReadRescanBlock(CBlockLocator& locator);
+    bool EraseRescanBlock();
+
     bool WriteOrderPosNext(int64_t nOrderPosNext);
 
     bool WriteDefaultKey(const CPubKey& vchPubKey);